@@ -0,0 +1,579 @@
+#ifndef ALTERNATIVEROUTES_H
+#define ALTERNATIVEROUTES_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "CSRGraph.h"
+#include "IndexedHeap.h"
+#include "SearchWorkspace.h"
+
+// Most routes one query may ask for
+#define ALTERNATIVES_MAX 10
+
+// Weight added to an edge, as a share of its own, each time a diverse
+// alternative uses it
+#define ALTERNATIVE_PENALTY 0.5
+
+// Penalty rounds per route asked for before the diverse search gives up
+#define ALTERNATIVE_ROUNDS 3
+
+// Per-thread state for k-shortest and diverse alternative routes
+//
+// Both searches start from the shortest-path tree into the destination,
+// a backward Dijkstra whose distances are exact lower bounds for every
+// later search. Routes are kept as runs of CSR edges in one buffer, and
+// so are Yen's candidates. Search arrays are stamped rather than cleared,
+// so a spur search costs only what it touches.
+typedef struct AlternativeSearch {
+    int capacity;         // cities
+    int edgeCapacity;
+
+    SearchWorkspace* tree;   // backward search; dist is the distance to the destination
+
+    double* dist;
+    int* parentEdge;
+    int* visitStamp;      // dist and parentEdge are valid where this is visit
+    int visit;
+    IndexedHeap* heap;
+
+    int* blockedEdge;     // blocked where equal to block
+    int* blockedCity;
+    int block;
+    int* clearStamp;      // clear is valid where this is block
+    unsigned char* clear; // 1 if the city's tree path avoids everything blocked
+    int* walk;            // cities of a tree walk or a spur path, scratch
+    int* path;            // edges of a spur or penalised search, scratch
+
+    float* penalized;     // edge weights for the diverse search
+
+    int* routeEdges;      // edges of route i are routeEdges[routeStart[i] .. routeStart[i + 1] - 1]
+    int* sortedEdges;     // routeEdges reordered by length, same capacity
+    int routeEdgeCapacity;
+    int routeStart[ALTERNATIVES_MAX + 1];
+    double routeLength[ALTERNATIVES_MAX];
+    int routeCount;
+
+    int* candidateEdges;  // Yen's candidates, laid out like the routes
+    int candidateEdgeCount;
+    int candidateEdgeCapacity;
+    int* candidateStart;
+    int* candidateSize;
+    double* candidateLength;   // -1 once taken
+    int candidateCount;
+    int candidateCapacity;
+
+    int settledCount;     // cities settled by the last query's searches
+} AlternativeSearch;
+
+// Function prototypes
+AlternativeSearch* createAlternativeSearch(int capacity, int edgeCapacity);
+void freeAlternativeSearch(AlternativeSearch* as);
+int kShortestRoutes(const CSRGraph* forward, const CSRGraph* backward, AlternativeSearch* as,
+                    int origin, int destination, int costOrTime, int k);
+int diverseRoutes(const CSRGraph* forward, const CSRGraph* backward, AlternativeSearch* as,
+                  int origin, int destination, int costOrTime, int k);
+int alternativePathEdges(const AlternativeSearch* as, int route, int* edges, int maxEdges);
+
+// Implementation
+AlternativeSearch* createAlternativeSearch(int capacity, int edgeCapacity) {
+    AlternativeSearch* as = (AlternativeSearch*)malloc(sizeof(AlternativeSearch));
+    if (as == NULL) {
+        return NULL;
+    }
+
+    if (capacity < 1) {
+        capacity = 1;
+    }
+    if (edgeCapacity < 1) {
+        edgeCapacity = 1;
+    }
+
+    as->capacity = capacity;
+    as->edgeCapacity = edgeCapacity;
+    as->tree = createSearchWorkspace(capacity);
+    as->dist = (double*)malloc(capacity * sizeof(double));
+    as->parentEdge = (int*)malloc(capacity * sizeof(int));
+    as->visitStamp = (int*)calloc(capacity, sizeof(int));
+    as->visit = 0;
+    as->heap = createIndexedHeap(capacity);
+    as->blockedEdge = (int*)calloc(edgeCapacity, sizeof(int));
+    as->blockedCity = (int*)calloc(capacity, sizeof(int));
+    as->block = 0;
+    as->clearStamp = (int*)calloc(capacity, sizeof(int));
+    as->clear = (unsigned char*)malloc(capacity * sizeof(unsigned char));
+    as->walk = (int*)malloc(capacity * sizeof(int));
+    as->path = (int*)malloc(capacity * sizeof(int));
+    as->penalized = (float*)malloc(edgeCapacity * sizeof(float));
+    as->routeEdgeCapacity = capacity;
+    as->routeEdges = (int*)malloc(as->routeEdgeCapacity * sizeof(int));
+    as->sortedEdges = (int*)malloc(as->routeEdgeCapacity * sizeof(int));
+    as->routeCount = 0;
+    as->routeStart[0] = 0;
+    as->candidateEdgeCapacity = capacity;
+    as->candidateEdges = (int*)malloc(as->candidateEdgeCapacity * sizeof(int));
+    as->candidateEdgeCount = 0;
+    as->candidateCapacity = 16;
+    as->candidateStart = (int*)malloc(as->candidateCapacity * sizeof(int));
+    as->candidateSize = (int*)malloc(as->candidateCapacity * sizeof(int));
+    as->candidateLength = (double*)malloc(as->candidateCapacity * sizeof(double));
+    as->candidateCount = 0;
+    as->settledCount = 0;
+
+    if (as->tree == NULL || as->dist == NULL || as->parentEdge == NULL || as->visitStamp == NULL ||
+        as->heap == NULL || as->blockedEdge == NULL || as->blockedCity == NULL || as->clearStamp == NULL ||
+        as->clear == NULL || as->walk == NULL || as->path == NULL || as->penalized == NULL ||
+        as->routeEdges == NULL || as->sortedEdges == NULL || as->candidateEdges == NULL || as->candidateStart == NULL || as->candidateSize == NULL ||
+        as->candidateLength == NULL) {
+        freeAlternativeSearch(as);
+        return NULL;
+    }
+
+    return as;
+}
+
+void freeAlternativeSearch(AlternativeSearch* as) {
+    if (as == NULL) {
+        return;
+    }
+
+    freeSearchWorkspace(as->tree);
+    free(as->dist);
+    free(as->parentEdge);
+    free(as->visitStamp);
+    freeIndexedHeap(as->heap);
+    free(as->blockedEdge);
+    free(as->blockedCity);
+    free(as->clearStamp);
+    free(as->clear);
+    free(as->walk);
+    free(as->path);
+    free(as->penalized);
+    free(as->routeEdges);
+    free(as->sortedEdges);
+    free(as->candidateEdges);
+    free(as->candidateStart);
+    free(as->candidateSize);
+    free(as->candidateLength);
+    free(as);
+}
+
+// Forward edge a city's shortest path to the destination starts with, -1
+// at the destination or where it cannot be reached
+static int alternativeTreeEdge(const CSRGraph* backward, const AlternativeSearch* as, int city) {
+    int edge = as->tree->parentEdge[city];
+    return edge != -1 ? backward->edgeRoutes[edge] : -1;
+}
+
+// Whether city's tree path to the destination avoids every blocked city
+// and edge. Answers are remembered until the next block, so each city is
+// walked at most once per spur.
+static int alternativeTreeClear(const CSRGraph* forward, const CSRGraph* backward, AlternativeSearch* as,
+                                int city, int destination) {
+    int count = 0;
+    int result = 0;
+    int u = city;
+    while (1) {
+        if (as->clearStamp[u] == as->block) {
+            result = as->clear[u];
+            break;
+        }
+        if (u == destination) {
+            result = 1;
+            break;
+        }
+
+        int edge = alternativeTreeEdge(backward, as, u);
+        if (edge == -1 || as->blockedEdge[edge] == as->block || (u != city && as->blockedCity[u] == as->block)) {
+            result = 0;
+            break;
+        }
+        as->walk[count++] = u;
+        u = forward->targets[edge];
+    }
+
+    for (int i = 0; i < count; i++) {
+        as->clearStamp[as->walk[i]] = as->block;
+        as->clear[as->walk[i]] = (unsigned char)result;
+    }
+    return result;
+}
+
+// A* from source to destination over weights, skipping blocked cities and
+// edges, with the tree distances as potentials. They are exact on the
+// unblocked graph, and blocking or penalising only lengthens paths, so
+// they stay consistent. With stopOnTree the search also ends at the first
+// city whose tree path is clear: no queued path can beat following it.
+//
+// Writes the path's edges to edges and returns their count, or -1 if the
+// destination cannot be reached.
+static int alternativeSearchPath(const CSRGraph* forward, const CSRGraph* backward, AlternativeSearch* as,
+                                 const float* weights, int source, int destination, int stopOnTree, int* edges) {
+    const double* toDestination = as->tree->dist;
+    as->visit++;
+    heapClear(as->heap);
+
+    as->dist[source] = 0;
+    as->parentEdge[source] = -1;
+    as->visitStamp[source] = as->visit;
+    heapPushOrDecrease(as->heap, source, toDestination[source]);
+
+    int reached = -1;
+    while (!heapEmpty(as->heap)) {
+        int u = heapPop(as->heap);
+        as->settledCount++;
+
+        if (u == destination || (stopOnTree && alternativeTreeClear(forward, backward, as, u, destination))) {
+            reached = u;
+            break;
+        }
+
+        for (int e = forward->offsets[u]; e < forward->offsets[u + 1]; e++) {
+            int v = forward->targets[e];
+            if (as->blockedEdge[e] == as->block || as->blockedCity[v] == as->block ||
+                toDestination[v] >= WORKSPACE_UNREACHED) {
+                continue;
+            }
+
+            double length = as->dist[u] + weights[e];
+            if (as->visitStamp[v] != as->visit || length < as->dist[v]) {
+                as->visitStamp[v] = as->visit;
+                as->dist[v] = length;
+                as->parentEdge[v] = e;
+                heapPushOrDecrease(as->heap, v, length + toDestination[v]);
+            }
+        }
+    }
+
+    if (reached == -1) {
+        return -1;
+    }
+
+    // Searched part back to the source, then the tree path on from reached
+    int count = 0;
+    for (int city = reached; as->parentEdge[city] != -1; city = csrEdgeSource(forward, as->parentEdge[city])) {
+        count++;
+    }
+    int index = count;
+    for (int city = reached; as->parentEdge[city] != -1; city = csrEdgeSource(forward, as->parentEdge[city])) {
+        edges[--index] = as->parentEdge[city];
+    }
+    for (int city = reached; city != destination; city = forward->targets[edges[count - 1]]) {
+        edges[count++] = alternativeTreeEdge(backward, as, city);
+    }
+
+    return count;
+}
+
+// Length of a run of edges under the query's objective
+static double alternativeLength(const float* weights, const int* edges, int count) {
+    double length = 0;
+    for (int i = 0; i < count; i++) {
+        length += weights[edges[i]];
+    }
+    return length;
+}
+
+// Whether stored edges are root followed by spur
+static int alternativeSame(const int* stored, int size, const int* root, int rootCount, const int* spur, int spurCount) {
+    return size == rootCount + spurCount &&
+           memcmp(stored, root, rootCount * sizeof(int)) == 0 &&
+           (spurCount == 0 || memcmp(stored + rootCount, spur, spurCount * sizeof(int)) == 0);
+}
+
+// Whether root followed by spur is already a route (or, with candidates,
+// a candidate)
+static int alternativeKnown(const AlternativeSearch* as, const int* root, int rootCount,
+                            const int* spur, int spurCount, int candidates) {
+    for (int r = 0; r < as->routeCount; r++) {
+        if (alternativeSame(as->routeEdges + as->routeStart[r], as->routeStart[r + 1] - as->routeStart[r],
+                            root, rootCount, spur, spurCount)) {
+            return 1;
+        }
+    }
+
+    for (int c = 0; candidates && c < as->candidateCount; c++) {
+        if (alternativeSame(as->candidateEdges + as->candidateStart[c], as->candidateSize[c],
+                            root, rootCount, spur, spurCount)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Append a route. Returns 0 when memory runs out.
+static int alternativeAddRoute(AlternativeSearch* as, const int* edges, int count, double length) {
+    int start = as->routeStart[as->routeCount];
+    if (start + count > as->routeEdgeCapacity) {
+        int capacity = 2 * (start + count);
+        int* grown = (int*)realloc(as->routeEdges, capacity * sizeof(int));
+        if (grown == NULL) {
+            return 0;
+        }
+        as->routeEdges = grown;
+        grown = (int*)realloc(as->sortedEdges, capacity * sizeof(int));
+        if (grown == NULL) {
+            return 0;
+        }
+        as->sortedEdges = grown;
+        as->routeEdgeCapacity = capacity;
+    }
+
+    memcpy(as->routeEdges + start, edges, count * sizeof(int));
+    as->routeLength[as->routeCount] = length;
+    as->routeCount++;
+    as->routeStart[as->routeCount] = start + count;
+    return 1;
+}
+
+// Append a Yen candidate. Returns 0 when memory runs out.
+static int alternativeAddCandidate(AlternativeSearch* as, const int* root, int rootCount,
+                                   const int* spur, int spurCount, double length) {
+    int count = rootCount + spurCount;
+    if (as->candidateEdgeCount + count > as->candidateEdgeCapacity) {
+        int capacity = 2 * (as->candidateEdgeCount + count);
+        int* grown = (int*)realloc(as->candidateEdges, capacity * sizeof(int));
+        if (grown == NULL) {
+            return 0;
+        }
+        as->candidateEdges = grown;
+        as->candidateEdgeCapacity = capacity;
+    }
+
+    if (as->candidateCount == as->candidateCapacity) {
+        int capacity = 2 * as->candidateCapacity;
+        int* starts = (int*)realloc(as->candidateStart, capacity * sizeof(int));
+        if (starts != NULL) {
+            as->candidateStart = starts;
+        }
+        int* sizes = (int*)realloc(as->candidateSize, capacity * sizeof(int));
+        if (sizes != NULL) {
+            as->candidateSize = sizes;
+        }
+        double* lengths = (double*)realloc(as->candidateLength, capacity * sizeof(double));
+        if (lengths != NULL) {
+            as->candidateLength = lengths;
+        }
+        if (starts == NULL || sizes == NULL || lengths == NULL) {
+            return 0;
+        }
+        as->candidateCapacity = capacity;
+    }
+
+    int c = as->candidateCount++;
+    as->candidateStart[c] = as->candidateEdgeCount;
+    as->candidateSize[c] = count;
+    as->candidateLength[c] = length;
+    memcpy(as->candidateEdges + as->candidateEdgeCount, root, rootCount * sizeof(int));
+    memcpy(as->candidateEdges + as->candidateEdgeCount + rootCount, spur, spurCount * sizeof(int));
+    as->candidateEdgeCount += count;
+    return 1;
+}
+
+// Reset the routes and build the shortest-path tree into destination.
+// Returns 0 if origin cannot reach destination.
+static int alternativeStart(const CSRGraph* backward, AlternativeSearch* as, int origin, int destination, int costOrTime) {
+    as->routeCount = 0;
+    as->routeStart[0] = 0;
+    as->candidateCount = 0;
+    as->candidateEdgeCount = 0;
+    as->settledCount = 0;
+
+    // Nothing is blocked until a stamp is taken
+    as->block++;
+
+    shortestPath(backward, as->tree, destination, -1, costOrTime);
+    as->settledCount += as->tree->settledCount;
+    return origin != destination && as->tree->dist[origin] < WORKSPACE_UNREACHED;
+}
+
+static int alternativeArgumentsValid(const CSRGraph* forward, const CSRGraph* backward, const AlternativeSearch* as,
+                                     int origin, int destination) {
+    return forward != NULL && backward != NULL && as != NULL && forward->nodeCount <= as->capacity &&
+           forward->edgeCount <= as->edgeCapacity && backward->nodeCount == forward->nodeCount &&
+           origin >= 0 && origin < forward->nodeCount && destination >= 0 && destination < forward->nodeCount;
+}
+
+// Yen's k shortest loopless paths (costOrTime: 1 = cost, 0 = time)
+//
+// The shortest route follows the tree from origin. Each later route is
+// the best candidate made by leaving an earlier one at some spur city:
+// the root up to the spur is kept, the edges other routes with that root
+// take next are blocked, and so are the root's cities, so the spur path
+// cannot loop back. A spur path that can simply follow the tree needs no
+// search; otherwise A* over the tree distances finds it, stopping as soon
+// as it meets a city whose tree path is clear. backward is the reverse of
+// forward from createReverseCSRGraph.
+//
+// Returns the number of routes found, shortest first, up to k (at most
+// ALTERNATIVES_MAX), or -1 on bad arguments or when memory runs out.
+int kShortestRoutes(const CSRGraph* forward, const CSRGraph* backward, AlternativeSearch* as,
+                    int origin, int destination, int costOrTime, int k) {
+    if (!alternativeArgumentsValid(forward, backward, as, origin, destination)) {
+        return -1;
+    }
+    if (k > ALTERNATIVES_MAX) {
+        k = ALTERNATIVES_MAX;
+    }
+    if (!alternativeStart(backward, as, origin, destination, costOrTime) || k < 1) {
+        return 0;
+    }
+
+    const float* weights = csrWeights(forward, costOrTime);
+    int* spur = as->path;
+
+    int count = 0;
+    for (int city = origin; city != destination; city = forward->targets[spur[count - 1]]) {
+        spur[count++] = alternativeTreeEdge(backward, as, city);
+    }
+    if (!alternativeAddRoute(as, spur, count, as->tree->dist[origin])) {
+        return -1;
+    }
+
+    while (as->routeCount < k) {
+        // Spur from every city of the newest route but the destination
+        int last = as->routeCount - 1;
+        const int* route = as->routeEdges + as->routeStart[last];
+        int routeSize = as->routeStart[last + 1] - as->routeStart[last];
+
+        double rootLength = 0;
+        for (int i = 0; i < routeSize; i++) {
+            int spurCity = i == 0 ? origin : forward->targets[route[i - 1]];
+            as->block++;
+
+            for (int r = 0; r < as->routeCount; r++) {
+                const int* other = as->routeEdges + as->routeStart[r];
+                int otherSize = as->routeStart[r + 1] - as->routeStart[r];
+                if (otherSize > i && memcmp(other, route, i * sizeof(int)) == 0) {
+                    as->blockedEdge[other[i]] = as->block;
+                }
+            }
+            for (int j = 0; j < i; j++) {
+                as->blockedCity[j == 0 ? origin : forward->targets[route[j - 1]]] = as->block;
+            }
+
+            int spurSize = alternativeSearchPath(forward, backward, as, weights, spurCity, destination, 1, spur);
+            if (spurSize > 0) {
+                double length = rootLength + alternativeLength(weights, spur, spurSize);
+                if (!alternativeKnown(as, route, i, spur, spurSize, 1) &&
+                    !alternativeAddCandidate(as, route, i, spur, spurSize, length)) {
+                    return -1;
+                }
+            }
+
+            rootLength += weights[route[i]];
+        }
+
+        // The shortest untaken candidate is the next route
+        int best = -1;
+        for (int c = 0; c < as->candidateCount; c++) {
+            if (as->candidateLength[c] >= 0 && (best == -1 || as->candidateLength[c] < as->candidateLength[best])) {
+                best = c;
+            }
+        }
+        if (best == -1) {
+            break;
+        }
+
+        if (!alternativeAddRoute(as, as->candidateEdges + as->candidateStart[best], as->candidateSize[best],
+                                 as->candidateLength[best])) {
+            return -1;
+        }
+        as->candidateLength[best] = -1;
+    }
+
+    return as->routeCount;
+}
+
+// Diverse alternatives by the penalty method (costOrTime: 1 = cost, 0 = time)
+//
+// Repeats a shortest-path search, each time adding ALTERNATIVE_PENALTY of
+// an edge's weight to every edge the last route used, so later routes
+// drift away from earlier ones instead of differing by one detour as
+// Yen's do. Each search is an A* over the same tree distances, which
+// still bound the penalised weights. Routes are listed by their real
+// length, shortest first; after ALTERNATIVE_ROUNDS searches per route
+// asked for, fewer than k may be returned.
+//
+// Returns the number of routes found, up to k (at most ALTERNATIVES_MAX),
+// or -1 on bad arguments or when memory runs out.
+int diverseRoutes(const CSRGraph* forward, const CSRGraph* backward, AlternativeSearch* as,
+                  int origin, int destination, int costOrTime, int k) {
+    if (!alternativeArgumentsValid(forward, backward, as, origin, destination)) {
+        return -1;
+    }
+    if (k > ALTERNATIVES_MAX) {
+        k = ALTERNATIVES_MAX;
+    }
+    if (!alternativeStart(backward, as, origin, destination, costOrTime) || k < 1) {
+        return 0;
+    }
+
+    const float* weights = csrWeights(forward, costOrTime);
+    memcpy(as->penalized, weights, forward->edgeCount * sizeof(float));
+    int* path = as->path;
+
+    for (int round = 0; round < ALTERNATIVE_ROUNDS * k && as->routeCount < k; round++) {
+        int count = alternativeSearchPath(forward, backward, as, as->penalized, origin, destination, 0, path);
+        if (count < 0) {
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            as->penalized[path[i]] += (float)(ALTERNATIVE_PENALTY * weights[path[i]]);
+        }
+
+        if (!alternativeKnown(as, path, count, NULL, 0, 0) &&
+            !alternativeAddRoute(as, path, count, alternativeLength(weights, path, count))) {
+            return -1;
+        }
+    }
+
+    // Order by real length; the first route found is the shortest, and at
+    // most ALTERNATIVES_MAX routes follow
+    int order[ALTERNATIVES_MAX];
+    for (int r = 0; r < as->routeCount; r++) {
+        int i = r;
+        while (i > 0 && as->routeLength[order[i - 1]] > as->routeLength[r]) {
+            order[i] = order[i - 1];
+            i--;
+        }
+        order[i] = r;
+    }
+
+    int* sorted = as->sortedEdges;
+    int starts[ALTERNATIVES_MAX + 1];
+    double lengths[ALTERNATIVES_MAX];
+    starts[0] = 0;
+    for (int r = 0; r < as->routeCount; r++) {
+        int size = as->routeStart[order[r] + 1] - as->routeStart[order[r]];
+        memcpy(sorted + starts[r], as->routeEdges + as->routeStart[order[r]], size * sizeof(int));
+        starts[r + 1] = starts[r] + size;
+        lengths[r] = as->routeLength[order[r]];
+    }
+    as->sortedEdges = as->routeEdges;
+    as->routeEdges = sorted;
+    memcpy(as->routeStart, starts, (as->routeCount + 1) * sizeof(int));
+    memcpy(as->routeLength, lengths, as->routeCount * sizeof(double));
+
+    return as->routeCount;
+}
+
+// CSR edges of a found route in travel order. Returns the number of
+// edges, or -1 if route is out of range or the path does not fit.
+int alternativePathEdges(const AlternativeSearch* as, int route, int* edges, int maxEdges) {
+    if (route < 0 || route >= as->routeCount) {
+        return -1;
+    }
+
+    int count = as->routeStart[route + 1] - as->routeStart[route];
+    if (count > maxEdges) {
+        return -1;
+    }
+
+    memcpy(edges, as->routeEdges + as->routeStart[route], count * sizeof(int));
+    return count;
+}
+
+#endif // ALTERNATIVEROUTES_H
@@ -0,0 +1,146 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdlib.h>
+#include <string.h>
+
+// Alignment of every arena allocation
+#define ARENA_ALIGNMENT 16
+
+// One contiguous chunk of arena memory; data follows the header
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;  // including the header
+    size_t used;  // including the header
+} ArenaBlock;
+
+// Header size padded so block data starts aligned
+#define ARENA_HEADER_SIZE ((sizeof(ArenaBlock) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+// Bump allocator
+//
+// Allocations are carved sequentially out of large blocks and are never
+// freed one by one. arenaReset rewinds every block so the next query
+// reuses the same memory, which keeps a long-running process at the
+// high-water mark of a single query instead of growing per query.
+typedef struct Arena {
+    ArenaBlock* first;
+    ArenaBlock* current;
+    size_t blockSize;
+    size_t bytesUsed;
+} Arena;
+
+// Function prototypes
+Arena* createArena(size_t blockSize);
+void freeArena(Arena* arena);
+void* arenaAlloc(Arena* arena, size_t bytes);
+void* arenaCalloc(Arena* arena, size_t count, size_t size);
+void arenaReset(Arena* arena);
+
+// Implementation
+Arena* createArena(size_t blockSize) {
+    Arena* arena = (Arena*)malloc(sizeof(Arena));
+    if (arena == NULL) {
+        return NULL;
+    }
+
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->blockSize = blockSize > 0 ? blockSize : 64 * 1024;
+    arena->bytesUsed = 0;
+
+    return arena;
+}
+
+void freeArena(Arena* arena) {
+    if (arena == NULL) {
+        return;
+    }
+
+    ArenaBlock* block = arena->first;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+
+    free(arena);
+}
+
+static ArenaBlock* arenaNewBlock(size_t size) {
+    ArenaBlock* block = (ArenaBlock*)malloc(ARENA_HEADER_SIZE + size);
+    if (block == NULL) {
+        return NULL;
+    }
+
+    block->next = NULL;
+    block->size = ARENA_HEADER_SIZE + size;
+    block->used = ARENA_HEADER_SIZE;
+
+    return block;
+}
+
+void* arenaAlloc(Arena* arena, size_t bytes) {
+    if (arena == NULL) {
+        return NULL;
+    }
+
+    bytes = (bytes + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+    // Use the current block, then any later block left over from a reset,
+    // and only then ask malloc for a new one
+    ArenaBlock* block = arena->current;
+    while (block != NULL && block->used + bytes > block->size) {
+        block = block->next;
+        if (block != NULL) {
+            block->used = ARENA_HEADER_SIZE;
+        }
+    }
+
+    if (block == NULL) {
+        block = arenaNewBlock(bytes > arena->blockSize ? bytes : arena->blockSize);
+        if (block == NULL) {
+            return NULL;
+        }
+
+        if (arena->current == NULL) {
+            arena->first = block;
+        } else {
+            // Link after the last block in the chain
+            ArenaBlock* last = arena->current;
+            while (last->next != NULL) {
+                last = last->next;
+            }
+            last->next = block;
+        }
+    }
+
+    arena->current = block;
+
+    void* memory = (char*)block + block->used;
+    block->used += bytes;
+    arena->bytesUsed += bytes;
+
+    return memory;
+}
+
+void* arenaCalloc(Arena* arena, size_t count, size_t size) {
+    void* memory = arenaAlloc(arena, count * size);
+    if (memory != NULL) {
+        memset(memory, 0, count * size);
+    }
+    return memory;
+}
+
+// Forget every allocation but keep the blocks for the next query
+void arenaReset(Arena* arena) {
+    if (arena == NULL || arena->first == NULL) {
+        return;
+    }
+
+    arena->current = arena->first;
+    arena->first->used = ARENA_HEADER_SIZE;
+    arena->bytesUsed = 0;
+}
+
+#endif // ARENA_H
@@ -0,0 +1,312 @@
+#ifndef BATCHQUERIES_H
+#define BATCHQUERIES_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "GraphFunctions.h"
+#include "SearchWorkspace.h"
+
+// Queries read and answered per round; results of a round are written in
+// input order before the next round is read
+#define BATCH_CHUNK_SIZE 4096
+#define BATCH_LINE_LENGTH 1024
+
+// One origin,destination,preference line and its JSON result
+typedef struct BatchQuery {
+    char line[BATCH_LINE_LENGTH];
+    const char* origin;
+    const char* destination;
+    int costOrTime;
+    int valid;
+
+    char* result;
+    size_t resultLength;
+    size_t resultCapacity;
+} BatchQuery;
+
+// Work shared by the threads of one round
+typedef struct BatchRound {
+    const Graph* graph;
+    BatchQuery* queries;
+    int queryCount;
+    int threadCount;
+} BatchRound;
+
+// Arguments of one worker thread
+typedef struct BatchWorker {
+    BatchRound* round;
+    SearchWorkspace* ws;
+    int* pathEdges;
+    int index;
+    int started;          // running on its own thread this round
+} BatchWorker;
+
+// Function prototypes
+int runBatchQueries(const Graph* graph, FILE* input, FILE* output, int threadCount);
+int parseBatchQuery(BatchQuery* query);
+void answerBatchQuery(const Graph* graph, SearchWorkspace* ws, int* pathEdges, BatchQuery* query);
+
+// Implementation
+static void batchAppend(BatchQuery* query, const char* format, ...) {
+    while (1) {
+        size_t available = query->resultCapacity - query->resultLength;
+
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(query->result + query->resultLength, available, format, args);
+        va_end(args);
+
+        if (written < 0) {
+            return;
+        }
+        if ((size_t)written < available) {
+            query->resultLength += written;
+            return;
+        }
+
+        size_t newCapacity = query->resultCapacity * 2 + written;
+        char* newResult = (char*)realloc(query->result, newCapacity);
+        if (newResult == NULL) {
+            return;
+        }
+        query->result = newResult;
+        query->resultCapacity = newCapacity;
+        PROFILE_ALLOCATION(1, newCapacity);
+    }
+}
+
+static void batchAppendString(BatchQuery* query, const char* text) {
+    batchAppend(query, "\"");
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            batchAppend(query, "\\%c", *c);
+        } else if ((unsigned char)*c < 0x20) {
+            batchAppend(query, "\\u%04x", *c);
+        } else {
+            batchAppend(query, "%c", *c);
+        }
+    }
+    batchAppend(query, "\"");
+}
+
+static char* batchTrim(char* text) {
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+
+    char* end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+
+    return text;
+}
+
+// Split query->line in place. Returns 1 for a query, 0 for a blank,
+// comment or header line.
+int parseBatchQuery(BatchQuery* query) {
+    query->valid = 0;
+    query->origin = NULL;
+    query->destination = NULL;
+    query->costOrTime = 0;
+
+    char* line = batchTrim(query->line);
+    if (*line == '\0' || *line == '#') {
+        return 0;
+    }
+
+    char* comma = strchr(line, ',');
+    if (comma == NULL) {
+        query->origin = line;
+        return 1;
+    }
+    *comma = '\0';
+    query->origin = batchTrim(line);
+
+    char* destination = comma + 1;
+    char* preference = strchr(destination, ',');
+    if (preference != NULL) {
+        *preference++ = '\0';
+        preference = batchTrim(preference);
+        query->costOrTime = strcmp(preference, "cost") == 0 || strcmp(preference, "cheapest") == 0;
+    }
+    query->destination = batchTrim(destination);
+
+    if (strcmp(query->origin, "origin") == 0 && strcmp(query->destination, "destination") == 0) {
+        return 0;
+    }
+
+    query->valid = 1;
+    return 1;
+}
+
+// Shortest path for one query, formatted as a JSON line into query->result
+void answerBatchQuery(const Graph* graph, SearchWorkspace* ws, int* pathEdges, BatchQuery* query) {
+    query->resultLength = 0;
+
+    batchAppend(query, "{\"origin\": ");
+    batchAppendString(query, query->origin != NULL ? query->origin : "");
+    batchAppend(query, ", \"destination\": ");
+    batchAppendString(query, query->destination != NULL ? query->destination : "");
+    batchAppend(query, ", \"preference\": \"%s\", ", query->costOrTime ? "cost" : "time");
+
+    if (!query->valid) {
+        batchAppend(query, "\"error\": \"Expected origin,destination,preference\"}\n");
+        return;
+    }
+
+    int origin = symbolLookup(graph->names, query->origin);
+    int destination = symbolLookup(graph->names, query->destination);
+    if (origin == -1 || destination == -1) {
+        batchAppend(query, "\"error\": \"City not found\"}\n");
+        return;
+    }
+
+    // Wall time, since other threads search alongside
+    struct timespec start;
+    struct timespec end;
+    PROFILE_BEGIN(scope, "shortestPath", "search");
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int found = shortestPath(graph->csr, ws, origin, destination, query->costOrTime);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    PROFILE_COUNT("settled", ws->settledCount);
+    PROFILE_END(scope);
+    double computationTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    if (!found) {
+        batchAppend(query, "\"error\": \"No route found\"}\n");
+        return;
+    }
+
+    int edgeCount = workspacePathEdges(ws, destination, pathEdges, graph->csr->nodeCount);
+    double totalTime = 0;
+    double totalCost = 0;
+
+    batchAppend(query, "\"path\": [");
+    batchAppendString(query, graph->cities[origin]->capital);
+    for (int i = 0; i < edgeCount; i++) {
+        totalTime += graph->csr->times[pathEdges[i]];
+        totalCost += graph->csr->costs[pathEdges[i]];
+
+        batchAppend(query, ", ");
+        batchAppendString(query, graph->cities[graph->csr->targets[pathEdges[i]]]->capital);
+    }
+    batchAppend(query, "], \"totalTime\": %.2f, \"totalCost\": %.2f, \"nodesVisited\": %d, \"computationTime\": %.6f}\n",
+                totalTime, totalCost, ws->settledCount, computationTime);
+}
+
+static void* batchWorkerRun(void* argument) {
+    BatchWorker* worker = (BatchWorker*)argument;
+    BatchRound* round = worker->round;
+
+    // Queries are striped across threads so each gets a similar mix
+    for (int i = worker->index; i < round->queryCount; i += round->threadCount) {
+        answerBatchQuery(round->graph, worker->ws, worker->pathEdges, &round->queries[i]);
+    }
+
+    return NULL;
+}
+
+// Answer every query line of input, writing one JSON line per query to
+// output in input order. Returns the number of queries answered.
+int runBatchQueries(const Graph* graph, FILE* input, FILE* output, int threadCount) {
+    if (graph == NULL || graph->csr == NULL || input == NULL || output == NULL) {
+        return 0;
+    }
+
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+
+    BatchQuery* queries = (BatchQuery*)calloc(BATCH_CHUNK_SIZE, sizeof(BatchQuery));
+    BatchWorker* workers = (BatchWorker*)calloc(threadCount, sizeof(BatchWorker));
+    pthread_t* threads = (pthread_t*)calloc(threadCount, sizeof(pthread_t));
+    if (queries == NULL || workers == NULL || threads == NULL) {
+        free(queries);
+        free(workers);
+        free(threads);
+        return 0;
+    }
+
+    // Per-thread search scratch, reused for every query the thread answers
+    BatchRound round;
+    round.graph = graph;
+    round.queries = queries;
+    round.threadCount = threadCount;
+
+    int ready = 1;
+    for (int t = 0; t < threadCount; t++) {
+        workers[t].round = &round;
+        workers[t].index = t;
+        workers[t].ws = createSearchWorkspace(graph->csr->nodeCount);
+        workers[t].pathEdges = (int*)malloc((graph->csr->nodeCount + 1) * sizeof(int));
+        if (workers[t].ws == NULL || workers[t].pathEdges == NULL) {
+            ready = 0;
+        }
+    }
+
+    int answered = 0;
+    while (ready) {
+        // Read the next chunk of query lines
+        PROFILE_BEGIN(reading, "readQueries", "load");
+        round.queryCount = 0;
+        while (round.queryCount < BATCH_CHUNK_SIZE) {
+            BatchQuery* query = &queries[round.queryCount];
+            if (fgets(query->line, sizeof(query->line), input) == NULL) {
+                break;
+            }
+            if (parseBatchQuery(query)) {
+                round.queryCount++;
+            }
+        }
+        PROFILE_END(reading);
+
+        if (round.queryCount == 0) {
+            break;
+        }
+
+        // Answer it in parallel; a share whose thread cannot start is
+        // answered here instead, so no query keeps the last chunk's result
+        for (int t = 1; t < threadCount; t++) {
+            workers[t].started = pthread_create(&threads[t], NULL, batchWorkerRun, &workers[t]) == 0;
+        }
+        batchWorkerRun(&workers[0]);
+        for (int t = 1; t < threadCount; t++) {
+            if (workers[t].started) {
+                pthread_join(threads[t], NULL);
+            } else {
+                batchWorkerRun(&workers[t]);
+            }
+        }
+
+        // Stream results out in input order
+        PROFILE_BEGIN(writing, "writeResults", "output");
+        for (int i = 0; i < round.queryCount; i++) {
+            fwrite(queries[i].result, 1, queries[i].resultLength, output);
+        }
+        fflush(output);
+        PROFILE_END(writing);
+        answered += round.queryCount;
+    }
+
+    for (int t = 0; t < threadCount; t++) {
+        freeSearchWorkspace(workers[t].ws);
+        free(workers[t].pathEdges);
+    }
+    for (int i = 0; i < BATCH_CHUNK_SIZE; i++) {
+        free(queries[i].result);
+    }
+    free(queries);
+    free(workers);
+    free(threads);
+
+    return answered;
+}
+
+#endif // BATCHQUERIES_H
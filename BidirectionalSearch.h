@@ -0,0 +1,115 @@
+#ifndef BIDIRECTIONALSEARCH_H
+#define BIDIRECTIONALSEARCH_H
+
+#include <stdlib.h>
+
+#include "CSRGraph.h"
+#include "SearchWorkspace.h"
+
+// Function prototypes
+int bidirectionalPath(const CSRGraph* forward, const CSRGraph* backward, SearchWorkspace* fws, SearchWorkspace* bws,
+                      int origin, int destination, int costOrTime);
+int bidirectionalPathEdges(const CSRGraph* backward, const SearchWorkspace* fws, const SearchWorkspace* bws,
+                           int meeting, int* edges, int maxEdges);
+
+// Implementation
+
+// Bidirectional Dijkstra (costOrTime: 1 = cost, 0 = time)
+//
+// fws searches forward from origin over forward; bws searches backward
+// from destination over backward, the reverse of forward built by
+// createReverseCSRGraph. Each step advances the side with the smaller
+// queue top. best is the shortest origin-destination length through any
+// city both sides have reached; once the two queue tops sum to at least
+// best, every unsettled path is longer and the search stops.
+//
+// Returns the city where the two halves of the shortest path meet, or -1
+// if destination cannot be reached. settledCount of the two workspaces
+// together is the number of cities settled.
+int bidirectionalPath(const CSRGraph* forward, const CSRGraph* backward, SearchWorkspace* fws, SearchWorkspace* bws,
+                      int origin, int destination, int costOrTime) {
+    if (forward == NULL || backward == NULL || fws == NULL || bws == NULL ||
+        forward->nodeCount > fws->capacity || forward->nodeCount > bws->capacity ||
+        origin < 0 || origin >= forward->nodeCount || destination < 0 || destination >= forward->nodeCount) {
+        return -1;
+    }
+
+    workspaceReset(fws);
+    workspaceReset(bws);
+
+    workspaceTouch(fws, origin);
+    workspaceTouch(bws, destination);
+    fws->dist[origin] = 0;
+    bws->dist[destination] = 0;
+    if (origin == destination) {
+        return origin;
+    }
+
+    heapPushOrDecrease(fws->heap, origin, 0);
+    heapPushOrDecrease(bws->heap, destination, 0);
+
+    double best = WORKSPACE_UNREACHED;
+    int meeting = -1;
+
+    while (!heapEmpty(fws->heap) && !heapEmpty(bws->heap)) {
+        double forwardTop = heapTopKey(fws->heap);
+        double backwardTop = heapTopKey(bws->heap);
+        if (forwardTop + backwardTop >= best) {
+            break;
+        }
+
+        int forwardStep = forwardTop <= backwardTop;
+        const CSRGraph* csr = forwardStep ? forward : backward;
+        SearchWorkspace* ws = forwardStep ? fws : bws;
+        const SearchWorkspace* other = forwardStep ? bws : fws;
+        const float* weights = csrWeights(csr, costOrTime);
+
+        int u = heapPop(ws->heap);
+        ws->settled[u] = 1;
+        ws->settledCount++;
+
+        for (int e = csr->offsets[u]; e < csr->offsets[u + 1]; e++) {
+            int v = csr->targets[e];
+            workspaceTouch(ws, v);
+            double length = ws->dist[u] + weights[e];
+            if (!ws->settled[v] && length < ws->dist[v]) {
+                ws->dist[v] = length;
+                ws->parent[v] = u;
+                ws->parentEdge[v] = e;
+                heapPushOrDecrease(ws->heap, v, length);
+            }
+
+            // v joins the two searches
+            double remaining = workspaceDist(other, v);
+            if (remaining < WORKSPACE_UNREACHED && ws->dist[v] + remaining < best) {
+                best = ws->dist[v] + remaining;
+                meeting = v;
+            }
+        }
+    }
+
+    return meeting;
+}
+
+// Edges of forward along the path found by bidirectionalPath, in travel
+// order. Returns the number of edges, or -1 if they do not fit in maxEdges.
+int bidirectionalPathEdges(const CSRGraph* backward, const SearchWorkspace* fws, const SearchWorkspace* bws,
+                           int meeting, int* edges, int maxEdges) {
+    int count = workspacePathEdges(fws, meeting, edges, maxEdges);
+    if (count < 0) {
+        return -1;
+    }
+
+    // The backward half runs from the meeting city to the destination;
+    // each reverse edge maps back to its forward edge
+    for (int city = meeting; workspaceParentEdge(bws, city) != -1; city = bws->parent[city]) {
+        if (count >= maxEdges) {
+            return -1;
+        }
+        edges[count++] = backward->edgeRoutes[bws->parentEdge[city]];
+    }
+
+    return count;
+}
+
+#endif // BIDIRECTIONALSEARCH_H
@@ -0,0 +1,264 @@
+#ifndef CSRGRAPH_H
+#define CSRGRAPH_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Profiler.h"
+
+// Transport modes stored per edge (one byte each)
+#define TRANSPORT_OTHER 0
+#define TRANSPORT_PLANE 1
+#define TRANSPORT_BUS   2
+#define TRANSPORT_TRAIN 3
+#define TRANSPORT_BOAT  4
+#define TRANSPORT_TRUCK 5
+#define TRANSPORT_MODE_COUNT 6
+
+// Compressed-sparse-row graph
+//
+// Cities are dense ids 0..nodeCount-1. The out-edges of city u are the
+// edge slots offsets[u] .. offsets[u+1]-1, and each edge's fields live in
+// their own packed array so the search loop only touches what it reads.
+// edgeRoutes maps an edge back to the caller's route table, which keeps
+// the string-heavy records out of the hot arrays.
+typedef struct CSRGraph {
+    int nodeCount;
+    int edgeCount;
+
+    int* offsets;
+    int* targets;
+    float* times;
+    float* costs;
+    unsigned char* modes;
+
+    int* edgeRoutes;
+} CSRGraph;
+
+// Function prototypes
+CSRGraph* createCSRGraph(int nodeCount, int edgeCount, const int* sources, const int* targets,
+                         const float* times, const float* costs, const unsigned char* modes);
+CSRGraph* createReverseCSRGraph(const CSRGraph* csr);
+CSRGraph* copyCSRGraph(const CSRGraph* csr);
+void freeCSRGraph(CSRGraph* csr);
+const float* csrWeights(const CSRGraph* csr, int costOrTime);
+int csrFindEdge(const CSRGraph* csr, int from, int to, int costOrTime);
+int csrEdgeSource(const CSRGraph* csr, int edge);
+int transportModeFromString(const char* transport);
+const char* transportModeName(int mode);
+
+// Implementation
+CSRGraph* createCSRGraph(int nodeCount, int edgeCount, const int* sources, const int* targets,
+                         const float* times, const float* costs, const unsigned char* modes) {
+    if (nodeCount < 0 || edgeCount < 0) {
+        return NULL;
+    }
+
+    CSRGraph* csr = (CSRGraph*)malloc(sizeof(CSRGraph));
+    if (csr == NULL) {
+        return NULL;
+    }
+
+    csr->nodeCount = nodeCount;
+    csr->offsets = (int*)calloc(nodeCount + 1, sizeof(int));
+
+    // Count out-degrees, skipping edges whose endpoints are not cities
+    int kept = 0;
+    if (csr->offsets != NULL) {
+        for (int i = 0; i < edgeCount; i++) {
+            if (sources[i] < 0 || sources[i] >= nodeCount || targets[i] < 0 || targets[i] >= nodeCount) {
+                continue;
+            }
+            csr->offsets[sources[i] + 1]++;
+            kept++;
+        }
+    }
+
+    csr->edgeCount = kept;
+    csr->targets = (int*)malloc((kept > 0 ? kept : 1) * sizeof(int));
+    csr->times = (float*)malloc((kept > 0 ? kept : 1) * sizeof(float));
+    csr->costs = (float*)malloc((kept > 0 ? kept : 1) * sizeof(float));
+    csr->modes = (unsigned char*)malloc((kept > 0 ? kept : 1) * sizeof(unsigned char));
+    csr->edgeRoutes = (int*)malloc((kept > 0 ? kept : 1) * sizeof(int));
+    int* cursor = (int*)malloc((nodeCount > 0 ? nodeCount : 1) * sizeof(int));
+
+    if (csr->offsets == NULL || csr->targets == NULL || csr->times == NULL || csr->costs == NULL ||
+        csr->modes == NULL || csr->edgeRoutes == NULL || cursor == NULL) {
+        free(cursor);
+        freeCSRGraph(csr);
+        return NULL;
+    }
+
+    PROFILE_ALLOCATION(8, sizeof(CSRGraph) + (nodeCount + 1) * sizeof(int) + (nodeCount > 0 ? nodeCount : 1) * sizeof(int) +
+                          (kept > 0 ? kept : 1) * (2 * sizeof(int) + 2 * sizeof(float) + sizeof(unsigned char)));
+
+    // Prefix sum turns degrees into offsets
+    for (int u = 0; u < nodeCount; u++) {
+        csr->offsets[u + 1] += csr->offsets[u];
+        cursor[u] = csr->offsets[u];
+    }
+
+    // Scatter edges into their source's slot range (stable, keeps input order)
+    for (int i = 0; i < edgeCount; i++) {
+        if (sources[i] < 0 || sources[i] >= nodeCount || targets[i] < 0 || targets[i] >= nodeCount) {
+            continue;
+        }
+        int slot = cursor[sources[i]]++;
+        csr->targets[slot] = targets[i];
+        csr->times[slot] = times[i];
+        csr->costs[slot] = costs[i];
+        csr->modes[slot] = modes != NULL ? modes[i] : TRANSPORT_OTHER;
+        csr->edgeRoutes[slot] = i;
+    }
+
+    free(cursor);
+    return csr;
+}
+
+// Transpose of csr: the out-edges of city v are the edges into v. Its
+// edgeRoutes hold the matching edge of csr rather than a route index.
+CSRGraph* createReverseCSRGraph(const CSRGraph* csr) {
+    if (csr == NULL) {
+        return NULL;
+    }
+
+    int m = csr->edgeCount;
+    int* sources = (int*)malloc((m > 0 ? m : 1) * sizeof(int));
+    if (sources == NULL) {
+        return NULL;
+    }
+
+    for (int u = 0; u < csr->nodeCount; u++) {
+        for (int e = csr->offsets[u]; e < csr->offsets[u + 1]; e++) {
+            sources[e] = u;
+        }
+    }
+
+    CSRGraph* reverse = createCSRGraph(csr->nodeCount, m, csr->targets, sources, csr->times, csr->costs, csr->modes);
+    free(sources);
+    return reverse;
+}
+
+// Independent copy of csr, for changing weights without touching a graph
+// other threads are searching
+CSRGraph* copyCSRGraph(const CSRGraph* csr) {
+    if (csr == NULL) {
+        return NULL;
+    }
+
+    CSRGraph* copy = (CSRGraph*)malloc(sizeof(CSRGraph));
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    int n = csr->nodeCount;
+    int m = csr->edgeCount > 0 ? csr->edgeCount : 1;
+    copy->nodeCount = csr->nodeCount;
+    copy->edgeCount = csr->edgeCount;
+    copy->offsets = (int*)malloc((n + 1) * sizeof(int));
+    copy->targets = (int*)malloc(m * sizeof(int));
+    copy->times = (float*)malloc(m * sizeof(float));
+    copy->costs = (float*)malloc(m * sizeof(float));
+    copy->modes = (unsigned char*)malloc(m * sizeof(unsigned char));
+    copy->edgeRoutes = (int*)malloc(m * sizeof(int));
+
+    if (copy->offsets == NULL || copy->targets == NULL || copy->times == NULL || copy->costs == NULL ||
+        copy->modes == NULL || copy->edgeRoutes == NULL) {
+        freeCSRGraph(copy);
+        return NULL;
+    }
+
+    m = csr->edgeCount;
+    memcpy(copy->offsets, csr->offsets, (n + 1) * sizeof(int));
+    memcpy(copy->targets, csr->targets, m * sizeof(int));
+    memcpy(copy->times, csr->times, m * sizeof(float));
+    memcpy(copy->costs, csr->costs, m * sizeof(float));
+    memcpy(copy->modes, csr->modes, m * sizeof(unsigned char));
+    memcpy(copy->edgeRoutes, csr->edgeRoutes, m * sizeof(int));
+
+    return copy;
+}
+
+void freeCSRGraph(CSRGraph* csr) {
+    if (csr == NULL) {
+        return;
+    }
+
+    free(csr->offsets);
+    free(csr->targets);
+    free(csr->times);
+    free(csr->costs);
+    free(csr->modes);
+    free(csr->edgeRoutes);
+    free(csr);
+}
+
+// Edge weight array for the chosen objective (1 = cost, 0 = time)
+const float* csrWeights(const CSRGraph* csr, int costOrTime) {
+    return costOrTime ? csr->costs : csr->times;
+}
+
+// Cheapest edge from -> to under the chosen objective, or -1
+int csrFindEdge(const CSRGraph* csr, int from, int to, int costOrTime) {
+    if (csr == NULL || from < 0 || from >= csr->nodeCount) {
+        return -1;
+    }
+
+    const float* weights = csrWeights(csr, costOrTime);
+    int best = -1;
+    for (int e = csr->offsets[from]; e < csr->offsets[from + 1]; e++) {
+        if (csr->targets[e] == to && (best == -1 || weights[e] < weights[best])) {
+            best = e;
+        }
+    }
+
+    return best;
+}
+
+// City an edge leaves from, by binary search over offsets
+int csrEdgeSource(const CSRGraph* csr, int edge) {
+    if (csr == NULL || edge < 0 || edge >= csr->edgeCount) {
+        return -1;
+    }
+
+    // Last city whose first edge is at or before edge
+    int low = 0;
+    int high = csr->nodeCount - 1;
+    while (low < high) {
+        int middle = low + (high - low + 1) / 2;
+        if (csr->offsets[middle] <= edge) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    return low;
+}
+
+int transportModeFromString(const char* transport) {
+    if (transport == NULL) {
+        return TRANSPORT_OTHER;
+    }
+
+    if (strcmp(transport, "plane") == 0) return TRANSPORT_PLANE;
+    if (strcmp(transport, "bus") == 0) return TRANSPORT_BUS;
+    if (strcmp(transport, "train") == 0) return TRANSPORT_TRAIN;
+    if (strcmp(transport, "boat") == 0) return TRANSPORT_BOAT;
+    if (strcmp(transport, "truck") == 0) return TRANSPORT_TRUCK;
+
+    return TRANSPORT_OTHER;
+}
+
+const char* transportModeName(int mode) {
+    switch (mode) {
+        case TRANSPORT_PLANE: return "plane";
+        case TRANSPORT_BUS: return "bus";
+        case TRANSPORT_TRAIN: return "train";
+        case TRANSPORT_BOAT: return "boat";
+        case TRANSPORT_TRUCK: return "truck";
+        default: return "other";
+    }
+}
+
+#endif // CSRGRAPH_H
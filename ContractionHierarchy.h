@@ -0,0 +1,964 @@
+#ifndef CONTRACTIONHIERARCHY_H
+#define CONTRACTIONHIERARCHY_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "CSRGraph.h"
+#include "IndexedHeap.h"
+#include "SourceFile.h"
+
+#define CONTRACTION_MAGIC "TRVLCHGR"
+#define CONTRACTION_VERSION 1
+
+// Metrics stored in a hierarchy, indexed like costOrTime
+#define CONTRACTION_METRICS 2
+
+// Cities a witness search may settle before giving up. A witness it
+// misses only costs a redundant shortcut, never a wrong answer.
+#define CONTRACTION_WITNESS_LIMIT 256
+
+// Distance of a city a search has not reached
+#define CONTRACTION_UNREACHED 1e30
+
+// Arc of the hierarchy: an edge of the input graph (second is -1 and
+// first is its CSR edge) or a shortcut standing for arc first followed
+// by arc second
+typedef struct ContractionArc {
+    int32_t first;
+    int32_t second;
+} ContractionArc;
+
+// Entry of an adjacency list: the neighbour, the arc's weight and the arc
+typedef struct ContractionEdge {
+    int32_t target;
+    float weight;
+    int32_t arc;
+} ContractionEdge;
+
+// Counts and byte offsets of one metric's sections
+typedef struct ContractionMetricHeader {
+    uint32_t arcCount;
+    uint32_t upCount;
+    uint32_t downCount;
+    uint32_t reserved;
+    uint64_t upOffsets;
+    uint64_t upEdges;
+    uint64_t downOffsets;
+    uint64_t downEdges;
+    uint64_t arcs;
+} ContractionMetricHeader;
+
+// On-disk header, followed for each metric by
+//   int32_t         upOffsets[nodeCount + 1]
+//   ContractionEdge upEdges[upCount]
+//   int32_t         downOffsets[nodeCount + 1]
+//   ContractionEdge downEdges[downCount]
+//   ContractionArc  arcs[arcCount]
+// The up list of a city holds the arcs leaving it for higher-ranked
+// cities. Its down list holds the arcs arriving from higher-ranked cities,
+// with target the city they leave from.
+typedef struct ContractionHierarchyHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t edgeCount;
+    uint32_t reserved;
+    SourceFileInfo cities;
+    SourceFileInfo routes;
+    ContractionMetricHeader metrics[CONTRACTION_METRICS];
+} ContractionHierarchyHeader;
+
+// One metric of a mapped hierarchy
+typedef struct ContractionMetric {
+    const int32_t* upOffsets;
+    const ContractionEdge* upEdges;
+    const int32_t* downOffsets;
+    const ContractionEdge* downEdges;
+    const ContractionArc* arcs;
+    int arcCount;
+} ContractionMetric;
+
+// Read-only view of a mapped hierarchy file
+typedef struct ContractionHierarchy {
+    void* mapping;
+    size_t mappingSize;
+
+    const ContractionHierarchyHeader* header;
+    int nodeCount;
+    ContractionMetric metrics[CONTRACTION_METRICS];
+} ContractionHierarchy;
+
+// Per-thread query state
+//
+// Side 0 searches up from the origin, side 1 up from the destination.
+// Only the cities a query reached are reset before the next one, so a
+// query costs what it touches rather than the size of the network.
+typedef struct ContractionQuery {
+    int capacity;
+
+    double* dist[2];
+    int* parent[2];       // previous city on the side's best path, -1 if none
+    int* parentArc[2];    // arc used to reach the city, -1 if none
+    IndexedHeap* heap[2];
+
+    int* touched;         // cities with a distance on either side
+    int touchedCount;
+    int* pathArcs;        // arcs of the last path, before unpacking
+    int* unpackStack;
+
+    int settledCount;     // cities settled by the last query, both sides
+} ContractionQuery;
+
+// Function prototypes
+int buildContractionHierarchy(const CSRGraph* csr, const SourceFileInfo* cities, const SourceFileInfo* routes, const char* hierarchyFile);
+ContractionHierarchy* openContractionHierarchy(const char* hierarchyFile);
+void closeContractionHierarchy(ContractionHierarchy* hierarchy);
+int contractionHierarchyFresh(const ContractionHierarchy* hierarchy, const CSRGraph* csr, const char* citiesFile, const char* routesFile);
+int contractionHierarchyMatches(const ContractionHierarchy* hierarchy, const CSRGraph* csr, const SourceFileInfo* cities, const SourceFileInfo* routes);
+ContractionQuery* createContractionQuery(int capacity);
+void freeContractionQuery(ContractionQuery* query);
+int contractionPathEdges(const ContractionHierarchy* hierarchy, ContractionQuery* query, int costOrTime,
+                         int origin, int destination, int* edges, int maxEdges);
+
+// Implementation
+
+// Growable list of arc ids
+typedef struct ContractionList {
+    int* items;
+    int count;
+    int capacity;
+} ContractionList;
+
+// Arc while the hierarchy is being built
+typedef struct ContractionBuildArc {
+    int from;
+    int to;
+    double weight;
+    int first;
+    int second;
+    int live;             // 0 once a shorter shortcut replaces it
+} ContractionBuildArc;
+
+// State of contracting one metric
+//
+// out and in hold the live arcs between cities not yet contracted; a
+// contracted city keeps its own lists, which are then its final arcs.
+typedef struct ContractionBuilder {
+    int nodeCount;
+
+    ContractionBuildArc* arcs;
+    int arcCount;
+    int arcCapacity;
+
+    ContractionList* out;
+    ContractionList* in;
+    int* rank;                  // contraction order, -1 until contracted
+    int* contractedNeighbours;
+
+    // Witness search scratch
+    double* dist;
+    int* touched;
+    int touchedCount;
+    int* targetStamp;
+    int stamp;
+    IndexedHeap* heap;
+} ContractionBuilder;
+
+// Sections of one contracted metric, before they are written
+typedef struct ContractionOutput {
+    int32_t* upOffsets;
+    ContractionEdge* upEdges;
+    int32_t* downOffsets;
+    ContractionEdge* downEdges;
+    ContractionArc* arcs;
+    int upCount;
+    int downCount;
+    int arcCount;
+} ContractionOutput;
+
+static int contractionListPush(ContractionList* list, int item) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity > 0 ? list->capacity * 2 : 4;
+        int* items = (int*)realloc(list->items, capacity * sizeof(int));
+        if (items == NULL) {
+            return 0;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+
+    list->items[list->count++] = item;
+    return 1;
+}
+
+static void contractionListRemove(ContractionList* list, int item) {
+    for (int i = 0; i < list->count; i++) {
+        if (list->items[i] == item) {
+            list->items[i] = list->items[--list->count];
+            return;
+        }
+    }
+}
+
+// Add an arc and link it into the lists of its ends. Returns its id, or -1.
+static int contractionAddArc(ContractionBuilder* b, int from, int to, double weight, int first, int second) {
+    if (b->arcCount == b->arcCapacity) {
+        int capacity = b->arcCapacity > 0 ? b->arcCapacity * 2 : 1024;
+        ContractionBuildArc* arcs = (ContractionBuildArc*)realloc(b->arcs, capacity * sizeof(ContractionBuildArc));
+        if (arcs == NULL) {
+            return -1;
+        }
+        b->arcs = arcs;
+        b->arcCapacity = capacity;
+    }
+
+    int id = b->arcCount;
+    if (!contractionListPush(&b->out[from], id) || !contractionListPush(&b->in[to], id)) {
+        return -1;
+    }
+
+    ContractionBuildArc* arc = &b->arcs[id];
+    arc->from = from;
+    arc->to = to;
+    arc->weight = weight;
+    arc->first = first;
+    arc->second = second;
+    arc->live = 1;
+    b->arcCount++;
+
+    return id;
+}
+
+// Live arc from -> to, or -1
+static int contractionFindArc(const ContractionBuilder* b, int from, int to) {
+    const ContractionList* out = &b->out[from];
+    for (int i = 0; i < out->count; i++) {
+        if (b->arcs[out->items[i]].to == to) {
+            return out->items[i];
+        }
+    }
+    return -1;
+}
+
+static void freeContractionBuilder(ContractionBuilder* b) {
+    if (b == NULL) {
+        return;
+    }
+
+    if (b->out != NULL && b->in != NULL) {
+        for (int i = 0; i < b->nodeCount; i++) {
+            free(b->out[i].items);
+            free(b->in[i].items);
+        }
+    }
+    free(b->out);
+    free(b->in);
+    free(b->arcs);
+    free(b->rank);
+    free(b->contractedNeighbours);
+    free(b->dist);
+    free(b->touched);
+    free(b->targetStamp);
+    freeIndexedHeap(b->heap);
+    free(b);
+}
+
+// Builder holding the edges of csr under one metric, parallel edges
+// reduced to the lightest
+static ContractionBuilder* createContractionBuilder(const CSRGraph* csr, int costOrTime) {
+    ContractionBuilder* b = (ContractionBuilder*)calloc(1, sizeof(ContractionBuilder));
+    if (b == NULL) {
+        return NULL;
+    }
+
+    int n = csr->nodeCount > 0 ? csr->nodeCount : 1;
+    b->nodeCount = csr->nodeCount;
+    b->out = (ContractionList*)calloc(n, sizeof(ContractionList));
+    b->in = (ContractionList*)calloc(n, sizeof(ContractionList));
+    b->rank = (int*)malloc(n * sizeof(int));
+    b->contractedNeighbours = (int*)calloc(n, sizeof(int));
+    b->dist = (double*)malloc(n * sizeof(double));
+    b->touched = (int*)malloc(n * sizeof(int));
+    b->targetStamp = (int*)calloc(n, sizeof(int));
+    b->heap = createIndexedHeap(n);
+
+    if (b->out == NULL || b->in == NULL || b->rank == NULL || b->contractedNeighbours == NULL ||
+        b->dist == NULL || b->touched == NULL || b->targetStamp == NULL || b->heap == NULL) {
+        freeContractionBuilder(b);
+        return NULL;
+    }
+
+    for (int i = 0; i < n; i++) {
+        b->rank[i] = -1;
+        b->dist[i] = CONTRACTION_UNREACHED;
+    }
+
+    const float* weights = csrWeights(csr, costOrTime);
+    for (int u = 0; u < csr->nodeCount; u++) {
+        for (int e = csr->offsets[u]; e < csr->offsets[u + 1]; e++) {
+            int v = csr->targets[e];
+            if (v == u) {
+                continue;
+            }
+
+            int existing = contractionFindArc(b, u, v);
+            if (existing != -1) {
+                if (weights[e] < b->arcs[existing].weight) {
+                    b->arcs[existing].weight = weights[e];
+                    b->arcs[existing].first = e;
+                }
+            } else if (contractionAddArc(b, u, v, weights[e], e, -1) == -1) {
+                freeContractionBuilder(b);
+                return NULL;
+            }
+        }
+    }
+
+    return b;
+}
+
+// Dijkstra from source among uncontracted cities other than excluded,
+// until it passes maxDistance, settles every city stamped as a target or
+// reaches CONTRACTION_WITNESS_LIMIT. Leaves distances in b->dist.
+static void contractionWitnessSearch(ContractionBuilder* b, int source, int excluded, double maxDistance, int targets) {
+    b->dist[source] = 0;
+    b->touched[b->touchedCount++] = source;
+    heapPushOrDecrease(b->heap, source, 0);
+
+    int settled = 0;
+    while (!heapEmpty(b->heap) && targets > 0 && settled < CONTRACTION_WITNESS_LIMIT) {
+        if (heapTopKey(b->heap) > maxDistance) {
+            break;
+        }
+
+        int u = heapPop(b->heap);
+        settled++;
+        if (b->targetStamp[u] == b->stamp) {
+            targets--;
+        }
+
+        const ContractionList* out = &b->out[u];
+        for (int i = 0; i < out->count; i++) {
+            const ContractionBuildArc* arc = &b->arcs[out->items[i]];
+            int v = arc->to;
+            if (v == excluded || b->rank[v] != -1) {
+                continue;
+            }
+
+            double length = b->dist[u] + arc->weight;
+            if (length < b->dist[v]) {
+                if (b->dist[v] >= CONTRACTION_UNREACHED) {
+                    b->touched[b->touchedCount++] = v;
+                }
+                b->dist[v] = length;
+                heapPushOrDecrease(b->heap, v, length);
+            }
+        }
+    }
+}
+
+static void contractionWitnessReset(ContractionBuilder* b) {
+    for (int i = 0; i < b->touchedCount; i++) {
+        b->dist[b->touched[i]] = CONTRACTION_UNREACHED;
+    }
+    b->touchedCount = 0;
+    heapClear(b->heap);
+}
+
+// Shortcuts needed to take city v out of the remaining graph: one for
+// each pair of neighbours u -> v -> w whose only shortest path runs
+// through v. Adds them unless simulate is set. Returns their number, or
+// -1 if memory runs out.
+static int contractionContract(ContractionBuilder* b, int v, int simulate) {
+    int shortcuts = 0;
+
+    for (int i = 0; i < b->in[v].count; i++) {
+        int inArc = b->in[v].items[i];
+        int u = b->arcs[inArc].from;
+        double inWeight = b->arcs[inArc].weight;
+
+        // Stamp the cities past v that u needs a path to
+        b->stamp++;
+        double maxDistance = 0;
+        int targets = 0;
+        for (int j = 0; j < b->out[v].count; j++) {
+            const ContractionBuildArc* outArc = &b->arcs[b->out[v].items[j]];
+            if (outArc->to == u) {
+                continue;
+            }
+            if (inWeight + outArc->weight > maxDistance) {
+                maxDistance = inWeight + outArc->weight;
+            }
+            if (b->targetStamp[outArc->to] != b->stamp) {
+                b->targetStamp[outArc->to] = b->stamp;
+                targets++;
+            }
+        }
+        if (targets == 0) {
+            continue;
+        }
+
+        contractionWitnessSearch(b, u, v, maxDistance, targets);
+
+        for (int j = 0; j < b->out[v].count; j++) {
+            int outArc = b->out[v].items[j];
+            int w = b->arcs[outArc].to;
+            double via = inWeight + b->arcs[outArc].weight;
+            if (w == u || b->dist[w] <= via) {
+                continue;
+            }
+
+            shortcuts++;
+            if (simulate) {
+                continue;
+            }
+
+            // A longer arc u -> w is replaced, not kept beside the shortcut
+            int existing = contractionFindArc(b, u, w);
+            if (existing != -1) {
+                b->arcs[existing].live = 0;
+                contractionListRemove(&b->out[u], existing);
+                contractionListRemove(&b->in[w], existing);
+            }
+            if (contractionAddArc(b, u, w, via, inArc, outArc) == -1) {
+                contractionWitnessReset(b);
+                return -1;
+            }
+        }
+
+        contractionWitnessReset(b);
+    }
+
+    return shortcuts;
+}
+
+// Contraction order key: shortcuts added less arcs removed, plus the
+// neighbours already contracted so the order spreads over the network
+static double contractionPriority(ContractionBuilder* b, int v) {
+    int shortcuts = contractionContract(b, v, 1);
+    return (double)shortcuts - b->in[v].count - b->out[v].count + b->contractedNeighbours[v];
+}
+
+// Contract every city in priority order, then split the live arcs into
+// up and down lists. Returns 1 on success.
+static int contractMetric(const CSRGraph* csr, int costOrTime, ContractionOutput* output) {
+    memset(output, 0, sizeof(ContractionOutput));
+
+    ContractionBuilder* b = createContractionBuilder(csr, costOrTime);
+    if (b == NULL) {
+        return 0;
+    }
+
+    int n = csr->nodeCount;
+    IndexedHeap* order = createIndexedHeap(n);
+    if (order == NULL) {
+        freeContractionBuilder(b);
+        return 0;
+    }
+
+    for (int v = 0; v < n; v++) {
+        heapPushOrDecrease(order, v, contractionPriority(b, v));
+    }
+
+    // Priorities go stale as neighbours are contracted; one that has grown
+    // since it was queued goes back in the queue rather than being taken
+    int nextRank = 0;
+    int ok = 1;
+    while (ok && !heapEmpty(order)) {
+        int v = heapPop(order);
+        double priority = contractionPriority(b, v);
+        if (!heapEmpty(order) && priority > heapTopKey(order)) {
+            heapPushOrDecrease(order, v, priority);
+            continue;
+        }
+
+        ok = contractionContract(b, v, 0) != -1;
+        b->rank[v] = nextRank++;
+
+        // Unlink v from the remaining graph
+        for (int i = 0; i < b->in[v].count; i++) {
+            const ContractionBuildArc* arc = &b->arcs[b->in[v].items[i]];
+            contractionListRemove(&b->out[arc->from], b->in[v].items[i]);
+            b->contractedNeighbours[arc->from]++;
+        }
+        for (int i = 0; i < b->out[v].count; i++) {
+            const ContractionBuildArc* arc = &b->arcs[b->out[v].items[i]];
+            contractionListRemove(&b->in[arc->to], b->out[v].items[i]);
+            b->contractedNeighbours[arc->to]++;
+        }
+
+        // Neighbours usually became cheaper to contract
+        for (int i = 0; ok && i < b->in[v].count; i++) {
+            int u = b->arcs[b->in[v].items[i]].from;
+            heapPushOrDecrease(order, u, contractionPriority(b, u));
+        }
+        for (int i = 0; ok && i < b->out[v].count; i++) {
+            int w = b->arcs[b->out[v].items[i]].to;
+            heapPushOrDecrease(order, w, contractionPriority(b, w));
+        }
+    }
+    freeIndexedHeap(order);
+
+    if (ok) {
+        output->arcCount = b->arcCount;
+        output->upOffsets = (int32_t*)calloc(n + 1, sizeof(int32_t));
+        output->downOffsets = (int32_t*)calloc(n + 1, sizeof(int32_t));
+        output->arcs = (ContractionArc*)malloc((b->arcCount > 0 ? b->arcCount : 1) * sizeof(ContractionArc));
+        ok = output->upOffsets != NULL && output->downOffsets != NULL && output->arcs != NULL;
+    }
+
+    if (ok) {
+        for (int a = 0; a < b->arcCount; a++) {
+            const ContractionBuildArc* arc = &b->arcs[a];
+            output->arcs[a].first = arc->first;
+            output->arcs[a].second = arc->second;
+            if (!arc->live) {
+                continue;
+            }
+            if (b->rank[arc->from] < b->rank[arc->to]) {
+                output->upOffsets[arc->from + 1]++;
+                output->upCount++;
+            } else {
+                output->downOffsets[arc->to + 1]++;
+                output->downCount++;
+            }
+        }
+
+        output->upEdges = (ContractionEdge*)malloc((output->upCount > 0 ? output->upCount : 1) * sizeof(ContractionEdge));
+        output->downEdges = (ContractionEdge*)malloc((output->downCount > 0 ? output->downCount : 1) * sizeof(ContractionEdge));
+        ok = output->upEdges != NULL && output->downEdges != NULL;
+    }
+
+    if (ok) {
+        for (int v = 0; v < n; v++) {
+            output->upOffsets[v + 1] += output->upOffsets[v];
+            output->downOffsets[v + 1] += output->downOffsets[v];
+        }
+
+        // Fill each list from the end of its range back to the start
+        for (int a = 0; a < b->arcCount; a++) {
+            const ContractionBuildArc* arc = &b->arcs[a];
+            if (!arc->live) {
+                continue;
+            }
+
+            ContractionEdge* edge;
+            if (b->rank[arc->from] < b->rank[arc->to]) {
+                edge = &output->upEdges[--output->upOffsets[arc->from + 1]];
+                edge->target = arc->to;
+            } else {
+                edge = &output->downEdges[--output->downOffsets[arc->to + 1]];
+                edge->target = arc->from;
+            }
+            edge->weight = (float)arc->weight;
+            edge->arc = a;
+        }
+
+        // offsets[v + 1] has counted down to the start of v's list
+        for (int v = 0; v < n; v++) {
+            output->upOffsets[v] = output->upOffsets[v + 1];
+            output->downOffsets[v] = output->downOffsets[v + 1];
+        }
+        output->upOffsets[n] = output->upCount;
+        output->downOffsets[n] = output->downCount;
+    }
+
+    freeContractionBuilder(b);
+    return ok;
+}
+
+static void freeContractionOutput(ContractionOutput* output) {
+    free(output->upOffsets);
+    free(output->upEdges);
+    free(output->downOffsets);
+    free(output->downEdges);
+    free(output->arcs);
+}
+
+// Contract csr under both metrics and write the hierarchy to
+// hierarchyFile, recording the inputs it was built from. Returns 1 on
+// success.
+int buildContractionHierarchy(const CSRGraph* csr, const SourceFileInfo* cities, const SourceFileInfo* routes, const char* hierarchyFile) {
+    if (csr == NULL || cities == NULL || routes == NULL || csr->nodeCount < 1) {
+        return 0;
+    }
+
+    ContractionOutput outputs[CONTRACTION_METRICS];
+    memset(outputs, 0, sizeof(outputs));
+
+    int ok = 1;
+    for (int costOrTime = 0; ok && costOrTime < CONTRACTION_METRICS; costOrTime++) {
+        ok = contractMetric(csr, costOrTime, &outputs[costOrTime]);
+    }
+
+    ContractionHierarchyHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CONTRACTION_MAGIC, sizeof(header.magic));
+    header.version = CONTRACTION_VERSION;
+    header.nodeCount = (uint32_t)csr->nodeCount;
+    header.edgeCount = (uint32_t)csr->edgeCount;
+    header.cities = *cities;
+    header.routes = *routes;
+
+    // Sections follow the header back to back; every size is a multiple
+    // of 4, and offsets lists are padded to 8 so edge records stay aligned
+    size_t offsetsSize = ((size_t)(csr->nodeCount + 1) * sizeof(int32_t) + 7) & ~(size_t)7;
+    uint64_t offset = (sizeof(header) + 63) & ~(size_t)63;
+    for (int m = 0; m < CONTRACTION_METRICS; m++) {
+        ContractionMetricHeader* section = &header.metrics[m];
+        section->arcCount = (uint32_t)outputs[m].arcCount;
+        section->upCount = (uint32_t)outputs[m].upCount;
+        section->downCount = (uint32_t)outputs[m].downCount;
+        section->upOffsets = offset;
+        offset += offsetsSize;
+        section->upEdges = offset;
+        offset += ((uint64_t)outputs[m].upCount * sizeof(ContractionEdge) + 7) & ~(uint64_t)7;
+        section->downOffsets = offset;
+        offset += offsetsSize;
+        section->downEdges = offset;
+        offset += ((uint64_t)outputs[m].downCount * sizeof(ContractionEdge) + 7) & ~(uint64_t)7;
+        section->arcs = offset;
+        offset += (uint64_t)outputs[m].arcCount * sizeof(ContractionArc);
+    }
+
+    // Write to a temporary name and rename, so a running server never maps
+    // a half-written hierarchy
+    if (ok) {
+        size_t nameLength = strlen(hierarchyFile) + 5;
+        char* temporary = (char*)malloc(nameLength);
+        FILE* file = NULL;
+        if (temporary != NULL) {
+            snprintf(temporary, nameLength, "%s.tmp", hierarchyFile);
+            file = fopen(temporary, "wb");
+        }
+
+        ok = file != NULL;
+        if (ok) {
+            ok = fwrite(&header, sizeof(header), 1, file) == 1;
+            for (int m = 0; ok && m < CONTRACTION_METRICS; m++) {
+                const ContractionMetricHeader* section = &header.metrics[m];
+                const ContractionOutput* output = &outputs[m];
+                ok = fseek(file, (long)section->upOffsets, SEEK_SET) == 0 &&
+                     fwrite(output->upOffsets, sizeof(int32_t), csr->nodeCount + 1, file) == (size_t)csr->nodeCount + 1 &&
+                     fseek(file, (long)section->upEdges, SEEK_SET) == 0 &&
+                     fwrite(output->upEdges, sizeof(ContractionEdge), output->upCount, file) == (size_t)output->upCount &&
+                     fseek(file, (long)section->downOffsets, SEEK_SET) == 0 &&
+                     fwrite(output->downOffsets, sizeof(int32_t), csr->nodeCount + 1, file) == (size_t)csr->nodeCount + 1 &&
+                     fseek(file, (long)section->downEdges, SEEK_SET) == 0 &&
+                     fwrite(output->downEdges, sizeof(ContractionEdge), output->downCount, file) == (size_t)output->downCount &&
+                     fseek(file, (long)section->arcs, SEEK_SET) == 0 &&
+                     fwrite(output->arcs, sizeof(ContractionArc), output->arcCount, file) == (size_t)output->arcCount;
+            }
+            ok = fclose(file) == 0 && ok;
+            ok = ok && rename(temporary, hierarchyFile) == 0;
+            if (!ok) {
+                remove(temporary);
+            }
+        }
+        free(temporary);
+    }
+
+    for (int m = 0; m < CONTRACTION_METRICS; m++) {
+        freeContractionOutput(&outputs[m]);
+    }
+
+    return ok;
+}
+
+// Map a hierarchy file read-only. Returns NULL if it is missing or
+// malformed.
+ContractionHierarchy* openContractionHierarchy(const char* hierarchyFile) {
+    int fd = open(hierarchyFile, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(ContractionHierarchyHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    void* mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+
+    const ContractionHierarchyHeader* header = (const ContractionHierarchyHeader*)mapping;
+    uint64_t size = (uint64_t)info.st_size;
+    uint64_t offsetsSize = (uint64_t)(header->nodeCount + 1) * sizeof(int32_t);
+    int valid = memcmp(header->magic, CONTRACTION_MAGIC, sizeof(header->magic)) == 0 &&
+                header->version == CONTRACTION_VERSION;
+    for (int m = 0; valid && m < CONTRACTION_METRICS; m++) {
+        const ContractionMetricHeader* section = &header->metrics[m];
+        valid = section->upOffsets + offsetsSize <= size &&
+                section->upEdges + (uint64_t)section->upCount * sizeof(ContractionEdge) <= size &&
+                section->downOffsets + offsetsSize <= size &&
+                section->downEdges + (uint64_t)section->downCount * sizeof(ContractionEdge) <= size &&
+                section->arcs + (uint64_t)section->arcCount * sizeof(ContractionArc) <= size;
+    }
+
+    ContractionHierarchy* hierarchy = valid ? (ContractionHierarchy*)malloc(sizeof(ContractionHierarchy)) : NULL;
+    if (hierarchy == NULL) {
+        munmap(mapping, (size_t)info.st_size);
+        return NULL;
+    }
+
+    hierarchy->mapping = mapping;
+    hierarchy->mappingSize = (size_t)info.st_size;
+    hierarchy->header = header;
+    hierarchy->nodeCount = (int)header->nodeCount;
+
+    const char* base = (const char*)mapping;
+    for (int m = 0; m < CONTRACTION_METRICS; m++) {
+        const ContractionMetricHeader* section = &header->metrics[m];
+        ContractionMetric* metric = &hierarchy->metrics[m];
+        metric->upOffsets = (const int32_t*)(base + section->upOffsets);
+        metric->upEdges = (const ContractionEdge*)(base + section->upEdges);
+        metric->downOffsets = (const int32_t*)(base + section->downOffsets);
+        metric->downEdges = (const ContractionEdge*)(base + section->downEdges);
+        metric->arcs = (const ContractionArc*)(base + section->arcs);
+        metric->arcCount = (int)section->arcCount;
+    }
+
+    return hierarchy;
+}
+
+void closeContractionHierarchy(ContractionHierarchy* hierarchy) {
+    if (hierarchy == NULL) {
+        return;
+    }
+
+    munmap(hierarchy->mapping, hierarchy->mappingSize);
+    free(hierarchy);
+}
+
+// 1 if the hierarchy was built from these CSV files and matches the graph
+int contractionHierarchyFresh(const ContractionHierarchy* hierarchy, const CSRGraph* csr, const char* citiesFile, const char* routesFile) {
+    if (hierarchy == NULL || csr == NULL) {
+        return 0;
+    }
+
+    return hierarchy->header->nodeCount == (uint32_t)csr->nodeCount &&
+           hierarchy->header->edgeCount == (uint32_t)csr->edgeCount &&
+           sourceFileUnchanged(&hierarchy->header->cities, citiesFile) &&
+           sourceFileUnchanged(&hierarchy->header->routes, routesFile);
+}
+
+// 1 if the hierarchy was built from inputs with these contents and
+// matches the graph
+int contractionHierarchyMatches(const ContractionHierarchy* hierarchy, const CSRGraph* csr, const SourceFileInfo* cities, const SourceFileInfo* routes) {
+    if (hierarchy == NULL || csr == NULL) {
+        return 0;
+    }
+
+    return hierarchy->header->nodeCount == (uint32_t)csr->nodeCount &&
+           hierarchy->header->edgeCount == (uint32_t)csr->edgeCount &&
+           sourceFileSame(&hierarchy->header->cities, cities) &&
+           sourceFileSame(&hierarchy->header->routes, routes);
+}
+
+ContractionQuery* createContractionQuery(int capacity) {
+    ContractionQuery* query = (ContractionQuery*)calloc(1, sizeof(ContractionQuery));
+    if (query == NULL) {
+        return NULL;
+    }
+
+    if (capacity < 1) {
+        capacity = 1;
+    }
+
+    query->capacity = capacity;
+    int ok = 1;
+    for (int side = 0; side < 2; side++) {
+        query->dist[side] = (double*)malloc(capacity * sizeof(double));
+        query->parent[side] = (int*)malloc(capacity * sizeof(int));
+        query->parentArc[side] = (int*)malloc(capacity * sizeof(int));
+        query->heap[side] = createIndexedHeap(capacity);
+        ok = ok && query->dist[side] != NULL && query->parent[side] != NULL &&
+             query->parentArc[side] != NULL && query->heap[side] != NULL;
+    }
+    query->touched = (int*)malloc(capacity * sizeof(int));
+    query->pathArcs = (int*)malloc(capacity * sizeof(int));
+    query->unpackStack = (int*)malloc((capacity + 1) * sizeof(int));
+
+    if (!ok || query->touched == NULL || query->pathArcs == NULL || query->unpackStack == NULL) {
+        freeContractionQuery(query);
+        return NULL;
+    }
+
+    for (int side = 0; side < 2; side++) {
+        for (int i = 0; i < capacity; i++) {
+            query->dist[side][i] = CONTRACTION_UNREACHED;
+            query->parent[side][i] = -1;
+            query->parentArc[side][i] = -1;
+        }
+    }
+
+    return query;
+}
+
+void freeContractionQuery(ContractionQuery* query) {
+    if (query == NULL) {
+        return;
+    }
+
+    for (int side = 0; side < 2; side++) {
+        free(query->dist[side]);
+        free(query->parent[side]);
+        free(query->parentArc[side]);
+        freeIndexedHeap(query->heap[side]);
+    }
+    free(query->touched);
+    free(query->pathArcs);
+    free(query->unpackStack);
+    free(query);
+}
+
+static void contractionQueryReset(ContractionQuery* query) {
+    for (int i = 0; i < query->touchedCount; i++) {
+        int city = query->touched[i];
+        for (int side = 0; side < 2; side++) {
+            query->dist[side][city] = CONTRACTION_UNREACHED;
+            query->parent[side][city] = -1;
+            query->parentArc[side][city] = -1;
+        }
+    }
+    query->touchedCount = 0;
+    heapClear(query->heap[0]);
+    heapClear(query->heap[1]);
+    query->settledCount = 0;
+}
+
+static void contractionQueryReach(ContractionQuery* query, int side, int city, double dist, int parent, int arc) {
+    if (query->dist[0][city] >= CONTRACTION_UNREACHED && query->dist[1][city] >= CONTRACTION_UNREACHED) {
+        query->touched[query->touchedCount++] = city;
+    }
+    query->dist[side][city] = dist;
+    query->parent[side][city] = parent;
+    query->parentArc[side][city] = arc;
+    heapPushOrDecrease(query->heap[side], city, dist);
+}
+
+// Shortest path (costOrTime: 1 = cost, 0 = time) as CSR edges in travel
+// order, found by searching up the hierarchy from both ends and unpacking
+// the shortcuts on the best meeting path. Returns the number of edges, or
+// -1 if there is no path or it does not fit in maxEdges.
+//
+// A city is stalled, and its arcs not relaxed, when a higher-ranked city
+// already reached by the same side gives it a shorter distance; its
+// shortest path then cannot pass through it going up.
+int contractionPathEdges(const ContractionHierarchy* hierarchy, ContractionQuery* query, int costOrTime,
+                         int origin, int destination, int* edges, int maxEdges) {
+    if (hierarchy == NULL || query == NULL) {
+        return -1;
+    }
+
+    contractionQueryReset(query);
+
+    int n = hierarchy->nodeCount;
+    if (n > query->capacity || origin < 0 || origin >= n || destination < 0 || destination >= n) {
+        return -1;
+    }
+
+    const ContractionMetric* metric = &hierarchy->metrics[costOrTime ? 1 : 0];
+    contractionQueryReach(query, 0, origin, 0, -1, -1);
+    contractionQueryReach(query, 1, destination, 0, -1, -1);
+
+    double best = CONTRACTION_UNREACHED;
+    int meeting = -1;
+
+    while (1) {
+        // A side is done once its queue top cannot improve on best
+        int forwardOpen = !heapEmpty(query->heap[0]) && heapTopKey(query->heap[0]) < best;
+        int backwardOpen = !heapEmpty(query->heap[1]) && heapTopKey(query->heap[1]) < best;
+        if (!forwardOpen && !backwardOpen) {
+            break;
+        }
+
+        int side = forwardOpen && (!backwardOpen || heapTopKey(query->heap[0]) <= heapTopKey(query->heap[1])) ? 0 : 1;
+        const double* dist = query->dist[side];
+        int u = heapPop(query->heap[side]);
+        query->settledCount++;
+
+        if (query->dist[0][u] + query->dist[1][u] < best) {
+            best = query->dist[0][u] + query->dist[1][u];
+            meeting = u;
+        }
+
+        // Forward goes up the up lists and stalls on the down lists;
+        // backward the other way round
+        const int32_t* offsets = side == 0 ? metric->upOffsets : metric->downOffsets;
+        const ContractionEdge* list = side == 0 ? metric->upEdges : metric->downEdges;
+        const int32_t* stallOffsets = side == 0 ? metric->downOffsets : metric->upOffsets;
+        const ContractionEdge* stallList = side == 0 ? metric->downEdges : metric->upEdges;
+
+        int stalled = 0;
+        for (int e = stallOffsets[u]; e < stallOffsets[u + 1]; e++) {
+            if (dist[stallList[e].target] + stallList[e].weight < dist[u]) {
+                stalled = 1;
+                break;
+            }
+        }
+        if (stalled) {
+            continue;
+        }
+
+        for (int e = offsets[u]; e < offsets[u + 1]; e++) {
+            int v = list[e].target;
+            double length = dist[u] + list[e].weight;
+            if (length < dist[v]) {
+                contractionQueryReach(query, side, v, length, u, list[e].arc);
+            }
+        }
+    }
+
+    if (meeting == -1) {
+        return -1;
+    }
+
+    // Arcs from the origin up to the meeting city, then down to the
+    // destination
+    int arcCount = 0;
+    for (int city = meeting; query->parentArc[0][city] != -1; city = query->parent[0][city]) {
+        arcCount++;
+    }
+    int index = arcCount;
+    for (int city = meeting; query->parentArc[0][city] != -1; city = query->parent[0][city]) {
+        query->pathArcs[--index] = query->parentArc[0][city];
+    }
+    for (int city = meeting; query->parentArc[1][city] != -1; city = query->parent[1][city]) {
+        query->pathArcs[arcCount++] = query->parentArc[1][city];
+    }
+
+    // Expand each shortcut into its two halves, first half first
+    int count = 0;
+    for (int i = 0; i < arcCount; i++) {
+        int top = 0;
+        query->unpackStack[top++] = query->pathArcs[i];
+        while (top > 0) {
+            const ContractionArc* arc = &metric->arcs[query->unpackStack[--top]];
+            if (arc->second == -1) {
+                if (count >= maxEdges) {
+                    return -1;
+                }
+                edges[count++] = arc->first;
+            } else {
+                query->unpackStack[top++] = arc->second;
+                query->unpackStack[top++] = arc->first;
+            }
+        }
+    }
+
+    return count;
+}
+
+#endif // CONTRACTIONHIERARCHY_H
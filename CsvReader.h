@@ -0,0 +1,513 @@
+#ifndef CSVREADER_H
+#define CSVREADER_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__GNUC__) && defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Return values of csvNextRecord
+#define CSV_RECORD 1
+#define CSV_END 0
+#define CSV_MALFORMED -1
+
+// Bytes read per refill; the buffer grows past this only for a record
+// that does not fit
+#define CSV_BUFFER_SIZE (1 << 20)
+
+// How a field was written
+#define CSV_SPAN_PLAIN 0
+#define CSV_SPAN_QUOTED 1
+#define CSV_SPAN_RAW 2      // malformed quoting, kept as written
+
+// Byte range of one field inside the buffer
+typedef struct CsvSpan {
+    size_t start;
+    size_t end;
+    int quoted;
+} CsvSpan;
+
+// Streaming RFC 4180 reader
+//
+// Records are read block by block into one buffer and split in place:
+// each field is unescaped and NUL-terminated where it lies, so reading a
+// record copies nothing. Quoted fields may hold commas, doubled quotes
+// and newlines. A quote inside an unquoted field is kept as text, and a
+// quoted field with text after its closing quote is reported and kept as
+// written up to the next delimiter, so one stray quote costs a warning
+// rather than the row.
+typedef struct CsvReader {
+    FILE* file;
+    const char* filename;
+    int eof;
+
+    char* buffer;
+    size_t capacity;
+    size_t start;    // first byte of the current record
+    size_t end;      // end of the bytes read so far
+
+    long line;       // line the current record starts on
+    long nextLine;
+    long malformedCount;
+    long reportedLine;
+
+    CsvSpan* spans;
+    char** fields;
+    int fieldCount;
+    int fieldCapacity;
+
+    const char* error;    // problem with the current record, if any
+} CsvReader;
+
+// Function prototypes
+CsvReader* openCsvReader(const char* filename);
+void closeCsvReader(CsvReader* reader);
+int csvNextRecord(CsvReader* reader);
+const char* csvField(const CsvReader* reader, int index);
+void csvReportMalformed(CsvReader* reader, const char* message);
+int csvParseDouble(const char* text, double* value);
+
+// Implementation
+CsvReader* openCsvReader(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    CsvReader* reader = (CsvReader*)malloc(sizeof(CsvReader));
+    if (reader == NULL) {
+        fclose(file);
+        return NULL;
+    }
+
+    reader->file = file;
+    reader->filename = filename;
+    reader->eof = 0;
+    reader->capacity = CSV_BUFFER_SIZE;
+    reader->buffer = (char*)malloc(reader->capacity + 1);
+    reader->start = 0;
+    reader->end = 0;
+    reader->line = 0;
+    reader->nextLine = 1;
+    reader->malformedCount = 0;
+    reader->reportedLine = 0;
+    reader->fieldCapacity = 16;
+    reader->spans = (CsvSpan*)malloc(reader->fieldCapacity * sizeof(CsvSpan));
+    reader->fields = (char**)malloc(reader->fieldCapacity * sizeof(char*));
+    reader->fieldCount = 0;
+    reader->error = NULL;
+
+    if (reader->buffer == NULL || reader->spans == NULL || reader->fields == NULL) {
+        closeCsvReader(reader);
+        return NULL;
+    }
+
+    return reader;
+}
+
+void closeCsvReader(CsvReader* reader) {
+    if (reader == NULL) {
+        return;
+    }
+
+    if (reader->file != NULL) {
+        fclose(reader->file);
+    }
+    free(reader->buffer);
+    free(reader->spans);
+    free(reader->fields);
+    free(reader);
+}
+
+// First ',' or '\n' in [p, end), or end. Whole vectors are compared at
+// once and the first match found from the bit mask.
+static const char* csvFindDelimiter(const char* p, const char* end) {
+#if defined(__GNUC__) && defined(__AVX2__)
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)p);
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, comma), _mm256_cmpeq_epi8(chunk, newline)));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+#elif defined(__GNUC__) && defined(__SSE2__)
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, comma), _mm_cmpeq_epi8(chunk, newline)));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p != ',' && *p != '\n') {
+        p++;
+    }
+    return p;
+}
+
+static int csvAddSpan(CsvReader* reader, size_t start, size_t end, int quoted) {
+    if (reader->fieldCount >= reader->fieldCapacity) {
+        int newCapacity = reader->fieldCapacity * 2;
+        CsvSpan* newSpans = (CsvSpan*)realloc(reader->spans, newCapacity * sizeof(CsvSpan));
+        if (newSpans == NULL) {
+            return 0;
+        }
+        reader->spans = newSpans;
+
+        char** newFields = (char**)realloc(reader->fields, newCapacity * sizeof(char*));
+        if (newFields == NULL) {
+            return 0;
+        }
+        reader->fields = newFields;
+        reader->fieldCapacity = newCapacity;
+    }
+
+    reader->spans[reader->fieldCount].start = start;
+    reader->spans[reader->fieldCount].end = end;
+    reader->spans[reader->fieldCount].quoted = quoted;
+    reader->fieldCount++;
+    return 1;
+}
+
+// Split the record at reader->start into spans. Returns 1 when the record
+// is complete, with *next set past it; 0 when more input is needed;
+// -1 when it cannot be read, with *next set past it. reader->error is set
+// for a record that was read despite a problem.
+static int csvScanRecord(CsvReader* reader, size_t* next) {
+    const char* buffer = reader->buffer;
+    const char* end = buffer + reader->end;
+    const char* p = buffer + reader->start;
+    reader->fieldCount = 0;
+    reader->error = NULL;
+
+    while (1) {
+        const char* resume = p;
+        if (p < end && *p == '"') {
+            // Quoted field: runs to a quote that is not doubled
+            const char* q = p + 1;
+            while (1) {
+                q = (const char*)memchr(q, '"', (size_t)(end - q));
+                if (q == NULL) {
+                    if (!reader->eof) {
+                        return 0;
+                    }
+                    reader->error = "unterminated quoted field";
+                    *next = reader->end;
+                    return -1;
+                }
+                if (q + 1 == end && !reader->eof) {
+                    return 0;
+                }
+                if (q + 1 < end && q[1] == '"') {
+                    q += 2;
+                    continue;
+                }
+                break;
+            }
+
+            const char* after = q + 1;
+            if (after < end && *after == '\r') {
+                if (after + 1 == end && !reader->eof) {
+                    return 0;
+                }
+                if (after + 1 == end || after[1] == '\n') {
+                    after++;
+                }
+            }
+
+            if (after == end && !reader->eof) {
+                return 0;
+            }
+            if (after == end || *after == ',' || *after == '\n') {
+                if (!csvAddSpan(reader, (size_t)(p + 1 - buffer), (size_t)(q - buffer), CSV_SPAN_QUOTED)) {
+                    reader->error = "out of memory";
+                    *next = reader->end;
+                    return -1;
+                }
+                if (after == end) {
+                    *next = reader->end;
+                    return 1;
+                }
+                if (*after == '\n') {
+                    *next = (size_t)(after + 1 - buffer);
+                    return 1;
+                }
+                p = after + 1;
+                continue;
+            }
+
+            // Text after the closing quote: keep the field as written
+            reader->error = "unexpected character after closing quote";
+            resume = q + 1;
+        }
+
+        // Unquoted field: runs to the next comma or newline
+        int kind = resume == p ? CSV_SPAN_PLAIN : CSV_SPAN_RAW;
+        const char* fieldStart = resume == p ? p : p + 1;
+        const char* d = csvFindDelimiter(resume, end);
+        if (d == end && !reader->eof) {
+            return 0;
+        }
+
+        const char* fieldEnd = d;
+        if ((d == end || *d == '\n') && fieldEnd > fieldStart && fieldEnd[-1] == '\r') {
+            fieldEnd--;
+        }
+        if (!csvAddSpan(reader, (size_t)(fieldStart - buffer), (size_t)(fieldEnd - buffer), kind)) {
+            reader->error = "out of memory";
+            *next = reader->end;
+            return -1;
+        }
+
+        if (d == end) {
+            *next = reader->end;
+            return 1;
+        }
+        if (*d == '\n') {
+            *next = (size_t)(d + 1 - buffer);
+            return 1;
+        }
+        p = d + 1;
+    }
+}
+
+// Move the unread bytes to the front of the buffer (growing it if a
+// single record fills it) and read more. Returns 0 at end of file.
+static int csvRefill(CsvReader* reader) {
+    if (reader->eof) {
+        return 0;
+    }
+
+    if (reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+
+    if (reader->end == reader->capacity) {
+        size_t newCapacity = reader->capacity * 2;
+        char* newBuffer = (char*)realloc(reader->buffer, newCapacity + 1);
+        if (newBuffer == NULL) {
+            reader->eof = 1;
+            return 0;
+        }
+        reader->buffer = newBuffer;
+        reader->capacity = newCapacity;
+    }
+
+    size_t read = fread(reader->buffer + reader->end, 1, reader->capacity - reader->end, reader->file);
+    reader->end += read;
+    if (read == 0) {
+        reader->eof = 1;
+    }
+
+    return 1;
+}
+
+static long csvCountNewlines(const char* p, const char* end) {
+    long count = 0;
+    while ((p = (const char*)memchr(p, '\n', (size_t)(end - p))) != NULL) {
+        count++;
+        p++;
+    }
+    return count;
+}
+
+// Unescape and NUL-terminate every field of a complete record in place
+static void csvFinishRecord(CsvReader* reader) {
+    long newlines = 1;
+
+    for (int i = 0; i < reader->fieldCount; i++) {
+        CsvSpan* span = &reader->spans[i];
+        char* start = reader->buffer + span->start;
+        char* end = reader->buffer + span->end;
+
+        if (span->quoted != CSV_SPAN_PLAIN) {
+            newlines += csvCountNewlines(start, end);
+        }
+        if (span->quoted == CSV_SPAN_QUOTED) {
+            // Collapse doubled quotes
+            char* out = (char*)memchr(start, '"', (size_t)(end - start));
+            if (out != NULL) {
+                for (char* in = out; in < end; in++) {
+                    *out++ = *in;
+                    if (*in == '"') {
+                        in++;
+                    }
+                }
+                end = out;
+            }
+        }
+
+        *end = '\0';
+        reader->fields[i] = start;
+    }
+
+    reader->nextLine += newlines;
+}
+
+// Read the next record. Returns CSV_RECORD, CSV_END, or CSV_MALFORMED
+// after reporting the problem; reading can continue after CSV_MALFORMED.
+// A record with stray quotes is reported and still returned.
+// Blank lines are skipped. Fields stay valid until the next call.
+int csvNextRecord(CsvReader* reader) {
+    while (1) {
+        if (reader->start == reader->end && !csvRefill(reader)) {
+            return CSV_END;
+        }
+        if (reader->start == reader->end) {
+            continue;
+        }
+
+        size_t next = 0;
+        int status = csvScanRecord(reader, &next);
+        if (status == 0) {
+            csvRefill(reader);
+            continue;
+        }
+
+        reader->line = reader->nextLine;
+
+        if (status < 0) {
+            reader->nextLine += csvCountNewlines(reader->buffer + reader->start, reader->buffer + next);
+            if (next == reader->end && (next == reader->start || reader->buffer[next - 1] != '\n')) {
+                reader->nextLine++;
+            }
+            reader->start = next;
+            reader->fieldCount = 0;
+            csvReportMalformed(reader, reader->error);
+            return CSV_MALFORMED;
+        }
+
+        csvFinishRecord(reader);
+        reader->start = next;
+        if (reader->error != NULL) {
+            csvReportMalformed(reader, reader->error);
+        }
+
+        if (reader->fieldCount == 1 && reader->spans[0].quoted == CSV_SPAN_PLAIN && reader->fields[0][0] == '\0') {
+            continue;
+        }
+        return CSV_RECORD;
+    }
+}
+
+// Field index of the current record, "" if the record is shorter
+const char* csvField(const CsvReader* reader, int index) {
+    if (index < 0 || index >= reader->fieldCount) {
+        return "";
+    }
+    return reader->fields[index];
+}
+
+// Report a problem with the current record as file:line: message. Only the
+// first problem on a line is reported.
+void csvReportMalformed(CsvReader* reader, const char* message) {
+    if (reader->line == reader->reportedLine) {
+        return;
+    }
+    reader->reportedLine = reader->line;
+    reader->malformedCount++;
+    printf("%s:%ld: %s\n", reader->filename, reader->line, message);
+}
+
+// Parse a decimal number such as "-12.5" or "1e3", ignoring surrounding
+// spaces. Unlike atof this does not consult the locale and rejects text
+// that is not entirely a number. Returns 1 on success.
+int csvParseDouble(const char* text, double* value) {
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char* p = text;
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+
+    int negative = 0;
+    if (*p == '-' || *p == '+') {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    int seen = 0;
+
+    for (; *p >= '0' && *p <= '9'; p++, seen++) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            digits += mantissa != 0;
+        } else {
+            exponent++;
+        }
+    }
+    if (*p == '.') {
+        for (p++; *p >= '0' && *p <= '9'; p++, seen++) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+    if (seen == 0) {
+        return 0;
+    }
+
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        int exponentNegative = 0;
+        if (*p == '-' || *p == '+') {
+            exponentNegative = *p == '-';
+            p++;
+        }
+        if (*p < '0' || *p > '9') {
+            return 0;
+        }
+        int explicitExponent = 0;
+        for (; *p >= '0' && *p <= '9'; p++) {
+            if (explicitExponent < 10000) {
+                explicitExponent = explicitExponent * 10 + (*p - '0');
+            }
+        }
+        exponent += exponentNegative ? -explicitExponent : explicitExponent;
+    }
+
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    if (*p != '\0') {
+        return 0;
+    }
+
+    // Exact when the mantissa and the power of ten are both exact doubles;
+    // anything else is rare in this data and left to strtod
+    double result;
+    if (mantissa < ((uint64_t)1 << 53) && exponent >= -22 && exponent <= 22) {
+        result = exponent < 0 ? (double)mantissa / powers[-exponent] : (double)mantissa * powers[exponent];
+        *value = negative ? -result : result;
+    } else {
+        *value = strtod(text, NULL);
+    }
+
+    return 1;
+}
+
+#endif // CSVREADER_H
@@ -0,0 +1,325 @@
+#ifndef CSVSCHEMA_H
+#define CSVSCHEMA_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "CsvReader.h"
+
+// What an input file holds
+#define CSV_SCHEMA_UNKNOWN 0
+#define CSV_SCHEMA_CITIES 1
+#define CSV_SCHEMA_ROUTES 2
+
+// Columns a schema maps to field indexes
+#define CSV_COLUMN_COUNTRY 0
+#define CSV_COLUMN_CITY 1
+#define CSV_COLUMN_LATITUDE 2
+#define CSV_COLUMN_LONGITUDE 3
+#define CSV_COLUMN_ORIGIN 4
+#define CSV_COLUMN_DESTINATION 5
+#define CSV_COLUMN_TRANSPORT 6
+#define CSV_COLUMN_TIME 7
+#define CSV_COLUMN_COST 8
+#define CSV_COLUMN_DISTANCE 9
+#define CSV_COLUMN_NOTE 10
+#define CSV_COLUMN_DEPARTURE 11
+#define CSV_COLUMN_HEADWAY 12
+#define CSV_COLUMN_COUNT 13
+
+// Rupees per US dollar. routes.csv prices are in dollars, and rupee
+// columns such as indian_cities.csv's Cost_INR are converted at this
+// fixed rate so one graph never mixes currencies.
+#define CSV_INR_PER_USD 83.0
+
+// Layout of one input file
+//
+// Graph units are hours, US dollars and kilometres; a header column with
+// a unit suffix (Cost_INR, Time_Minutes, Distance_MI) is scaled into them.
+// A scheduled route gives its first daily departure as a clock time such
+// as 06:30 or in hours, and optionally the time between departures.
+typedef struct CsvSchema {
+    int kind;
+    int columns[CSV_COLUMN_COUNT];   // field index, -1 if the file has none
+    int requiredFields;              // fields a data row needs
+    double timeScale;
+    double costScale;
+    double distanceScale;
+    double headwayScale;
+} CsvSchema;
+
+// Function prototypes
+int csvDetectSchema(CsvReader* reader, int expectedKind, CsvSchema* schema);
+const char* csvSchemaField(const CsvReader* reader, const CsvSchema* schema, int column);
+int csvSchemaNumber(const CsvReader* reader, const CsvSchema* schema, int column, double* value);
+const char* csvSchemaKindName(int kind);
+
+// Implementation
+
+// Header names accepted for each column, lower case
+static const char* const csvColumnNames[CSV_COLUMN_COUNT][5] = {
+    {"country", NULL},
+    {"city", "capital", "name", NULL},
+    {"latitude", "lat", NULL},
+    {"longitude", "lon", "lng", "long", NULL},
+    {"origin", "from", "source", NULL},
+    {"destination", "to", "dest", NULL},
+    {"transport", "mode", NULL},
+    {"time", "duration", NULL},
+    {"cost", "price", "fare", NULL},
+    {"distance", NULL},
+    {"note", "notes", "comment", NULL},
+    {"departure", "departs", "first departure", "first", NULL},
+    {"headway", "every", "frequency", NULL}
+};
+
+// Columns that identify each kind of file; a data row needs all of them
+static const int csvCityColumns[] = {CSV_COLUMN_CITY, CSV_COLUMN_LATITUDE, CSV_COLUMN_LONGITUDE};
+static const int csvRouteColumns[] = {CSV_COLUMN_ORIGIN, CSV_COLUMN_DESTINATION, CSV_COLUMN_TIME, CSV_COLUMN_COST};
+
+// Highest field index among the listed columns plus one, 0 if any is missing
+static int csvColumnsPresent(const int* columns, const int* wanted, int count) {
+    int fields = 0;
+    for (int i = 0; i < count; i++) {
+        if (columns[wanted[i]] == -1) {
+            return 0;
+        }
+        if (columns[wanted[i]] + 1 > fields) {
+            fields = columns[wanted[i]] + 1;
+        }
+    }
+    return fields;
+}
+
+// Positional layout of the shipped files, used when there is no header
+static void csvDefaultSchema(int kind, CsvSchema* schema) {
+    schema->kind = kind;
+    for (int i = 0; i < CSV_COLUMN_COUNT; i++) {
+        schema->columns[i] = -1;
+    }
+    schema->timeScale = 1.0;
+    schema->costScale = 1.0;
+    schema->distanceScale = 1.0;
+    schema->headwayScale = 1.0;
+
+    if (kind == CSV_SCHEMA_CITIES) {
+        // country,city,latitude,longitude
+        schema->columns[CSV_COLUMN_COUNTRY] = 0;
+        schema->columns[CSV_COLUMN_CITY] = 1;
+        schema->columns[CSV_COLUMN_LATITUDE] = 2;
+        schema->columns[CSV_COLUMN_LONGITUDE] = 3;
+        schema->requiredFields = 4;
+    } else {
+        // origin,destination,transport,time,cost[,note]
+        schema->columns[CSV_COLUMN_ORIGIN] = 0;
+        schema->columns[CSV_COLUMN_DESTINATION] = 1;
+        schema->columns[CSV_COLUMN_TRANSPORT] = 2;
+        schema->columns[CSV_COLUMN_TIME] = 3;
+        schema->columns[CSV_COLUMN_COST] = 4;
+        schema->columns[CSV_COLUMN_NOTE] = 5;
+        schema->requiredFields = 5;
+    }
+}
+
+// Split a header such as "Cost_INR" into a lower-case name and unit
+static void csvSplitHeader(const char* field, char* name, char* unit, size_t size) {
+    while (isspace((unsigned char)*field)) {
+        field++;
+    }
+
+    size_t n = 0;
+    while (*field != '\0' && *field != '_' && *field != '(' && n + 1 < size) {
+        name[n++] = (char)tolower((unsigned char)*field++);
+    }
+    while (n > 0 && isspace((unsigned char)name[n - 1])) {
+        n--;
+    }
+    name[n] = '\0';
+
+    while (*field == '_' || *field == '(' || isspace((unsigned char)*field)) {
+        field++;
+    }
+    n = 0;
+    while (*field != '\0' && *field != ')' && !isspace((unsigned char)*field) && n + 1 < size) {
+        unit[n++] = (char)tolower((unsigned char)*field++);
+    }
+    unit[n] = '\0';
+}
+
+// Factor taking a column's unit to graph units, 0 if it is not known
+static double csvUnitScale(int column, const char* unit) {
+    if (unit[0] == '\0') {
+        return 1.0;
+    }
+
+    if (column == CSV_COLUMN_TIME || column == CSV_COLUMN_HEADWAY) {
+        if (strcmp(unit, "hours") == 0 || strcmp(unit, "hour") == 0 || strcmp(unit, "h") == 0 || strcmp(unit, "hrs") == 0) {
+            return 1.0;
+        }
+        if (strcmp(unit, "minutes") == 0 || strcmp(unit, "min") == 0 || strcmp(unit, "mins") == 0) {
+            return 1.0 / 60.0;
+        }
+    } else if (column == CSV_COLUMN_COST) {
+        if (strcmp(unit, "usd") == 0) {
+            return 1.0;
+        }
+        if (strcmp(unit, "inr") == 0) {
+            return 1.0 / CSV_INR_PER_USD;
+        }
+    } else if (column == CSV_COLUMN_DISTANCE) {
+        if (strcmp(unit, "km") == 0) {
+            return 1.0;
+        }
+        if (strcmp(unit, "mi") == 0 || strcmp(unit, "miles") == 0) {
+            return 1.609344;
+        }
+    } else {
+        return 1.0;
+    }
+
+    return 0.0;
+}
+
+// Look at the first record of a file. If it is a header, map the columns
+// it names and return 1; the caller skips the record. Otherwise fill in
+// the positional layout of expectedKind and return 0; the record is data.
+// Returns -1, after reporting it, for a header that is not a file of
+// expectedKind.
+int csvDetectSchema(CsvReader* reader, int expectedKind, CsvSchema* schema) {
+    csvDefaultSchema(expectedKind, schema);
+
+    int columns[CSV_COLUMN_COUNT];
+    double scales[CSV_COLUMN_COUNT];
+    const char* badUnit = NULL;
+    int matched = 0;
+    for (int i = 0; i < CSV_COLUMN_COUNT; i++) {
+        columns[i] = -1;
+        scales[i] = 1.0;
+    }
+
+    for (int field = 0; field < reader->fieldCount; field++) {
+        char name[64];
+        char unit[64];
+        csvSplitHeader(csvField(reader, field), name, unit, sizeof(name));
+
+        for (int column = 0; column < CSV_COLUMN_COUNT; column++) {
+            int known = 0;
+            for (int alias = 0; csvColumnNames[column][alias] != NULL; alias++) {
+                if (strcmp(name, csvColumnNames[column][alias]) == 0) {
+                    known = 1;
+                    break;
+                }
+            }
+            if (!known || columns[column] != -1) {
+                continue;
+            }
+
+            columns[column] = field;
+            scales[column] = csvUnitScale(column, unit);
+            if (scales[column] == 0.0) {
+                badUnit = csvField(reader, field);
+                scales[column] = 1.0;
+            }
+            matched++;
+            break;
+        }
+    }
+
+    // A header names at least the columns that identify its kind
+    int kind = CSV_SCHEMA_UNKNOWN;
+    int requiredFields = csvColumnsPresent(columns, csvCityColumns, 3);
+    if (requiredFields > 0) {
+        kind = CSV_SCHEMA_CITIES;
+    } else {
+        requiredFields = csvColumnsPresent(columns, csvRouteColumns, 4);
+        if (requiredFields > 0) {
+            kind = CSV_SCHEMA_ROUTES;
+        }
+    }
+
+    if (kind == CSV_SCHEMA_UNKNOWN) {
+        if (matched >= 2) {
+            csvReportMalformed(reader, "header names no known file layout, reading by position");
+            return 1;
+        }
+        return 0;
+    }
+
+    if (kind != expectedKind) {
+        printf("%s: header is for a %s file, expected a %s file\n",
+               reader->filename, csvSchemaKindName(kind), csvSchemaKindName(expectedKind));
+        return -1;
+    }
+
+    schema->requiredFields = requiredFields;
+    for (int i = 0; i < CSV_COLUMN_COUNT; i++) {
+        schema->columns[i] = columns[i];
+    }
+    schema->timeScale = scales[CSV_COLUMN_TIME];
+    schema->costScale = scales[CSV_COLUMN_COST];
+    schema->distanceScale = scales[CSV_COLUMN_DISTANCE];
+    schema->headwayScale = scales[CSV_COLUMN_HEADWAY];
+
+    if (badUnit != NULL) {
+        printf("%s: unknown unit in column %s, values are used as they are\n", reader->filename, badUnit);
+    }
+    return 1;
+}
+
+// Text of a column in the current record, "" if the file has no such column
+const char* csvSchemaField(const CsvReader* reader, const CsvSchema* schema, int column) {
+    return csvField(reader, schema->columns[column]);
+}
+
+// Numeric column in graph units. Returns 0 if it is missing or not a number.
+// A departure may also be a clock time, hours:minutes.
+int csvSchemaNumber(const CsvReader* reader, const CsvSchema* schema, int column, double* value) {
+    if (schema->columns[column] == -1) {
+        return 0;
+    }
+
+    const char* text = csvField(reader, schema->columns[column]);
+    const char* colon = strchr(text, ':');
+    if (column == CSV_COLUMN_DEPARTURE && colon != NULL) {
+        char hours[32];
+        double minutes;
+        size_t length = (size_t)(colon - text);
+        if (length >= sizeof(hours)) {
+            return 0;
+        }
+        memcpy(hours, text, length);
+        hours[length] = '\0';
+        if (!csvParseDouble(hours, value) || !csvParseDouble(colon + 1, &minutes)) {
+            return 0;
+        }
+        *value += minutes / 60.0;
+        return 1;
+    }
+
+    if (!csvParseDouble(text, value)) {
+        return 0;
+    }
+
+    if (column == CSV_COLUMN_TIME) {
+        *value *= schema->timeScale;
+    } else if (column == CSV_COLUMN_COST) {
+        *value *= schema->costScale;
+    } else if (column == CSV_COLUMN_DISTANCE) {
+        *value *= schema->distanceScale;
+    } else if (column == CSV_COLUMN_HEADWAY) {
+        *value *= schema->headwayScale;
+    }
+    return 1;
+}
+
+const char* csvSchemaKindName(int kind) {
+    switch (kind) {
+        case CSV_SCHEMA_CITIES: return "cities";
+        case CSV_SCHEMA_ROUTES: return "routes";
+        default: return "unknown";
+    }
+}
+
+#endif // CSVSCHEMA_H
@@ -0,0 +1,234 @@
+#ifndef DISTANCEMATRIX_H
+#define DISTANCEMATRIX_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "CSRGraph.h"
+#include "SearchWorkspace.h"
+
+#define DISTANCE_MATRIX_MAGIC "TRVLMTRX"
+#define DISTANCE_MATRIX_VERSION 1
+
+// On-disk header of a matrix written by writeDistanceMatrix, followed by
+//   float times[originCount][destinationCount]
+//   float costs[originCount][destinationCount]
+// in the order the origins and destinations were given. A pair with no
+// path holds WORKSPACE_UNREACHED.
+typedef struct DistanceMatrixHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t originCount;
+    uint32_t destinationCount;
+    uint32_t reserved;
+} DistanceMatrixHeader;
+
+// Work shared by the threads filling one matrix
+typedef struct DistanceMatrixJob {
+    const CSRGraph* csr;
+    const int* origins;
+    int originCount;
+    const int* destinations;
+    int destinationCount;
+    int distinctDestinations;
+    const unsigned char* isDestination;
+    float* times;
+    float* costs;
+    int threadCount;
+} DistanceMatrixJob;
+
+typedef struct DistanceMatrixWorker {
+    DistanceMatrixJob* job;
+    int index;
+    int failed;
+    int started;          // running on its own thread
+    long settledCount;
+} DistanceMatrixWorker;
+
+// Function prototypes
+int distanceMatrix(const CSRGraph* csr, const int* origins, int originCount, const int* destinations, int destinationCount,
+                   float* times, float* costs, int threadCount, long* settledCount);
+int writeDistanceMatrix(const char* filename, const float* times, const float* costs, int originCount, int destinationCount);
+
+// Implementation
+
+// Dijkstra from origin that stops once every destination is settled
+// rather than sweeping the whole network. Leaves distances for
+// workspaceDist.
+static void distanceMatrixSweep(const CSRGraph* csr, SearchWorkspace* ws, const DistanceMatrixJob* job,
+                                int origin, int costOrTime) {
+    workspaceReset(ws);
+
+    const float* weights = csrWeights(csr, costOrTime);
+    int remaining = job->distinctDestinations;
+    workspaceTouch(ws, origin);
+    ws->dist[origin] = 0;
+    heapPushOrDecrease(ws->heap, origin, 0);
+
+    while (!heapEmpty(ws->heap)) {
+        int u = heapPop(ws->heap);
+        ws->settled[u] = 1;
+        ws->settledCount++;
+
+        if (job->isDestination[u] && --remaining == 0) {
+            return;
+        }
+
+        for (int e = csr->offsets[u]; e < csr->offsets[u + 1]; e++) {
+            int v = csr->targets[e];
+            workspaceTouch(ws, v);
+            double length = ws->dist[u] + weights[e];
+            if (!ws->settled[v] && length < ws->dist[v]) {
+                ws->dist[v] = length;
+                ws->parent[v] = u;
+                ws->parentEdge[v] = e;
+                heapPushOrDecrease(ws->heap, v, length);
+            }
+        }
+    }
+}
+
+static void* distanceMatrixWorkerRun(void* argument) {
+    DistanceMatrixWorker* worker = (DistanceMatrixWorker*)argument;
+    DistanceMatrixJob* job = worker->job;
+
+    SearchWorkspace* ws = createSearchWorkspace(job->csr->nodeCount);
+    if (ws == NULL) {
+        worker->failed = 1;
+        return NULL;
+    }
+
+    for (int row = worker->index; row < job->originCount; row += job->threadCount) {
+        for (int costOrTime = 0; costOrTime < 2; costOrTime++) {
+            float* matrix = costOrTime ? job->costs : job->times;
+            if (matrix == NULL) {
+                continue;
+            }
+
+            distanceMatrixSweep(job->csr, ws, job, job->origins[row], costOrTime);
+            worker->settledCount += ws->settledCount;
+
+            float* cells = matrix + (size_t)row * job->destinationCount;
+            for (int column = 0; column < job->destinationCount; column++) {
+                cells[column] = (float)workspaceDist(ws, job->destinations[column]);
+            }
+        }
+    }
+
+    freeSearchWorkspace(ws);
+    return NULL;
+}
+
+// Fastest time and cheapest cost from every origin to every destination,
+// row-major with a row per origin. Either matrix may be NULL to skip that
+// metric. Each origin takes one search per metric, shared by all the
+// destinations, and the origins are split over threadCount threads.
+// settledCount, if given, receives the cities the searches settled.
+//
+// Returns 1 on success, 0 on bad arguments or when memory runs out.
+int distanceMatrix(const CSRGraph* csr, const int* origins, int originCount, const int* destinations, int destinationCount,
+                   float* times, float* costs, int threadCount, long* settledCount) {
+    if (csr == NULL || origins == NULL || destinations == NULL || originCount < 0 || destinationCount < 0) {
+        return 0;
+    }
+    for (int i = 0; i < originCount; i++) {
+        if (origins[i] < 0 || origins[i] >= csr->nodeCount) {
+            return 0;
+        }
+    }
+
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+    if (threadCount > originCount) {
+        threadCount = originCount > 0 ? originCount : 1;
+    }
+
+    DistanceMatrixJob job;
+    job.csr = csr;
+    job.origins = origins;
+    job.originCount = originCount;
+    job.destinations = destinations;
+    job.destinationCount = destinationCount;
+    job.distinctDestinations = 0;
+    job.times = times;
+    job.costs = costs;
+    job.threadCount = threadCount;
+
+    unsigned char* isDestination = (unsigned char*)calloc(csr->nodeCount > 0 ? csr->nodeCount : 1, sizeof(unsigned char));
+    DistanceMatrixWorker* workers = (DistanceMatrixWorker*)calloc(threadCount, sizeof(DistanceMatrixWorker));
+    pthread_t* threads = (pthread_t*)calloc(threadCount, sizeof(pthread_t));
+
+    int ok = isDestination != NULL && workers != NULL && threads != NULL;
+    for (int i = 0; ok && i < destinationCount; i++) {
+        if (destinations[i] < 0 || destinations[i] >= csr->nodeCount) {
+            ok = 0;
+        } else if (!isDestination[destinations[i]]) {
+            isDestination[destinations[i]] = 1;
+            job.distinctDestinations++;
+        }
+    }
+    job.isDestination = isDestination;
+
+    if (ok && job.distinctDestinations > 0) {
+        for (int t = 0; t < threadCount; t++) {
+            workers[t].job = &job;
+            workers[t].index = t;
+        }
+        // Origins whose thread cannot start are searched from here instead
+        for (int t = 1; t < threadCount; t++) {
+            workers[t].started = pthread_create(&threads[t], NULL, distanceMatrixWorkerRun, &workers[t]) == 0;
+        }
+        distanceMatrixWorkerRun(&workers[0]);
+        for (int t = 1; t < threadCount; t++) {
+            if (workers[t].started) {
+                pthread_join(threads[t], NULL);
+            } else {
+                distanceMatrixWorkerRun(&workers[t]);
+            }
+        }
+        for (int t = 0; t < threadCount; t++) {
+            ok = ok && !workers[t].failed;
+        }
+    }
+
+    if (ok && settledCount != NULL) {
+        *settledCount = 0;
+        for (int t = 0; t < threadCount; t++) {
+            *settledCount += workers[t].settledCount;
+        }
+    }
+
+    free(isDestination);
+    free(workers);
+    free(threads);
+    return ok;
+}
+
+// Write both matrices to filename in the layout of DistanceMatrixHeader.
+// Returns 1 on success.
+int writeDistanceMatrix(const char* filename, const float* times, const float* costs, int originCount, int destinationCount) {
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL) {
+        return 0;
+    }
+
+    DistanceMatrixHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DISTANCE_MATRIX_MAGIC, sizeof(header.magic));
+    header.version = DISTANCE_MATRIX_VERSION;
+    header.originCount = (uint32_t)originCount;
+    header.destinationCount = (uint32_t)destinationCount;
+
+    size_t cells = (size_t)originCount * destinationCount;
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(times, sizeof(float), cells, file) == cells &&
+             fwrite(costs, sizeof(float), cells, file) == cells;
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+#endif // DISTANCEMATRIX_H
@@ -0,0 +1,838 @@
+#ifndef DISTANCETABLE_H
+#define DISTANCETABLE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "CSRGraph.h"
+#include "SearchWorkspace.h"
+#include "SourceFile.h"
+
+#define DISTANCE_TABLE_MAGIC "TRVLAPSP"
+#define DISTANCE_TABLE_VERSION 1
+
+// Metrics stored in a table, indexed like costOrTime
+#define DISTANCE_TABLE_METRICS 2
+
+// Largest network a table is built for; the file holds 16 * n * n bytes
+#define DISTANCE_TABLE_MAX_NODES 8192
+
+// On-disk header, followed at dataOffset by
+//   float   distances[DISTANCE_TABLE_METRICS][nodeCount][nodeCount]
+//   int32_t nextEdges[DISTANCE_TABLE_METRICS][nodeCount][nodeCount]
+// nextEdges[m][i][j] is the CSR edge leaving i on a shortest path to j,
+// -1 when j is unreachable or i == j.
+typedef struct DistanceTableHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t edgeCount;
+    uint32_t dataOffset;
+    SourceFileInfo cities;
+    SourceFileInfo routes;
+} DistanceTableHeader;
+
+// Read-only view of a mapped table file, or of a version repaired from it
+//
+// Cells are reached through a pointer per row, so a repaired version
+// copies only the rows an update changes and shares the rest with the
+// version it came from. Rows outside the mapping were allocated by
+// repairs; a version frees the rows its successor dropped, and the newest
+// version frees the rest along with the mapping, so versions are closed
+// oldest first.
+typedef struct DistanceTable {
+    void* mapping;
+    size_t mappingSize;
+
+    const DistanceTableHeader* header;
+    int nodeCount;
+    const float** distanceRows;       // [costOrTime * nodeCount + city]
+    const int32_t** nextEdgeRows;
+
+    void** retiredRows;   // rows of this version the next one replaced
+    int retiredCount;
+    int replaced;         // 1 once repairDistanceTable built a newer version
+} DistanceTable;
+
+// Function prototypes
+int buildDistanceTable(const CSRGraph* csr, const SourceFileInfo* cities, const SourceFileInfo* routes, const char* tableFile, int threadCount);
+DistanceTable* openDistanceTable(const char* tableFile);
+void closeDistanceTable(DistanceTable* table);
+int distanceTableFresh(const DistanceTable* table, const CSRGraph* csr, const char* citiesFile, const char* routesFile);
+int distanceTableMatches(const DistanceTable* table, const CSRGraph* csr, const SourceFileInfo* cities, const SourceFileInfo* routes);
+float tableDistance(const DistanceTable* table, int costOrTime, int from, int to);
+int tablePathEdges(const DistanceTable* table, const CSRGraph* csr, int costOrTime, int from, int to, int* edges, int maxEdges);
+DistanceTable* repairDistanceTable(DistanceTable* table, const CSRGraph* oldCsr, const CSRGraph* csr, const CSRGraph* backward,
+                                   const int* edgeMap);
+
+// Implementation
+
+// Work shared by the threads building one table
+typedef struct DistanceTableJob {
+    const CSRGraph* csr;
+    float* distances;
+    int32_t* nextEdges;
+    int threadCount;
+} DistanceTableJob;
+
+typedef struct DistanceTableWorker {
+    DistanceTableJob* job;
+    int index;
+    int failed;
+    int started;          // running on its own thread
+} DistanceTableWorker;
+
+// Fill row origin of both matrices for one metric from a finished search
+static void distanceTableFillRow(const CSRGraph* csr, const SearchWorkspace* ws, int origin, float* distances, int32_t* nextEdges, int* pending) {
+    int n = csr->nodeCount;
+    float* distanceRow = distances + (size_t)origin * n;
+    int32_t* nextRow = nextEdges + (size_t)origin * n;
+
+    for (int city = 0; city < n; city++) {
+        distanceRow[city] = (float)ws->dist[city];
+        nextRow[city] = -2;
+    }
+    nextRow[origin] = -1;
+
+    // The first edge toward a city is the first edge toward its parent,
+    // so walk up to a city that is already known and fill in on the way back
+    for (int city = 0; city < n; city++) {
+        if (nextRow[city] != -2) {
+            continue;
+        }
+        if (ws->parentEdge[city] == -1) {
+            nextRow[city] = -1;
+            continue;
+        }
+
+        int count = 0;
+        int current = city;
+        while (nextRow[current] == -2 && ws->parent[current] != origin) {
+            pending[count++] = current;
+            current = ws->parent[current];
+        }
+        if (nextRow[current] == -2) {
+            nextRow[current] = ws->parentEdge[current];
+        }
+
+        int first = nextRow[current];
+        while (count > 0) {
+            nextRow[pending[--count]] = first;
+        }
+    }
+}
+
+static void* distanceTableWorkerRun(void* argument) {
+    DistanceTableWorker* worker = (DistanceTableWorker*)argument;
+    DistanceTableJob* job = worker->job;
+    const CSRGraph* csr = job->csr;
+    size_t cells = (size_t)csr->nodeCount * csr->nodeCount;
+
+    SearchWorkspace* ws = createSearchWorkspace(csr->nodeCount);
+    int* pending = (int*)malloc(csr->nodeCount * sizeof(int));
+    if (ws == NULL || pending == NULL) {
+        worker->failed = 1;
+        freeSearchWorkspace(ws);
+        free(pending);
+        return NULL;
+    }
+
+    for (int origin = worker->index; origin < csr->nodeCount; origin += job->threadCount) {
+        for (int costOrTime = 0; costOrTime < DISTANCE_TABLE_METRICS; costOrTime++) {
+            shortestPath(csr, ws, origin, -1, costOrTime);
+            distanceTableFillRow(csr, ws, origin, job->distances + costOrTime * cells, job->nextEdges + costOrTime * cells, pending);
+        }
+    }
+
+    freeSearchWorkspace(ws);
+    free(pending);
+    return NULL;
+}
+
+// Run a one-to-all search from every city for both metrics and write the
+// table to tableFile, recording the inputs it was built from. Returns 1 on
+// success.
+int buildDistanceTable(const CSRGraph* csr, const SourceFileInfo* cities, const SourceFileInfo* routes, const char* tableFile, int threadCount) {
+    if (csr == NULL || cities == NULL || routes == NULL || csr->nodeCount < 1 || csr->nodeCount > DISTANCE_TABLE_MAX_NODES) {
+        return 0;
+    }
+
+    DistanceTableHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DISTANCE_TABLE_MAGIC, sizeof(header.magic));
+    header.version = DISTANCE_TABLE_VERSION;
+    header.nodeCount = (uint32_t)csr->nodeCount;
+    header.edgeCount = (uint32_t)csr->edgeCount;
+    header.dataOffset = (uint32_t)((sizeof(DistanceTableHeader) + 63) & ~(size_t)63);
+    header.cities = *cities;
+    header.routes = *routes;
+
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+
+    size_t cells = (size_t)csr->nodeCount * csr->nodeCount * DISTANCE_TABLE_METRICS;
+    DistanceTableJob job;
+    job.csr = csr;
+    job.distances = (float*)malloc(cells * sizeof(float));
+    job.nextEdges = (int32_t*)malloc(cells * sizeof(int32_t));
+    job.threadCount = threadCount;
+
+    DistanceTableWorker* workers = (DistanceTableWorker*)calloc(threadCount, sizeof(DistanceTableWorker));
+    pthread_t* threads = (pthread_t*)calloc(threadCount, sizeof(pthread_t));
+
+    int ok = job.distances != NULL && job.nextEdges != NULL && workers != NULL && threads != NULL;
+    if (ok) {
+        for (int t = 0; t < threadCount; t++) {
+            workers[t].job = &job;
+            workers[t].index = t;
+        }
+        // Rows whose thread cannot start are filled here instead
+        for (int t = 1; t < threadCount; t++) {
+            workers[t].started = pthread_create(&threads[t], NULL, distanceTableWorkerRun, &workers[t]) == 0;
+        }
+        distanceTableWorkerRun(&workers[0]);
+        for (int t = 1; t < threadCount; t++) {
+            if (workers[t].started) {
+                pthread_join(threads[t], NULL);
+            } else {
+                distanceTableWorkerRun(&workers[t]);
+            }
+        }
+        for (int t = 0; t < threadCount; t++) {
+            ok = ok && !workers[t].failed;
+        }
+    }
+
+    // Write to a temporary name and rename, so a running server never maps
+    // a half-written table
+    if (ok) {
+        size_t nameLength = strlen(tableFile) + 5;
+        char* temporary = (char*)malloc(nameLength);
+        FILE* file = NULL;
+        if (temporary != NULL) {
+            snprintf(temporary, nameLength, "%s.tmp", tableFile);
+            file = fopen(temporary, "wb");
+        }
+
+        ok = file != NULL;
+        if (ok) {
+            char padding[64] = {0};
+            ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(padding, 1, header.dataOffset - sizeof(header), file) == header.dataOffset - sizeof(header) &&
+                 fwrite(job.distances, sizeof(float), cells, file) == cells &&
+                 fwrite(job.nextEdges, sizeof(int32_t), cells, file) == cells;
+            ok = fclose(file) == 0 && ok;
+            ok = ok && rename(temporary, tableFile) == 0;
+            if (!ok) {
+                remove(temporary);
+            }
+        }
+        free(temporary);
+    }
+
+    free(job.distances);
+    free(job.nextEdges);
+    free(workers);
+    free(threads);
+
+    return ok;
+}
+
+// Map a table file read-only. Returns NULL if it is missing or malformed.
+DistanceTable* openDistanceTable(const char* tableFile) {
+    int fd = open(tableFile, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(DistanceTableHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    void* mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+
+    const DistanceTableHeader* header = (const DistanceTableHeader*)mapping;
+    size_t cells = (size_t)header->nodeCount * header->nodeCount * DISTANCE_TABLE_METRICS;
+    if (memcmp(header->magic, DISTANCE_TABLE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != DISTANCE_TABLE_VERSION ||
+        header->nodeCount > DISTANCE_TABLE_MAX_NODES ||
+        (size_t)info.st_size != header->dataOffset + cells * (sizeof(float) + sizeof(int32_t))) {
+        munmap(mapping, (size_t)info.st_size);
+        return NULL;
+    }
+
+    DistanceTable* table = (DistanceTable*)malloc(sizeof(DistanceTable));
+    size_t rows = (size_t)header->nodeCount * DISTANCE_TABLE_METRICS;
+    const float** distanceRows = (const float**)malloc((rows > 0 ? rows : 1) * sizeof(float*));
+    const int32_t** nextEdgeRows = (const int32_t**)malloc((rows > 0 ? rows : 1) * sizeof(int32_t*));
+    if (table == NULL || distanceRows == NULL || nextEdgeRows == NULL) {
+        free(table);
+        free(distanceRows);
+        free(nextEdgeRows);
+        munmap(mapping, (size_t)info.st_size);
+        return NULL;
+    }
+
+    const float* distances = (const float*)((const char*)mapping + header->dataOffset);
+    const int32_t* nextEdges = (const int32_t*)(distances + cells);
+    for (size_t row = 0; row < rows; row++) {
+        distanceRows[row] = distances + row * header->nodeCount;
+        nextEdgeRows[row] = nextEdges + row * header->nodeCount;
+    }
+
+    table->mapping = mapping;
+    table->mappingSize = (size_t)info.st_size;
+    table->header = header;
+    table->nodeCount = (int)header->nodeCount;
+    table->distanceRows = distanceRows;
+    table->nextEdgeRows = nextEdgeRows;
+    table->retiredRows = NULL;
+    table->retiredCount = 0;
+    table->replaced = 0;
+
+    return table;
+}
+
+// 1 if a row lies in the table's mapping rather than on the heap
+static int distanceTableMappedRow(const DistanceTable* table, const void* row) {
+    const char* start = (const char*)table->mapping;
+    return (const char*)row >= start && (const char*)row < start + table->mappingSize;
+}
+
+// Close one version. The newest also unmaps the file, so close versions
+// oldest first.
+void closeDistanceTable(DistanceTable* table) {
+    if (table == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < table->retiredCount; i++) {
+        free(table->retiredRows[i]);
+    }
+    free(table->retiredRows);
+
+    if (!table->replaced) {
+        size_t rows = (size_t)table->nodeCount * DISTANCE_TABLE_METRICS;
+        for (size_t row = 0; row < rows; row++) {
+            if (!distanceTableMappedRow(table, table->distanceRows[row])) {
+                free((void*)table->distanceRows[row]);
+                free((void*)table->nextEdgeRows[row]);
+            }
+        }
+        munmap(table->mapping, table->mappingSize);
+    }
+
+    free(table->distanceRows);
+    free(table->nextEdgeRows);
+    free(table);
+}
+
+// 1 if the table was built from these CSV files and matches the graph
+int distanceTableFresh(const DistanceTable* table, const CSRGraph* csr, const char* citiesFile, const char* routesFile) {
+    if (table == NULL || csr == NULL) {
+        return 0;
+    }
+
+    return table->header->nodeCount == (uint32_t)csr->nodeCount &&
+           table->header->edgeCount == (uint32_t)csr->edgeCount &&
+           sourceFileUnchanged(&table->header->cities, citiesFile) &&
+           sourceFileUnchanged(&table->header->routes, routesFile);
+}
+
+// 1 if the table was built from inputs with these contents and matches
+// the graph
+int distanceTableMatches(const DistanceTable* table, const CSRGraph* csr, const SourceFileInfo* cities, const SourceFileInfo* routes) {
+    if (table == NULL || csr == NULL) {
+        return 0;
+    }
+
+    return table->header->nodeCount == (uint32_t)csr->nodeCount &&
+           table->header->edgeCount == (uint32_t)csr->edgeCount &&
+           sourceFileSame(&table->header->cities, cities) &&
+           sourceFileSame(&table->header->routes, routes);
+}
+
+// Shortest distance (costOrTime: 1 = cost, 0 = time), WORKSPACE_UNREACHED
+// if there is no path
+float tableDistance(const DistanceTable* table, int costOrTime, int from, int to) {
+    return table->distanceRows[(costOrTime ? table->nodeCount : 0) + from][to];
+}
+
+// CSR edges of a shortest path in travel order, following next hops.
+// Returns the number of edges, or -1 if there is no path or it does not
+// fit in maxEdges.
+int tablePathEdges(const DistanceTable* table, const CSRGraph* csr, int costOrTime, int from, int to, int* edges, int maxEdges) {
+    int n = table->nodeCount;
+    if (from < 0 || from >= n || to < 0 || to >= n) {
+        return -1;
+    }
+
+    const int32_t* const* next = table->nextEdgeRows + (costOrTime ? n : 0);
+    int count = 0;
+    int city = from;
+    while (city != to) {
+        int edge = next[city][to];
+        if (edge < 0 || count >= maxEdges) {
+            return -1;
+        }
+        edges[count++] = edge;
+        city = csr->targets[edge];
+    }
+
+    return count;
+}
+
+// State of one repairDistanceTable call
+typedef struct DistanceTableRepair {
+    const DistanceTable* base;
+    DistanceTable* table;         // the version being built
+    const CSRGraph* csr;
+    const CSRGraph* backward;
+    const int* edgeMap;
+    unsigned char* owned;         // per row: 1 once the new version has its own copy
+
+    // Scratch for recomputing one column
+    int* childHead;
+    int* childNext;
+    int* member;                  // stamp of the column whose affected cities include the city
+    int* done;
+    int stamp;
+    int* members;
+    double* dist;
+    int* via;
+    IndexedHeap* heap;
+} DistanceTableRepair;
+
+// Give the new version its own copy of a row (metric, city), widened to
+// the new city count and with edges renumbered. Returns 0 when memory
+// runs out.
+static int distanceTableOwnRow(DistanceTableRepair* r, int metric, int city) {
+    int n = r->table->nodeCount;
+    int oldN = r->base->nodeCount;
+    size_t row = (size_t)metric * n + city;
+    if (r->owned[row]) {
+        return 1;
+    }
+
+    float* distances = (float*)malloc(n * sizeof(float));
+    int32_t* next = (int32_t*)malloc(n * sizeof(int32_t));
+    if (distances == NULL || next == NULL) {
+        free(distances);
+        free(next);
+        return 0;
+    }
+
+    int copied = 0;
+    if (city < oldN) {
+        const float* oldDistances = r->base->distanceRows[(size_t)metric * oldN + city];
+        const int32_t* oldNext = r->base->nextEdgeRows[(size_t)metric * oldN + city];
+        memcpy(distances, oldDistances, oldN * sizeof(float));
+        for (int j = 0; j < oldN; j++) {
+            next[j] = oldNext[j] >= 0 && r->edgeMap != NULL ? r->edgeMap[oldNext[j]] : oldNext[j];
+        }
+        copied = oldN;
+    }
+    for (int j = copied; j < n; j++) {
+        distances[j] = j == city ? 0.0f : (float)WORKSPACE_UNREACHED;
+        next[j] = -1;
+    }
+
+    r->table->distanceRows[row] = distances;
+    r->table->nextEdgeRows[row] = next;
+    r->owned[row] = 1;
+    return 1;
+}
+
+// Set one cell of the new version, copying its row first if the value
+// changes. Returns 0 when memory runs out.
+static int distanceTableSetCell(DistanceTableRepair* r, int metric, int from, int to, float distance, int32_t edge) {
+    size_t row = (size_t)metric * r->table->nodeCount + from;
+    if (r->table->distanceRows[row][to] == distance && r->table->nextEdgeRows[row][to] == edge) {
+        return 1;
+    }
+    if (!distanceTableOwnRow(r, metric, from)) {
+        return 0;
+    }
+
+    ((float*)r->table->distanceRows[row])[to] = distance;
+    ((int32_t*)r->table->nextEdgeRows[row])[to] = edge;
+    return 1;
+}
+
+// Recompute column to of one metric for the cities whose path to it ran
+// over an edge that got longer or went away: the roots, which that edge
+// leaves from, and every city whose path passes through one. Other cities
+// keep their paths, which got no longer while nothing got shorter, so the
+// affected ones are seeded from their edges to the rest and settled by a
+// Dijkstra confined to them. weights is the graph at this stage of the
+// repair, negative for an edge it does not have yet. Returns 0 when memory
+// runs out.
+static int distanceTableRepairColumn(DistanceTableRepair* r, int metric, int to, const int* roots, int rootCount,
+                                     const float* weights) {
+    const CSRGraph* csr = r->csr;
+    const CSRGraph* backward = r->backward;
+    int n = r->table->nodeCount;
+    const float* const* distanceRows = r->table->distanceRows + (size_t)metric * n;
+    const int32_t* const* nextEdgeRows = r->table->nextEdgeRows + (size_t)metric * n;
+    r->stamp++;
+
+    // The table's paths toward to form a tree; find the subtrees under the roots
+    for (int city = 0; city < n; city++) {
+        r->childHead[city] = -1;
+    }
+    for (int city = 0; city < n; city++) {
+        int edge = nextEdgeRows[city][to];
+        if (edge >= 0) {
+            int parent = csr->targets[edge];
+            r->childNext[city] = r->childHead[parent];
+            r->childHead[parent] = city;
+        }
+    }
+
+    int memberCount = 0;
+    for (int i = 0; i < rootCount; i++) {
+        if (r->member[roots[i]] == r->stamp) {
+            continue;
+        }
+        r->member[roots[i]] = r->stamp;
+        r->members[memberCount++] = roots[i];
+    }
+    for (int i = 0; i < memberCount; i++) {
+        for (int child = r->childHead[r->members[i]]; child != -1; child = r->childNext[child]) {
+            if (r->member[child] != r->stamp) {
+                r->member[child] = r->stamp;
+                r->members[memberCount++] = child;
+            }
+        }
+    }
+
+    // Best way out of the affected cities through an unaffected one
+    heapClear(r->heap);
+    for (int i = 0; i < memberCount; i++) {
+        int city = r->members[i];
+        r->dist[city] = WORKSPACE_UNREACHED;
+        r->via[city] = -1;
+        for (int e = csr->offsets[city]; e < csr->offsets[city + 1]; e++) {
+            int target = csr->targets[e];
+            if (weights[e] < 0 || r->member[target] == r->stamp || distanceRows[target][to] >= WORKSPACE_UNREACHED) {
+                continue;
+            }
+            double length = weights[e] + distanceRows[target][to];
+            if (length < r->dist[city]) {
+                r->dist[city] = length;
+                r->via[city] = e;
+            }
+        }
+        if (r->via[city] != -1) {
+            heapPushOrDecrease(r->heap, city, r->dist[city]);
+        }
+    }
+
+    // Settle them backward over the edges into each
+    while (!heapEmpty(r->heap)) {
+        int city = heapPop(r->heap);
+        r->done[city] = r->stamp;
+        for (int b = backward->offsets[city]; b < backward->offsets[city + 1]; b++) {
+            int source = backward->targets[b];
+            int edge = backward->edgeRoutes[b];
+            if (weights[edge] < 0 || r->member[source] != r->stamp || r->done[source] == r->stamp) {
+                continue;
+            }
+            double length = r->dist[city] + weights[edge];
+            if (length < r->dist[source]) {
+                r->dist[source] = length;
+                r->via[source] = edge;
+                heapPushOrDecrease(r->heap, source, length);
+            }
+        }
+    }
+
+    for (int i = 0; i < memberCount; i++) {
+        int city = r->members[i];
+        float distance = r->via[city] != -1 ? (float)r->dist[city] : (float)WORKSPACE_UNREACHED;
+        if (!distanceTableSetCell(r, metric, city, to, distance, r->via[city])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Bring one metric up to date with an edge from -> target that got
+// shorter or was added. A path can only improve by using it, and only for
+// origins that reach target faster through it, so those rows take
+// min(old, via the edge) for every destination. Returns 0 when memory
+// runs out.
+static int distanceTableRepairEdge(DistanceTableRepair* r, int metric, int edge, int from, int target, float weight) {
+    int n = r->table->nodeCount;
+    size_t rows = (size_t)metric * n;
+
+    for (int origin = 0; origin < n; origin++) {
+        double toFrom = r->table->distanceRows[rows + origin][from];
+        if (toFrom >= WORKSPACE_UNREACHED || toFrom + weight >= r->table->distanceRows[rows + origin][target]) {
+            continue;
+        }
+
+        int32_t first = origin == from ? edge : r->table->nextEdgeRows[rows + origin][from];
+        if (!distanceTableOwnRow(r, metric, origin)) {
+            return 0;
+        }
+
+        float* distances = (float*)r->table->distanceRows[rows + origin];
+        int32_t* next = (int32_t*)r->table->nextEdgeRows[rows + origin];
+        const float* fromTarget = r->table->distanceRows[rows + target];
+        for (int to = 0; to < n; to++) {
+            if (fromTarget[to] >= WORKSPACE_UNREACHED) {
+                continue;
+            }
+            double length = toFrom + weight + fromTarget[to];
+            if (length < distances[to]) {
+                distances[to] = (float)length;
+                next[to] = first;
+            }
+        }
+    }
+
+    return 1;
+}
+
+// A new version of table for the graph csr, which an update made from
+// oldCsr, the graph table was built or last repaired for. backward is the
+// reverse of csr. edgeMap gives the edge of csr each edge of oldCsr became,
+// -1 if it was removed; NULL means the edges kept their ids and only
+// weights changed. csr may add cities at the end.
+//
+// Weight increases and removals are handled first, with the decreases
+// held back at their old weights: only the cities whose table path used
+// such an edge are recomputed, column by column. Decreases and additions
+// are then applied one edge at a time. Only rows that change are copied,
+// except that new cities or renumbered edges widen or rewrite every row.
+// table is then marked replaced and is closed before the new version.
+//
+// Returns NULL if table is not the newest version, the graph is too large
+// for a table, or memory runs out; table is left as it was.
+DistanceTable* repairDistanceTable(DistanceTable* table, const CSRGraph* oldCsr, const CSRGraph* csr, const CSRGraph* backward,
+                                   const int* edgeMap) {
+    if (table == NULL || oldCsr == NULL || csr == NULL || backward == NULL || table->replaced ||
+        oldCsr->nodeCount != table->nodeCount || csr->nodeCount < oldCsr->nodeCount || csr->nodeCount > DISTANCE_TABLE_MAX_NODES ||
+        backward->nodeCount != csr->nodeCount || (edgeMap == NULL && csr->edgeCount != oldCsr->edgeCount)) {
+        return NULL;
+    }
+
+    int n = csr->nodeCount;
+    int oldN = oldCsr->nodeCount;
+    int edgeCount = csr->edgeCount;
+    int oldEdgeCount = oldCsr->edgeCount;
+    size_t rows = (size_t)n * DISTANCE_TABLE_METRICS;
+
+    DistanceTableRepair r;
+    memset(&r, 0, sizeof(r));
+    r.base = table;
+    r.csr = csr;
+    r.backward = backward;
+    r.edgeMap = edgeMap;
+    r.table = (DistanceTable*)malloc(sizeof(DistanceTable));
+    r.owned = (unsigned char*)calloc(rows, sizeof(unsigned char));
+    r.childHead = (int*)malloc(n * sizeof(int));
+    r.childNext = (int*)malloc(n * sizeof(int));
+    r.member = (int*)calloc(n, sizeof(int));
+    r.done = (int*)calloc(n, sizeof(int));
+    r.members = (int*)malloc(n * sizeof(int));
+    r.dist = (double*)malloc(n * sizeof(double));
+    r.via = (int*)malloc(n * sizeof(int));
+    r.heap = createIndexedHeap(n);
+
+    int* newToOld = (int*)malloc((edgeCount > 0 ? edgeCount : 1) * sizeof(int));
+    int* oldSources = (int*)malloc((oldEdgeCount > 0 ? oldEdgeCount : 1) * sizeof(int));
+    float* stageWeights = (float*)malloc((edgeCount > 0 ? edgeCount : 1) * sizeof(float));
+    int* columnHead = (int*)malloc(n * sizeof(int));
+    int* roots = (int*)malloc(n * sizeof(int));
+    int entryCapacity = n;
+    int* entryCity = (int*)malloc(entryCapacity * sizeof(int));
+    int* entryNext = (int*)malloc(entryCapacity * sizeof(int));
+
+    int ok = r.table != NULL && r.owned != NULL && r.childHead != NULL && r.childNext != NULL && r.member != NULL &&
+             r.done != NULL && r.members != NULL && r.dist != NULL && r.via != NULL && r.heap != NULL &&
+             newToOld != NULL && oldSources != NULL && stageWeights != NULL && columnHead != NULL && roots != NULL &&
+             entryCity != NULL && entryNext != NULL;
+    if (ok) {
+        r.table->distanceRows = (const float**)calloc(rows, sizeof(float*));
+        r.table->nextEdgeRows = (const int32_t**)calloc(rows, sizeof(int32_t*));
+        ok = r.table->distanceRows != NULL && r.table->nextEdgeRows != NULL;
+    } else if (r.table != NULL) {
+        r.table->distanceRows = NULL;
+        r.table->nextEdgeRows = NULL;
+    }
+
+    if (ok) {
+        r.table->mapping = table->mapping;
+        r.table->mappingSize = table->mappingSize;
+        r.table->header = table->header;
+        r.table->nodeCount = n;
+        r.table->retiredRows = NULL;
+        r.table->retiredCount = 0;
+        r.table->replaced = 0;
+
+        // Rows are shared until changed, unless every one must be rewritten
+        for (int metric = 0; metric < DISTANCE_TABLE_METRICS; metric++) {
+            for (int city = 0; city < oldN; city++) {
+                r.table->distanceRows[(size_t)metric * n + city] = table->distanceRows[(size_t)metric * oldN + city];
+                r.table->nextEdgeRows[(size_t)metric * n + city] = table->nextEdgeRows[(size_t)metric * oldN + city];
+            }
+            for (int city = 0; ok && (n != oldN || edgeMap != NULL) && city < n; city++) {
+                ok = distanceTableOwnRow(&r, metric, city);
+            }
+        }
+
+        for (int edge = 0; edge < edgeCount; edge++) {
+            newToOld[edge] = -1;
+        }
+        for (int edge = 0; edge < oldEdgeCount; edge++) {
+            int mapped = edgeMap != NULL ? edgeMap[edge] : edge;
+            if (mapped >= 0) {
+                newToOld[mapped] = edge;
+            }
+        }
+        for (int city = 0; city < oldN; city++) {
+            for (int edge = oldCsr->offsets[city]; edge < oldCsr->offsets[city + 1]; edge++) {
+                oldSources[edge] = city;
+            }
+        }
+    }
+
+    for (int metric = 0; ok && metric < DISTANCE_TABLE_METRICS; metric++) {
+        const float* oldWeights = csrWeights(oldCsr, metric);
+        const float* weights = csrWeights(csr, metric);
+
+        // The graph with only the increases and removals applied
+        for (int edge = 0; edge < edgeCount; edge++) {
+            int old = newToOld[edge];
+            stageWeights[edge] = old < 0 ? -1.0f : (weights[edge] > oldWeights[old] ? weights[edge] : oldWeights[old]);
+        }
+
+        // Columns whose table paths use an edge that got longer or went away
+        int entryCount = 0;
+        for (int city = 0; city < n; city++) {
+            columnHead[city] = -1;
+        }
+        for (int edge = 0; ok && edge < oldEdgeCount; edge++) {
+            int mapped = edgeMap != NULL ? edgeMap[edge] : edge;
+            if (mapped >= 0 && weights[mapped] <= oldWeights[edge]) {
+                continue;
+            }
+
+            int from = oldSources[edge];
+            const int32_t* next = table->nextEdgeRows[(size_t)metric * oldN + from];
+            for (int to = 0; to < oldN; to++) {
+                if (next[to] != edge) {
+                    continue;
+                }
+                if (entryCount == entryCapacity) {
+                    entryCapacity *= 2;
+                    int* grownCity = (int*)realloc(entryCity, entryCapacity * sizeof(int));
+                    if (grownCity != NULL) {
+                        entryCity = grownCity;
+                    }
+                    int* grownNext = (int*)realloc(entryNext, entryCapacity * sizeof(int));
+                    if (grownNext != NULL) {
+                        entryNext = grownNext;
+                    }
+                    if (grownCity == NULL || grownNext == NULL) {
+                        ok = 0;
+                        break;
+                    }
+                }
+                entryCity[entryCount] = from;
+                entryNext[entryCount] = columnHead[to];
+                columnHead[to] = entryCount++;
+            }
+        }
+
+        for (int to = 0; ok && to < n; to++) {
+            int rootCount = 0;
+            for (int entry = columnHead[to]; entry != -1; entry = entryNext[entry]) {
+                roots[rootCount++] = entryCity[entry];
+            }
+            if (rootCount > 0) {
+                ok = distanceTableRepairColumn(&r, metric, to, roots, rootCount, stageWeights);
+            }
+        }
+
+        // Then the edges that got shorter or were added
+        for (int from = 0; ok && from < n; from++) {
+            for (int edge = csr->offsets[from]; ok && edge < csr->offsets[from + 1]; edge++) {
+                int old = newToOld[edge];
+                if (old < 0 || weights[edge] < oldWeights[old]) {
+                    ok = distanceTableRepairEdge(&r, metric, edge, from, csr->targets[edge], weights[edge]);
+                }
+            }
+        }
+    }
+
+    // Rows the new version replaced are freed with the old one
+    void** retired = NULL;
+    int retiredCount = 0;
+    if (ok) {
+        retired = (void**)malloc((rows > 0 ? rows : 1) * 2 * sizeof(void*));
+        ok = retired != NULL;
+    }
+    if (ok) {
+        for (int metric = 0; metric < DISTANCE_TABLE_METRICS; metric++) {
+            for (int city = 0; city < oldN; city++) {
+                size_t oldRow = (size_t)metric * oldN + city;
+                if (r.owned[(size_t)metric * n + city] && !distanceTableMappedRow(table, table->distanceRows[oldRow])) {
+                    retired[retiredCount++] = (void*)table->distanceRows[oldRow];
+                    retired[retiredCount++] = (void*)table->nextEdgeRows[oldRow];
+                }
+            }
+        }
+        table->retiredRows = retired;
+        table->retiredCount = retiredCount;
+        table->replaced = 1;
+    } else if (r.table != NULL) {
+        for (size_t row = 0; r.owned != NULL && r.table->distanceRows != NULL && r.table->nextEdgeRows != NULL && row < rows; row++) {
+            if (r.owned[row]) {
+                free((void*)r.table->distanceRows[row]);
+                free((void*)r.table->nextEdgeRows[row]);
+            }
+        }
+        free(r.table->distanceRows);
+        free(r.table->nextEdgeRows);
+        free(r.table);
+        r.table = NULL;
+    }
+
+    free(r.owned);
+    free(r.childHead);
+    free(r.childNext);
+    free(r.member);
+    free(r.done);
+    free(r.members);
+    free(r.dist);
+    free(r.via);
+    freeIndexedHeap(r.heap);
+    free(newToOld);
+    free(oldSources);
+    free(stageWeights);
+    free(columnHead);
+    free(roots);
+    free(entryCity);
+    free(entryNext);
+
+    return r.table;
+}
+
+#endif // DISTANCETABLE_H
@@ -7,6 +7,10 @@
 
 #include "Location.h"
 #include "Route.h"
+#include "CsvReader.h"
+#include "CsvSchema.h"
+#include "SourceFile.h"
+#include "Profiler.h"
 
 // Forward declarations
 struct Graph;
@@ -20,23 +24,39 @@ int loadCities(Graph* graph, const char* filename);
 int loadRoutes(Graph* graph, const char* filename);
 void generateOutput(const char* filename, Stack* cities, Stack* routes, int costOrTime);
 
+// Graph and Stack definitions (needs the prototypes above)
+#include "GraphFunctions.h"
+
 // Implementation
 int loadRoutesAndCities(Graph* graph, const char* citiesFilename, const char* routesFilename) {
     if (graph == NULL || citiesFilename == NULL || routesFilename == NULL) {
         return 0;
     }
     
-    // First load routes
-    if (!loadRoutes(graph, routesFilename)) {
+    // First load routes; several routes files may be listed
+    const char* list = routesFilename;
+    char filename[4096];
+    int loaded = 0;
+    while (nextSourceFile(&list, filename, sizeof(filename))) {
+        PROFILE_BEGIN(scope, "loadRoutes", "load");
+        int ok = loadRoutes(graph, filename);
+        PROFILE_END(scope);
+        if (!ok) {
+            return 0;
+        }
+        loaded++;
+    }
+    if (loaded == 0) {
+        printf("No routes file given\n");
         return 0;
     }
     
     // Then load cities and connect them to routes
-    if (!loadCities(graph, citiesFilename)) {
-        return 0;
-    }
+    PROFILE_BEGIN(scope, "loadCities", "load");
+    int ok = loadCities(graph, citiesFilename);
+    PROFILE_END(scope);
     
-    return 1;
+    return ok;
 }
 
 int loadCities(Graph* graph, const char* filename) {
@@ -44,62 +64,55 @@ int loadCities(Graph* graph, const char* filename) {
         return 0;
     }
     
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
+    CsvReader* reader = openCsvReader(filename);
+    if (reader == NULL) {
         printf("Error opening cities file: %s\n", filename);
         return 0;
     }
     
-    char line[1024];
-    char country[256];
-    char city[256];
-    char latitude[32];
-    char longitude[32];
-    
-    while (fgets(line, sizeof(line), file)) {
-        // Remove newline
-        line[strcspn(line, "\n")] = 0;
+    CsvSchema schema;
+    int first = 1;
+    int status;
+    while ((status = csvNextRecord(reader)) != CSV_END) {
+        if (status == CSV_MALFORMED) continue;
         
-        // Parse CSV line
-        char* token = strtok(line, ",");
-        if (token == NULL) continue;
-        strncpy(country, token, sizeof(country) - 1);
-        country[sizeof(country) - 1] = '\0';
+        // Columns are found by name when the file has a header
+        if (first) {
+            first = 0;
+            int header = csvDetectSchema(reader, CSV_SCHEMA_CITIES, &schema);
+            if (header < 0) {
+                closeCsvReader(reader);
+                return 0;
+            }
+            if (header) continue;
+        }
         
-        token = strtok(NULL, ",");
-        if (token == NULL) continue;
-        strncpy(city, token, sizeof(city) - 1);
-        city[sizeof(city) - 1] = '\0';
+        if (reader->fieldCount < schema.requiredFields) {
+            csvReportMalformed(reader, "missing city, latitude or longitude");
+            continue;
+        }
         
-        token = strtok(NULL, ",");
-        if (token == NULL) continue;
-        strncpy(latitude, token, sizeof(latitude) - 1);
-        latitude[sizeof(latitude) - 1] = '\0';
+        const char* country = csvSchemaField(reader, &schema, CSV_COLUMN_COUNTRY);
+        const char* city = csvSchemaField(reader, &schema, CSV_COLUMN_CITY);
+        double latitude;
+        double longitude;
+        if (!csvSchemaNumber(reader, &schema, CSV_COLUMN_LATITUDE, &latitude) ||
+            !csvSchemaNumber(reader, &schema, CSV_COLUMN_LONGITUDE, &longitude)) {
+            csvReportMalformed(reader, "latitude and longitude must be numbers");
+            continue;
+        }
         
-        token = strtok(NULL, ",");
-        if (token == NULL) continue;
-        strncpy(longitude, token, sizeof(longitude) - 1);
-        longitude[sizeof(longitude) - 1] = '\0';
+        // Skip repeated cities, the first row keeps the name's id
+        if (symbolLookup(graph->names, city) != -1) {
+            continue;
+        }
         
         // Create location
-        Location* node = createLocationWithCoords(country, city, atof(latitude), atof(longitude));
+        Location* node = createLocationWithCoords(country, city, (float)latitude, (float)longitude);
         if (node == NULL) {
             continue;
         }
         
-        // Connect routes to this city
-        for (int i = 0; i < graph->routeCount; i++) {
-            Route* route = graph->routes[i];
-            
-            if (strcmp(route->originS, node->capital) == 0) {
-                route->origin = node;
-                addRouteToLocation(node, route);
-            }
-            else if (strcmp(route->destinationS, node->capital) == 0) {
-                route->destination = node;
-            }
-        }
-        
         // Add city to graph
         if (graph->cityCount >= graph->cityCapacity) {
             int newCapacity = graph->cityCapacity == 0 ? 10 : graph->cityCapacity * 2;
@@ -108,14 +121,37 @@ int loadCities(Graph* graph, const char* filename) {
                 freeLocation(node);
                 continue;
             }
+            PROFILE_ALLOCATION(1, newCapacity * sizeof(Location*));
             graph->cities = newCities;
             graph->cityCapacity = newCapacity;
         }
         
+        // Cities are the only names interned, so the symbol id is the city id
+        node->id = symbolIntern(graph->names, node->capital);
+        if (node->id != graph->cityCount) {
+            freeLocation(node);
+            continue;
+        }
         graph->cities[graph->cityCount++] = node;
     }
     
-    fclose(file);
+    closeCsvReader(reader);
+    
+    PROFILE_COUNT("cities", graph->cityCount);
+    
+    // Connect routes to their cities with one hash lookup per endpoint
+    PROFILE_BEGIN(scope, "linkRoutes", "load");
+    for (int i = 0; i < graph->routeCount; i++) {
+        Route* route = graph->routes[i];
+        
+        int originId = symbolLookup(graph->names, route->originS);
+        int destinationId = symbolLookup(graph->names, route->destinationS);
+        
+        route->origin = originId != -1 ? graph->cities[originId] : NULL;
+        route->destination = destinationId != -1 ? graph->cities[destinationId] : NULL;
+    }
+    PROFILE_END(scope);
+
     printf("Cities Parsed from: %s\n", filename);
     
     return 1;
@@ -126,56 +162,69 @@ int loadRoutes(Graph* graph, const char* filename) {
         return 0;
     }
     
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
+    CsvReader* reader = openCsvReader(filename);
+    if (reader == NULL) {
         printf("Error opening routes file: %s\n", filename);
         return 0;
     }
     
-    char line[1024];
-    char origin[256];
-    char destination[256];
-    char transport[256];
-    char time[32];
-    char cost[32];
-    char note[256];
-    
-    while (fgets(line, sizeof(line), file)) {
-        // Remove newline
-        line[strcspn(line, "\n")] = 0;
-        
-        // Parse CSV line
-        char* token = strtok(line, ",");
-        if (token == NULL) continue;
-        strncpy(origin, token, sizeof(origin) - 1);
-        origin[sizeof(origin) - 1] = '\0';
-        
-        token = strtok(NULL, ",");
-        if (token == NULL) continue;
-        strncpy(destination, token, sizeof(destination) - 1);
-        destination[sizeof(destination) - 1] = '\0';
+    CsvSchema schema;
+    int first = 1;
+    int status;
+    long long routeCount = 0;
+    while ((status = csvNextRecord(reader)) != CSV_END) {
+        if (status == CSV_MALFORMED) continue;
         
-        token = strtok(NULL, ",");
-        if (token == NULL) continue;
-        strncpy(transport, token, sizeof(transport) - 1);
-        transport[sizeof(transport) - 1] = '\0';
+        // routes.csv has no header and is read by position; other layouts,
+        // such as indian_cities.csv, are mapped by their header
+        if (first) {
+            first = 0;
+            int header = csvDetectSchema(reader, CSV_SCHEMA_ROUTES, &schema);
+            if (header < 0) {
+                closeCsvReader(reader);
+                return 0;
+            }
+            if (header) continue;
+        }
         
-        token = strtok(NULL, ",");
-        if (token == NULL) continue;
-        strncpy(time, token, sizeof(time) - 1);
-        time[sizeof(time) - 1] = '\0';
+        if (reader->fieldCount < schema.requiredFields) {
+            csvReportMalformed(reader, "missing origin, destination, time or cost");
+            continue;
+        }
+        if (schema.columns[CSV_COLUMN_NOTE] != -1 && reader->fieldCount > schema.columns[CSV_COLUMN_NOTE] + 1 &&
+            schema.columns[CSV_COLUMN_DEPARTURE] < schema.columns[CSV_COLUMN_NOTE] &&
+            schema.columns[CSV_COLUMN_HEADWAY] < schema.columns[CSV_COLUMN_NOTE]) {
+            csvReportMalformed(reader, "fields after the note are ignored");
+        }
         
-        token = strtok(NULL, ",");
-        if (token == NULL) continue;
-        strncpy(cost, token, sizeof(cost) - 1);
-        cost[sizeof(cost) - 1] = '\0';
+        const char* origin = csvSchemaField(reader, &schema, CSV_COLUMN_ORIGIN);
+        const char* destination = csvSchemaField(reader, &schema, CSV_COLUMN_DESTINATION);
+        const char* transport = csvSchemaField(reader, &schema, CSV_COLUMN_TRANSPORT);
+        const char* note = csvSchemaField(reader, &schema, CSV_COLUMN_NOTE);
+        double time;
+        double cost;
+        double distance;
+        double departure;
+        double headway;
+        if (!csvSchemaNumber(reader, &schema, CSV_COLUMN_TIME, &time) ||
+            !csvSchemaNumber(reader, &schema, CSV_COLUMN_COST, &cost)) {
+            csvReportMalformed(reader, "time and cost must be numbers");
+            continue;
+        }
+        if (!csvSchemaNumber(reader, &schema, CSV_COLUMN_DISTANCE, &distance)) {
+            distance = 0;
+        }
         
-        token = strtok(NULL, ",");
-        if (token != NULL) {
-            strncpy(note, token, sizeof(note) - 1);
-            note[sizeof(note) - 1] = '\0';
-        } else {
-            note[0] = '\0';
+        // A route without a departure runs whenever it is needed. Schedules
+        // repeat daily, so 25:30 is the 01:30 departure.
+        if (!csvSchemaNumber(reader, &schema, CSV_COLUMN_DEPARTURE, &departure) || departure < 0) {
+            departure = -1;
+        }
+        while (departure >= 24.0) {
+            departure -= 24.0;
+        }
+        if (!csvSchemaNumber(reader, &schema, CSV_COLUMN_HEADWAY, &headway) || headway < 0) {
+            headway = 0;
         }
         
         // Create route
@@ -193,8 +242,11 @@ int loadRoutes(Graph* graph, const char* filename) {
         strncpy(route->transport, transport, sizeof(route->transport) - 1);
         route->transport[sizeof(route->transport) - 1] = '\0';
         
-        route->time = atof(time);
-        route->cost = atof(cost);
+        route->time = (float)time;
+        route->cost = (float)cost;
+        route->distance = (float)distance;
+        route->departure = (float)departure;
+        route->headway = (float)headway;
         
         strncpy(route->note, note, sizeof(route->note) - 1);
         route->note[sizeof(route->note) - 1] = '\0';
@@ -207,14 +259,17 @@ int loadRoutes(Graph* graph, const char* filename) {
                 freeRoute(route);
                 continue;
             }
+            PROFILE_ALLOCATION(1, newCapacity * sizeof(Route*));
             graph->routes = newRoutes;
             graph->routeCapacity = newCapacity;
         }
         
         graph->routes[graph->routeCount++] = route;
+        routeCount++;
     }
     
-    fclose(file);
+    closeCsvReader(reader);
+    PROFILE_COUNT("routes", routeCount);
     printf("Routes Parsed from: %s\n", filename);
     
     return 1;
@@ -0,0 +1,496 @@
+#ifndef GRAPHFUNCTIONS_H
+#define GRAPHFUNCTIONS_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "Location.h"
+#include "Route.h"
+#include "CSRGraph.h"
+#include "SymbolTable.h"
+#include "SearchWorkspace.h"
+#include "GraphSnapshot.h"
+#include "Profiler.h"
+
+// Stack structure used to hand the result path to the output writer
+typedef struct StackNode {
+    void* data;
+    struct StackNode* next;
+} StackNode;
+
+typedef struct Stack {
+    StackNode* top;
+    int size;
+} Stack;
+
+// Graph structure
+//
+// cities and routes are the cold records used for output; csr is the
+// packed adjacency the search runs on, built once after loading.
+//
+// A graph opened from a snapshot has csr and names pointing into the
+// mapped file. Its routes are indexed by CSR edge and created on first
+// use by graphEdgeRoute; everything else reads the mapping directly.
+typedef struct Graph {
+    Location** cities;
+    int cityCount;
+    int cityCapacity;
+
+    Route** routes;
+    int routeCount;
+    int routeCapacity;
+
+    // City name -> city id
+    SymbolTable* names;
+
+    CSRGraph* csr;
+
+    // Mapped snapshot backing csr and names, NULL for a CSV graph
+    GraphSnapshot* snapshot;
+} Graph;
+
+// Function prototypes
+Stack* createStack();
+void freeStack(Stack* stack);
+void push(Stack* stack, void* data);
+void* pop(Stack* stack);
+void* peek(Stack* stack);
+int isEmpty(Stack* stack);
+
+Graph* createGraph(const char* citiesFilename, const char* routesFilename);
+Graph* createGraphFromSnapshot(const char* snapshotFilename);
+void freeGraph(Graph* graph);
+int buildGraphCSR(Graph* graph);
+Location* getCity(Graph* graph, const char* name);
+Route* graphEdgeRoute(Graph* graph, int edge);
+const char* graphEdgeTransport(const Graph* graph, int edge);
+float graphEdgeDistance(const Graph* graph, int edge);
+const char* graphEdgeNote(const Graph* graph, int edge);
+int describeGraphSources(const Graph* graph, const char* citiesFilename, const char* routesFilename,
+                         SourceFileInfo* cities, SourceFileInfo* routes);
+int dijkstras(const Graph* graph, SearchWorkspace* ws, const char* origin, int costOrTime);
+Stack* cityStacker(Graph* graph, const SearchWorkspace* ws, const char* destination);
+Stack* routeStacker(Graph* graph, const SearchWorkspace* ws, const char* destination);
+Stack* pathCityStacker(Graph* graph, int origin, const int* edges, int edgeCount);
+Stack* pathRouteStacker(Graph* graph, const int* edges, int edgeCount);
+
+// Loaders (need the Graph definition above)
+#include "FileOperations.h"
+
+// Stack implementation
+Stack* createStack() {
+    Stack* stack = (Stack*)malloc(sizeof(Stack));
+    if (stack == NULL) {
+        return NULL;
+    }
+
+    stack->top = NULL;
+    stack->size = 0;
+
+    return stack;
+}
+
+void freeStack(Stack* stack) {
+    if (stack == NULL) {
+        return;
+    }
+
+    // Only the stack nodes are freed, the data belongs to the graph
+    StackNode* current = stack->top;
+    while (current != NULL) {
+        StackNode* next = current->next;
+        free(current);
+        current = next;
+    }
+
+    free(stack);
+}
+
+void push(Stack* stack, void* data) {
+    if (stack == NULL) {
+        return;
+    }
+
+    StackNode* node = (StackNode*)malloc(sizeof(StackNode));
+    if (node == NULL) {
+        return;
+    }
+    PROFILE_ALLOCATION(1, sizeof(StackNode));
+
+    node->data = data;
+    node->next = stack->top;
+    stack->top = node;
+    stack->size++;
+}
+
+void* pop(Stack* stack) {
+    if (stack == NULL || stack->top == NULL) {
+        return NULL;
+    }
+
+    StackNode* node = stack->top;
+    void* data = node->data;
+
+    stack->top = node->next;
+    stack->size--;
+    free(node);
+
+    return data;
+}
+
+void* peek(Stack* stack) {
+    if (stack == NULL || stack->top == NULL) {
+        return NULL;
+    }
+
+    return stack->top->data;
+}
+
+int isEmpty(Stack* stack) {
+    return stack == NULL || stack->top == NULL;
+}
+
+// Graph implementation
+
+static Graph* createGraphFromFiles(const char* citiesFilename, const char* routesFilename) {
+    Graph* graph = (Graph*)malloc(sizeof(Graph));
+    if (graph == NULL) {
+        return NULL;
+    }
+
+    graph->cities = NULL;
+    graph->cityCount = 0;
+    graph->cityCapacity = 0;
+    graph->routes = NULL;
+    graph->routeCount = 0;
+    graph->routeCapacity = 0;
+    graph->names = createSymbolTable(64);
+    graph->csr = NULL;
+    graph->snapshot = NULL;
+
+    if (graph->names == NULL || !loadRoutesAndCities(graph, citiesFilename, routesFilename)) {
+        freeGraph(graph);
+        return NULL;
+    }
+
+    PROFILE_BEGIN(scope, "buildGraphCSR", "load");
+    int built = buildGraphCSR(graph);
+    PROFILE_END(scope);
+    if (!built) {
+        freeGraph(graph);
+        return NULL;
+    }
+
+    return graph;
+}
+
+// Load from CSV files, or map citiesFilename directly if it is a snapshot
+// (routesFilename is then ignored)
+Graph* createGraph(const char* citiesFilename, const char* routesFilename) {
+    PROFILE_BEGIN(scope, "createGraph", "load");
+    Graph* graph = isGraphSnapshotFile(citiesFilename) ? createGraphFromSnapshot(citiesFilename)
+                                                       : createGraphFromFiles(citiesFilename, routesFilename);
+    PROFILE_END(scope);
+    return graph;
+}
+
+Graph* createGraphFromSnapshot(const char* snapshotFilename) {
+    GraphSnapshot* snapshot = openGraphSnapshot(snapshotFilename);
+    if (snapshot == NULL) {
+        printf("Error opening graph snapshot: %s\n", snapshotFilename);
+        return NULL;
+    }
+
+    Graph* graph = (Graph*)malloc(sizeof(Graph));
+    if (graph == NULL) {
+        closeGraphSnapshot(snapshot);
+        return NULL;
+    }
+
+    int cityCount = snapshot->csr.nodeCount;
+    int edgeCount = snapshot->csr.edgeCount;
+
+    graph->snapshot = snapshot;
+    graph->csr = &snapshot->csr;
+    graph->names = &snapshot->names;
+    graph->cityCount = 0;
+    graph->cityCapacity = cityCount;
+    graph->cities = (Location**)malloc((cityCount > 0 ? cityCount : 1) * sizeof(Location*));
+    graph->routeCount = edgeCount;
+    graph->routeCapacity = edgeCount;
+    graph->routes = (Route**)calloc(edgeCount > 0 ? edgeCount : 1, sizeof(Route*));
+
+    if (graph->cities == NULL || graph->routes == NULL) {
+        freeGraph(graph);
+        return NULL;
+    }
+
+    // Locations are the one per-city record built at open
+    for (int i = 0; i < cityCount; i++) {
+        Location* city = createLocationWithCoords(snapshotCityCountry(snapshot, i), snapshotCityName(snapshot, i),
+                                                  snapshot->cities[i].lat, snapshot->cities[i].lon);
+        if (city == NULL) {
+            freeGraph(graph);
+            return NULL;
+        }
+        city->id = i;
+        graph->cities[graph->cityCount++] = city;
+    }
+
+    printf("Graph mapped from: %s\n", snapshotFilename);
+    return graph;
+}
+
+void freeGraph(Graph* graph) {
+    if (graph == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < graph->routeCount; i++) {
+        freeRoute(graph->routes[i]);
+    }
+    free(graph->routes);
+
+    for (int i = 0; i < graph->cityCount; i++) {
+        freeLocation(graph->cities[i]);
+    }
+    free(graph->cities);
+
+    if (graph->snapshot != NULL) {
+        closeGraphSnapshot(graph->snapshot);
+    } else {
+        freeSymbolTable(graph->names);
+        freeCSRGraph(graph->csr);
+    }
+    free(graph);
+}
+
+// Pack the linked routes into the CSR adjacency. Routes whose origin or
+// destination is not a loaded city are left out of the search graph.
+int buildGraphCSR(Graph* graph) {
+    if (graph == NULL) {
+        return 0;
+    }
+
+    int count = graph->routeCount;
+    int* sources = (int*)malloc((count > 0 ? count : 1) * sizeof(int));
+    int* targets = (int*)malloc((count > 0 ? count : 1) * sizeof(int));
+    float* times = (float*)malloc((count > 0 ? count : 1) * sizeof(float));
+    float* costs = (float*)malloc((count > 0 ? count : 1) * sizeof(float));
+    unsigned char* modes = (unsigned char*)malloc((count > 0 ? count : 1) * sizeof(unsigned char));
+
+    if (sources == NULL || targets == NULL || times == NULL || costs == NULL || modes == NULL) {
+        free(sources);
+        free(targets);
+        free(times);
+        free(costs);
+        free(modes);
+        return 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        Route* route = graph->routes[i];
+        sources[i] = route->origin != NULL ? route->origin->id : -1;
+        targets[i] = route->destination != NULL ? route->destination->id : -1;
+        times[i] = route->time;
+        costs[i] = route->cost;
+        modes[i] = (unsigned char)transportModeFromString(route->transport);
+    }
+
+    freeCSRGraph(graph->csr);
+    graph->csr = createCSRGraph(graph->cityCount, count, sources, targets, times, costs, modes);
+
+    free(sources);
+    free(targets);
+    free(times);
+    free(costs);
+    free(modes);
+
+    return graph->csr != NULL;
+}
+
+Location* getCity(Graph* graph, const char* name) {
+    if (graph == NULL || name == NULL) {
+        return NULL;
+    }
+
+    int id = symbolLookup(graph->names, name);
+    return id != -1 ? graph->cities[id] : NULL;
+}
+
+// Route record of a CSR edge. For a snapshot graph it is built on first
+// use, so this must not race with itself; concurrent readers use the
+// CSR arrays and graphEdgeTransport instead.
+Route* graphEdgeRoute(Graph* graph, int edge) {
+    if (graph == NULL || graph->csr == NULL || edge < 0 || edge >= graph->csr->edgeCount) {
+        return NULL;
+    }
+
+    if (graph->snapshot == NULL) {
+        return graph->routes[graph->csr->edgeRoutes[edge]];
+    }
+
+    if (graph->routes[edge] == NULL) {
+        int origin = csrEdgeSource(graph->csr, edge);
+        Route* route = createRouteWithDetails(graph->cities[origin], graph->cities[graph->csr->targets[edge]],
+                                              snapshotEdgeTransport(graph->snapshot, edge),
+                                              graph->csr->times[edge], graph->csr->costs[edge],
+                                              snapshotEdgeNote(graph->snapshot, edge));
+        if (route != NULL) {
+            route->distance = snapshotEdgeDistance(graph->snapshot, edge);
+            strncpy(route->originS, graph->cities[origin]->capital, sizeof(route->originS) - 1);
+            route->originS[sizeof(route->originS) - 1] = '\0';
+            strncpy(route->destinationS, route->destination->capital, sizeof(route->destinationS) - 1);
+            route->destinationS[sizeof(route->destinationS) - 1] = '\0';
+        }
+        graph->routes[edge] = route;
+    }
+
+    return graph->routes[edge];
+}
+
+// Transport name of a CSR edge; safe to call from several threads
+const char* graphEdgeTransport(const Graph* graph, int edge) {
+    if (graph->snapshot != NULL) {
+        return snapshotEdgeTransport(graph->snapshot, edge);
+    }
+
+    return graph->routes[graph->csr->edgeRoutes[edge]]->transport;
+}
+
+// Distance in km the routes file gives for a CSR edge, 0 if it gives none;
+// safe to call from several threads
+float graphEdgeDistance(const Graph* graph, int edge) {
+    if (graph->snapshot != NULL) {
+        return snapshotEdgeDistance(graph->snapshot, edge);
+    }
+
+    return graph->routes[graph->csr->edgeRoutes[edge]]->distance;
+}
+
+// Note the routes file gives for a CSR edge; safe to call from several threads
+const char* graphEdgeNote(const Graph* graph, int edge) {
+    if (graph->snapshot != NULL) {
+        return snapshotEdgeNote(graph->snapshot, edge);
+    }
+
+    return graph->routes[graph->csr->edgeRoutes[edge]]->note;
+}
+
+// Size, mtime and hash of the CSV files the graph came from; a snapshot
+// graph reports the files it was compiled from. Returns 1 on success.
+int describeGraphSources(const Graph* graph, const char* citiesFilename, const char* routesFilename,
+                         SourceFileInfo* cities, SourceFileInfo* routes) {
+    if (graph->snapshot != NULL) {
+        *cities = graph->snapshot->header->cities;
+        *routes = graph->snapshot->header->routes;
+        return 1;
+    }
+
+    return describeSourceFile(citiesFilename, cities) && describeSourceFile(routesFilename, routes);
+}
+
+// Single-source Dijkstra from origin over the CSR arrays (costOrTime:
+// 1 = cost, 0 = time), leaving distances and the path tree in ws for the
+// stackers. The graph is only read, so threads may share it. Returns 0 if
+// origin is not a city.
+int dijkstras(const Graph* graph, SearchWorkspace* ws, const char* origin, int costOrTime) {
+    if (graph == NULL || graph->csr == NULL || ws == NULL || origin == NULL) {
+        return 0;
+    }
+
+    int start = symbolLookup(graph->names, origin);
+    if (start == -1) {
+        printf("Origin city not found: %s\n", origin);
+        return 0;
+    }
+
+    PROFILE_BEGIN(scope, "dijkstras", "search");
+    int found = shortestPath(graph->csr, ws, start, -1, costOrTime);
+    PROFILE_COUNT("settled", ws->settledCount);
+    PROFILE_END(scope);
+    return found;
+}
+
+// Cities on the path to destination in the last search of ws, origin at
+// the bottom of the stack
+Stack* cityStacker(Graph* graph, const SearchWorkspace* ws, const char* destination) {
+    Stack* stack = createStack();
+    Location* city = getCity(graph, destination);
+    if (stack == NULL || city == NULL || workspaceDist(ws, city->id) >= WORKSPACE_UNREACHED) {
+        return stack;
+    }
+
+    Stack* reversed = createStack();
+    for (int id = city->id; id != -1; id = workspaceParent(ws, id)) {
+        push(reversed, graph->cities[id]);
+    }
+
+    while (!isEmpty(reversed)) {
+        push(stack, pop(reversed));
+    }
+    freeStack(reversed);
+
+    return stack;
+}
+
+// Routes on the path to destination in the last search of ws, first leg
+// at the bottom of the stack
+Stack* routeStacker(Graph* graph, const SearchWorkspace* ws, const char* destination) {
+    Stack* stack = createStack();
+    Location* city = getCity(graph, destination);
+    if (stack == NULL || city == NULL || workspaceDist(ws, city->id) >= WORKSPACE_UNREACHED) {
+        return stack;
+    }
+
+    Stack* reversed = createStack();
+    for (int id = city->id; workspaceParentEdge(ws, id) != -1; id = workspaceParent(ws, id)) {
+        Route* route = graphEdgeRoute(graph, workspaceParentEdge(ws, id));
+        if (route != NULL) {
+            push(reversed, route);
+        }
+    }
+
+    while (!isEmpty(reversed)) {
+        push(stack, pop(reversed));
+    }
+    freeStack(reversed);
+
+    return stack;
+}
+
+// Cities along a path given as CSR edges from origin, origin at the
+// bottom of the stack
+Stack* pathCityStacker(Graph* graph, int origin, const int* edges, int edgeCount) {
+    Stack* stack = createStack();
+    if (stack == NULL || origin < 0 || origin >= graph->cityCount) {
+        return stack;
+    }
+
+    push(stack, graph->cities[origin]);
+    for (int i = 0; i < edgeCount; i++) {
+        push(stack, graph->cities[graph->csr->targets[edges[i]]]);
+    }
+
+    return stack;
+}
+
+// Routes of a path given as CSR edges, first leg at the bottom of the stack
+Stack* pathRouteStacker(Graph* graph, const int* edges, int edgeCount) {
+    Stack* stack = createStack();
+    if (stack == NULL) {
+        return stack;
+    }
+
+    for (int i = 0; i < edgeCount; i++) {
+        Route* route = graphEdgeRoute(graph, edges[i]);
+        if (route != NULL) {
+            push(stack, route);
+        }
+    }
+
+    return stack;
+}
+
+#endif // GRAPHFUNCTIONS_H
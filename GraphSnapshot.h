@@ -0,0 +1,383 @@
+#ifndef GRAPHSNAPSHOT_H
+#define GRAPHSNAPSHOT_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "CSRGraph.h"
+#include "SymbolTable.h"
+#include "SourceFile.h"
+
+#define GRAPH_SNAPSHOT_MAGIC "TRVLGRPH"
+#define GRAPH_SNAPSHOT_VERSION 2
+
+// Every section starts on this boundary
+#define GRAPH_SNAPSHOT_ALIGNMENT 64
+
+// One city; strings are offsets into the string pool
+typedef struct SnapshotCity {
+    uint32_t name;
+    uint32_t country;
+    float lat;
+    float lon;
+} SnapshotCity;
+
+// Text of one edge, in CSR edge order
+typedef struct SnapshotEdgeText {
+    uint32_t transport;
+    uint32_t note;
+} SnapshotEdgeText;
+
+// On-disk header. Each *Offset is the byte offset of a section:
+//   cityOffset       SnapshotCity[nodeCount]
+//   csrOffset        int32 offsets[nodeCount + 1]
+//   targetOffset     int32 targets[edgeCount]
+//   timeOffset       float times[edgeCount]
+//   costOffset       float costs[edgeCount]
+//   modeOffset       uint8 modes[edgeCount]
+//   edgeRouteOffset  int32 route line of each edge[edgeCount]
+//   edgeTextOffset   SnapshotEdgeText[edgeCount]
+//   distanceOffset   float km of each edge, 0 if unknown[edgeCount]
+//   slotOffset       int32 name hash slots[slotCapacity]
+//   hashOffset       uint32 name hashes[nodeCount]
+//   nameOffset       int32 name offsets in the pool[nodeCount]
+//   poolOffset       char pool[poolSize]
+// The name sections are a SymbolTable laid out as in memory, so lookups
+// run on the mapped bytes directly.
+typedef struct GraphSnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t edgeCount;
+    uint32_t slotCapacity;
+    uint64_t poolSize;
+    uint64_t fileSize;
+
+    uint64_t cityOffset;
+    uint64_t csrOffset;
+    uint64_t targetOffset;
+    uint64_t timeOffset;
+    uint64_t costOffset;
+    uint64_t modeOffset;
+    uint64_t edgeRouteOffset;
+    uint64_t edgeTextOffset;
+    uint64_t distanceOffset;
+    uint64_t slotOffset;
+    uint64_t hashOffset;
+    uint64_t nameOffset;
+    uint64_t poolOffset;
+
+    SourceFileInfo cities;
+    SourceFileInfo routes;
+} GraphSnapshotHeader;
+
+// A mapped snapshot
+//
+// csr and names point straight into the read-only mapping. They must not
+// be freed or interned into; closeGraphSnapshot releases everything.
+// Processes mapping the same file share one page-cache copy of it.
+typedef struct GraphSnapshot {
+    void* mapping;
+    size_t mappingSize;
+
+    const GraphSnapshotHeader* header;
+    const SnapshotCity* cities;
+    const SnapshotEdgeText* edgeTexts;
+    const float* distances;
+    const char* pool;
+
+    CSRGraph csr;
+    SymbolTable names;
+} GraphSnapshot;
+
+// Function prototypes
+int isGraphSnapshotFile(const char* filename);
+int writeGraphSnapshot(const char* filename, const CSRGraph* csr, const SymbolTable* names,
+                       const char* const* countries, const float* lats, const float* lons,
+                       const char* const* transports, const char* const* notes, const float* distances,
+                       const SourceFileInfo* citiesSource, const SourceFileInfo* routesSource);
+GraphSnapshot* openGraphSnapshot(const char* filename);
+void closeGraphSnapshot(GraphSnapshot* snapshot);
+const char* snapshotCityName(const GraphSnapshot* snapshot, int city);
+const char* snapshotCityCountry(const GraphSnapshot* snapshot, int city);
+const char* snapshotEdgeTransport(const GraphSnapshot* snapshot, int edge);
+const char* snapshotEdgeNote(const GraphSnapshot* snapshot, int edge);
+float snapshotEdgeDistance(const GraphSnapshot* snapshot, int edge);
+
+// Implementation
+
+// 1 if filename starts with the snapshot magic
+int isGraphSnapshotFile(const char* filename) {
+    if (filename == NULL) {
+        return 0;
+    }
+
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+
+    char magic[8];
+    int match = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+                memcmp(magic, GRAPH_SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+    fclose(file);
+
+    return match;
+}
+
+static uint64_t snapshotAlign(uint64_t offset) {
+    return (offset + GRAPH_SNAPSHOT_ALIGNMENT - 1) & ~(uint64_t)(GRAPH_SNAPSHOT_ALIGNMENT - 1);
+}
+
+// Append a section at the next aligned offset, padding with zeros
+static int snapshotWriteSection(FILE* file, uint64_t* offset, uint64_t* sectionOffset, const void* data, size_t bytes) {
+    static const char padding[GRAPH_SNAPSHOT_ALIGNMENT] = {0};
+    uint64_t start = snapshotAlign(*offset);
+
+    if (fwrite(padding, 1, (size_t)(start - *offset), file) != (size_t)(start - *offset) ||
+        (bytes > 0 && fwrite(data, 1, bytes, file) != bytes)) {
+        return 0;
+    }
+
+    *sectionOffset = start;
+    *offset = start + bytes;
+    return 1;
+}
+
+// Offset in the snapshot pool of a string interned into texts
+static uint32_t snapshotTextOffset(const SymbolTable* names, SymbolTable* texts, const char* text) {
+    int id = symbolIntern(texts, text != NULL ? text : "");
+    return (uint32_t)(names->poolSize + texts->offsets[id]);
+}
+
+// Write csr and its city and edge records as a snapshot. names maps city
+// names to csr city ids; countries, lats and lons are indexed by city id;
+// transports, notes and distances by the route index in csr->edgeRoutes.
+// Returns 1 on success.
+int writeGraphSnapshot(const char* filename, const CSRGraph* csr, const SymbolTable* names,
+                       const char* const* countries, const float* lats, const float* lons,
+                       const char* const* transports, const char* const* notes, const float* distances,
+                       const SourceFileInfo* citiesSource, const SourceFileInfo* routesSource) {
+    if (filename == NULL || csr == NULL || names == NULL || names->count != csr->nodeCount) {
+        return 0;
+    }
+
+    int n = csr->nodeCount;
+    int m = csr->edgeCount;
+
+    // Countries, transports and notes are deduplicated into a pool that
+    // follows the city names, so name offsets stay as they are
+    SymbolTable* texts = createSymbolTable(64);
+    SnapshotCity* cities = (SnapshotCity*)malloc((n > 0 ? n : 1) * sizeof(SnapshotCity));
+    SnapshotEdgeText* edgeTexts = (SnapshotEdgeText*)malloc((m > 0 ? m : 1) * sizeof(SnapshotEdgeText));
+    float* edgeDistances = (float*)malloc((m > 0 ? m : 1) * sizeof(float));
+    if (texts == NULL || cities == NULL || edgeTexts == NULL || edgeDistances == NULL) {
+        freeSymbolTable(texts);
+        free(cities);
+        free(edgeTexts);
+        free(edgeDistances);
+        return 0;
+    }
+
+    for (int city = 0; city < n; city++) {
+        cities[city].name = (uint32_t)names->offsets[city];
+        cities[city].country = snapshotTextOffset(names, texts, countries[city]);
+        cities[city].lat = lats[city];
+        cities[city].lon = lons[city];
+    }
+    for (int edge = 0; edge < m; edge++) {
+        int route = csr->edgeRoutes[edge];
+        edgeTexts[edge].transport = snapshotTextOffset(names, texts, transports[route]);
+        edgeTexts[edge].note = snapshotTextOffset(names, texts, notes[route]);
+        edgeDistances[edge] = distances[route];
+    }
+
+    GraphSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GRAPH_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = GRAPH_SNAPSHOT_VERSION;
+    header.nodeCount = (uint32_t)n;
+    header.edgeCount = (uint32_t)m;
+    header.slotCapacity = (uint32_t)names->slotCapacity;
+    header.poolSize = (uint64_t)names->poolSize + (uint64_t)texts->poolSize;
+    if (citiesSource != NULL) {
+        header.cities = *citiesSource;
+    }
+    if (routesSource != NULL) {
+        header.routes = *routesSource;
+    }
+
+    // Write to a temporary name and rename, so processes that already map
+    // the old snapshot keep a consistent copy
+    size_t nameLength = strlen(filename) + 5;
+    char* temporary = (char*)malloc(nameLength);
+    FILE* file = NULL;
+    if (temporary != NULL) {
+        snprintf(temporary, nameLength, "%s.tmp", filename);
+        file = fopen(temporary, "wb");
+    }
+
+    int ok = file != NULL;
+    if (ok) {
+        // Sections first, then the finished header over the placeholder
+        uint64_t offset = sizeof(header);
+        ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             snapshotWriteSection(file, &offset, &header.cityOffset, cities, n * sizeof(SnapshotCity)) &&
+             snapshotWriteSection(file, &offset, &header.csrOffset, csr->offsets, (n + 1) * sizeof(int32_t)) &&
+             snapshotWriteSection(file, &offset, &header.targetOffset, csr->targets, m * sizeof(int32_t)) &&
+             snapshotWriteSection(file, &offset, &header.timeOffset, csr->times, m * sizeof(float)) &&
+             snapshotWriteSection(file, &offset, &header.costOffset, csr->costs, m * sizeof(float)) &&
+             snapshotWriteSection(file, &offset, &header.modeOffset, csr->modes, m * sizeof(unsigned char)) &&
+             snapshotWriteSection(file, &offset, &header.edgeRouteOffset, csr->edgeRoutes, m * sizeof(int32_t)) &&
+             snapshotWriteSection(file, &offset, &header.edgeTextOffset, edgeTexts, m * sizeof(SnapshotEdgeText)) &&
+             snapshotWriteSection(file, &offset, &header.distanceOffset, edgeDistances, m * sizeof(float)) &&
+             snapshotWriteSection(file, &offset, &header.slotOffset, names->slots, names->slotCapacity * sizeof(int32_t)) &&
+             snapshotWriteSection(file, &offset, &header.hashOffset, names->hashes, n * sizeof(uint32_t)) &&
+             snapshotWriteSection(file, &offset, &header.nameOffset, names->offsets, n * sizeof(int32_t)) &&
+             snapshotWriteSection(file, &offset, &header.poolOffset, names->pool, names->poolSize) &&
+             fwrite(texts->pool, 1, texts->poolSize, file) == (size_t)texts->poolSize;
+
+        header.fileSize = offset + texts->poolSize;
+        ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = fclose(file) == 0 && ok;
+        ok = ok && rename(temporary, filename) == 0;
+        if (!ok) {
+            remove(temporary);
+        }
+    }
+
+    free(temporary);
+    freeSymbolTable(texts);
+    free(cities);
+    free(edgeTexts);
+    free(edgeDistances);
+
+    return ok;
+}
+
+// 1 if a section of count elements of size bytes lies inside the file
+static int snapshotSectionFits(const GraphSnapshotHeader* header, uint64_t offset, uint64_t count, uint64_t size) {
+    return offset % 4 == 0 && offset <= header->fileSize && count * size <= header->fileSize - offset;
+}
+
+// Map a snapshot read-only. Returns NULL if it is missing or malformed.
+GraphSnapshot* openGraphSnapshot(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(GraphSnapshotHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    void* mapping = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+
+    const GraphSnapshotHeader* header = (const GraphSnapshotHeader*)mapping;
+    uint64_t n = header->nodeCount;
+    uint64_t m = header->edgeCount;
+    int valid = memcmp(header->magic, GRAPH_SNAPSHOT_MAGIC, sizeof(header->magic)) == 0 &&
+                header->version == GRAPH_SNAPSHOT_VERSION &&
+                header->fileSize == (uint64_t)status.st_size &&
+                n < 0x7fffffff && m < 0x7fffffff &&
+                header->slotCapacity >= 2 * n && (header->slotCapacity & (header->slotCapacity - 1)) == 0 &&
+                snapshotSectionFits(header, header->cityOffset, n, sizeof(SnapshotCity)) &&
+                snapshotSectionFits(header, header->csrOffset, n + 1, sizeof(int32_t)) &&
+                snapshotSectionFits(header, header->targetOffset, m, sizeof(int32_t)) &&
+                snapshotSectionFits(header, header->timeOffset, m, sizeof(float)) &&
+                snapshotSectionFits(header, header->costOffset, m, sizeof(float)) &&
+                snapshotSectionFits(header, header->modeOffset, m, sizeof(unsigned char)) &&
+                snapshotSectionFits(header, header->edgeRouteOffset, m, sizeof(int32_t)) &&
+                snapshotSectionFits(header, header->edgeTextOffset, m, sizeof(SnapshotEdgeText)) &&
+                snapshotSectionFits(header, header->distanceOffset, m, sizeof(float)) &&
+                snapshotSectionFits(header, header->slotOffset, header->slotCapacity, sizeof(int32_t)) &&
+                snapshotSectionFits(header, header->hashOffset, n, sizeof(uint32_t)) &&
+                snapshotSectionFits(header, header->nameOffset, n, sizeof(int32_t)) &&
+                snapshotSectionFits(header, header->poolOffset, header->poolSize, 1) &&
+                header->poolSize > 0 && ((const char*)mapping)[header->poolOffset + header->poolSize - 1] == '\0';
+
+    // The CSR bounds are all the search loop relies on
+    const int* offsets = (const int*)((const char*)mapping + header->csrOffset);
+    valid = valid && offsets[0] == 0 && (uint64_t)offsets[n] == m;
+
+    GraphSnapshot* snapshot = valid ? (GraphSnapshot*)malloc(sizeof(GraphSnapshot)) : NULL;
+    if (snapshot == NULL) {
+        munmap(mapping, (size_t)status.st_size);
+        return NULL;
+    }
+
+    const char* base = (const char*)mapping;
+    snapshot->mapping = mapping;
+    snapshot->mappingSize = (size_t)status.st_size;
+    snapshot->header = header;
+    snapshot->cities = (const SnapshotCity*)(base + header->cityOffset);
+    snapshot->edgeTexts = (const SnapshotEdgeText*)(base + header->edgeTextOffset);
+    snapshot->distances = (const float*)(base + header->distanceOffset);
+    snapshot->pool = base + header->poolOffset;
+
+    // Views over the mapping; the casts drop const only to fit the structs,
+    // nothing writes through them
+    snapshot->csr.nodeCount = (int)n;
+    snapshot->csr.edgeCount = (int)m;
+    snapshot->csr.offsets = (int*)(base + header->csrOffset);
+    snapshot->csr.targets = (int*)(base + header->targetOffset);
+    snapshot->csr.times = (float*)(base + header->timeOffset);
+    snapshot->csr.costs = (float*)(base + header->costOffset);
+    snapshot->csr.modes = (unsigned char*)(base + header->modeOffset);
+    snapshot->csr.edgeRoutes = (int*)(base + header->edgeRouteOffset);
+
+    snapshot->names.count = (int)n;
+    snapshot->names.slots = (int*)(base + header->slotOffset);
+    snapshot->names.slotCapacity = (int)header->slotCapacity;
+    snapshot->names.hashes = (unsigned int*)(base + header->hashOffset);
+    snapshot->names.offsets = (int*)(base + header->nameOffset);
+    snapshot->names.idCapacity = (int)n;
+    snapshot->names.pool = (char*)snapshot->pool;
+    snapshot->names.poolSize = (int)header->poolSize;
+    snapshot->names.poolCapacity = (int)header->poolSize;
+
+    return snapshot;
+}
+
+void closeGraphSnapshot(GraphSnapshot* snapshot) {
+    if (snapshot == NULL) {
+        return;
+    }
+
+    munmap(snapshot->mapping, snapshot->mappingSize);
+    free(snapshot);
+}
+
+const char* snapshotCityName(const GraphSnapshot* snapshot, int city) {
+    return snapshot->pool + snapshot->cities[city].name;
+}
+
+const char* snapshotCityCountry(const GraphSnapshot* snapshot, int city) {
+    return snapshot->pool + snapshot->cities[city].country;
+}
+
+const char* snapshotEdgeTransport(const GraphSnapshot* snapshot, int edge) {
+    return snapshot->pool + snapshot->edgeTexts[edge].transport;
+}
+
+const char* snapshotEdgeNote(const GraphSnapshot* snapshot, int edge) {
+    return snapshot->pool + snapshot->edgeTexts[edge].note;
+}
+
+float snapshotEdgeDistance(const GraphSnapshot* snapshot, int edge) {
+    return snapshot->distances[edge];
+}
+
+#endif // GRAPHSNAPSHOT_H
@@ -0,0 +1,196 @@
+#ifndef INDEXEDHEAP_H
+#define INDEXEDHEAP_H
+
+#include <stdlib.h>
+
+#include "Profiler.h"
+
+// Children per heap node. Four keeps a node's children in one cache line
+// and halves the depth of a binary heap.
+#define HEAP_ARITY 4
+
+// Indexed d-ary min-heap over ids 0..capacity-1
+//
+// Each id is in the heap at most once; positions[] tracks where, so a
+// better key for an id already queued is a decrease-key instead of a
+// duplicate entry.
+typedef struct IndexedHeap {
+    int size;
+    int capacity;
+
+    int* items;       // heap order, holds ids
+    double* keys;     // key of each id
+    int* positions;   // index of each id in items, -1 if not queued
+} IndexedHeap;
+
+// Function prototypes
+IndexedHeap* createIndexedHeap(int capacity);
+void freeIndexedHeap(IndexedHeap* heap);
+void heapClear(IndexedHeap* heap);
+int heapEmpty(const IndexedHeap* heap);
+int heapContains(const IndexedHeap* heap, int id);
+double heapKey(const IndexedHeap* heap, int id);
+double heapTopKey(const IndexedHeap* heap);
+int heapPushOrDecrease(IndexedHeap* heap, int id, double key);
+int heapPop(IndexedHeap* heap);
+
+// Implementation
+IndexedHeap* createIndexedHeap(int capacity) {
+    IndexedHeap* heap = (IndexedHeap*)malloc(sizeof(IndexedHeap));
+    if (heap == NULL) {
+        return NULL;
+    }
+
+    if (capacity < 1) {
+        capacity = 1;
+    }
+
+    heap->size = 0;
+    heap->capacity = capacity;
+    heap->items = (int*)malloc(capacity * sizeof(int));
+    heap->keys = (double*)malloc(capacity * sizeof(double));
+    heap->positions = (int*)malloc(capacity * sizeof(int));
+
+    if (heap->items == NULL || heap->keys == NULL || heap->positions == NULL) {
+        freeIndexedHeap(heap);
+        return NULL;
+    }
+
+    for (int i = 0; i < capacity; i++) {
+        heap->positions[i] = -1;
+    }
+    PROFILE_ALLOCATION(4, sizeof(IndexedHeap) + capacity * (2 * sizeof(int) + sizeof(double)));
+
+    return heap;
+}
+
+void freeIndexedHeap(IndexedHeap* heap) {
+    if (heap == NULL) {
+        return;
+    }
+
+    free(heap->items);
+    free(heap->keys);
+    free(heap->positions);
+    free(heap);
+}
+
+// Empty the heap in O(size), leaving it ready for the next query
+void heapClear(IndexedHeap* heap) {
+    for (int i = 0; i < heap->size; i++) {
+        heap->positions[heap->items[i]] = -1;
+    }
+    heap->size = 0;
+}
+
+int heapEmpty(const IndexedHeap* heap) {
+    return heap == NULL || heap->size == 0;
+}
+
+int heapContains(const IndexedHeap* heap, int id) {
+    return heap->positions[id] != -1;
+}
+
+double heapKey(const IndexedHeap* heap, int id) {
+    return heap->keys[id];
+}
+
+double heapTopKey(const IndexedHeap* heap) {
+    return heap->keys[heap->items[0]];
+}
+
+static void heapSiftUp(IndexedHeap* heap, int index) {
+    int id = heap->items[index];
+    double key = heap->keys[id];
+
+    while (index > 0) {
+        int parent = (index - 1) / HEAP_ARITY;
+        int parentId = heap->items[parent];
+        if (heap->keys[parentId] <= key) {
+            break;
+        }
+        heap->items[index] = parentId;
+        heap->positions[parentId] = index;
+        index = parent;
+    }
+
+    heap->items[index] = id;
+    heap->positions[id] = index;
+}
+
+static void heapSiftDown(IndexedHeap* heap, int index) {
+    int id = heap->items[index];
+    double key = heap->keys[id];
+
+    while (1) {
+        int first = index * HEAP_ARITY + 1;
+        if (first >= heap->size) {
+            break;
+        }
+
+        int last = first + HEAP_ARITY < heap->size ? first + HEAP_ARITY : heap->size;
+        int best = first;
+        for (int child = first + 1; child < last; child++) {
+            if (heap->keys[heap->items[child]] < heap->keys[heap->items[best]]) {
+                best = child;
+            }
+        }
+
+        int bestId = heap->items[best];
+        if (heap->keys[bestId] >= key) {
+            break;
+        }
+        heap->items[index] = bestId;
+        heap->positions[bestId] = index;
+        index = best;
+    }
+
+    heap->items[index] = id;
+    heap->positions[id] = index;
+}
+
+// Queue id with key, or lower its key if it is already queued with a
+// larger one. Returns 1 if the heap changed.
+int heapPushOrDecrease(IndexedHeap* heap, int id, double key) {
+    if (heap == NULL || id < 0 || id >= heap->capacity) {
+        return 0;
+    }
+
+    int position = heap->positions[id];
+    if (position != -1) {
+        if (key >= heap->keys[id]) {
+            return 0;
+        }
+        heap->keys[id] = key;
+        heapSiftUp(heap, position);
+        return 1;
+    }
+
+    heap->keys[id] = key;
+    heap->items[heap->size] = id;
+    heap->positions[id] = heap->size;
+    heap->size++;
+    heapSiftUp(heap, heap->size - 1);
+
+    return 1;
+}
+
+// Remove and return the id with the smallest key, or -1 if empty
+int heapPop(IndexedHeap* heap) {
+    if (heapEmpty(heap)) {
+        return -1;
+    }
+
+    int top = heap->items[0];
+    heap->positions[top] = -1;
+    heap->size--;
+
+    if (heap->size > 0) {
+        heap->items[0] = heap->items[heap->size];
+        heapSiftDown(heap, 0);
+    }
+
+    return top;
+}
+
+#endif // INDEXEDHEAP_H
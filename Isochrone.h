@@ -0,0 +1,113 @@
+#ifndef ISOCHRONE_H
+#define ISOCHRONE_H
+
+#include <stdlib.h>
+
+#include "CSRGraph.h"
+#include "SearchWorkspace.h"
+
+// Per-thread state for reachability queries
+//
+// The search runs in a SearchWorkspace and stops at the budget, so a query
+// costs the cities inside it rather than the size of the network. That
+// keeps repeated queries cheap enough to rerun as a slider moves.
+typedef struct IsochroneSearch {
+    SearchWorkspace* ws;  // dist is the best total of the searched metric
+    double* other;        // the other metric along that path, for the cities reached
+
+    int* reached;         // cities within the budget in the order settled, so by dist
+    int reachedCount;
+} IsochroneSearch;
+
+// Function prototypes
+IsochroneSearch* createIsochroneSearch(int capacity);
+void freeIsochroneSearch(IsochroneSearch* is);
+int reachableWithin(const CSRGraph* csr, IsochroneSearch* is, int origin, int costOrTime, double budget);
+
+// Implementation
+IsochroneSearch* createIsochroneSearch(int capacity) {
+    IsochroneSearch* is = (IsochroneSearch*)malloc(sizeof(IsochroneSearch));
+    if (is == NULL) {
+        return NULL;
+    }
+
+    if (capacity < 1) {
+        capacity = 1;
+    }
+
+    is->ws = createSearchWorkspace(capacity);
+    is->other = (double*)malloc(capacity * sizeof(double));
+    is->reached = (int*)malloc(capacity * sizeof(int));
+    is->reachedCount = 0;
+
+    if (is->ws == NULL || is->other == NULL || is->reached == NULL) {
+        freeIsochroneSearch(is);
+        return NULL;
+    }
+
+    return is;
+}
+
+void freeIsochroneSearch(IsochroneSearch* is) {
+    if (is == NULL) {
+        return;
+    }
+
+    freeSearchWorkspace(is->ws);
+    free(is->other);
+    free(is->reached);
+    free(is);
+}
+
+// Every city origin reaches within budget hours or dollars (costOrTime:
+// 1 = cost, 0 = time), origin first. A Dijkstra that never queues a city
+// past the budget, so it ends with the last city inside it. Fills
+// is->reached; each city's best total is is->ws->dist[city], and
+// is->other holds the other metric along the same path.
+//
+// Returns the number of cities reached, or -1 on bad arguments.
+int reachableWithin(const CSRGraph* csr, IsochroneSearch* is, int origin, int costOrTime, double budget) {
+    if (csr == NULL || is == NULL || csr->nodeCount > is->ws->capacity || origin < 0 || origin >= csr->nodeCount ||
+        budget < 0) {
+        return -1;
+    }
+
+    SearchWorkspace* ws = is->ws;
+    const float* weights = csrWeights(csr, costOrTime);
+    const float* otherWeights = csrWeights(csr, !costOrTime);
+    workspaceReset(ws);
+    is->reachedCount = 0;
+
+    workspaceTouch(ws, origin);
+    ws->dist[origin] = 0;
+    is->other[origin] = 0;
+    heapPushOrDecrease(ws->heap, origin, 0);
+
+    while (!heapEmpty(ws->heap)) {
+        int u = heapPop(ws->heap);
+        ws->settled[u] = 1;
+        ws->settledCount++;
+        is->reached[is->reachedCount++] = u;
+
+        for (int e = csr->offsets[u]; e < csr->offsets[u + 1]; e++) {
+            int v = csr->targets[e];
+            double length = ws->dist[u] + weights[e];
+            if (length > budget) {
+                continue;
+            }
+
+            workspaceTouch(ws, v);
+            if (!ws->settled[v] && length < ws->dist[v]) {
+                ws->dist[v] = length;
+                ws->parent[v] = u;
+                ws->parentEdge[v] = e;
+                is->other[v] = is->other[u] + otherWeights[e];
+                heapPushOrDecrease(ws->heap, v, length);
+            }
+        }
+    }
+
+    return is->reachedCount;
+}
+
+#endif // ISOCHRONE_H
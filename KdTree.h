@@ -0,0 +1,251 @@
+#ifndef KDTREE_H
+#define KDTREE_H
+
+#include <stdlib.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Static k-d tree over city coordinates for nearest-neighbour queries
+//
+// Cities are placed on the unit sphere, so straight-line (chord) distance
+// orders them exactly as great-circle distance does and the date line
+// needs no special case. The tree is implicit: the cities of a subtree
+// over positions [lo, hi) sit in order[lo, hi) with the splitting city at
+// the middle, split on axis[middle].
+typedef struct KdTree {
+    int count;
+    double* points;        // [3 * city] x, y, z on the unit sphere
+    int* order;            // city at each tree position
+    unsigned char* axis;   // splitting axis at each tree position
+} KdTree;
+
+// Function prototypes
+KdTree* createKdTree(const double* latitudes, const double* longitudes, int count);
+void freeKdTree(KdTree* tree);
+void kdTreePoint(double latitude, double longitude, double* point);
+int kdTreeNearest(const KdTree* tree, const double* point, int exclude, int k, int* nearest, double* chords);
+
+// Implementation
+void kdTreePoint(double latitude, double longitude, double* point) {
+    double lat = latitude * M_PI / 180.0;
+    double lon = longitude * M_PI / 180.0;
+    point[0] = cos(lat) * cos(lon);
+    point[1] = cos(lat) * sin(lon);
+    point[2] = sin(lat);
+}
+
+// Reorder order[lo, hi) so the city at position middle has the coordinate
+// it would have sorted on axis, with none larger before it and none
+// smaller after
+static void kdTreeSelect(KdTree* tree, int lo, int hi, int middle, int axis) {
+    const double* points = tree->points;
+    int* order = tree->order;
+    hi--;
+
+    while (lo < hi) {
+        // Median of three keeps sorted or clustered input from going quadratic
+        int mid = lo + (hi - lo) / 2;
+        double a = points[3 * order[lo] + axis];
+        double b = points[3 * order[mid] + axis];
+        double c = points[3 * order[hi] + axis];
+        double pivot = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+
+        int i = lo;
+        int j = hi;
+        while (i <= j) {
+            while (points[3 * order[i] + axis] < pivot) {
+                i++;
+            }
+            while (points[3 * order[j] + axis] > pivot) {
+                j--;
+            }
+            if (i <= j) {
+                int swap = order[i];
+                order[i] = order[j];
+                order[j] = swap;
+                i++;
+                j--;
+            }
+        }
+
+        if (middle <= j) {
+            hi = j;
+        } else if (middle >= i) {
+            lo = i;
+        } else {
+            return;
+        }
+    }
+}
+
+// Split positions [lo, hi) on their widest axis and recurse into both halves
+static void kdTreeBuild(KdTree* tree, int lo, int hi) {
+    while (hi - lo > 1) {
+        double low[3] = {2, 2, 2};
+        double high[3] = {-2, -2, -2};
+        for (int i = lo; i < hi; i++) {
+            const double* point = tree->points + 3 * tree->order[i];
+            for (int d = 0; d < 3; d++) {
+                low[d] = point[d] < low[d] ? point[d] : low[d];
+                high[d] = point[d] > high[d] ? point[d] : high[d];
+            }
+        }
+
+        int axis = 0;
+        for (int d = 1; d < 3; d++) {
+            if (high[d] - low[d] > high[axis] - low[axis]) {
+                axis = d;
+            }
+        }
+
+        int middle = lo + (hi - lo) / 2;
+        kdTreeSelect(tree, lo, hi, middle, axis);
+        tree->axis[middle] = (unsigned char)axis;
+
+        // Recurse into the smaller half and loop on the larger
+        if (middle - lo < hi - middle - 1) {
+            kdTreeBuild(tree, lo, middle);
+            lo = middle + 1;
+        } else {
+            kdTreeBuild(tree, middle + 1, hi);
+            hi = middle;
+        }
+    }
+    if (hi - lo == 1) {
+        tree->axis[lo] = 0;
+    }
+}
+
+// Build a tree over count cities given in degrees; city i is index i
+KdTree* createKdTree(const double* latitudes, const double* longitudes, int count) {
+    KdTree* tree = (KdTree*)malloc(sizeof(KdTree));
+    if (tree == NULL) {
+        return NULL;
+    }
+
+    if (count < 0) {
+        count = 0;
+    }
+
+    tree->count = count;
+    tree->points = (double*)malloc((3 * count + 1) * sizeof(double));
+    tree->order = (int*)malloc((count + 1) * sizeof(int));
+    tree->axis = (unsigned char*)malloc(count + 1);
+    if (tree->points == NULL || tree->order == NULL || tree->axis == NULL) {
+        freeKdTree(tree);
+        return NULL;
+    }
+
+    for (int i = 0; i < count; i++) {
+        kdTreePoint(latitudes[i], longitudes[i], tree->points + 3 * i);
+        tree->order[i] = i;
+    }
+    kdTreeBuild(tree, 0, count);
+
+    return tree;
+}
+
+void freeKdTree(KdTree* tree) {
+    if (tree == NULL) {
+        return;
+    }
+
+    free(tree->points);
+    free(tree->order);
+    free(tree->axis);
+    free(tree);
+}
+
+// Nearest-first list of at most k cities and their squared chords
+typedef struct KdTreeBest {
+    int* cities;
+    double* chords;
+    int count;
+    int k;
+} KdTreeBest;
+
+static void kdTreeOffer(KdTreeBest* best, int city, double chord) {
+    if (best->count == best->k) {
+        // Ties go to the lower id, so results do not depend on the tree shape
+        int last = best->count - 1;
+        if (chord > best->chords[last] || (chord == best->chords[last] && city > best->cities[last])) {
+            return;
+        }
+        best->count--;
+    }
+
+    int i = best->count++;
+    while (i > 0 && (best->chords[i - 1] > chord || (best->chords[i - 1] == chord && best->cities[i - 1] > city))) {
+        best->cities[i] = best->cities[i - 1];
+        best->chords[i] = best->chords[i - 1];
+        i--;
+    }
+    best->cities[i] = city;
+    best->chords[i] = chord;
+}
+
+static void kdTreeSearch(const KdTree* tree, int lo, int hi, const double* point, int exclude, KdTreeBest* best) {
+    if (lo >= hi) {
+        return;
+    }
+
+    int middle = lo + (hi - lo) / 2;
+    int city = tree->order[middle];
+    const double* at = tree->points + 3 * city;
+    if (city != exclude) {
+        double dx = at[0] - point[0];
+        double dy = at[1] - point[1];
+        double dz = at[2] - point[2];
+        kdTreeOffer(best, city, dx * dx + dy * dy + dz * dz);
+    }
+
+    int axis = tree->axis[middle];
+    double offset = point[axis] - at[axis];
+    int nearLo = offset < 0 ? lo : middle + 1;
+    int nearHi = offset < 0 ? middle : hi;
+    kdTreeSearch(tree, nearLo, nearHi, point, exclude, best);
+
+    // The far half can only hold a closer city if the splitting plane is
+    // closer than the kth best so far
+    if (best->count < best->k || offset * offset <= best->chords[best->count - 1]) {
+        kdTreeSearch(tree, offset < 0 ? middle + 1 : lo, offset < 0 ? hi : middle, point, exclude, best);
+    }
+}
+
+// The k cities nearest a point from kdTreePoint, nearest first, skipping
+// city exclude (-1 for none). Fills nearest and, if given, chords with
+// their squared straight-line distances on the unit sphere. Safe to call
+// from several threads at once.
+//
+// Returns the number found, fewer than k only if the tree holds fewer.
+int kdTreeNearest(const KdTree* tree, const double* point, int exclude, int k, int* nearest, double* chords) {
+    if (tree == NULL || k <= 0) {
+        return 0;
+    }
+
+    double local[64];
+    double* space = chords;
+    if (space == NULL) {
+        space = k <= 64 ? local : (double*)malloc(k * sizeof(double));
+        if (space == NULL) {
+            return 0;
+        }
+    }
+
+    KdTreeBest best;
+    best.cities = nearest;
+    best.chords = space;
+    best.count = 0;
+    best.k = k;
+    kdTreeSearch(tree, 0, tree->count, point, exclude, &best);
+
+    if (space != chords && space != local) {
+        free(space);
+    }
+    return best.count;
+}
+
+#endif // KDTREE_H
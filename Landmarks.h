@@ -0,0 +1,485 @@
+#ifndef LANDMARKS_H
+#define LANDMARKS_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "CSRGraph.h"
+#include "SearchWorkspace.h"
+#include "SourceFile.h"
+
+#define LANDMARK_MAGIC "TRVLLMRK"
+#define LANDMARK_VERSION 1
+
+// Metrics landmarks are chosen for, indexed like costOrTime
+#define LANDMARK_METRICS 2
+
+#define LANDMARK_DEFAULT_COUNT 16
+
+// Distance to or from a landmark that has no path
+#define LANDMARK_UNREACHED 1e30f
+
+// Ways of choosing landmarks
+#define LANDMARK_SELECT_FARTHEST 0   // each one farthest from those already chosen
+#define LANDMARK_SELECT_AVOID 1      // leaf of the shortest-path tree region the bound covers worst
+
+// ALT (A*, landmarks, triangle inequality) lower bounds
+//
+// For each metric, a handful of landmark cities with the distance from
+// every city to each landmark and from each landmark to every city. By the
+// triangle inequality d(v, t) >= d(v, L) - d(t, L) and d(v, t) >= d(L, t) -
+// d(L, v), which bounds the remaining cost in the search's own units.
+// Distances are stored city-major, so the bound for one city reads two
+// contiguous runs of count floats per direction.
+typedef struct Landmarks {
+    int count;             // landmarks per metric
+    int nodeCount;
+
+    int* cities;           // [metric][landmark]
+    float* fromLandmark;   // [metric][city][landmark]: d(landmark, city)
+    float* toLandmark;     // [metric][city][landmark]: d(city, landmark)
+} Landmarks;
+
+// On-disk header, followed by cities, fromLandmark and toLandmark as laid
+// out in memory
+typedef struct LandmarkFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t edgeCount;
+    uint32_t count;
+    SourceFileInfo cities;
+    SourceFileInfo routes;
+} LandmarkFileHeader;
+
+// Function prototypes
+Landmarks* createLandmarks(const CSRGraph* csr, int count, int strategy);
+void freeLandmarks(Landmarks* landmarks);
+double landmarkBound(const Landmarks* landmarks, int costOrTime, int city, int goal);
+int landmarkShortestPath(const CSRGraph* csr, SearchWorkspace* ws, const Landmarks* landmarks, int origin, int destination, int costOrTime);
+int saveLandmarks(const Landmarks* landmarks, const CSRGraph* csr, const SourceFileInfo* cities, const SourceFileInfo* routes, const char* filename);
+Landmarks* loadLandmarks(const char* filename, const CSRGraph* csr, const SourceFileInfo* cities, const SourceFileInfo* routes);
+
+// Implementation
+
+static Landmarks* allocateLandmarks(int nodeCount, int count) {
+    Landmarks* landmarks = (Landmarks*)malloc(sizeof(Landmarks));
+    if (landmarks == NULL) {
+        return NULL;
+    }
+
+    size_t cells = (size_t)LANDMARK_METRICS * nodeCount * count;
+    landmarks->count = count;
+    landmarks->nodeCount = nodeCount;
+    landmarks->cities = (int*)malloc((LANDMARK_METRICS * count > 0 ? LANDMARK_METRICS * count : 1) * sizeof(int));
+    landmarks->fromLandmark = (float*)malloc((cells > 0 ? cells : 1) * sizeof(float));
+    landmarks->toLandmark = (float*)malloc((cells > 0 ? cells : 1) * sizeof(float));
+
+    if (landmarks->cities == NULL || landmarks->fromLandmark == NULL || landmarks->toLandmark == NULL) {
+        freeLandmarks(landmarks);
+        return NULL;
+    }
+
+    return landmarks;
+}
+
+// Bound over the first used landmarks only, for selection while the rest
+// are still unknown
+static double landmarkPartialBound(const Landmarks* landmarks, int costOrTime, int used, int city, int goal) {
+    size_t base = (size_t)costOrTime * landmarks->nodeCount * landmarks->count;
+    const float* fromCity = landmarks->fromLandmark + base + (size_t)city * landmarks->count;
+    const float* fromGoal = landmarks->fromLandmark + base + (size_t)goal * landmarks->count;
+    const float* toCity = landmarks->toLandmark + base + (size_t)city * landmarks->count;
+    const float* toGoal = landmarks->toLandmark + base + (size_t)goal * landmarks->count;
+
+    double bound = 0.0;
+    for (int l = 0; l < used; l++) {
+        // goal reaches the landmark, so any path from city to goal does too
+        if (toGoal[l] < LANDMARK_UNREACHED) {
+            if (toCity[l] >= LANDMARK_UNREACHED) {
+                return LANDMARK_UNREACHED;
+            }
+            if (toCity[l] - toGoal[l] > bound) {
+                bound = toCity[l] - toGoal[l];
+            }
+        }
+
+        // the landmark reaches city, so it would reach goal through it
+        if (fromCity[l] < LANDMARK_UNREACHED) {
+            if (fromGoal[l] >= LANDMARK_UNREACHED) {
+                return LANDMARK_UNREACHED;
+            }
+            if (fromGoal[l] - fromCity[l] > bound) {
+                bound = fromGoal[l] - fromCity[l];
+            }
+        }
+    }
+
+    return bound;
+}
+
+// Lower bound on the distance from city to goal (costOrTime: 1 = cost,
+// 0 = time). LANDMARK_UNREACHED means city cannot reach goal at all.
+double landmarkBound(const Landmarks* landmarks, int costOrTime, int city, int goal) {
+    return landmarkPartialBound(landmarks, costOrTime, landmarks->count, city, goal);
+}
+
+// A* from origin to destination guided by landmarkBound, leaving the same
+// dist, parent and parentEdge in ws as shortestPath would for the cities it
+// settles, and counting into ws->counters the same way. The bound is
+// consistent, so a city is final when popped, as in Dijkstra. Returns 1 if
+// destination was reached.
+int landmarkShortestPath(const CSRGraph* csr, SearchWorkspace* ws, const Landmarks* landmarks, int origin, int destination, int costOrTime) {
+    if (csr == NULL || ws == NULL || landmarks == NULL || csr->nodeCount > ws->capacity || landmarks->nodeCount != csr->nodeCount ||
+        origin < 0 || origin >= csr->nodeCount || destination < 0 || destination >= csr->nodeCount) {
+        return 0;
+    }
+
+    workspaceReset(ws);
+
+    double bound = landmarkBound(landmarks, costOrTime, origin, destination);
+    if (bound >= LANDMARK_UNREACHED) {
+        return 0;
+    }
+
+    const float* weights = csrWeights(csr, costOrTime);
+    workspaceTouch(ws, origin);
+    ws->dist[origin] = 0;
+    heapPushOrDecrease(ws->heap, origin, bound);
+    SEARCH_COUNT_PUSHED(ws->counters, ws->heap);
+
+    while (!heapEmpty(ws->heap)) {
+        int u = heapPop(ws->heap);
+        ws->settled[u] = 1;
+        ws->settledCount++;
+        SEARCH_COUNT_SETTLED(ws->counters, u);
+
+        if (u == destination) {
+            return 1;
+        }
+
+        for (int e = csr->offsets[u]; e < csr->offsets[u + 1]; e++) {
+            int v = csr->targets[e];
+            workspaceTouch(ws, v);
+            double length = ws->dist[u] + weights[e];
+            SEARCH_COUNT_RELAXED(ws->counters);
+            if (!ws->settled[v] && length < ws->dist[v]) {
+                // Cities the landmarks prove cannot reach destination are never queued
+                bound = landmarkBound(landmarks, costOrTime, v, destination);
+                if (bound >= LANDMARK_UNREACHED) {
+                    continue;
+                }
+                ws->dist[v] = length;
+                ws->parent[v] = u;
+                ws->parentEdge[v] = e;
+                heapPushOrDecrease(ws->heap, v, length + bound);
+                SEARCH_COUNT_PUSHED(ws->counters, ws->heap);
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Record the distances of a search from (or, on the reverse graph, to)
+// landmark slot l
+static void landmarkStoreColumn(const Landmarks* landmarks, const SearchWorkspace* ws, float* column, int l) {
+    for (int city = 0; city < landmarks->nodeCount; city++) {
+        column[(size_t)city * landmarks->count + l] = ws->dist[city] < WORKSPACE_UNREACHED ? (float)ws->dist[city] : LANDMARK_UNREACHED;
+    }
+}
+
+// City farthest from the landmarks chosen so far, among the cities they
+// reach. Only once they reach everything else does a city in another
+// component get one; spending landmarks on small islands early would
+// leave the main network poorly bounded.
+static int landmarkSelectFarthest(const Landmarks* landmarks, const float* from, const int* chosen, int used, const SearchWorkspace* ws) {
+    int best = -1;
+    double bestDistance = -1.0;
+    int unreached = -1;
+
+    for (int city = 0; city < landmarks->nodeCount; city++) {
+        double nearest;
+        if (used == 0) {
+            // First landmark: farthest from the random root searched in ws
+            nearest = ws->dist[city] < WORKSPACE_UNREACHED ? ws->dist[city] : LANDMARK_UNREACHED;
+        } else {
+            nearest = LANDMARK_UNREACHED;
+            for (int l = 0; l < used; l++) {
+                if (chosen[l] == city) {
+                    nearest = -1.0;
+                    break;
+                }
+                double distance = from[(size_t)city * landmarks->count + l];
+                if (distance < nearest) {
+                    nearest = distance;
+                }
+            }
+        }
+
+        if (nearest >= LANDMARK_UNREACHED) {
+            if (unreached == -1) {
+                unreached = city;
+            }
+        } else if (nearest > bestDistance) {
+            bestDistance = nearest;
+            best = city;
+        }
+    }
+
+    return best != -1 && bestDistance > 0.0 ? best : (unreached != -1 ? unreached : best);
+}
+
+// Avoid selection: in the shortest-path tree from root, weigh each city by
+// how far the current bound falls short of its true distance, sum the
+// weights over each subtree holding no landmark, and walk from root into
+// the heaviest subtree down to a leaf. Returns -1 if every subtree already
+// holds a landmark.
+static int landmarkSelectAvoid(const Landmarks* landmarks, int costOrTime, int used, const int* chosen, int root,
+                               const SearchWorkspace* ws, double* size, int* childOffsets, int* children, int* order) {
+    int n = landmarks->nodeCount;
+
+    // Children of each city in the tree, grouped like a CSR
+    memset(childOffsets, 0, (n + 1) * sizeof(int));
+    for (int city = 0; city < n; city++) {
+        if (ws->parent[city] != -1) {
+            childOffsets[ws->parent[city] + 1]++;
+        }
+    }
+    for (int city = 0; city < n; city++) {
+        childOffsets[city + 1] += childOffsets[city];
+    }
+    for (int city = 0; city < n; city++) {
+        if (ws->parent[city] != -1) {
+            children[--childOffsets[ws->parent[city] + 1]] = city;
+        }
+    }
+    // childOffsets[v + 1] counted down to the start of v's children
+    int treeEdges = childOffsets[n];
+    for (int city = 0; city < n; city++) {
+        childOffsets[city] = childOffsets[city + 1];
+    }
+    childOffsets[n] = treeEdges;
+
+    // Breadth-first order from root; sizes are summed in reverse
+    int count = 0;
+    order[count++] = root;
+    for (int i = 0; i < count; i++) {
+        int city = order[i];
+        for (int c = childOffsets[city]; c < childOffsets[city + 1]; c++) {
+            order[count++] = children[c];
+        }
+    }
+
+    for (int i = count - 1; i >= 0; i--) {
+        int city = order[i];
+        double weight = ws->dist[city] - landmarkPartialBound(landmarks, costOrTime, used, root, city);
+        size[city] = weight > 0.0 ? weight : 0.0;
+
+        int holdsLandmark = 0;
+        for (int l = 0; l < used; l++) {
+            holdsLandmark = holdsLandmark || chosen[l] == city;
+        }
+        for (int c = childOffsets[city]; c < childOffsets[city + 1]; c++) {
+            if (size[children[c]] < 0.0) {
+                holdsLandmark = 1;
+            }
+            size[city] += size[children[c]] > 0.0 ? size[children[c]] : 0.0;
+        }
+
+        // A negative size marks a subtree that already holds a landmark
+        if (holdsLandmark) {
+            size[city] = -1.0;
+        }
+    }
+
+    int city = root;
+    while (1) {
+        int heaviest = -1;
+        for (int c = childOffsets[city]; c < childOffsets[city + 1]; c++) {
+            if (size[children[c]] > 0.0 && (heaviest == -1 || size[children[c]] > size[heaviest])) {
+                heaviest = children[c];
+            }
+        }
+        if (heaviest == -1) {
+            break;
+        }
+        city = heaviest;
+    }
+
+    return city != root ? city : -1;
+}
+
+// Choose count landmarks per metric with the given strategy and search
+// from and to each of them. Returns NULL if memory runs out.
+Landmarks* createLandmarks(const CSRGraph* csr, int count, int strategy) {
+    if (csr == NULL || csr->nodeCount < 1) {
+        return NULL;
+    }
+    if (count > csr->nodeCount) {
+        count = csr->nodeCount;
+    }
+    if (count < 1) {
+        count = 1;
+    }
+
+    int n = csr->nodeCount;
+    Landmarks* landmarks = allocateLandmarks(n, count);
+    CSRGraph* reverse = createReverseCSRGraph(csr);
+    SearchWorkspace* ws = createSearchWorkspace(n);
+    double* size = (double*)malloc(n * sizeof(double));
+    int* childOffsets = (int*)malloc((n + 1) * sizeof(int));
+    int* children = (int*)malloc(n * sizeof(int));
+    int* order = (int*)malloc(n * sizeof(int));
+
+    int ok = landmarks != NULL && reverse != NULL && ws != NULL && size != NULL &&
+             childOffsets != NULL && children != NULL && order != NULL;
+
+    // Fixed seed, so the same graph always gets the same landmarks
+    unsigned int seed = 2166136261u;
+
+    for (int costOrTime = 0; ok && costOrTime < LANDMARK_METRICS; costOrTime++) {
+        int* chosen = landmarks->cities + costOrTime * count;
+        size_t base = (size_t)costOrTime * n * count;
+        float* from = landmarks->fromLandmark + base;
+        float* to = landmarks->toLandmark + base;
+
+        for (int l = 0; l < count; l++) {
+            int landmark = -1;
+
+            if (strategy == LANDMARK_SELECT_AVOID) {
+                // A root whose whole tree is covered gets a few retries
+                for (int attempt = 0; landmark == -1 && attempt < 8; attempt++) {
+                    seed = seed * 1103515245u + 12345u;
+                    int root = (int)((seed >> 8) % (unsigned int)n);
+                    shortestPath(csr, ws, root, -1, costOrTime);
+                    landmark = landmarkSelectAvoid(landmarks, costOrTime, l, chosen, root, ws, size, childOffsets, children, order);
+                }
+            }
+
+            if (landmark == -1) {
+                if (l == 0) {
+                    seed = seed * 1103515245u + 12345u;
+                    shortestPath(csr, ws, (int)((seed >> 8) % (unsigned int)n), -1, costOrTime);
+                }
+                landmark = landmarkSelectFarthest(landmarks, from, chosen, l, ws);
+            }
+
+            chosen[l] = landmark;
+            shortestPath(csr, ws, landmark, -1, costOrTime);
+            landmarkStoreColumn(landmarks, ws, from, l);
+            shortestPath(reverse, ws, landmark, -1, costOrTime);
+            landmarkStoreColumn(landmarks, ws, to, l);
+        }
+    }
+
+    freeCSRGraph(reverse);
+    freeSearchWorkspace(ws);
+    free(size);
+    free(childOffsets);
+    free(children);
+    free(order);
+
+    if (!ok) {
+        freeLandmarks(landmarks);
+        return NULL;
+    }
+    return landmarks;
+}
+
+void freeLandmarks(Landmarks* landmarks) {
+    if (landmarks == NULL) {
+        return;
+    }
+
+    free(landmarks->cities);
+    free(landmarks->fromLandmark);
+    free(landmarks->toLandmark);
+    free(landmarks);
+}
+
+// Write landmarks to filename, recording the inputs they were built from.
+// Returns 1 on success.
+int saveLandmarks(const Landmarks* landmarks, const CSRGraph* csr, const SourceFileInfo* cities, const SourceFileInfo* routes, const char* filename) {
+    if (landmarks == NULL || csr == NULL || cities == NULL || routes == NULL) {
+        return 0;
+    }
+
+    LandmarkFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LANDMARK_MAGIC, sizeof(header.magic));
+    header.version = LANDMARK_VERSION;
+    header.nodeCount = (uint32_t)landmarks->nodeCount;
+    header.edgeCount = (uint32_t)csr->edgeCount;
+    header.count = (uint32_t)landmarks->count;
+    header.cities = *cities;
+    header.routes = *routes;
+
+    size_t ids = (size_t)LANDMARK_METRICS * landmarks->count;
+    size_t cells = ids * landmarks->nodeCount;
+
+    size_t nameLength = strlen(filename) + 5;
+    char* temporary = (char*)malloc(nameLength);
+    if (temporary == NULL) {
+        return 0;
+    }
+    snprintf(temporary, nameLength, "%s.tmp", filename);
+
+    FILE* file = fopen(temporary, "wb");
+    int ok = file != NULL;
+    if (ok) {
+        ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(landmarks->cities, sizeof(int), ids, file) == ids &&
+             fwrite(landmarks->fromLandmark, sizeof(float), cells, file) == cells &&
+             fwrite(landmarks->toLandmark, sizeof(float), cells, file) == cells;
+        ok = fclose(file) == 0 && ok;
+        ok = ok && rename(temporary, filename) == 0;
+        if (!ok) {
+            remove(temporary);
+        }
+    }
+
+    free(temporary);
+    return ok;
+}
+
+// Landmarks saved by saveLandmarks for this graph and these inputs, or
+// NULL if the file is missing, malformed or was built from something else
+Landmarks* loadLandmarks(const char* filename, const CSRGraph* csr, const SourceFileInfo* cities, const SourceFileInfo* routes) {
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    LandmarkFileHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, LANDMARK_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != LANDMARK_VERSION ||
+        header.nodeCount != (uint32_t)csr->nodeCount ||
+        header.edgeCount != (uint32_t)csr->edgeCount ||
+        header.count < 1 || header.count > header.nodeCount ||
+        !sourceFileSame(&header.cities, cities) ||
+        !sourceFileSame(&header.routes, routes)) {
+        fclose(file);
+        return NULL;
+    }
+
+    Landmarks* landmarks = allocateLandmarks((int)header.nodeCount, (int)header.count);
+    size_t ids = (size_t)LANDMARK_METRICS * header.count;
+    size_t cells = ids * header.nodeCount;
+    if (landmarks == NULL ||
+        fread(landmarks->cities, sizeof(int), ids, file) != ids ||
+        fread(landmarks->fromLandmark, sizeof(float), cells, file) != cells ||
+        fread(landmarks->toLandmark, sizeof(float), cells, file) != cells) {
+        freeLandmarks(landmarks);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+    return landmarks;
+}
+
+#endif // LANDMARKS_H
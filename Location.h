@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "Profiler.h"
+
 // Forward declaration
 struct Route;
 typedef struct Route Route;
@@ -15,13 +17,8 @@ typedef struct Location {
 	float lat;
 	float lon;
 
-	Route** routes;
-	int routeCount;
-	int routeCapacity;
-
-	int exists;
-	struct Location* previous;
-	float lengthFromStart;
+	// Dense id used by the CSR graph (-1 until added to a graph)
+	int id;
 } Location;
 
 // Function prototypes
@@ -29,12 +26,7 @@ Location* createLocation();
 void freeLocation(Location* loc);
 Location* createLocationWithData(const char* count, const char* cap);
 Location* createLocationWithCoords(const char* count, const char* cap, float lt, float lg);
-float getLocationWeight(Location* loc, Location* start, Location* end);
 int compareLocations(const Location* l1, const Location* l2);
-int locationLessThan(const Location* l1, const Location* l2);
-int locationGreaterThan(const Location* l1, const Location* l2);
-int locationCompare(Location* l1, Location* l2);
-void addRouteToLocation(Location* loc, Route* route);
 
 // Implementation
 Location* createLocation() {
@@ -42,21 +34,13 @@ Location* createLocation() {
 	if (loc == NULL) {
 		return NULL;
 	}
+	PROFILE_ALLOCATION(1, sizeof(Location));
 	
 	loc->country[0] = '\0';
 	loc->capital[0] = '\0';
 	loc->lat = 0;
 	loc->lon = 0;
-
-	// Used as a highest value possible for comparison purposes
-	loc->lengthFromStart = 999999;
-
-	loc->exists = 1;
-	loc->previous = NULL;
-	
-	loc->routes = NULL;
-	loc->routeCount = 0;
-	loc->routeCapacity = 0;
+	loc->id = -1;
 	
 	return loc;
 }
@@ -66,8 +50,7 @@ void freeLocation(Location* loc) {
 		return;
 	}
 	
-	// Don't free the routes here, they should be freed by the graph
-	free(loc->routes);
+	// Routes are owned by the graph
 	free(loc);
 }
 
@@ -102,35 +85,4 @@ int compareLocations(const Location* l1, const Location* l2) {
 	return strcmp(l1->capital, l2->capital);
 }
 
-int locationLessThan(const Location* l1, const Location* l2) {
-	return l1->lengthFromStart < l2->lengthFromStart;
-}
-
-int locationGreaterThan(const Location* l1, const Location* l2) {
-	return l1->lengthFromStart > l2->lengthFromStart;
-}
-
-int locationCompare(Location* l1, Location* l2) {
-	return l1->lengthFromStart < l2->lengthFromStart;
-}
-
-void addRouteToLocation(Location* loc, Route* route) {
-	if (loc == NULL || route == NULL) {
-		return;
-	}
-	
-	// Resize array if needed
-	if (loc->routeCount >= loc->routeCapacity) {
-		int newCapacity = loc->routeCapacity == 0 ? 4 : loc->routeCapacity * 2;
-		Route** newRoutes = (Route**)realloc(loc->routes, newCapacity * sizeof(Route*));
-		if (newRoutes == NULL) {
-			return;
-		}
-		loc->routes = newRoutes;
-		loc->routeCapacity = newCapacity;
-	}
-	
-	loc->routes[loc->routeCount++] = route;
-}
-
 #endif // LOCATION_H
@@ -1,12 +1,295 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "FileOperations.h"
 #include "Route.h"
 #include "GraphFunctions.h"
+#include "BatchQueries.h"
+#include "DistanceTable.h"
+#include "ContractionHierarchy.h"
+#include "DistanceMatrix.h"
 
-int main(int argc, char* argv[]) {
+// Batch mode: answer every origin,destination,preference line of a query
+// file (or stdin for "-") against one loaded graph, writing one JSON line
+// per query to the output file (or stdout for "-")
+int runBatch(int argc, char* argv[]) {
+    if (argc < 4) {
+        printf("Usage: %s --batch <cities_file> <routes_file> [queries_file|-] [output_file|-] [threads]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* input = stdin;
+    if (argc > 4 && strcmp(argv[4], "-") != 0) {
+        input = fopen(argv[4], "r");
+        if (input == NULL) {
+            printf("Could not open query file %s\n", argv[4]);
+            return 1;
+        }
+    }
+
+    FILE* output = stdout;
+    if (argc > 5 && strcmp(argv[5], "-") != 0) {
+        output = fopen(argv[5], "w");
+        if (output == NULL) {
+            printf("Could not open output file %s\n", argv[5]);
+            if (input != stdin) {
+                fclose(input);
+            }
+            return 1;
+        }
+    }
+
+    int threads = argc > 6 ? atoi(argv[6]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    Graph* graph = createGraph(argv[2], argv[3]);
+    if (graph == NULL) {
+        printf("Failed to create graph\n");
+        if (input != stdin) {
+            fclose(input);
+        }
+        if (output != stdout) {
+            fclose(output);
+        }
+        return 1;
+    }
+
+    int answered = runBatchQueries(graph, input, output, threads);
+    if (output != stdout) {
+        printf("Answered %d queries with %d threads\n", answered, threads);
+        fclose(output);
+    }
+
+    freeGraph(graph);
+    if (input != stdin) {
+        fclose(input);
+    }
+    return 0;
+}
+
+// Precompute mode: write time and cost distance/next-hop tables for every
+// pair of cities so the routing daemon can answer by table lookup
+int runPrecompute(int argc, char* argv[]) {
+    if (argc < 5) {
+        printf("Usage: %s --precompute <cities_file> <routes_file> <table_file> [threads]\n", argv[0]);
+        return 1;
+    }
+
+    int threads = argc > 5 ? atoi(argv[5]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    Graph* graph = createGraph(argv[2], argv[3]);
+    if (graph == NULL) {
+        printf("Failed to create graph\n");
+        return 1;
+    }
+
+    if (graph->csr->nodeCount > DISTANCE_TABLE_MAX_NODES) {
+        printf("%d cities is too many for a distance table (limit %d)\n", graph->csr->nodeCount, DISTANCE_TABLE_MAX_NODES);
+        freeGraph(graph);
+        return 1;
+    }
+
+    SourceFileInfo cities;
+    SourceFileInfo routes;
+    if (!describeGraphSources(graph, argv[2], argv[3], &cities, &routes) ||
+        !buildDistanceTable(graph->csr, &cities, &routes, argv[4], threads)) {
+        printf("Failed to write distance table %s\n", argv[4]);
+        freeGraph(graph);
+        return 1;
+    }
+
+    printf("Distance table for %d cities written to %s\n", graph->csr->nodeCount, argv[4]);
+    freeGraph(graph);
+    return 0;
+}
+
+// Contract mode: order the cities and add shortcuts for both metrics so
+// the routing daemon can answer with a search up the hierarchy
+int runContract(int argc, char* argv[]) {
+    if (argc < 5) {
+        printf("Usage: %s --contract <cities_file> <routes_file> <hierarchy_file>\n", argv[0]);
+        return 1;
+    }
+
+    Graph* graph = createGraph(argv[2], argv[3]);
+    if (graph == NULL) {
+        printf("Failed to create graph\n");
+        return 1;
+    }
+
+    SourceFileInfo cities;
+    SourceFileInfo routes;
+    if (!describeGraphSources(graph, argv[2], argv[3], &cities, &routes) ||
+        !buildContractionHierarchy(graph->csr, &cities, &routes, argv[4])) {
+        printf("Failed to write contraction hierarchy %s\n", argv[4]);
+        freeGraph(graph);
+        return 1;
+    }
+
+    ContractionHierarchy* hierarchy = openContractionHierarchy(argv[4]);
+    if (hierarchy != NULL) {
+        printf("Contraction hierarchy for %d cities written to %s (%d time arcs, %d cost arcs for %d routes)\n",
+               graph->csr->nodeCount, argv[4], hierarchy->metrics[0].arcCount, hierarchy->metrics[1].arcCount, graph->csr->edgeCount);
+        closeContractionHierarchy(hierarchy);
+    }
+
+    freeGraph(graph);
+    return 0;
+}
+
+// Path from origin to destination found with a contraction hierarchy,
+// as stacks for generateOutput. Returns 0 if the hierarchy cannot be used.
+int hierarchyStacks(Graph* graph, const char* citiesFile, const char* routesFile, const char* hierarchyFile,
+                    const char* origin, const char* destination, int costOrTime, Stack** cityStack, Stack** routeStack) {
+    ContractionHierarchy* hierarchy = openContractionHierarchy(hierarchyFile);
+    if (hierarchy == NULL) {
+        printf("Could not open contraction hierarchy %s, searching instead\n", hierarchyFile);
+        return 0;
+    }
+
+    // A hierarchy built from other CSV files would give wrong answers
+    if (graph->snapshot != NULL
+            ? !contractionHierarchyMatches(hierarchy, graph->csr, &graph->snapshot->header->cities, &graph->snapshot->header->routes)
+            : !contractionHierarchyFresh(hierarchy, graph->csr, citiesFile, routesFile)) {
+        printf("Contraction hierarchy %s is stale, searching instead\n", hierarchyFile);
+        closeContractionHierarchy(hierarchy);
+        return 0;
+    }
+
+    Location* from = getCity(graph, origin);
+    Location* to = getCity(graph, destination);
+    int* edges = (int*)malloc((graph->csr->nodeCount + 1) * sizeof(int));
+    ContractionQuery* query = createContractionQuery(graph->csr->nodeCount);
+
+    int edgeCount = -1;
+    if (from != NULL && to != NULL && edges != NULL && query != NULL) {
+        edgeCount = contractionPathEdges(hierarchy, query, costOrTime, from->id, to->id, edges, graph->csr->nodeCount);
+    } else if (from == NULL) {
+        printf("Origin city not found: %s\n", origin);
+    }
+
+    if (edgeCount >= 0) {
+        *cityStack = pathCityStacker(graph, from->id, edges, edgeCount);
+        *routeStack = pathRouteStacker(graph, edges, edgeCount);
+    } else {
+        *cityStack = createStack();
+        *routeStack = createStack();
+    }
+
+    freeContractionQuery(query);
+    free(edges);
+    closeContractionHierarchy(hierarchy);
+    return 1;
+}
+
+// City ids named one per line in filename; blank lines and lines starting
+// with # are skipped. Returns NULL, after reporting it, if the file cannot
+// be read or names a city the graph does not have.
+static int* readCityList(Graph* graph, const char* filename, int* count) {
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        printf("Could not open city list %s\n", filename);
+        return NULL;
+    }
+
+    int capacity = 64;
+    int* ids = (int*)malloc(capacity * sizeof(int));
+    char line[512];
+    *count = 0;
+    while (ids != NULL && fgets(line, sizeof(line), file) != NULL) {
+        char* name = line;
+        while (*name == ' ' || *name == '\t') {
+            name++;
+        }
+        size_t length = strlen(name);
+        while (length > 0 && (name[length - 1] == '\n' || name[length - 1] == '\r' || name[length - 1] == ' ')) {
+            name[--length] = '\0';
+        }
+        if (length == 0 || name[0] == '#') {
+            continue;
+        }
+
+        Location* city = getCity(graph, name);
+        if (city == NULL) {
+            printf("%s: city %s not found\n", filename, name);
+            free(ids);
+            ids = NULL;
+            break;
+        }
+
+        if (*count == capacity) {
+            capacity *= 2;
+            int* grown = (int*)realloc(ids, capacity * sizeof(int));
+            if (grown == NULL) {
+                free(ids);
+                ids = NULL;
+                break;
+            }
+            ids = grown;
+        }
+        ids[(*count)++] = city->id;
+    }
+
+    fclose(file);
+    return ids;
+}
+
+// Matrix mode: fastest time and cheapest cost from every city of one list
+// to every city of another, written as a binary matrix (see
+// DistanceMatrixHeader)
+int runMatrix(int argc, char* argv[]) {
+    if (argc < 7) {
+        printf("Usage: %s --matrix <cities_file> <routes_file> <origins_file> <destinations_file> <matrix_file> [threads]\n", argv[0]);
+        return 1;
+    }
+
+    int threads = argc > 7 ? atoi(argv[7]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    Graph* graph = createGraph(argv[2], argv[3]);
+    if (graph == NULL) {
+        printf("Failed to create graph\n");
+        return 1;
+    }
+
+    int originCount = 0;
+    int destinationCount = 0;
+    int* origins = readCityList(graph, argv[4], &originCount);
+    int* destinations = origins != NULL ? readCityList(graph, argv[5], &destinationCount) : NULL;
+    size_t cells = (size_t)originCount * destinationCount;
+    float* times = (float*)malloc((cells > 0 ? cells : 1) * sizeof(float));
+    float* costs = (float*)malloc((cells > 0 ? cells : 1) * sizeof(float));
+    long settled = 0;
+
+    int ok = origins != NULL && destinations != NULL && times != NULL && costs != NULL &&
+             distanceMatrix(graph->csr, origins, originCount, destinations, destinationCount, times, costs, threads, &settled) &&
+             writeDistanceMatrix(argv[6], times, costs, originCount, destinationCount);
+    if (ok) {
+        printf("%d x %d matrix written to %s (%ld cities settled with %d threads)\n",
+               originCount, destinationCount, argv[6], settled, threads);
+    } else {
+        printf("Failed to write distance matrix %s\n", argv[6]);
+    }
+
+    free(origins);
+    free(destinations);
+    free(times);
+    free(costs);
+    freeGraph(graph);
+    return ok ? 0 : 1;
+}
+
+// Route mode: one search from origin to destination, written as HTML
+int runPlanner(int argc, char* argv[]) {
     char citiesFilename[256] = {0};
     char routesFilename[256] = {0};
     char outputFilename[256] = {0};
@@ -69,12 +352,30 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    dijkstras(graph, origin, biPreference);
+    // A hierarchy from --contract may be given after the preference
+    Stack* cityStack = NULL;
+    Stack* routeStack = NULL;
+    if (argc <= 7 || !hierarchyStacks(graph, citiesFilename, routesFilename, argv[7], origin, destination, biPreference, &cityStack, &routeStack)) {
+        SearchWorkspace* ws = createSearchWorkspace(graph->csr->nodeCount);
+        if (ws == NULL) {
+            printf("Failed to allocate search workspace\n");
+            freeGraph(graph);
+            return 1;
+        }
+
+        dijkstras(graph, ws, origin, biPreference);
+
+        PROFILE_BEGIN(stacking, "stackPath", "output");
+        cityStack = cityStacker(graph, ws, destination);
+        routeStack = routeStacker(graph, ws, destination);
+        PROFILE_END(stacking);
 
-    Stack* cityStack = cityStacker(graph, destination);
-    Stack* routeStack = routeStacker(graph, destination, biPreference);
+        freeSearchWorkspace(ws);
+    }
 
+    PROFILE_BEGIN(writing, "generateOutput", "output");
     generateOutput(outputFilename, cityStack, routeStack, biPreference);
+    PROFILE_END(writing);
 
     // Free memory
     freeGraph(graph);
@@ -82,4 +383,35 @@ int main(int argc, char* argv[]) {
     freeStack(routeStack);
 
     return 0;
+}
+
+int main(int argc, char* argv[]) {
+    // --profile <trace_file> before any mode records where the time and
+    // allocations go, as a Chrome trace plus a summary on stderr
+    const char* traceFilename = NULL;
+    if (argc > 2 && strcmp(argv[1], "--profile") == 0) {
+        traceFilename = argv[2];
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+        profileStart();
+    }
+
+    int status;
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+        status = runBatch(argc, argv);
+    } else if (argc > 1 && strcmp(argv[1], "--precompute") == 0) {
+        status = runPrecompute(argc, argv);
+    } else if (argc > 1 && strcmp(argv[1], "--contract") == 0) {
+        status = runContract(argc, argv);
+    } else if (argc > 1 && strcmp(argv[1], "--matrix") == 0) {
+        status = runMatrix(argc, argv);
+    } else {
+        status = runPlanner(argc, argv);
+    }
+
+    if (traceFilename != NULL && !profileFinish(traceFilename, stderr)) {
+        fprintf(stderr, "Could not write profile trace %s\n", traceFilename);
+    }
+    return status;
 } 
\ No newline at end of file
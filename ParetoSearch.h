@@ -0,0 +1,615 @@
+#ifndef PARETOSEARCH_H
+#define PARETOSEARCH_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CSRGraph.h"
+#include "SearchWorkspace.h"
+
+// Labels kept per city unless the caller asks for another bound
+#define PARETO_DEFAULT_MAX_LABELS 128
+
+// Most labels a caller may ask a bag to hold
+#define PARETO_MAX_LABELS 4096
+
+// No limit on a criterion
+#define PARETO_UNLIMITED 1e30
+
+// No limit on legs
+#define PARETO_UNLIMITED_LEGS (1 << 30)
+
+// Every transport mode allowed
+#define PARETO_ALL_MODES ((1u << TRANSPORT_MODE_COUNT) - 1)
+
+// What an itinerary may use
+//
+// Legs count the flights or rides taken, so a route whose note says it
+// has one stop is two legs. edgeLegs gives that count per CSR edge of the
+// forward graph; without it every edge is one leg.
+typedef struct ParetoLimits {
+    double maxTime;
+    double maxCost;
+    int maxLegs;
+    unsigned int modes;               // bit 1 << TRANSPORT_* per allowed mode
+    const unsigned char* excluded;    // nonzero for cities to avoid, NULL for none
+    const unsigned char* edgeLegs;    // legs per forward edge, NULL for one each
+} ParetoLimits;
+
+// One partial itinerary: the totals of a path from the origin to city
+typedef struct ParetoLabel {
+    double time;
+    double cost;
+    int legs;
+
+    int city;
+    int parent;           // label this one extends, -1 at the origin
+    int edge;             // CSR edge from the parent's city, -1 at the origin
+    int next;             // next label in city's bag, -1 at the end
+    int dominated;        // dropped from its bag after being queued
+} ParetoLabel;
+
+// Per-thread multi-criteria search state
+//
+// Labels live in one pool for the whole query and are referred to by
+// index. Each city keeps a bag, a linked list of labels no other label at
+// that city beats on time, cost and legs at once. Like SearchWorkspace,
+// one ParetoSearch per thread lets any number of threads share a graph.
+typedef struct ParetoSearch {
+    int capacity;
+    int maxLabels;        // labels a city's bag holds in paretoRoutes by default
+    int bagLimit;         // the bound for the current query, 0 for none
+    int compareLegs;      // legs count towards dominance in the current query
+
+    ParetoLabel* labels;
+    int labelCount;
+    int labelCapacity;
+
+    int* bagHead;         // first label of each city's bag, -1 if empty
+    int* bagSize;
+    int* touched;         // cities with a non-empty bag
+    int touchedCount;
+
+    int* queue;           // binary heap of label indices
+    int queueSize;
+    int queueCapacity;
+    int costFirst;        // queue by cost before time rather than after
+
+    double* timeBound;    // least time from each city to the destination
+    double* costBound;
+    double* legBound;     // fewest legs, WORKSPACE_UNREACHED if unreachable
+    SearchWorkspace* ws;  // runs the backward searches for the bounds
+
+    int* routes;          // labels at the destination, in queue order
+    int routeCount;
+    int routeCapacity;
+    int settledCount;     // labels taken off the queue by the last query
+    int truncated;        // 1 if a full bag evicted or turned away a label
+} ParetoSearch;
+
+// Function prototypes
+ParetoSearch* createParetoSearch(int capacity, int maxLabels);
+void freeParetoSearch(ParetoSearch* ps);
+void paretoNoLimits(ParetoLimits* limits);
+int paretoRoutes(const CSRGraph* forward, const CSRGraph* backward, ParetoSearch* ps,
+                 int origin, int destination, const ParetoLimits* limits, int maxLabels);
+int constrainedRoute(const CSRGraph* forward, const CSRGraph* backward, ParetoSearch* ps,
+                     int origin, int destination, int costOrTime, const ParetoLimits* limits);
+int paretoPathEdges(const ParetoSearch* ps, int route, int* edges, int maxEdges);
+
+// Implementation
+ParetoSearch* createParetoSearch(int capacity, int maxLabels) {
+    ParetoSearch* ps = (ParetoSearch*)malloc(sizeof(ParetoSearch));
+    if (ps == NULL) {
+        return NULL;
+    }
+
+    if (capacity < 1) {
+        capacity = 1;
+    }
+
+    ps->capacity = capacity;
+    ps->maxLabels = maxLabels > 0 ? maxLabels : PARETO_DEFAULT_MAX_LABELS;
+    ps->bagLimit = ps->maxLabels;
+    ps->compareLegs = 1;
+    ps->labelCapacity = capacity;
+    ps->labels = (ParetoLabel*)malloc(ps->labelCapacity * sizeof(ParetoLabel));
+    ps->labelCount = 0;
+    ps->bagHead = (int*)malloc(capacity * sizeof(int));
+    ps->bagSize = (int*)calloc(capacity, sizeof(int));
+    ps->touched = (int*)malloc(capacity * sizeof(int));
+    ps->touchedCount = 0;
+    ps->queueCapacity = capacity;
+    ps->queue = (int*)malloc(ps->queueCapacity * sizeof(int));
+    ps->queueSize = 0;
+    ps->costFirst = 0;
+    ps->timeBound = (double*)malloc(capacity * sizeof(double));
+    ps->costBound = (double*)malloc(capacity * sizeof(double));
+    ps->legBound = (double*)malloc(capacity * sizeof(double));
+    ps->ws = createSearchWorkspace(capacity);
+    ps->routeCapacity = ps->maxLabels;
+    ps->routes = (int*)malloc(ps->routeCapacity * sizeof(int));
+    ps->routeCount = 0;
+    ps->settledCount = 0;
+    ps->truncated = 0;
+
+    if (ps->labels == NULL || ps->bagHead == NULL || ps->bagSize == NULL || ps->touched == NULL ||
+        ps->queue == NULL || ps->timeBound == NULL || ps->costBound == NULL || ps->legBound == NULL ||
+        ps->ws == NULL || ps->routes == NULL) {
+        freeParetoSearch(ps);
+        return NULL;
+    }
+
+    for (int i = 0; i < capacity; i++) {
+        ps->bagHead[i] = -1;
+    }
+
+    return ps;
+}
+
+void freeParetoSearch(ParetoSearch* ps) {
+    if (ps == NULL) {
+        return;
+    }
+
+    free(ps->labels);
+    free(ps->bagHead);
+    free(ps->bagSize);
+    free(ps->touched);
+    free(ps->queue);
+    free(ps->timeBound);
+    free(ps->costBound);
+    free(ps->legBound);
+    freeSearchWorkspace(ps->ws);
+    free(ps->routes);
+    free(ps);
+}
+
+// Limits that allow every itinerary
+void paretoNoLimits(ParetoLimits* limits) {
+    limits->maxTime = PARETO_UNLIMITED;
+    limits->maxCost = PARETO_UNLIMITED;
+    limits->maxLegs = PARETO_UNLIMITED_LEGS;
+    limits->modes = PARETO_ALL_MODES;
+    limits->excluded = NULL;
+    limits->edgeLegs = NULL;
+}
+
+// (time, cost, legs) is no worse than b on every criterion the query compares
+static int paretoCovers(const ParetoSearch* ps, double time, double cost, int legs, const ParetoLabel* b) {
+    return time <= b->time && cost <= b->cost && (!ps->compareLegs || legs <= b->legs);
+}
+
+// Queue order: time, cost, then legs, or cost before time if costFirst
+static int paretoBefore(const ParetoSearch* ps, int a, int b) {
+    const ParetoLabel* x = &ps->labels[a];
+    const ParetoLabel* y = &ps->labels[b];
+    double xFirst = ps->costFirst ? x->cost : x->time;
+    double yFirst = ps->costFirst ? y->cost : y->time;
+    double xSecond = ps->costFirst ? x->time : x->cost;
+    double ySecond = ps->costFirst ? y->time : y->cost;
+    if (xFirst != yFirst) {
+        return xFirst < yFirst;
+    }
+    if (xSecond != ySecond) {
+        return xSecond < ySecond;
+    }
+    return x->legs < y->legs;
+}
+
+static int paretoQueuePush(ParetoSearch* ps, int label) {
+    if (ps->queueSize == ps->queueCapacity) {
+        int* grown = (int*)realloc(ps->queue, 2 * ps->queueCapacity * sizeof(int));
+        if (grown == NULL) {
+            return 0;
+        }
+        ps->queue = grown;
+        ps->queueCapacity *= 2;
+    }
+
+    int i = ps->queueSize++;
+    while (i > 0 && paretoBefore(ps, label, ps->queue[(i - 1) / 2])) {
+        ps->queue[i] = ps->queue[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    ps->queue[i] = label;
+    return 1;
+}
+
+static int paretoQueuePop(ParetoSearch* ps) {
+    int top = ps->queue[0];
+    int last = ps->queue[--ps->queueSize];
+
+    int i = 0;
+    while (2 * i + 1 < ps->queueSize) {
+        int child = 2 * i + 1;
+        if (child + 1 < ps->queueSize && paretoBefore(ps, ps->queue[child + 1], ps->queue[child])) {
+            child++;
+        }
+        if (!paretoBefore(ps, ps->queue[child], last)) {
+            break;
+        }
+        ps->queue[i] = ps->queue[child];
+        i = child;
+    }
+    ps->queue[i] = last;
+    return top;
+}
+
+// Some label in city's bag is no worse than (time, cost, legs)
+static int paretoBagCovers(const ParetoSearch* ps, int city, double time, double cost, int legs) {
+    for (int l = ps->bagHead[city]; l != -1; l = ps->labels[l].next) {
+        const ParetoLabel* label = &ps->labels[l];
+        if (label->time <= time && label->cost <= cost && (!ps->compareLegs || label->legs <= legs)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// The label a full bag gives up for (time, cost, legs): the one nearest
+// it on time and cost, each scaled by its spread over the bag, leaving
+// alone the labels with the bag's least time, cost and legs unless the
+// new label beats them. -1 if every label is one of those.
+static int paretoEvictable(const ParetoSearch* ps, int city, double time, double cost, int legs) {
+    int fastest = -1;
+    int cheapest = -1;
+    int fewest = -1;
+    double timeLow = time;
+    double timeHigh = time;
+    double costLow = cost;
+    double costHigh = cost;
+    for (int l = ps->bagHead[city]; l != -1; l = ps->labels[l].next) {
+        const ParetoLabel* label = &ps->labels[l];
+        if (fastest == -1 || label->time < ps->labels[fastest].time) {
+            fastest = l;
+        }
+        if (cheapest == -1 || label->cost < ps->labels[cheapest].cost) {
+            cheapest = l;
+        }
+        if (fewest == -1 || label->legs < ps->labels[fewest].legs) {
+            fewest = l;
+        }
+        timeLow = label->time < timeLow ? label->time : timeLow;
+        timeHigh = label->time > timeHigh ? label->time : timeHigh;
+        costLow = label->cost < costLow ? label->cost : costLow;
+        costHigh = label->cost > costHigh ? label->cost : costHigh;
+    }
+    if (fastest != -1 && time < ps->labels[fastest].time) {
+        fastest = -1;
+    }
+    if (cheapest != -1 && cost < ps->labels[cheapest].cost) {
+        cheapest = -1;
+    }
+    if (fewest != -1 && legs < ps->labels[fewest].legs) {
+        fewest = -1;
+    }
+
+    double timeSpread = timeHigh > timeLow ? timeHigh - timeLow : 1;
+    double costSpread = costHigh > costLow ? costHigh - costLow : 1;
+    int victim = -1;
+    double nearest = 0;
+    for (int l = ps->bagHead[city]; l != -1; l = ps->labels[l].next) {
+        if (l == fastest || l == cheapest || l == fewest) {
+            continue;
+        }
+        const ParetoLabel* label = &ps->labels[l];
+        double gap = fabs(label->time - time) / timeSpread + fabs(label->cost - cost) / costSpread;
+        if (victim == -1 || gap < nearest) {
+            victim = l;
+            nearest = gap;
+        }
+    }
+    return victim;
+}
+
+// Add a label to city's bag, dropping the labels it beats. A full bag
+// makes room by evicting a label (see paretoEvictable) and sets
+// truncated. Returns the new label's index, -1 if the bag is full and
+// nothing can go, or -2 if memory runs out.
+static int paretoAddLabel(ParetoSearch* ps, int city, double time, double cost, int legs, int parent, int edge) {
+    int firstLabel = ps->bagHead[city] == -1;
+    int victim = -1;
+    if (ps->bagLimit > 0 && ps->bagSize[city] >= ps->bagLimit) {
+        victim = paretoEvictable(ps, city, time, cost, legs);
+    }
+
+    int* link = &ps->bagHead[city];
+    while (*link != -1) {
+        ParetoLabel* old = &ps->labels[*link];
+        if (paretoCovers(ps, time, cost, legs, old)) {
+            old->dominated = 1;
+            ps->bagSize[city]--;
+            *link = old->next;
+        } else {
+            link = &old->next;
+        }
+    }
+
+    if (ps->bagLimit > 0 && ps->bagSize[city] >= ps->bagLimit) {
+        ps->truncated = 1;
+        if (victim == -1) {
+            return -1;
+        }
+        link = &ps->bagHead[city];
+        while (*link != victim) {
+            link = &ps->labels[*link].next;
+        }
+        ps->labels[victim].dominated = 1;
+        ps->bagSize[city]--;
+        *link = ps->labels[victim].next;
+    }
+
+    if (ps->labelCount == ps->labelCapacity) {
+        ParetoLabel* grown = (ParetoLabel*)realloc(ps->labels, 2 * ps->labelCapacity * sizeof(ParetoLabel));
+        if (grown == NULL) {
+            return -2;
+        }
+        ps->labels = grown;
+        ps->labelCapacity *= 2;
+    }
+
+    int index = ps->labelCount++;
+    ParetoLabel* label = &ps->labels[index];
+    label->time = time;
+    label->cost = cost;
+    label->legs = legs;
+    label->city = city;
+    label->parent = parent;
+    label->edge = edge;
+    label->next = ps->bagHead[city];
+    label->dominated = 0;
+
+    if (firstLabel) {
+        ps->touched[ps->touchedCount++] = city;
+    }
+    ps->bagHead[city] = index;
+    ps->bagSize[city]++;
+    return index;
+}
+
+static void paretoReset(ParetoSearch* ps) {
+    for (int i = 0; i < ps->touchedCount; i++) {
+        ps->bagHead[ps->touched[i]] = -1;
+        ps->bagSize[ps->touched[i]] = 0;
+    }
+    ps->touchedCount = 0;
+    ps->labelCount = 0;
+    ps->queueSize = 0;
+    ps->routeCount = 0;
+    ps->settledCount = 0;
+    ps->truncated = 0;
+}
+
+// Legs of a forward edge
+static int paretoEdgeLegs(const ParetoLimits* limits, int edge) {
+    return limits->edgeLegs != NULL ? limits->edgeLegs[edge] : 1;
+}
+
+// Backward Dijkstra from destination over the edges the limits allow,
+// leaving the least time (metric 0), cost (1) or legs (2) from each city
+// to destination in ps->ws->dist
+static void paretoBoundSearch(const CSRGraph* backward, ParetoSearch* ps, int destination,
+                              const ParetoLimits* limits, int metric) {
+    SearchWorkspace* ws = ps->ws;
+    workspaceReset(ws);
+
+    workspaceTouch(ws, destination);
+    ws->dist[destination] = 0;
+    heapPushOrDecrease(ws->heap, destination, 0);
+
+    while (!heapEmpty(ws->heap)) {
+        int u = heapPop(ws->heap);
+        ws->settled[u] = 1;
+        ws->settledCount++;
+
+        for (int e = backward->offsets[u]; e < backward->offsets[u + 1]; e++) {
+            // Reverse edge e stands for forward edge edgeRoutes[e] from v to u
+            int v = backward->targets[e];
+            if ((limits->modes & (1u << backward->modes[e])) == 0 ||
+                (limits->excluded != NULL && limits->excluded[v])) {
+                continue;
+            }
+
+            double weight = metric == 0 ? backward->times[e]
+                          : metric == 1 ? backward->costs[e]
+                          : paretoEdgeLegs(limits, backward->edgeRoutes[e]);
+            workspaceTouch(ws, v);
+            double length = ws->dist[u] + weight;
+            if (!ws->settled[v] && length < ws->dist[v]) {
+                ws->dist[v] = length;
+                heapPushOrDecrease(ws->heap, v, length);
+            }
+        }
+    }
+
+    // The bounds are copied out whole
+    workspaceTouchAll(ws);
+}
+
+// Label-setting search shared by paretoRoutes and constrainedRoute. With
+// stopAtFirst the first destination label off the queue ends the search,
+// which makes it the best by the queue's order.
+static int paretoSearchLabels(const CSRGraph* forward, const CSRGraph* backward, ParetoSearch* ps,
+                              int origin, int destination, const ParetoLimits* limits, int stopAtFirst) {
+    ParetoLimits none;
+    if (limits == NULL) {
+        paretoNoLimits(&none);
+        limits = &none;
+    }
+
+    if (forward == NULL || backward == NULL || ps == NULL || forward->nodeCount > ps->capacity ||
+        backward->nodeCount != forward->nodeCount ||
+        origin < 0 || origin >= forward->nodeCount || destination < 0 || destination >= forward->nodeCount) {
+        return -1;
+    }
+
+    paretoReset(ps);
+    if (origin == destination || (limits->excluded != NULL && (limits->excluded[origin] || limits->excluded[destination]))) {
+        return 0;
+    }
+
+    // Excluded cities and those that cannot reach destination over the
+    // allowed modes keep WORKSPACE_UNREACHED in every bound, which keeps
+    // the search out of them
+    int n = forward->nodeCount;
+    paretoBoundSearch(backward, ps, destination, limits, 0);
+    memcpy(ps->timeBound, ps->ws->dist, n * sizeof(double));
+    paretoBoundSearch(backward, ps, destination, limits, 1);
+    memcpy(ps->costBound, ps->ws->dist, n * sizeof(double));
+    paretoBoundSearch(backward, ps, destination, limits, 2);
+    memcpy(ps->legBound, ps->ws->dist, n * sizeof(double));
+    if (ps->legBound[origin] >= WORKSPACE_UNREACHED) {
+        return 0;
+    }
+
+    int start = paretoAddLabel(ps, origin, 0, 0, 0, -1, -1);
+    if (start < 0 || !paretoQueuePush(ps, start)) {
+        return -1;
+    }
+
+    while (ps->queueSize > 0) {
+        int current = paretoQueuePop(ps);
+        if (ps->labels[current].dominated) {
+            continue;
+        }
+        ps->settledCount++;
+
+        int u = ps->labels[current].city;
+        if (u == destination) {
+            if (stopAtFirst) {
+                ps->routes[ps->routeCount++] = current;
+                return 1;
+            }
+            continue;
+        }
+
+        for (int e = forward->offsets[u]; e < forward->offsets[u + 1]; e++) {
+            int v = forward->targets[e];
+            if (ps->legBound[v] >= WORKSPACE_UNREACHED || (limits->modes & (1u << forward->modes[e])) == 0) {
+                continue;
+            }
+
+            // The pool may move when it grows, so read through the index
+            double time = ps->labels[current].time + forward->times[e];
+            double cost = ps->labels[current].cost + forward->costs[e];
+            int legs = ps->labels[current].legs + paretoEdgeLegs(limits, e);
+
+            // Even the best finish from v breaks a limit or is matched by
+            // an itinerary already found
+            double leastTime = time + ps->timeBound[v];
+            double leastCost = cost + ps->costBound[v];
+            int leastLegs = legs + (int)ps->legBound[v];
+            if (leastTime > limits->maxTime || leastCost > limits->maxCost || leastLegs > limits->maxLegs ||
+                paretoBagCovers(ps, destination, leastTime, leastCost, leastLegs) ||
+                paretoBagCovers(ps, v, time, cost, legs)) {
+                continue;
+            }
+
+            int label = paretoAddLabel(ps, v, time, cost, legs, current, e);
+            if (label == -2 || (label >= 0 && !paretoQueuePush(ps, label))) {
+                return -1;
+            }
+        }
+    }
+
+    if (stopAtFirst) {
+        return 0;
+    }
+
+    // The destination's bag is the frontier; list it in queue order
+    if (ps->bagSize[destination] > ps->routeCapacity) {
+        int* grown = (int*)realloc(ps->routes, ps->bagSize[destination] * sizeof(int));
+        if (grown == NULL) {
+            return -1;
+        }
+        ps->routes = grown;
+        ps->routeCapacity = ps->bagSize[destination];
+    }
+    for (int l = ps->bagHead[destination]; l != -1; l = ps->labels[l].next) {
+        int i = ps->routeCount++;
+        while (i > 0 && paretoBefore(ps, l, ps->routes[i - 1])) {
+            ps->routes[i] = ps->routes[i - 1];
+            i--;
+        }
+        ps->routes[i] = l;
+    }
+
+    return ps->routeCount;
+}
+
+// Multi-criteria label-setting search (time, cost and legs)
+//
+// Finds every origin-destination itinerary within limits (NULL for none)
+// that no other itinerary beats on all three criteria at once, in one
+// search. backward is the reverse of forward from createReverseCSRGraph;
+// searches over it give each city lower bounds on what remains to the
+// destination using only the modes and cities the limits allow, so a
+// label whose bounded totals break a limit or are already matched by an
+// itinerary found for the destination is never queued.
+//
+// Each city's bag holds up to maxLabels labels (0 for ps->maxLabels).
+// A full bag keeps its fastest, cheapest and fewest-leg labels and evicts
+// the label nearest a newcomer, so the frontier keeps both of its ends
+// but may be missing itineraries between them; truncated says so.
+//
+// Returns the number of itineraries, fastest first in routes[], or -1 on
+// bad arguments or when memory runs out.
+int paretoRoutes(const CSRGraph* forward, const CSRGraph* backward, ParetoSearch* ps,
+                 int origin, int destination, const ParetoLimits* limits, int maxLabels) {
+    if (ps != NULL) {
+        ps->costFirst = 0;
+        ps->bagLimit = maxLabels > 0 ? maxLabels : ps->maxLabels;
+        ps->compareLegs = 1;
+    }
+    return paretoSearchLabels(forward, backward, ps, origin, destination, limits, 0);
+}
+
+// Resource-constrained shortest path (costOrTime: 1 = cost, 0 = time)
+//
+// The fastest or cheapest itinerary within limits. It runs the search
+// paretoRoutes does with the objective first in queue order, so labels
+// that cannot meet the limits are pruned as they are made and the first
+// itinerary to reach the destination is the answer. Bags are never
+// capped here, since a label turned away could be the one the answer
+// runs through; the pool grows instead. Without a leg limit, legs are
+// left out of dominance, which keeps the bags to the time/cost frontier.
+//
+// Returns 1 with the itinerary in routes[0], 0 if none meets the limits,
+// or -1 on bad arguments or when memory runs out.
+int constrainedRoute(const CSRGraph* forward, const CSRGraph* backward, ParetoSearch* ps,
+                     int origin, int destination, int costOrTime, const ParetoLimits* limits) {
+    if (ps != NULL) {
+        ps->costFirst = costOrTime;
+        ps->bagLimit = 0;
+        ps->compareLegs = limits != NULL && limits->maxLegs < PARETO_UNLIMITED_LEGS;
+    }
+    return paretoSearchLabels(forward, backward, ps, origin, destination, limits, 1);
+}
+
+// CSR edges of routes[route] in travel order. Returns the number of
+// edges, or -1 if route is out of range or the path does not fit.
+int paretoPathEdges(const ParetoSearch* ps, int route, int* edges, int maxEdges) {
+    if (route < 0 || route >= ps->routeCount) {
+        return -1;
+    }
+
+    int count = 0;
+    for (int l = ps->routes[route]; ps->labels[l].parent != -1; l = ps->labels[l].parent) {
+        count++;
+    }
+
+    if (count > maxEdges) {
+        return -1;
+    }
+
+    int index = count;
+    for (int l = ps->routes[route]; ps->labels[l].parent != -1; l = ps->labels[l].parent) {
+        edges[--index] = ps->labels[l].edge;
+    }
+
+    return count;
+}
+
+#endif // PARETOSEARCH_H
@@ -0,0 +1,369 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+// Build with -DPROFILER=0 to compile every probe out
+#ifndef PROFILER
+#define PROFILER 1
+#endif
+
+#define PROFILE_INITIAL_EVENTS 1024
+#define PROFILE_MAX_COUNTERS 16
+
+// Kinds of recorded event
+#define PROFILE_EVENT_SCOPE 0    // a timed phase, "X" in the trace
+#define PROFILE_EVENT_COUNTER 1  // a counter's running total, "C" in the trace
+
+// One recorded event. Names are not copied, so they must be literals.
+typedef struct ProfileEvent {
+    const char* name;
+    const char* category;
+    int kind;
+    long long start;          // ns since profileStart
+    long long duration;       // ns, scopes only
+    long long allocations;    // scopes: allocations made inside; counters: the total
+    long long bytes;
+} ProfileEvent;
+
+// Events and allocation totals of one thread
+//
+// Each thread appends only to its own buffer, found through a thread-local
+// pointer, so probes take no lock. Buffers are linked into one list when a
+// thread first records something and outlive the thread, so they can be
+// written out after it has been joined.
+typedef struct ProfileBuffer {
+    int thread;
+    ProfileEvent* events;
+    int count;
+    int capacity;
+    long long dropped;        // events lost because the buffer could not grow
+
+    long long allocations;    // running totals for this thread
+    long long bytes;
+
+    const char* counterNames[PROFILE_MAX_COUNTERS];
+    long long counterTotals[PROFILE_MAX_COUNTERS];
+    int counterCount;
+
+    struct ProfileBuffer* next;
+} ProfileBuffer;
+
+// A phase being timed, from PROFILE_BEGIN to PROFILE_END on one thread
+typedef struct ProfileScope {
+    const char* name;
+    const char* category;
+    long long start;
+    long long allocations;
+    long long bytes;
+} ProfileScope;
+
+// Set by profileStart. Every probe tests it first, so a build with the
+// profiler compiled in costs one predictable branch per probe until then.
+static int profileEnabled = 0;
+static struct timespec profileEpoch;
+static ProfileBuffer* profileBuffers = NULL;
+static int profileThreadCount = 0;
+static pthread_mutex_t profileMutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread ProfileBuffer* profileThreadBuffer = NULL;
+
+#if PROFILER
+#define PROFILE_BEGIN(scope, name, category) \
+    ProfileScope scope; \
+    if (profileEnabled) { \
+        profileBegin(&scope, name, category); \
+    }
+#define PROFILE_END(scope) \
+    do { \
+        if (profileEnabled) { \
+            profileEnd(&scope); \
+        } \
+    } while (0)
+#define PROFILE_ALLOCATION(count, bytes) \
+    do { \
+        if (profileEnabled) { \
+            profileAllocation(count, bytes); \
+        } \
+    } while (0)
+#define PROFILE_COUNT(name, amount) \
+    do { \
+        if (profileEnabled) { \
+            profileCount(name, amount); \
+        } \
+    } while (0)
+#else
+#define PROFILE_BEGIN(scope, name, category)
+#define PROFILE_END(scope) do { } while (0)
+#define PROFILE_ALLOCATION(count, bytes) do { (void)(count); (void)(bytes); } while (0)
+#define PROFILE_COUNT(name, amount) do { (void)(amount); } while (0)
+#endif
+
+// Function prototypes
+void profileStart(void);
+int profileFinish(const char* traceFilename, FILE* summary);
+void profileBegin(ProfileScope* scope, const char* name, const char* category);
+void profileEnd(ProfileScope* scope);
+void profileAllocation(int count, size_t bytes);
+void profileCount(const char* name, long long amount);
+
+// Implementation
+
+static long long profileNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)(now.tv_sec - profileEpoch.tv_sec) * 1000000000LL + (now.tv_nsec - profileEpoch.tv_nsec);
+}
+
+// This thread's buffer, created on first use. NULL if out of memory.
+static ProfileBuffer* profileThread(void) {
+    if (profileThreadBuffer != NULL) {
+        return profileThreadBuffer;
+    }
+
+    ProfileBuffer* buffer = (ProfileBuffer*)calloc(1, sizeof(ProfileBuffer));
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&profileMutex);
+    buffer->thread = profileThreadCount++;
+    buffer->next = profileBuffers;
+    profileBuffers = buffer;
+    pthread_mutex_unlock(&profileMutex);
+
+    profileThreadBuffer = buffer;
+    return buffer;
+}
+
+static ProfileEvent* profileAppend(ProfileBuffer* buffer) {
+    if (buffer->count == buffer->capacity) {
+        int capacity = buffer->capacity == 0 ? PROFILE_INITIAL_EVENTS : buffer->capacity * 2;
+        ProfileEvent* events = (ProfileEvent*)realloc(buffer->events, capacity * sizeof(ProfileEvent));
+        if (events == NULL) {
+            buffer->dropped++;
+            return NULL;
+        }
+        buffer->events = events;
+        buffer->capacity = capacity;
+    }
+    return &buffer->events[buffer->count++];
+}
+
+// Start recording; the trace's clock starts here
+void profileStart(void) {
+    clock_gettime(CLOCK_MONOTONIC, &profileEpoch);
+    profileEnabled = 1;
+}
+
+void profileBegin(ProfileScope* scope, const char* name, const char* category) {
+    ProfileBuffer* buffer = profileThread();
+    scope->name = name;
+    scope->category = category;
+    scope->start = profileNow();
+    scope->allocations = buffer != NULL ? buffer->allocations : 0;
+    scope->bytes = buffer != NULL ? buffer->bytes : 0;
+}
+
+// Record the scope as one event. Its allocations include those of any
+// scopes nested inside it on the same thread.
+void profileEnd(ProfileScope* scope) {
+    ProfileBuffer* buffer = profileThread();
+    long long end = profileNow();
+    ProfileEvent* event = buffer != NULL ? profileAppend(buffer) : NULL;
+    if (event == NULL) {
+        return;
+    }
+
+    event->name = scope->name;
+    event->category = scope->category;
+    event->kind = PROFILE_EVENT_SCOPE;
+    event->start = scope->start;
+    event->duration = end - scope->start;
+    event->allocations = buffer->allocations - scope->allocations;
+    event->bytes = buffer->bytes - scope->bytes;
+}
+
+// Count count allocations totalling bytes against the scopes open on this
+// thread
+void profileAllocation(int count, size_t bytes) {
+    ProfileBuffer* buffer = profileThread();
+    if (buffer != NULL) {
+        buffer->allocations += count;
+        buffer->bytes += (long long)bytes;
+    }
+}
+
+// Add amount to this thread's total for the counter name, recording the
+// new total. Totals only grow; amount should not be negative.
+void profileCount(const char* name, long long amount) {
+    ProfileBuffer* buffer = profileThread();
+    if (buffer == NULL) {
+        return;
+    }
+
+    int c = 0;
+    while (c < buffer->counterCount && buffer->counterNames[c] != name && strcmp(buffer->counterNames[c], name) != 0) {
+        c++;
+    }
+    if (c == buffer->counterCount) {
+        if (c == PROFILE_MAX_COUNTERS) {
+            return;
+        }
+        buffer->counterNames[c] = name;
+        buffer->counterTotals[c] = 0;
+        buffer->counterCount++;
+    }
+    buffer->counterTotals[c] += amount;
+
+    ProfileEvent* event = profileAppend(buffer);
+    if (event == NULL) {
+        return;
+    }
+    event->name = name;
+    event->category = "counter";
+    event->kind = PROFILE_EVENT_COUNTER;
+    event->start = profileNow();
+    event->duration = 0;
+    event->allocations = buffer->counterTotals[c];
+    event->bytes = 0;
+}
+
+// Totals for one scope name, for the summary
+typedef struct ProfilePhase {
+    const char* name;
+    long long calls;
+    long long duration;
+    long long allocations;
+    long long bytes;
+} ProfilePhase;
+
+static void profileWriteSummary(FILE* summary) {
+    ProfilePhase phases[64];
+    int phaseCount = 0;
+    const char* counterNames[PROFILE_MAX_COUNTERS];
+    long long counterTotals[PROFILE_MAX_COUNTERS];
+    int counterCount = 0;
+    long long dropped = 0;
+
+    for (ProfileBuffer* buffer = profileBuffers; buffer != NULL; buffer = buffer->next) {
+        dropped += buffer->dropped;
+        for (int i = 0; i < buffer->count; i++) {
+            const ProfileEvent* event = &buffer->events[i];
+            if (event->kind != PROFILE_EVENT_SCOPE) {
+                continue;
+            }
+
+            int p = 0;
+            while (p < phaseCount && strcmp(phases[p].name, event->name) != 0) {
+                p++;
+            }
+            if (p == phaseCount) {
+                if (phaseCount == 64) {
+                    continue;
+                }
+                memset(&phases[p], 0, sizeof(ProfilePhase));
+                phases[p].name = event->name;
+                phaseCount++;
+            }
+            phases[p].calls++;
+            phases[p].duration += event->duration;
+            phases[p].allocations += event->allocations;
+            phases[p].bytes += event->bytes;
+        }
+
+        for (int c = 0; c < buffer->counterCount; c++) {
+            int t = 0;
+            while (t < counterCount && strcmp(counterNames[t], buffer->counterNames[c]) != 0) {
+                t++;
+            }
+            if (t == counterCount) {
+                counterNames[t] = buffer->counterNames[c];
+                counterTotals[t] = 0;
+                counterCount++;
+            }
+            counterTotals[t] += buffer->counterTotals[c];
+        }
+    }
+
+    // Phases summed over every thread; time on several threads adds up
+    fprintf(summary, "%-24s %10s %14s %14s %16s\n", "phase", "calls", "total ms", "allocations", "bytes");
+    for (int p = 0; p < phaseCount; p++) {
+        fprintf(summary, "%-24s %10lld %14.3f %14lld %16lld\n", phases[p].name, phases[p].calls,
+                phases[p].duration / 1e6, phases[p].allocations, phases[p].bytes);
+    }
+    for (int t = 0; t < counterCount; t++) {
+        fprintf(summary, "%-24s %10lld\n", counterNames[t], counterTotals[t]);
+    }
+    if (dropped > 0) {
+        fprintf(summary, "%lld events dropped for lack of memory\n", dropped);
+    }
+}
+
+// Write every event as Chrome trace-event JSON, loadable in chrome://tracing
+// or Perfetto. Returns 1 on success.
+static int profileWriteTrace(const char* filename) {
+    FILE* file = fopen(filename, "w");
+    if (file == NULL) {
+        return 0;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    int first = 1;
+    for (ProfileBuffer* buffer = profileBuffers; buffer != NULL; buffer = buffer->next) {
+        fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s %d\"}}",
+                first ? "" : ",\n", buffer->thread, buffer->thread == 0 ? "main" : "thread", buffer->thread);
+        first = 0;
+
+        // Timestamps are in microseconds
+        for (int i = 0; i < buffer->count; i++) {
+            const ProfileEvent* event = &buffer->events[i];
+            if (event->kind == PROFILE_EVENT_SCOPE) {
+                fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, "
+                        "\"args\": {\"allocations\": %lld, \"bytes\": %lld}}",
+                        event->name, event->category, buffer->thread, event->start / 1e3, event->duration / 1e3,
+                        event->allocations, event->bytes);
+            } else {
+                fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"C\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, "
+                        "\"args\": {\"thread %d\": %lld}}",
+                        event->name, event->category, buffer->thread, event->start / 1e3, buffer->thread, event->allocations);
+            }
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    return fclose(file) == 0;
+}
+
+// Stop recording, write the trace to traceFilename and a per-phase
+// summary to summary (if not NULL), and free every buffer. Call it once the
+// threads that recorded have finished. Returns 1 if the trace was written.
+int profileFinish(const char* traceFilename, FILE* summary) {
+    profileEnabled = 0;
+
+    int written = traceFilename != NULL && profileWriteTrace(traceFilename);
+    if (summary != NULL) {
+        profileWriteSummary(summary);
+    }
+
+    pthread_mutex_lock(&profileMutex);
+    ProfileBuffer* buffer = profileBuffers;
+    profileBuffers = NULL;
+    profileThreadCount = 0;
+    pthread_mutex_unlock(&profileMutex);
+
+    while (buffer != NULL) {
+        ProfileBuffer* next = buffer->next;
+        free(buffer->events);
+        free(buffer);
+        buffer = next;
+    }
+    profileThreadBuffer = NULL;
+
+    return written;
+}
+
+#endif // PROFILER_H
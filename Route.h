@@ -3,6 +3,9 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+
+#include "Profiler.h"
 
 // Forward declaration
 struct Location;
@@ -21,6 +24,9 @@ typedef struct Route {
 	char transport[256];
 	float time;
 	float cost;
+	float distance;		// km, 0 if the routes file gives none
+	float departure;	// hours after midnight of the first daily departure, -1 if it runs at any time
+	float headway;		// hours between departures, 0 if it leaves once a day
 	char note[256];
 } Route;
 
@@ -30,6 +36,7 @@ void freeRoute(Route* route);
 Route* createRouteWithLocations(Location* org, Location* dest);
 Route* createRouteWithDetails(Location* org, Location* dest, const char* trans, float tim, float cst, const char* notee);
 int doesRouteConnect(Route* route, Location* start, Location* end);
+int noteStopCount(const char* note);
 
 // Implementation
 Route* createRoute() {
@@ -37,6 +44,7 @@ Route* createRoute() {
 	if (route == NULL) {
 		return NULL;
 	}
+	PROFILE_ALLOCATION(1, sizeof(Route));
 	
 	route->origin = NULL;
 	route->destination = NULL;
@@ -45,6 +53,9 @@ Route* createRoute() {
 	route->transport[0] = '\0';
 	route->time = 0;
 	route->cost = 0;
+	route->distance = 0;
+	route->departure = -1;
+	route->headway = 0;
 	route->note[0] = '\0';
 	
 	return route;
@@ -101,4 +112,38 @@ int doesRouteConnect(Route* route, Location* start, Location* end) {
 	return 0;
 }
 
+// Intermediate stops a route's note mentions, as in "KLM Airways, 1 stop"
+// or "Two stops"; 0 for direct routes and notes that say nothing
+int noteStopCount(const char* note) {
+	static const char* words[] = {"one", "two", "three", "four", "five"};
+	
+	if (note == NULL) {
+		return 0;
+	}
+	
+	for (const char* p = note; *p != '\0'; p++) {
+		if (strncasecmp(p, "stop", 4) != 0 || p == note || p[-1] != ' ') {
+			continue;
+		}
+		
+		// The word before " stop"
+		const char* end = p - 1;
+		const char* start = end;
+		while (start > note && start[-1] != ' ' && start[-1] != ',') {
+			start--;
+		}
+		
+		if (start < end && start[0] >= '0' && start[0] <= '9') {
+			return atoi(start);
+		}
+		for (int i = 0; i < 5; i++) {
+			if ((size_t)(end - start) == strlen(words[i]) && strncasecmp(start, words[i], end - start) == 0) {
+				return i + 1;
+			}
+		}
+	}
+	
+	return 0;
+}
+
 #endif // ROUTE_H
@@ -0,0 +1,352 @@
+#ifndef ROUTESYNTHESIS_H
+#define ROUTESYNTHESIS_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "KdTree.h"
+
+#define ROUTE_SYNTHESIS_DEFAULT_NEIGHBORS 8
+#define ROUTE_SYNTHESIS_DEFAULT_HUBS 32
+#define ROUTE_SYNTHESIS_DEFAULT_SEED 1
+
+// Average speed the generated times assume, km/h
+#define ROUTE_SYNTHESIS_SPEED 800.0
+
+// How to synthesize routes between cities that have only coordinates
+typedef struct RouteSynthesisOptions {
+    int neighbors;      // nearest cities each city is joined to
+    int hubs;           // long-haul hubs, joined to each other and to the cities nearest them
+    uint64_t seed;      // same seed, same routes
+    int threadCount;
+} RouteSynthesisOptions;
+
+// Routes joining cities by id, in both directions, as parallel arrays
+// ready for createCSRGraph
+//
+// Each city is joined to its nearest neighbours and to its nearest hub,
+// and the hubs are joined to each other, so any city reaches any other
+// in a few hops. That is O(V k + h^2) routes instead of the O(V^2) of a
+// complete graph. Costs and times vary around distance at random, but
+// each route's draw depends only on the seed and its two cities, so the
+// same cities and seed give the same routes whatever the thread count.
+typedef struct SynthesizedRoutes {
+    int routeCount;
+    int* sources;
+    int* targets;
+    float* distances;   // great-circle km
+    float* times;       // hours
+    float* costs;
+
+    int* hubs;          // hub cities, in the order chosen
+    int hubCount;
+} SynthesizedRoutes;
+
+// Work shared by the threads finding neighbours
+typedef struct RouteSynthesisJob {
+    const KdTree* tree;
+    int cityCount;
+    int neighbors;
+    int* nearest;          // [city * neighbors + rank], -1 past the cities found
+    const int* hubs;
+    int hubCount;
+    int* nearestHub;
+    int threadCount;
+} RouteSynthesisJob;
+
+typedef struct RouteSynthesisWorker {
+    RouteSynthesisJob* job;
+    int index;
+    int started;          // running on its own thread
+} RouteSynthesisWorker;
+
+// Function prototypes
+void routeSynthesisDefaults(RouteSynthesisOptions* options);
+SynthesizedRoutes* synthesizeRoutes(const double* latitudes, const double* longitudes, int cityCount,
+                                    const RouteSynthesisOptions* options);
+void freeSynthesizedRoutes(SynthesizedRoutes* routes);
+
+// Implementation
+void routeSynthesisDefaults(RouteSynthesisOptions* options) {
+    options->neighbors = ROUTE_SYNTHESIS_DEFAULT_NEIGHBORS;
+    options->hubs = ROUTE_SYNTHESIS_DEFAULT_HUBS;
+    options->seed = ROUTE_SYNTHESIS_DEFAULT_SEED;
+    options->threadCount = 1;
+}
+
+// SplitMix64, a full-period mix of its input
+static uint64_t routeSynthesisMix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Uniform draw in [0, 1) from a 64-bit state
+static double routeSynthesisUniform(uint64_t state) {
+    return (double)(state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Great-circle km between two cities through their unit-sphere points
+static double routeSynthesisDistance(const KdTree* tree, int from, int to) {
+    const double* a = tree->points + 3 * from;
+    const double* b = tree->points + 3 * to;
+    double dx = a[0] - b[0];
+    double dy = a[1] - b[1];
+    double dz = a[2] - b[2];
+    double chord = sqrt(dx * dx + dy * dy + dz * dz);
+    return 2.0 * 6371.0 * asin(chord > 2.0 ? 1.0 : chord / 2.0);
+}
+
+// Hubs spread over the map: each one the city farthest from those already
+// chosen, starting from a city the seed picks
+static int routeSynthesisHubs(const KdTree* tree, int cityCount, int hubCount, uint64_t seed, int* hubs) {
+    if (hubCount > cityCount) {
+        hubCount = cityCount;
+    }
+    if (hubCount <= 0) {
+        return 0;
+    }
+
+    double* nearest = (double*)malloc(cityCount * sizeof(double));
+    if (nearest == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < cityCount; i++) {
+        nearest[i] = 1e30;
+    }
+
+    hubs[0] = (int)(routeSynthesisMix(seed) % (uint64_t)cityCount);
+    for (int h = 1; h <= hubCount; h++) {
+        const double* hub = tree->points + 3 * hubs[h - 1];
+        int farthest = 0;
+        for (int i = 0; i < cityCount; i++) {
+            const double* point = tree->points + 3 * i;
+            double dx = point[0] - hub[0];
+            double dy = point[1] - hub[1];
+            double dz = point[2] - hub[2];
+            double chord = dx * dx + dy * dy + dz * dz;
+            if (chord < nearest[i]) {
+                nearest[i] = chord;
+            }
+            if (nearest[i] > nearest[farthest]) {
+                farthest = i;
+            }
+        }
+        if (h < hubCount) {
+            hubs[h] = farthest;
+        }
+    }
+
+    free(nearest);
+    return hubCount;
+}
+
+static void* routeSynthesisWorkerRun(void* argument) {
+    RouteSynthesisWorker* worker = (RouteSynthesisWorker*)argument;
+    RouteSynthesisJob* job = worker->job;
+    const KdTree* tree = job->tree;
+
+    for (int city = worker->index; city < job->cityCount; city += job->threadCount) {
+        int* nearest = job->nearest + (size_t)city * job->neighbors;
+        int found = kdTreeNearest(tree, tree->points + 3 * city, city, job->neighbors, nearest, NULL);
+        for (int rank = found; rank < job->neighbors; rank++) {
+            nearest[rank] = -1;
+        }
+
+        double best = 1e30;
+        job->nearestHub[city] = -1;
+        for (int h = 0; h < job->hubCount; h++) {
+            const double* hub = tree->points + 3 * job->hubs[h];
+            const double* point = tree->points + 3 * city;
+            double dx = point[0] - hub[0];
+            double dy = point[1] - hub[1];
+            double dz = point[2] - hub[2];
+            double chord = dx * dx + dy * dy + dz * dz;
+            if (chord < best) {
+                best = chord;
+                job->nearestHub[city] = job->hubs[h];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// Whether to is among from's nearest neighbours
+static int routeSynthesisIsNeighbor(const RouteSynthesisJob* job, int from, int to) {
+    const int* nearest = job->nearest + (size_t)from * job->neighbors;
+    for (int rank = 0; rank < job->neighbors; rank++) {
+        if (nearest[rank] == to) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Add the route from -> to with distance-based time and cost
+static void routeSynthesisAdd(SynthesizedRoutes* routes, const KdTree* tree, uint64_t seed, int from, int to) {
+    double distance = routeSynthesisDistance(tree, from, to);
+    uint64_t state = routeSynthesisMix(seed ^ routeSynthesisMix(((uint64_t)(uint32_t)from << 32) | (uint32_t)to));
+    double costFactor = 0.5 + routeSynthesisUniform(state) * 0.5;
+    double timeFactor = 0.8 + routeSynthesisUniform(routeSynthesisMix(state)) * 0.4;
+
+    int r = routes->routeCount++;
+    routes->sources[r] = from;
+    routes->targets[r] = to;
+    routes->distances[r] = (float)distance;
+    routes->costs[r] = (float)(distance * costFactor);
+    routes->times[r] = (float)(distance / ROUTE_SYNTHESIS_SPEED * timeFactor);
+}
+
+// Add from -> to and to -> from
+static void routeSynthesisAddBoth(SynthesizedRoutes* routes, const KdTree* tree, uint64_t seed, int from, int to) {
+    routeSynthesisAdd(routes, tree, seed, from, to);
+    routeSynthesisAdd(routes, tree, seed, to, from);
+}
+
+// Routes over cityCount cities given in degrees, as set out above SynthesizedRoutes.
+// options may be NULL for the defaults. Neighbour searches are split over
+// options->threadCount threads.
+//
+// Returns the routes, or NULL on bad arguments or when memory runs out.
+SynthesizedRoutes* synthesizeRoutes(const double* latitudes, const double* longitudes, int cityCount,
+                                    const RouteSynthesisOptions* options) {
+    RouteSynthesisOptions defaults;
+    if (options == NULL) {
+        routeSynthesisDefaults(&defaults);
+        options = &defaults;
+    }
+    if (latitudes == NULL || longitudes == NULL || cityCount < 0 || options->neighbors < 0 || options->hubs < 0) {
+        return NULL;
+    }
+
+    int neighbors = options->neighbors < cityCount ? options->neighbors : (cityCount > 0 ? cityCount - 1 : 0);
+    int threadCount = options->threadCount < 1 ? 1 : options->threadCount;
+    if (threadCount > cityCount) {
+        threadCount = cityCount > 0 ? cityCount : 1;
+    }
+
+    SynthesizedRoutes* routes = (SynthesizedRoutes*)calloc(1, sizeof(SynthesizedRoutes));
+    KdTree* tree = createKdTree(latitudes, longitudes, cityCount);
+    int* nearest = (int*)malloc(((size_t)cityCount * neighbors + 1) * sizeof(int));
+    int* nearestHub = (int*)malloc((cityCount + 1) * sizeof(int));
+    RouteSynthesisWorker* workers = (RouteSynthesisWorker*)calloc(threadCount, sizeof(RouteSynthesisWorker));
+    pthread_t* threads = (pthread_t*)calloc(threadCount, sizeof(pthread_t));
+
+    int ok = routes != NULL && tree != NULL && nearest != NULL && nearestHub != NULL && workers != NULL && threads != NULL;
+    if (ok) {
+        int hubLimit = options->hubs < cityCount ? options->hubs : cityCount;
+        routes->hubs = (int*)malloc((hubLimit + 1) * sizeof(int));
+        routes->hubCount = routes->hubs != NULL ? routeSynthesisHubs(tree, cityCount, hubLimit, options->seed, routes->hubs) : -1;
+        ok = routes->hubCount >= 0;
+    }
+
+    RouteSynthesisJob job;
+    job.tree = tree;
+    job.cityCount = cityCount;
+    job.neighbors = neighbors;
+    job.nearest = nearest;
+    job.hubs = routes != NULL ? routes->hubs : NULL;
+    job.hubCount = routes != NULL ? routes->hubCount : 0;
+    job.nearestHub = nearestHub;
+    job.threadCount = threadCount;
+
+    if (ok && cityCount > 0) {
+        for (int t = 0; t < threadCount; t++) {
+            workers[t].job = &job;
+            workers[t].index = t;
+        }
+        // Cities whose thread cannot start get their neighbours found here
+        for (int t = 1; t < threadCount; t++) {
+            workers[t].started = pthread_create(&threads[t], NULL, routeSynthesisWorkerRun, &workers[t]) == 0;
+        }
+        routeSynthesisWorkerRun(&workers[0]);
+        for (int t = 1; t < threadCount; t++) {
+            if (workers[t].started) {
+                pthread_join(threads[t], NULL);
+            } else {
+                routeSynthesisWorkerRun(&workers[t]);
+            }
+        }
+    }
+
+    // Every neighbour pair both ways, every city to and from its hub, and
+    // every pair of hubs, each at most once
+    size_t capacity = ok ? (size_t)cityCount * neighbors * 2 + (size_t)cityCount * 2 + (size_t)routes->hubCount * routes->hubCount + 1 : 0;
+    if (ok) {
+        routes->sources = (int*)malloc(capacity * sizeof(int));
+        routes->targets = (int*)malloc(capacity * sizeof(int));
+        routes->distances = (float*)malloc(capacity * sizeof(float));
+        routes->times = (float*)malloc(capacity * sizeof(float));
+        routes->costs = (float*)malloc(capacity * sizeof(float));
+        ok = routes->sources != NULL && routes->targets != NULL && routes->distances != NULL &&
+             routes->times != NULL && routes->costs != NULL;
+    }
+
+    if (ok) {
+        unsigned char* isHub = (unsigned char*)calloc(cityCount + 1, 1);
+        ok = isHub != NULL;
+        for (int h = 0; ok && h < routes->hubCount; h++) {
+            isHub[routes->hubs[h]] = 1;
+        }
+
+        for (int city = 0; ok && city < cityCount; city++) {
+            for (int rank = 0; rank < neighbors; rank++) {
+                int other = nearest[(size_t)city * neighbors + rank];
+                // A mutual pair is added by the lower id only
+                if (other != -1 && (!routeSynthesisIsNeighbor(&job, other, city) || city < other)) {
+                    routeSynthesisAddBoth(routes, tree, options->seed, city, other);
+                }
+            }
+
+            int hub = nearestHub[city];
+            if (hub != -1 && !isHub[city] && !routeSynthesisIsNeighbor(&job, city, hub) &&
+                !routeSynthesisIsNeighbor(&job, hub, city)) {
+                routeSynthesisAddBoth(routes, tree, options->seed, city, hub);
+            }
+        }
+
+        for (int a = 0; ok && a < routes->hubCount; a++) {
+            for (int b = a + 1; b < routes->hubCount; b++) {
+                int from = routes->hubs[a];
+                int to = routes->hubs[b];
+                if (!routeSynthesisIsNeighbor(&job, from, to) && !routeSynthesisIsNeighbor(&job, to, from)) {
+                    routeSynthesisAddBoth(routes, tree, options->seed, from, to);
+                }
+            }
+        }
+
+        free(isHub);
+    }
+
+    freeKdTree(tree);
+    free(nearest);
+    free(nearestHub);
+    free(workers);
+    free(threads);
+
+    if (!ok) {
+        freeSynthesizedRoutes(routes);
+        return NULL;
+    }
+    return routes;
+}
+
+void freeSynthesizedRoutes(SynthesizedRoutes* routes) {
+    if (routes == NULL) {
+        return;
+    }
+
+    free(routes->sources);
+    free(routes->targets);
+    free(routes->distances);
+    free(routes->times);
+    free(routes->costs);
+    free(routes->hubs);
+    free(routes);
+}
+
+#endif // ROUTESYNTHESIS_H
@@ -0,0 +1,71 @@
+#ifndef SEARCHCOUNTERS_H
+#define SEARCHCOUNTERS_H
+
+#include <string.h>
+
+// Build with -DSEARCH_COUNTERS=0 to compile the counting out of every
+// search; the counts then stay at zero
+#ifndef SEARCH_COUNTERS
+#define SEARCH_COUNTERS 1
+#endif
+
+// What one search did, for comparing algorithms on the same query
+//
+// A search counts into the SearchCounters its workspace points at, if
+// any, so searches that nobody is comparing pay one untaken branch per
+// step and nothing at all when SEARCH_COUNTERS is 0.
+typedef struct SearchCounters {
+    long settled;          // cities popped and finalised
+    long relaxed;          // edges examined out of settled cities
+    long pushed;           // heap inserts and decrease-keys
+    int heapPeak;          // most cities queued at once
+
+    int* visited;          // settled cities in order, the first visitedCapacity of them
+    int visitedCapacity;
+} SearchCounters;
+
+#if SEARCH_COUNTERS
+#define SEARCH_COUNT_SETTLED(counters, city) \
+    do { \
+        if ((counters) != NULL) { \
+            if ((counters)->settled < (counters)->visitedCapacity) { \
+                (counters)->visited[(counters)->settled] = (city); \
+            } \
+            (counters)->settled++; \
+        } \
+    } while (0)
+#define SEARCH_COUNT_RELAXED(counters) \
+    do { \
+        if ((counters) != NULL) { \
+            (counters)->relaxed++; \
+        } \
+    } while (0)
+#define SEARCH_COUNT_PUSHED(counters, heap) \
+    do { \
+        if ((counters) != NULL) { \
+            (counters)->pushed++; \
+            if ((heap)->size > (counters)->heapPeak) { \
+                (counters)->heapPeak = (heap)->size; \
+            } \
+        } \
+    } while (0)
+#else
+#define SEARCH_COUNT_SETTLED(counters, city) do { } while (0)
+#define SEARCH_COUNT_RELAXED(counters) do { } while (0)
+#define SEARCH_COUNT_PUSHED(counters, heap) do { } while (0)
+#endif
+
+// Function prototypes
+void searchCountersReset(SearchCounters* counters, int* visited, int visitedCapacity);
+
+// Implementation
+
+// Zero the counts, recording up to visitedCapacity settled cities into
+// visited (which may be NULL for none)
+void searchCountersReset(SearchCounters* counters, int* visited, int visitedCapacity) {
+    memset(counters, 0, sizeof(SearchCounters));
+    counters->visited = visited;
+    counters->visitedCapacity = visited != NULL ? visitedCapacity : 0;
+}
+
+#endif // SEARCHCOUNTERS_H
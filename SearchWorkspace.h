@@ -0,0 +1,213 @@
+#ifndef SEARCHWORKSPACE_H
+#define SEARCHWORKSPACE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "CSRGraph.h"
+#include "IndexedHeap.h"
+#include "SearchCounters.h"
+
+// Distance of a city the search has not reached
+#define WORKSPACE_UNREACHED 1e30
+
+// Per-thread search state
+//
+// Everything a shortest-path query writes lives here, keyed by city id,
+// so any number of threads can search one shared CSRGraph as long as each
+// has its own workspace. The arrays are stamped rather than cleared: a
+// city's entries belong to the current query only where visitStamp is
+// visit, so starting a query costs nothing however large the graph. Read
+// them through workspaceDist and friends, or directly after a full search,
+// which leaves every city current.
+typedef struct SearchWorkspace {
+    int capacity;
+
+    double* dist;
+    int* parent;          // previous city on the best path, -1 if none
+    int* parentEdge;      // CSR edge used to reach the city, -1 if none
+    unsigned char* settled;
+    int* visitStamp;      // the entries above are valid where this is visit
+    int visit;
+    IndexedHeap* heap;
+
+    int settledCount;     // cities settled by the last query
+    SearchCounters* counters;   // counts searches into this when set, NULL otherwise
+} SearchWorkspace;
+
+// Function prototypes
+SearchWorkspace* createSearchWorkspace(int capacity);
+void freeSearchWorkspace(SearchWorkspace* ws);
+void workspaceReset(SearchWorkspace* ws);
+void workspaceTouch(SearchWorkspace* ws, int city);
+void workspaceTouchAll(SearchWorkspace* ws);
+double workspaceDist(const SearchWorkspace* ws, int city);
+int workspaceParent(const SearchWorkspace* ws, int city);
+int workspaceParentEdge(const SearchWorkspace* ws, int city);
+int shortestPath(const CSRGraph* csr, SearchWorkspace* ws, int origin, int destination, int costOrTime);
+int workspacePathEdges(const SearchWorkspace* ws, int destination, int* edges, int maxEdges);
+
+// Implementation
+SearchWorkspace* createSearchWorkspace(int capacity) {
+    SearchWorkspace* ws = (SearchWorkspace*)malloc(sizeof(SearchWorkspace));
+    if (ws == NULL) {
+        return NULL;
+    }
+
+    if (capacity < 1) {
+        capacity = 1;
+    }
+
+    ws->capacity = capacity;
+    ws->dist = (double*)malloc(capacity * sizeof(double));
+    ws->parent = (int*)malloc(capacity * sizeof(int));
+    ws->parentEdge = (int*)malloc(capacity * sizeof(int));
+    ws->settled = (unsigned char*)malloc(capacity * sizeof(unsigned char));
+    ws->visitStamp = (int*)calloc(capacity, sizeof(int));
+    ws->visit = 0;
+    ws->heap = createIndexedHeap(capacity);
+    ws->settledCount = 0;
+    ws->counters = NULL;
+
+    if (ws->dist == NULL || ws->parent == NULL || ws->parentEdge == NULL || ws->settled == NULL || ws->visitStamp == NULL ||
+        ws->heap == NULL) {
+        freeSearchWorkspace(ws);
+        return NULL;
+    }
+
+    // The heap counted its own
+    PROFILE_ALLOCATION(6, sizeof(SearchWorkspace) + capacity * (sizeof(double) + 3 * sizeof(int) + sizeof(unsigned char)));
+
+    workspaceReset(ws);
+    return ws;
+}
+
+void freeSearchWorkspace(SearchWorkspace* ws) {
+    if (ws == NULL) {
+        return;
+    }
+
+    free(ws->dist);
+    free(ws->parent);
+    free(ws->parentEdge);
+    free(ws->settled);
+    free(ws->visitStamp);
+    freeIndexedHeap(ws->heap);
+    free(ws);
+}
+
+void workspaceReset(SearchWorkspace* ws) {
+    // Only once every two billion queries, so no old stamp can match
+    if (ws->visit == INT_MAX) {
+        memset(ws->visitStamp, 0, ws->capacity * sizeof(int));
+        ws->visit = 0;
+    }
+    ws->visit++;
+    heapClear(ws->heap);
+    ws->settledCount = 0;
+}
+
+// Make city's entries current, as unreached if this query has not reached
+// it yet. Searches touch a city before reading or writing it.
+void workspaceTouch(SearchWorkspace* ws, int city) {
+    if (ws->visitStamp[city] != ws->visit) {
+        ws->visitStamp[city] = ws->visit;
+        ws->dist[city] = WORKSPACE_UNREACHED;
+        ws->parent[city] = -1;
+        ws->parentEdge[city] = -1;
+        ws->settled[city] = 0;
+    }
+}
+
+// Make every city current, so the arrays can be read whole. O(capacity),
+// which a search that sweeps the whole graph pays anyway.
+void workspaceTouchAll(SearchWorkspace* ws) {
+    for (int city = 0; city < ws->capacity; city++) {
+        workspaceTouch(ws, city);
+    }
+}
+
+// Distance of city in the last query, WORKSPACE_UNREACHED if not reached
+double workspaceDist(const SearchWorkspace* ws, int city) {
+    return ws->visitStamp[city] == ws->visit ? ws->dist[city] : WORKSPACE_UNREACHED;
+}
+
+int workspaceParent(const SearchWorkspace* ws, int city) {
+    return ws->visitStamp[city] == ws->visit ? ws->parent[city] : -1;
+}
+
+int workspaceParentEdge(const SearchWorkspace* ws, int city) {
+    return ws->visitStamp[city] == ws->visit ? ws->parentEdge[city] : -1;
+}
+
+// Dijkstra from origin (costOrTime: 1 = cost, 0 = time). Stops once
+// destination is settled; pass -1 to settle every reachable city, which
+// also leaves every city current. Returns 1 if destination was reached
+// (always 1 for -1).
+int shortestPath(const CSRGraph* csr, SearchWorkspace* ws, int origin, int destination, int costOrTime) {
+    if (csr == NULL || ws == NULL || csr->nodeCount > ws->capacity || origin < 0 || origin >= csr->nodeCount) {
+        return 0;
+    }
+
+    workspaceReset(ws);
+
+    const float* weights = csrWeights(csr, costOrTime);
+    workspaceTouch(ws, origin);
+    ws->dist[origin] = 0;
+    heapPushOrDecrease(ws->heap, origin, 0);
+    SEARCH_COUNT_PUSHED(ws->counters, ws->heap);
+
+    while (!heapEmpty(ws->heap)) {
+        int u = heapPop(ws->heap);
+        ws->settled[u] = 1;
+        ws->settledCount++;
+        SEARCH_COUNT_SETTLED(ws->counters, u);
+
+        if (u == destination) {
+            return 1;
+        }
+
+        for (int e = csr->offsets[u]; e < csr->offsets[u + 1]; e++) {
+            int v = csr->targets[e];
+            workspaceTouch(ws, v);
+            double length = ws->dist[u] + weights[e];
+            SEARCH_COUNT_RELAXED(ws->counters);
+            if (!ws->settled[v] && length < ws->dist[v]) {
+                ws->dist[v] = length;
+                ws->parent[v] = u;
+                ws->parentEdge[v] = e;
+                heapPushOrDecrease(ws->heap, v, length);
+                SEARCH_COUNT_PUSHED(ws->counters, ws->heap);
+            }
+        }
+    }
+
+    if (destination == -1) {
+        workspaceTouchAll(ws);
+        return 1;
+    }
+    return 0;
+}
+
+// CSR edges of the path to destination in travel order. Returns the
+// number of edges, or -1 if the path does not fit in maxEdges.
+int workspacePathEdges(const SearchWorkspace* ws, int destination, int* edges, int maxEdges) {
+    int count = 0;
+    for (int city = destination; workspaceParentEdge(ws, city) != -1; city = ws->parent[city]) {
+        count++;
+    }
+
+    if (count > maxEdges) {
+        return -1;
+    }
+
+    int index = count;
+    for (int city = destination; workspaceParentEdge(ws, city) != -1; city = ws->parent[city]) {
+        edges[--index] = ws->parentEdge[city];
+    }
+
+    return count;
+}
+
+#endif // SEARCHWORKSPACE_H
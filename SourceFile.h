@@ -0,0 +1,129 @@
+#ifndef SOURCEFILE_H
+#define SOURCEFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// Several input files can be passed as one argument separated by commas,
+// such as "routes.csv,indian_cities.csv"; they are read in that order
+#define SOURCE_LIST_SEPARATOR ','
+
+// Size, modification time and content hash of an input CSV (or list of
+// them), recorded in files derived from it so they can tell when it has
+// changed
+typedef struct SourceFileInfo {
+    int64_t size;
+    int64_t mtime;
+    uint64_t hash;
+} SourceFileInfo;
+
+// Function prototypes
+int nextSourceFile(const char** list, char* filename, size_t size);
+int describeSourceFile(const char* filename, SourceFileInfo* info);
+int sourceFileUnchanged(const SourceFileInfo* recorded, const char* filename);
+int sourceFileSame(const SourceFileInfo* a, const SourceFileInfo* b);
+
+// Implementation
+
+// Copy the next name of a file list into filename and move *list past it.
+// Returns 0 when the list is used up.
+int nextSourceFile(const char** list, char* filename, size_t size) {
+    const char* p = *list;
+    while (*p == SOURCE_LIST_SEPARATOR) {
+        p++;
+    }
+    if (*p == '\0' || size == 0) {
+        return 0;
+    }
+
+    const char* end = strchr(p, SOURCE_LIST_SEPARATOR);
+    size_t length = end != NULL ? (size_t)(end - p) : strlen(p);
+    if (length >= size) {
+        length = size - 1;
+    }
+    memcpy(filename, p, length);
+    filename[length] = '\0';
+
+    *list = end != NULL ? end + 1 : p + strlen(p);
+    return 1;
+}
+
+// Total size and newest mtime of a file list. Returns 0 if one is missing.
+static int sourceListStat(const char* list, int64_t* size, int64_t* mtime) {
+    char filename[4096];
+    int count = 0;
+    *size = 0;
+    *mtime = 0;
+
+    while (nextSourceFile(&list, filename, sizeof(filename))) {
+        struct stat status;
+        if (stat(filename, &status) != 0) {
+            return 0;
+        }
+        *size += (int64_t)status.st_size;
+        if ((int64_t)status.st_mtime > *mtime) {
+            *mtime = (int64_t)status.st_mtime;
+        }
+        count++;
+    }
+
+    return count > 0;
+}
+
+// Size, mtime and FNV-1a hash of a file, or of a list of files read one
+// after the other. Returns 0 if one cannot be read.
+int describeSourceFile(const char* filename, SourceFileInfo* info) {
+    if (filename == NULL || !sourceListStat(filename, &info->size, &info->mtime)) {
+        return 0;
+    }
+
+    uint64_t hash = 14695981039346656037ULL;
+    unsigned char buffer[65536];
+    char name[4096];
+    const char* list = filename;
+    while (nextSourceFile(&list, name, sizeof(name))) {
+        FILE* file = fopen(name, "rb");
+        if (file == NULL) {
+            return 0;
+        }
+
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            for (size_t i = 0; i < read; i++) {
+                hash ^= buffer[i];
+                hash *= 1099511628211ULL;
+            }
+        }
+        fclose(file);
+    }
+
+    info->hash = hash;
+    return 1;
+}
+
+// 1 if filename (or file list) still has the recorded contents
+int sourceFileUnchanged(const SourceFileInfo* recorded, const char* filename) {
+    int64_t size;
+    int64_t mtime;
+    if (filename == NULL || !sourceListStat(filename, &size, &mtime) || size != recorded->size) {
+        return 0;
+    }
+
+    // Same size and mtime is taken as unchanged; otherwise the content
+    // decides, so a touched but identical file is still accepted
+    if (mtime == recorded->mtime) {
+        return 1;
+    }
+
+    SourceFileInfo current;
+    return describeSourceFile(filename, &current) && current.hash == recorded->hash;
+}
+
+// 1 if two records describe the same contents
+int sourceFileSame(const SourceFileInfo* a, const SourceFileInfo* b) {
+    return a->size == b->size && a->hash == b->hash;
+}
+
+#endif // SOURCEFILE_H
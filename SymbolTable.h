@@ -0,0 +1,212 @@
+#ifndef SYMBOLTABLE_H
+#define SYMBOLTABLE_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Profiler.h"
+
+// Interned string table
+//
+// Each distinct name gets a stable integer id in insertion order. Names
+// are copied into one growable character pool and found through an
+// open-addressing (linear probing) hash of ids, so a lookup costs one
+// hash plus, on a hit, one string compare.
+typedef struct SymbolTable {
+    int count;
+
+    int* slots;            // symbol id or -1, slotCapacity is a power of two
+    int slotCapacity;
+
+    unsigned int* hashes;  // hash of each symbol, indexed by id
+    int* offsets;          // start of each symbol in pool, indexed by id
+    int idCapacity;
+
+    char* pool;
+    int poolSize;
+    int poolCapacity;
+} SymbolTable;
+
+// Function prototypes
+SymbolTable* createSymbolTable(int expectedCount);
+void freeSymbolTable(SymbolTable* table);
+unsigned int symbolHash(const char* name);
+int symbolLookup(const SymbolTable* table, const char* name);
+int symbolIntern(SymbolTable* table, const char* name);
+const char* symbolName(const SymbolTable* table, int id);
+
+// Implementation
+SymbolTable* createSymbolTable(int expectedCount) {
+    SymbolTable* table = (SymbolTable*)malloc(sizeof(SymbolTable));
+    if (table == NULL) {
+        return NULL;
+    }
+
+    // Keep the load factor at or below one half
+    int slotCapacity = 16;
+    while (slotCapacity < expectedCount * 2) {
+        slotCapacity *= 2;
+    }
+    int idCapacity = expectedCount > 8 ? expectedCount : 8;
+
+    table->count = 0;
+    table->slotCapacity = slotCapacity;
+    table->slots = (int*)malloc(slotCapacity * sizeof(int));
+    table->idCapacity = idCapacity;
+    table->hashes = (unsigned int*)malloc(idCapacity * sizeof(unsigned int));
+    table->offsets = (int*)malloc(idCapacity * sizeof(int));
+    table->poolCapacity = idCapacity * 16;
+    table->poolSize = 0;
+    table->pool = (char*)malloc(table->poolCapacity);
+
+    if (table->slots == NULL || table->hashes == NULL || table->offsets == NULL || table->pool == NULL) {
+        freeSymbolTable(table);
+        return NULL;
+    }
+
+    for (int i = 0; i < slotCapacity; i++) {
+        table->slots[i] = -1;
+    }
+    PROFILE_ALLOCATION(5, sizeof(SymbolTable) + slotCapacity * sizeof(int) + idCapacity * (sizeof(unsigned int) + sizeof(int)) + table->poolCapacity);
+
+    return table;
+}
+
+void freeSymbolTable(SymbolTable* table) {
+    if (table == NULL) {
+        return;
+    }
+
+    free(table->slots);
+    free(table->hashes);
+    free(table->offsets);
+    free(table->pool);
+    free(table);
+}
+
+// FNV-1a
+unsigned int symbolHash(const char* name) {
+    unsigned int hash = 2166136261u;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int symbolLookup(const SymbolTable* table, const char* name) {
+    if (table == NULL || name == NULL) {
+        return -1;
+    }
+
+    unsigned int hash = symbolHash(name);
+    unsigned int mask = (unsigned int)table->slotCapacity - 1;
+
+    for (unsigned int slot = hash & mask; ; slot = (slot + 1) & mask) {
+        int id = table->slots[slot];
+        if (id == -1) {
+            return -1;
+        }
+        if (table->hashes[id] == hash && strcmp(table->pool + table->offsets[id], name) == 0) {
+            return id;
+        }
+    }
+}
+
+int symbolIntern(SymbolTable* table, const char* name) {
+    if (table == NULL || name == NULL) {
+        return -1;
+    }
+
+    int existing = symbolLookup(table, name);
+    if (existing != -1) {
+        return existing;
+    }
+
+    // Grow the id-indexed arrays
+    if (table->count >= table->idCapacity) {
+        int newCapacity = table->idCapacity * 2;
+        unsigned int* newHashes = (unsigned int*)realloc(table->hashes, newCapacity * sizeof(unsigned int));
+        if (newHashes == NULL) {
+            return -1;
+        }
+        table->hashes = newHashes;
+
+        int* newOffsets = (int*)realloc(table->offsets, newCapacity * sizeof(int));
+        if (newOffsets == NULL) {
+            return -1;
+        }
+        table->offsets = newOffsets;
+        table->idCapacity = newCapacity;
+        PROFILE_ALLOCATION(2, newCapacity * (sizeof(unsigned int) + sizeof(int)));
+    }
+
+    // Grow the string pool
+    int length = (int)strlen(name) + 1;
+    if (table->poolSize + length > table->poolCapacity) {
+        int newCapacity = table->poolCapacity * 2;
+        while (table->poolSize + length > newCapacity) {
+            newCapacity *= 2;
+        }
+        char* newPool = (char*)realloc(table->pool, newCapacity);
+        if (newPool == NULL) {
+            return -1;
+        }
+        table->pool = newPool;
+        table->poolCapacity = newCapacity;
+        PROFILE_ALLOCATION(1, newCapacity);
+    }
+
+    // Rehash once the table would pass half full
+    if ((table->count + 1) * 2 > table->slotCapacity) {
+        int newCapacity = table->slotCapacity * 2;
+        int* newSlots = (int*)malloc(newCapacity * sizeof(int));
+        if (newSlots == NULL) {
+            return -1;
+        }
+        for (int i = 0; i < newCapacity; i++) {
+            newSlots[i] = -1;
+        }
+
+        unsigned int mask = (unsigned int)newCapacity - 1;
+        for (int id = 0; id < table->count; id++) {
+            unsigned int slot = table->hashes[id] & mask;
+            while (newSlots[slot] != -1) {
+                slot = (slot + 1) & mask;
+            }
+            newSlots[slot] = id;
+        }
+
+        free(table->slots);
+        table->slots = newSlots;
+        table->slotCapacity = newCapacity;
+        PROFILE_ALLOCATION(1, newCapacity * sizeof(int));
+    }
+
+    int id = table->count++;
+    unsigned int hash = symbolHash(name);
+    table->hashes[id] = hash;
+    table->offsets[id] = table->poolSize;
+    memcpy(table->pool + table->poolSize, name, length);
+    table->poolSize += length;
+
+    unsigned int mask = (unsigned int)table->slotCapacity - 1;
+    unsigned int slot = hash & mask;
+    while (table->slots[slot] != -1) {
+        slot = (slot + 1) & mask;
+    }
+    table->slots[slot] = id;
+
+    return id;
+}
+
+// Interned name of id; the pointer is valid until the next symbolIntern
+const char* symbolName(const SymbolTable* table, int id) {
+    if (table == NULL || id < 0 || id >= table->count) {
+        return NULL;
+    }
+
+    return table->pool + table->offsets[id];
+}
+
+#endif // SYMBOLTABLE_H
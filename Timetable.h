@@ -0,0 +1,369 @@
+#ifndef TIMETABLE_H
+#define TIMETABLE_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "GraphFunctions.h"
+#include "IndexedHeap.h"
+
+// Days of departures laid out from midnight of the query's day. A journey
+// must arrive within them; schedules repeat daily.
+#define TIMETABLE_DAYS 3
+
+// Hours allowed to change from one route to the next unless the query
+// asks for another
+#define TIMETABLE_DEFAULT_TRANSFER 0.5
+
+// Shortest time between departures; a smaller headway is read as this
+#define TIMETABLE_MIN_HEADWAY (1.0 / 60.0)
+
+// Arrival at a city a query has not reached
+#define TIMETABLE_UNREACHED 1e30
+
+// One departure of a scheduled route
+typedef struct TimetableConnection {
+    float departure;      // hours after midnight of the first day
+    float arrival;
+    int from;
+    int to;
+    int edge;             // CSR edge the departure runs on
+} TimetableConnection;
+
+// Departures of every scheduled route, built once and shared read-only
+//
+// The connections are one array sorted by departure, so an earliest
+// arrival query is a single forward scan over contiguous memory (the
+// Connection Scan Algorithm) rather than a search that jumps about the
+// graph. Routes without a departure time run whenever they are needed;
+// they are kept as lists of CSR edges per city and relaxed from a heap as
+// the scan's clock passes the cities they leave from.
+typedef struct Timetable {
+    int nodeCount;
+
+    TimetableConnection* connections;
+    int connectionCount;
+
+    int* anytimeOffsets;  // anytime edges of city i are anytimeEdges[anytimeOffsets[i] .. anytimeOffsets[i + 1] - 1]
+    int* anytimeEdges;
+    int scheduledRoutes;  // CSR edges with a departure time
+} Timetable;
+
+// Per-thread earliest arrival state
+//
+// Arrays are stamped rather than cleared, so a query costs the
+// connections it scans and the cities it reaches.
+typedef struct TimetableQuery {
+    int capacity;
+
+    double* arrival;      // earliest arrival at each city, valid where stamp is visit
+    double* ready;        // arrival plus the transfer: when the next leg may leave
+    int* inbound;         // connection reaching the city, -2 - edge for an anytime route, -1 at the origin
+    int* stamp;
+    int visit;
+    IndexedHeap* heap;    // cities whose anytime routes are still to be relaxed, by ready
+
+    int scannedCount;     // connections the last query looked at
+    int settledCount;     // cities whose anytime routes it relaxed
+} TimetableQuery;
+
+// Function prototypes
+Timetable* createTimetable(Graph* graph);
+void freeTimetable(Timetable* timetable);
+TimetableQuery* createTimetableQuery(int capacity);
+void freeTimetableQuery(TimetableQuery* query);
+int earliestArrival(const Timetable* timetable, const CSRGraph* csr, TimetableQuery* query,
+                    int origin, int destination, double departAt, double transfer);
+double timetableArrival(const TimetableQuery* query, int city);
+int timetablePathLegs(const Timetable* timetable, const CSRGraph* csr, const TimetableQuery* query, int destination,
+                      int* edges, double* departures, double* arrivals, int maxLegs);
+
+// Implementation
+static int timetableCompareConnections(const void* a, const void* b) {
+    const TimetableConnection* x = (const TimetableConnection*)a;
+    const TimetableConnection* y = (const TimetableConnection*)b;
+    if (x->departure != y->departure) {
+        return x->departure < y->departure ? -1 : 1;
+    }
+    if (x->arrival != y->arrival) {
+        return x->arrival < y->arrival ? -1 : 1;
+    }
+    return x->edge - y->edge;
+}
+
+// Departures of a scheduled route in one day, from its first until midnight
+static int timetableDailyDepartures(const Route* route) {
+    if (route->headway <= 0) {
+        return 1;
+    }
+
+    double headway = route->headway < TIMETABLE_MIN_HEADWAY ? TIMETABLE_MIN_HEADWAY : route->headway;
+    return 1 + (int)((24.0 - route->departure - 1e-9) / headway);
+}
+
+// Lay out the departures of graph's routes over TIMETABLE_DAYS days. A
+// graph mapped from a snapshot keeps no schedules, so all of its routes
+// run at any time.
+Timetable* createTimetable(Graph* graph) {
+    if (graph == NULL || graph->csr == NULL) {
+        return NULL;
+    }
+
+    const CSRGraph* csr = graph->csr;
+    Timetable* timetable = (Timetable*)malloc(sizeof(Timetable));
+    if (timetable == NULL) {
+        return NULL;
+    }
+
+    timetable->nodeCount = csr->nodeCount;
+    timetable->connections = NULL;
+    timetable->connectionCount = 0;
+    timetable->scheduledRoutes = 0;
+    timetable->anytimeOffsets = (int*)calloc(csr->nodeCount + 1, sizeof(int));
+    timetable->anytimeEdges = (int*)malloc((csr->edgeCount > 0 ? csr->edgeCount : 1) * sizeof(int));
+    if (timetable->anytimeOffsets == NULL || timetable->anytimeEdges == NULL) {
+        freeTimetable(timetable);
+        return NULL;
+    }
+
+    // Count the departures, then fill them in
+    long count = 0;
+    for (int edge = 0; edge < csr->edgeCount; edge++) {
+        const Route* route = graphEdgeRoute(graph, edge);
+        if (route != NULL && route->departure >= 0) {
+            count += (long)TIMETABLE_DAYS * timetableDailyDepartures(route);
+            timetable->scheduledRoutes++;
+        }
+    }
+
+    timetable->connections = (TimetableConnection*)malloc((count > 0 ? count : 1) * sizeof(TimetableConnection));
+    if (timetable->connections == NULL) {
+        freeTimetable(timetable);
+        return NULL;
+    }
+
+    int anytime = 0;
+    for (int city = 0; city < csr->nodeCount; city++) {
+        timetable->anytimeOffsets[city] = anytime;
+        for (int edge = csr->offsets[city]; edge < csr->offsets[city + 1]; edge++) {
+            const Route* route = graphEdgeRoute(graph, edge);
+            if (route == NULL || route->departure < 0) {
+                timetable->anytimeEdges[anytime++] = edge;
+                continue;
+            }
+
+            int daily = timetableDailyDepartures(route);
+            double headway = route->headway < TIMETABLE_MIN_HEADWAY ? TIMETABLE_MIN_HEADWAY : route->headway;
+            for (int day = 0; day < TIMETABLE_DAYS; day++) {
+                for (int i = 0; i < daily; i++) {
+                    TimetableConnection* connection = &timetable->connections[timetable->connectionCount++];
+                    connection->departure = (float)(24.0 * day + route->departure + i * headway);
+                    connection->arrival = connection->departure + csr->times[edge];
+                    connection->from = city;
+                    connection->to = csr->targets[edge];
+                    connection->edge = edge;
+                }
+            }
+        }
+    }
+    timetable->anytimeOffsets[csr->nodeCount] = anytime;
+
+    qsort(timetable->connections, timetable->connectionCount, sizeof(TimetableConnection), timetableCompareConnections);
+    return timetable;
+}
+
+void freeTimetable(Timetable* timetable) {
+    if (timetable == NULL) {
+        return;
+    }
+
+    free(timetable->connections);
+    free(timetable->anytimeOffsets);
+    free(timetable->anytimeEdges);
+    free(timetable);
+}
+
+TimetableQuery* createTimetableQuery(int capacity) {
+    TimetableQuery* query = (TimetableQuery*)malloc(sizeof(TimetableQuery));
+    if (query == NULL) {
+        return NULL;
+    }
+
+    if (capacity < 1) {
+        capacity = 1;
+    }
+
+    query->capacity = capacity;
+    query->arrival = (double*)malloc(capacity * sizeof(double));
+    query->ready = (double*)malloc(capacity * sizeof(double));
+    query->inbound = (int*)malloc(capacity * sizeof(int));
+    query->stamp = (int*)calloc(capacity, sizeof(int));
+    query->visit = 0;
+    query->heap = createIndexedHeap(capacity);
+    query->scannedCount = 0;
+    query->settledCount = 0;
+
+    if (query->arrival == NULL || query->ready == NULL || query->inbound == NULL || query->stamp == NULL ||
+        query->heap == NULL) {
+        freeTimetableQuery(query);
+        return NULL;
+    }
+
+    return query;
+}
+
+void freeTimetableQuery(TimetableQuery* query) {
+    if (query == NULL) {
+        return;
+    }
+
+    free(query->arrival);
+    free(query->ready);
+    free(query->inbound);
+    free(query->stamp);
+    freeIndexedHeap(query->heap);
+    free(query);
+}
+
+// Record an arrival at city if it beats the one known
+static void timetableImprove(TimetableQuery* query, int city, double arrival, double transfer, int inbound) {
+    if (query->stamp[city] == query->visit && arrival >= query->arrival[city]) {
+        return;
+    }
+
+    query->stamp[city] = query->visit;
+    query->arrival[city] = arrival;
+    query->ready[city] = arrival + transfer;
+    query->inbound[city] = inbound;
+    heapPushOrDecrease(query->heap, city, query->ready[city]);
+}
+
+// Earliest arrival at destination leaving origin at departAt, in hours
+// after midnight of the first timetable day (0 <= departAt < 24). Each
+// change of route takes transfer hours.
+//
+// Connections are scanned in departure order from departAt. Before each
+// one, every city ready by its departure has its anytime routes relaxed,
+// so the scan sees those arrivals in time. The scan stops once departures
+// pass the best arrival at destination.
+//
+// Returns 1 if destination is reached within TIMETABLE_DAYS, 0 if not, or
+// -1 on bad arguments.
+int earliestArrival(const Timetable* timetable, const CSRGraph* csr, TimetableQuery* query,
+                    int origin, int destination, double departAt, double transfer) {
+    if (timetable == NULL || csr == NULL || query == NULL || timetable->nodeCount != csr->nodeCount ||
+        csr->nodeCount > query->capacity || origin < 0 || origin >= csr->nodeCount ||
+        destination < 0 || destination >= csr->nodeCount || transfer < 0) {
+        return -1;
+    }
+
+    query->visit++;
+    query->scannedCount = 0;
+    query->settledCount = 0;
+    heapClear(query->heap);
+
+    // No change is needed to board the first leg
+    timetableImprove(query, origin, departAt, 0, -1);
+
+    // First connection leaving at or after departAt
+    int low = 0;
+    int high = timetable->connectionCount;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (timetable->connections[middle].departure < departAt) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    for (int c = low; ; c++) {
+        double now = c < timetable->connectionCount ? timetable->connections[c].departure : TIMETABLE_UNREACHED;
+        double best = query->stamp[destination] == query->visit ? query->arrival[destination] : TIMETABLE_UNREACHED;
+
+        // Anytime routes out of every city ready by now
+        while (!heapEmpty(query->heap) && heapTopKey(query->heap) <= now && heapTopKey(query->heap) < best) {
+            int city = heapPop(query->heap);
+            query->settledCount++;
+            if (city == destination) {
+                continue;
+            }
+
+            for (int i = timetable->anytimeOffsets[city]; i < timetable->anytimeOffsets[city + 1]; i++) {
+                int edge = timetable->anytimeEdges[i];
+                double arrival = query->ready[city] + csr->times[edge];
+                if (arrival < best) {
+                    timetableImprove(query, csr->targets[edge], arrival, transfer, -2 - edge);
+                    if (csr->targets[edge] == destination) {
+                        best = arrival;
+                    }
+                }
+            }
+        }
+
+        if (now >= best || c >= timetable->connectionCount) {
+            break;
+        }
+
+        const TimetableConnection* connection = &timetable->connections[c];
+        query->scannedCount++;
+        if (query->stamp[connection->from] == query->visit && query->ready[connection->from] <= connection->departure &&
+            connection->arrival < best) {
+            timetableImprove(query, connection->to, connection->arrival, transfer, c);
+        }
+    }
+
+    return query->stamp[destination] == query->visit;
+}
+
+// Arrival at city found by the last query, TIMETABLE_UNREACHED if none
+double timetableArrival(const TimetableQuery* query, int city) {
+    if (city < 0 || city >= query->capacity || query->stamp[city] != query->visit) {
+        return TIMETABLE_UNREACHED;
+    }
+    return query->arrival[city];
+}
+
+// Legs of the last query's journey to destination in travel order: the
+// CSR edge of each with the hours it leaves and arrives. Returns the
+// number of legs, or -1 if destination was not reached or they do not fit.
+int timetablePathLegs(const Timetable* timetable, const CSRGraph* csr, const TimetableQuery* query, int destination,
+                      int* edges, double* departures, double* arrivals, int maxLegs) {
+    if (timetableArrival(query, destination) >= TIMETABLE_UNREACHED) {
+        return -1;
+    }
+
+    int count = 0;
+    for (int city = destination; query->inbound[city] != -1; ) {
+        int inbound = query->inbound[city];
+        city = inbound >= 0 ? timetable->connections[inbound].from : csrEdgeSource(csr, -2 - inbound);
+        count++;
+    }
+    if (count > maxLegs) {
+        return -1;
+    }
+
+    int index = count;
+    for (int city = destination; query->inbound[city] != -1; ) {
+        int inbound = query->inbound[city];
+        index--;
+        if (inbound >= 0) {
+            const TimetableConnection* connection = &timetable->connections[inbound];
+            edges[index] = connection->edge;
+            departures[index] = connection->departure;
+            arrivals[index] = connection->arrival;
+            city = connection->from;
+        } else {
+            int edge = -2 - inbound;
+            int from = csrEdgeSource(csr, edge);
+            edges[index] = edge;
+            departures[index] = query->ready[from];
+            arrivals[index] = query->arrival[city];
+            city = from;
+        }
+    }
+
+    return count;
+}
+
+#endif // TIMETABLE_H
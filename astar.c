@@ -4,6 +4,17 @@
 #include <math.h>
 #include <time.h>
 #include <float.h>
+#include <limits.h>
+
+#include "SymbolTable.h"
+#include "CSRGraph.h"
+#include "IndexedHeap.h"
+#include "Arena.h"
+#include "GraphSnapshot.h"
+#include "CsvReader.h"
+#include "CsvSchema.h"
+#include "BidirectionalSearch.h"
+#include "Landmarks.h"
 
 // Define M_PI if not defined
 #ifndef M_PI
@@ -25,47 +36,66 @@ typedef struct {
     double distance;
     double cost;
     double time;
+    int fromIndex;  // City indices, -1 if the city is not loaded
+    int toIndex;
 } Route;
 
-// Structure for A* algorithm node
-typedef struct Node {
-    char city[256];
+// A* search record, allocated from the per-query arena (one per city reached)
+typedef struct SearchRecord {
+    int cityIndex;
+    int parent;     // Index of the parent record, -1 for the start
     double g_cost;  // Cost from start to current node
     double h_cost;  // Heuristic cost to goal
-    double f_cost;  // g_cost + h_cost
-    struct Node* parent;
-} Node;
+} SearchRecord;
 
-// Structure for priority queue
-typedef struct PQNode {
-    Node* node;
-    struct PQNode* next;
-} PQNode;
+// Records of one query; path ends at goal (-1 if no path was found)
+typedef struct SearchResult {
+    SearchRecord* records;
+    int recordCount;
+    int goal;
+} SearchResult;
 
-typedef struct {
-    PQNode* front;
-} PriorityQueue;
+// Record of a city in the current query, valid where stamp is its visit
+typedef struct AStarEntry {
+    int stamp;
+    int record;
+} AStarEntry;
+
+// A* state kept across queries
+//
+// The open set is cleared rather than reallocated, and recordOf is
+// stamped like a SearchWorkspace, so starting a query costs nothing
+// however many cities there are. A city is closed once it has a record
+// and has left the open set.
+typedef struct AStarSearch {
+    int capacity;
+    IndexedHeap* openSet;
+    AStarEntry* recordOf;
+    int visit;
+} AStarSearch;
 
 // Function prototypes
 City* createCity(const char* name, const char* country, double lat, double lon);
 void freeCity(City* city);
 Route* createRoute(const char* from, const char* to, double distance, double cost, double time);
 void freeRoute(Route* route);
-Node* createNode(const char* city, double g_cost, double h_cost, Node* parent);
-void freeNode(Node* node);
-void freeAllNodes(Node* node);
-PriorityQueue* createPriorityQueue();
-void freePriorityQueue(PriorityQueue* pq);
-void push(PriorityQueue* pq, Node* node);
-Node* pop(PriorityQueue* pq);
-int isEmpty(PriorityQueue* pq);
 double haversine(double lat1, double lon1, double lat2, double lon2);
-double heuristic(const City* a, const City* b);
-int findCityIndex(City** cities, int cityCount, const char* name);
+double heuristic(const Landmarks* landmarks, int costOrTime, int city, int goal);
+SymbolTable* buildCityIndex(City** cities, int* cityCount);
+int findCityIndex(const SymbolTable* cityIndex, const char* name);
+CSRGraph* buildRouteGraph(const SymbolTable* cityIndex, int cityCount, Route** routes, int routeCount);
 void parseCitiesFile(const char* filename, City*** cities, int* cityCount);
-void parseRoutesFile(const char* filename, Route*** routes, int* routeCount);
-void generateOutputFile(const char* filename, Node* path, City** cities, int cityCount, Route** routes, int routeCount, const char* criteria, clock_t startTime, int nodesVisited);
-Node* astar(City** cities, int cityCount, Route** routes, int routeCount, const char* start, const char* goal, const char* criteria, int* nodesVisited);
+void parseRoutesFile(const char* filenames, Route*** routes, int* routeCount);
+City** citiesFromSnapshot(const GraphSnapshot* snapshot);
+void generateOutputFile(const char* filename, const SearchResult* path, City** cities, const CSRGraph* graph, const float* edgeDistances, const char* criteria, clock_t startTime, int nodesVisited);
+int parseCriteria(const char* criteria, int* bidirectional);
+AStarSearch* createAStarSearch(int capacity);
+void freeAStarSearch(AStarSearch* search);
+SearchResult astar(Arena* arena, AStarSearch* search, const SymbolTable* cityIndex, const CSRGraph* graph, const Landmarks* landmarks, const char* start, const char* goal, const char* criteria, int* nodesVisited);
+Landmarks* prepareLandmarks(const char* landmarksFile, const CSRGraph* graph, const GraphSnapshot* snapshot, const char* citiesFile, const char* routesFile);
+SearchResult bidirectionalSearch(Arena* arena, SearchWorkspace* forward, SearchWorkspace* backward, const SymbolTable* cityIndex, const CSRGraph* graph, const CSRGraph* reverse, const char* start, const char* goal, const char* criteria, int* nodesVisited);
+void writeJsonString(FILE* file, const char* text);
+int runBatch(int argc, char* argv[]);
 
 // City functions
 City* createCity(const char* name, const char* country, double lat, double lon) {
@@ -106,6 +136,8 @@ Route* createRoute(const char* from, const char* to, double distance, double cos
     route->distance = distance;
     route->cost = cost;
     route->time = time;
+    route->fromIndex = -1;
+    route->toIndex = -1;
     
     return route;
 }
@@ -114,112 +146,6 @@ void freeRoute(Route* route) {
     free(route);
 }
 
-// Node functions
-Node* createNode(const char* city, double g_cost, double h_cost, Node* parent) {
-    Node* node = (Node*)malloc(sizeof(Node));
-    if (node == NULL) {
-        return NULL;
-    }
-    
-    strncpy(node->city, city, sizeof(node->city) - 1);
-    node->city[sizeof(node->city) - 1] = '\0';
-    
-    node->g_cost = g_cost;
-    node->h_cost = h_cost;
-    node->f_cost = g_cost + h_cost;
-    node->parent = parent;
-    
-    return node;
-}
-
-void freeNode(Node* node) {
-    free(node);
-}
-
-void freeAllNodes(Node* node) {
-    if (node == NULL) {
-        return;
-    }
-    
-    if (node->parent != NULL) {
-        freeAllNodes(node->parent);
-    }
-    
-    freeNode(node);
-}
-
-// Priority queue functions
-PriorityQueue* createPriorityQueue() {
-    PriorityQueue* pq = (PriorityQueue*)malloc(sizeof(PriorityQueue));
-    if (pq == NULL) {
-        return NULL;
-    }
-    
-    pq->front = NULL;
-    
-    return pq;
-}
-
-void freePriorityQueue(PriorityQueue* pq) {
-    if (pq == NULL) {
-        return;
-    }
-    
-    PQNode* current = pq->front;
-    while (current != NULL) {
-        PQNode* next = current->next;
-        free(current);
-        current = next;
-    }
-    
-    free(pq);
-}
-
-void push(PriorityQueue* pq, Node* node) {
-    if (pq == NULL || node == NULL) {
-        return;
-    }
-    
-    PQNode* newNode = (PQNode*)malloc(sizeof(PQNode));
-    if (newNode == NULL) {
-        return;
-    }
-    
-    newNode->node = node;
-    
-    // Insert in sorted order (by f_cost)
-    if (pq->front == NULL || pq->front->node->f_cost > node->f_cost) {
-        newNode->next = pq->front;
-        pq->front = newNode;
-    } else {
-        PQNode* current = pq->front;
-        while (current->next != NULL && current->next->node->f_cost <= node->f_cost) {
-            current = current->next;
-        }
-        
-        newNode->next = current->next;
-        current->next = newNode;
-    }
-}
-
-Node* pop(PriorityQueue* pq) {
-    if (pq == NULL || pq->front == NULL) {
-        return NULL;
-    }
-    
-    PQNode* frontNode = pq->front;
-    Node* node = frontNode->node;
-    
-    pq->front = frontNode->next;
-    free(frontNode);
-    
-    return node;
-}
-
-int isEmpty(PriorityQueue* pq) {
-    return pq == NULL || pq->front == NULL;
-}
-
 // Haversine formula to calculate distance between two points on Earth
 double haversine(double lat1, double lon1, double lat2, double lon2) {
     // Convert latitude and longitude from degrees to radians
@@ -240,157 +166,230 @@ double haversine(double lat1, double lon1, double lat2, double lon2) {
     return radius * c;
 }
 
-// Heuristic function for A* (straight-line distance)
-double heuristic(const City* a, const City* b) {
-    return haversine(a->latitude, a->longitude, b->latitude, b->longitude);
+// Heuristic function for A*: the landmark lower bound, in the same hours
+// or dollars as the search (0 without landmarks, which is still admissible).
+// LANDMARK_UNREACHED means city cannot reach goal.
+double heuristic(const Landmarks* landmarks, int costOrTime, int city, int goal) {
+    return landmarks != NULL ? landmarkBound(landmarks, costOrTime, city, goal) : 0.0;
+}
+
+// Intern city names so that symbol id == index in cities. A repeated
+// name is skipped like loadCities does: the first row keeps it, and the
+// later ones are freed and cities closed up over them.
+SymbolTable* buildCityIndex(City** cities, int* cityCount) {
+    SymbolTable* cityIndex = createSymbolTable(*cityCount);
+    if (cityIndex == NULL) {
+        return NULL;
+    }
+    
+    int kept = 0;
+    for (int i = 0; i < *cityCount; i++) {
+        if (symbolIntern(cityIndex, cities[i]->name) != kept) {
+            printf("Skipping duplicate city in cities file: %s\n", cities[i]->name);
+            freeCity(cities[i]);
+            continue;
+        }
+        cities[kept++] = cities[i];
+    }
+    *cityCount = kept;
+    
+    return cityIndex;
 }
 
 // Find city index by name
-int findCityIndex(City** cities, int cityCount, const char* name) {
-    for (int i = 0; i < cityCount; i++) {
-        if (strcmp(cities[i]->name, name) == 0) {
-            return i;
+int findCityIndex(const SymbolTable* cityIndex, const char* name) {
+    return symbolLookup(cityIndex, name);
+}
+
+// Resolve route endpoints once and pack them into a CSR adjacency
+CSRGraph* buildRouteGraph(const SymbolTable* cityIndex, int cityCount, Route** routes, int routeCount) {
+    int* sources = (int*)malloc(routeCount * sizeof(int));
+    int* targets = (int*)malloc(routeCount * sizeof(int));
+    float* times = (float*)malloc(routeCount * sizeof(float));
+    float* costs = (float*)malloc(routeCount * sizeof(float));
+    
+    CSRGraph* graph = NULL;
+    if (sources != NULL && targets != NULL && times != NULL && costs != NULL) {
+        for (int i = 0; i < routeCount; i++) {
+            routes[i]->fromIndex = findCityIndex(cityIndex, routes[i]->from);
+            routes[i]->toIndex = findCityIndex(cityIndex, routes[i]->to);
+            
+            sources[i] = routes[i]->fromIndex;
+            targets[i] = routes[i]->toIndex;
+            times[i] = (float)routes[i]->time;
+            costs[i] = (float)routes[i]->cost;
         }
+        
+        graph = createCSRGraph(cityCount, routeCount, sources, targets, times, costs, NULL);
     }
-    return -1;
+    
+    free(sources);
+    free(targets);
+    free(times);
+    free(costs);
+    
+    return graph;
 }
 
 // Parse cities from file
 void parseCitiesFile(const char* filename, City*** cities, int* cityCount) {
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
+    CsvReader* reader = openCsvReader(filename);
+    if (reader == NULL) {
         printf("Error opening cities file: %s\n", filename);
         return;
     }
     
-    // Count lines to allocate memory
-    int count = 0;
-    char line[1024];
-    
-    while (fgets(line, sizeof(line), file)) {
-        count++;
-    }
-    
-    // Allocate memory for cities
-    *cities = (City**)malloc(count * sizeof(City*));
+    int capacity = 64;
+    *cities = (City**)malloc(capacity * sizeof(City*));
     if (*cities == NULL) {
-        fclose(file);
+        closeCsvReader(reader);
         return;
     }
     
-    // Reset file pointer to beginning
-    rewind(file);
-    
-    // Parse file
+    // Parse file, mapping columns by the header if there is one
     *cityCount = 0;
-    while (fgets(line, sizeof(line), file)) {
-        // Remove newline
-        line[strcspn(line, "\n")] = 0;
+    CsvSchema schema;
+    int first = 1;
+    int status;
+    while ((status = csvNextRecord(reader)) != CSV_END) {
+        if (status == CSV_MALFORMED) continue;
         
-        // Parse CSV line
-        char* token = strtok(line, ",");
-        if (token == NULL) continue;
-        char country[256];
-        strncpy(country, token, sizeof(country) - 1);
-        country[sizeof(country) - 1] = '\0';
+        if (first) {
+            first = 0;
+            int header = csvDetectSchema(reader, CSV_SCHEMA_CITIES, &schema);
+            if (header < 0) break;
+            if (header) continue;
+        }
         
-        token = strtok(NULL, ",");
-        if (token == NULL) continue;
-        char name[256];
-        strncpy(name, token, sizeof(name) - 1);
-        name[sizeof(name) - 1] = '\0';
+        if (reader->fieldCount < schema.requiredFields) {
+            csvReportMalformed(reader, "missing city, latitude or longitude");
+            continue;
+        }
         
-        token = strtok(NULL, ",");
-        if (token == NULL) continue;
-        double lat = atof(token);
+        double lat;
+        double lon;
+        if (!csvSchemaNumber(reader, &schema, CSV_COLUMN_LATITUDE, &lat) ||
+            !csvSchemaNumber(reader, &schema, CSV_COLUMN_LONGITUDE, &lon)) {
+            csvReportMalformed(reader, "latitude and longitude must be numbers");
+            continue;
+        }
         
-        token = strtok(NULL, ",");
-        if (token == NULL) continue;
-        double lon = atof(token);
+        if (*cityCount >= capacity) {
+            City** grown = (City**)realloc(*cities, capacity * 2 * sizeof(City*));
+            if (grown == NULL) break;
+            *cities = grown;
+            capacity *= 2;
+        }
         
         // Create city
-        City* city = createCity(name, country, lat, lon);
+        City* city = createCity(csvSchemaField(reader, &schema, CSV_COLUMN_CITY),
+                                csvSchemaField(reader, &schema, CSV_COLUMN_COUNTRY), lat, lon);
         if (city != NULL) {
             (*cities)[(*cityCount)++] = city;
         }
     }
     
-    fclose(file);
+    closeCsvReader(reader);
 }
 
-// Parse routes from file
-void parseRoutesFile(const char* filename, Route*** routes, int* routeCount) {
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
-        printf("Error opening routes file: %s\n", filename);
-        return;
-    }
-    
-    // Count lines to allocate memory
-    int count = 0;
-    char line[1024];
-    
-    while (fgets(line, sizeof(line), file)) {
-        count++;
-    }
-    
-    // Allocate memory for routes
-    *routes = (Route**)malloc(count * sizeof(Route*));
+// Parse routes from a file, or from each file of a comma-separated list
+void parseRoutesFile(const char* filenames, Route*** routes, int* routeCount) {
+    int capacity = 256;
+    *routes = (Route**)malloc(capacity * sizeof(Route*));
     if (*routes == NULL) {
-        fclose(file);
         return;
     }
-    
-    // Reset file pointer to beginning
-    rewind(file);
-    
-    // Parse file
     *routeCount = 0;
-    while (fgets(line, sizeof(line), file)) {
-        // Remove newline
-        line[strcspn(line, "\n")] = 0;
-        
-        // Parse CSV line
-        char* token = strtok(line, ",");
-        if (token == NULL) continue;
-        char from[256];
-        strncpy(from, token, sizeof(from) - 1);
-        from[sizeof(from) - 1] = '\0';
-        
-        token = strtok(NULL, ",");
-        if (token == NULL) continue;
-        char to[256];
-        strncpy(to, token, sizeof(to) - 1);
-        to[sizeof(to) - 1] = '\0';
-        
-        token = strtok(NULL, ",");
-        if (token == NULL) continue;
-        // Skip transport mode
-        
-        token = strtok(NULL, ",");
-        if (token == NULL) continue;
-        double time = atof(token);
-        
-        token = strtok(NULL, ",");
-        if (token == NULL) continue;
-        double cost = atof(token);
+    
+    const char* list = filenames;
+    char filename[4096];
+    while (nextSourceFile(&list, filename, sizeof(filename))) {
+        CsvReader* reader = openCsvReader(filename);
+        if (reader == NULL) {
+            printf("Error opening routes file: %s\n", filename);
+            continue;
+        }
         
-        // Calculate distance (will be recalculated based on city coordinates)
-        double distance = 0.0;
+        // Parse file; transport mode and notes are not used here
+        CsvSchema schema;
+        int first = 1;
+        int status;
+        while ((status = csvNextRecord(reader)) != CSV_END) {
+            if (status == CSV_MALFORMED) continue;
+            
+            if (first) {
+                first = 0;
+                int header = csvDetectSchema(reader, CSV_SCHEMA_ROUTES, &schema);
+                if (header < 0) break;
+                if (header) continue;
+            }
+            
+            if (reader->fieldCount < schema.requiredFields) {
+                csvReportMalformed(reader, "missing origin, destination, time or cost");
+                continue;
+            }
+            
+            double time;
+            double cost;
+            if (!csvSchemaNumber(reader, &schema, CSV_COLUMN_TIME, &time) ||
+                !csvSchemaNumber(reader, &schema, CSV_COLUMN_COST, &cost)) {
+                csvReportMalformed(reader, "time and cost must be numbers");
+                continue;
+            }
+            
+            // Files without a distance get one from city coordinates later
+            double distance;
+            if (!csvSchemaNumber(reader, &schema, CSV_COLUMN_DISTANCE, &distance)) {
+                distance = 0.0;
+            }
+            
+            if (*routeCount >= capacity) {
+                Route** grown = (Route**)realloc(*routes, capacity * 2 * sizeof(Route*));
+                if (grown == NULL) break;
+                *routes = grown;
+                capacity *= 2;
+            }
+            
+            // Create route
+            Route* route = createRoute(csvSchemaField(reader, &schema, CSV_COLUMN_ORIGIN),
+                                       csvSchemaField(reader, &schema, CSV_COLUMN_DESTINATION), distance, cost, time);
+            if (route != NULL) {
+                (*routes)[(*routeCount)++] = route;
+            }
+        }
         
-        // Create route
-        Route* route = createRoute(from, to, distance, cost, time);
-        if (route != NULL) {
-            (*routes)[(*routeCount)++] = route;
+        closeCsvReader(reader);
+    }
+}
+
+// City records of a mapped snapshot, indexed by its city ids
+City** citiesFromSnapshot(const GraphSnapshot* snapshot) {
+    int cityCount = snapshot->csr.nodeCount;
+    City** cities = (City**)malloc((cityCount > 0 ? cityCount : 1) * sizeof(City*));
+    if (cities == NULL) {
+        return NULL;
+    }
+    
+    for (int i = 0; i < cityCount; i++) {
+        cities[i] = createCity(snapshotCityName(snapshot, i), snapshotCityCountry(snapshot, i),
+                               snapshot->cities[i].lat, snapshot->cities[i].lon);
+        if (cities[i] == NULL) {
+            for (int j = 0; j < i; j++) {
+                freeCity(cities[j]);
+            }
+            free(cities);
+            return NULL;
         }
     }
     
-    fclose(file);
+    return cities;
 }
 
-// Generate output HTML file
-void generateOutputFile(const char* filename, Node* path, City** cities, int cityCount, Route** routes, int routeCount, const char* criteria, clock_t startTime, int nodesVisited) {
-    if (path == NULL) {
+// Generate output HTML file. edgeDistances gives the km of each graph
+// edge, 0 where unknown; legs without one (or all, if it is NULL) use
+// the great-circle distance.
+void generateOutputFile(const char* filename, const SearchResult* path, City** cities, const CSRGraph* graph, const float* edgeDistances, const char* criteria, clock_t startTime, int nodesVisited) {
+    if (path == NULL || path->goal == -1) {
         printf("No path found.\n");
         return;
     }
@@ -424,24 +423,24 @@ void generateOutputFile(const char* filename, Node* path, City** cities, int cit
     
     // Count path length and build path array
     int pathLength = 0;
-    Node* current = path;
-    while (current != NULL) {
+    for (int current = path->goal; current != -1; current = path->records[current].parent) {
         pathLength++;
-        current = current->parent;
     }
     
-    char** pathArray = (char**)malloc(pathLength * sizeof(char*));
+    int* pathArray = (int*)malloc(pathLength * sizeof(int));
     if (pathArray == NULL) {
         fclose(file);
         return;
     }
     
-    current = path;
+    int current = path->goal;
     for (int i = pathLength - 1; i >= 0; i--) {
-        pathArray[i] = current->city;
-        current = current->parent;
+        pathArray[i] = path->records[current].cityIndex;
+        current = path->records[current].parent;
     }
     
+    int costOrTime = parseCriteria(criteria, NULL);
+    
     // Calculate totals
     double totalCost = 0.0;
     double totalTime = 0.0;
@@ -449,10 +448,7 @@ void generateOutputFile(const char* filename, Node* path, City** cities, int cit
     
     // Print route
     for (int i = 0; i < pathLength; i++) {
-        int cityIndex = findCityIndex(cities, cityCount, pathArray[i]);
-        if (cityIndex == -1) continue;
-        
-        City* city = cities[cityIndex];
+        City* city = cities[pathArray[i]];
         
         fprintf(file, "        <div class=\"route-item\">\n");
         
@@ -462,24 +458,25 @@ void generateOutputFile(const char* filename, Node* path, City** cities, int cit
             fprintf(file, "            <h2>To: %s, %s</h2>\n", city->name, city->country);
             
             // Find route info
-            for (int j = 0; j < routeCount; j++) {
-                if (strcmp(routes[j]->from, pathArray[i-1]) == 0 && strcmp(routes[j]->to, pathArray[i]) == 0) {
-                    fprintf(file, "            <p>Time: %.2f hours</p>\n", routes[j]->time);
-                    fprintf(file, "            <p>Cost: $%.2f</p>\n", routes[j]->cost);
-                    
-                    int prevCityIndex = findCityIndex(cities, cityCount, pathArray[i-1]);
-                    if (prevCityIndex != -1) {
-                        double dist = haversine(cities[prevCityIndex]->latitude, cities[prevCityIndex]->longitude, 
-                                              city->latitude, city->longitude);
-                        fprintf(file, "            <p>Distance: %.2f km</p>\n", dist);
-                        
-                        totalDistance += dist;
-                        totalCost += routes[j]->cost;
-                        totalTime += routes[j]->time;
-                    }
-                    
-                    break;
+            int edge = csrFindEdge(graph, pathArray[i-1], pathArray[i], costOrTime);
+            if (edge != -1) {
+                double time = graph->times[edge];
+                double cost = graph->costs[edge];
+                City* prevCity = cities[pathArray[i-1]];
+                
+                fprintf(file, "            <p>Time: %.2f hours</p>\n", time);
+                fprintf(file, "            <p>Cost: $%.2f</p>\n", cost);
+                
+                double dist = edgeDistances != NULL ? edgeDistances[edge] : 0.0;
+                if (dist <= 0.0) {
+                    dist = haversine(prevCity->latitude, prevCity->longitude, 
+                                     city->latitude, city->longitude);
                 }
+                fprintf(file, "            <p>Distance: %.2f km</p>\n", dist);
+                
+                totalDistance += dist;
+                totalCost += cost;
+                totalTime += time;
             }
         }
         
@@ -513,110 +510,399 @@ void generateOutputFile(const char* filename, Node* path, City** cities, int cit
     printf("Output generated to: %s\n", filename);
 }
 
-// A* algorithm implementation
-Node* astar(City** cities, int cityCount, Route** routes, int routeCount, const char* start, const char* goal, const char* criteria, int* nodesVisited) {
-    if (cities == NULL || cityCount <= 0 || routes == NULL || routeCount <= 0) {
+AStarSearch* createAStarSearch(int capacity) {
+    AStarSearch* search = (AStarSearch*)malloc(sizeof(AStarSearch));
+    if (search == NULL) {
         return NULL;
     }
     
-    int startIndex = findCityIndex(cities, cityCount, start);
-    int goalIndex = findCityIndex(cities, cityCount, goal);
+    search->capacity = capacity;
+    search->openSet = createIndexedHeap(capacity);
+    search->recordOf = (AStarEntry*)calloc(capacity + 1, sizeof(AStarEntry));
+    search->visit = 0;
+    if (search->openSet == NULL || search->recordOf == NULL) {
+        freeAStarSearch(search);
+        return NULL;
+    }
+    
+    return search;
+}
+
+void freeAStarSearch(AStarSearch* search) {
+    if (search == NULL) {
+        return;
+    }
+    
+    freeIndexedHeap(search->openSet);
+    free(search->recordOf);
+    free(search);
+}
+
+// A* algorithm implementation
+//
+// The records come from arena, which is reset first, so nothing needs
+// freeing by the caller and repeated queries reuse the same blocks. The
+// open set and city -> record map live in search.
+SearchResult astar(Arena* arena, AStarSearch* search, const SymbolTable* cityIndex, const CSRGraph* graph, const Landmarks* landmarks, const char* start, const char* goal, const char* criteria, int* nodesVisited) {
+    SearchResult result = { NULL, 0, -1 };
+    *nodesVisited = 0;
+    
+    if (arena == NULL || search == NULL || cityIndex == NULL || graph == NULL || graph->nodeCount <= 0 ||
+        graph->nodeCount > search->capacity) {
+        return result;
+    }
+    
+    int startIndex = findCityIndex(cityIndex, start);
+    int goalIndex = findCityIndex(cityIndex, goal);
     
     if (startIndex == -1 || goalIndex == -1) {
         printf("Start or goal city not found.\n");
-        return NULL;
+        return result;
     }
     
-    // Initialize priority queue and visited set
-    PriorityQueue* openSet = createPriorityQueue();
-    if (openSet == NULL) {
-        return NULL;
+    arenaReset(arena);
+    int cityCount = graph->nodeCount;
+    
+    // Start from an empty open set and no records, without touching every city
+    IndexedHeap* openSet = search->openSet;
+    AStarEntry* recordOf = search->recordOf;
+    heapClear(openSet);
+    if (search->visit == INT_MAX) {
+        memset(recordOf, 0, search->capacity * sizeof(AStarEntry));
+        search->visit = 0;
     }
+    int visit = ++search->visit;
     
-    char** closedSet = (char**)malloc(cityCount * sizeof(char*));
-    if (closedSet == NULL) {
-        freePriorityQueue(openSet);
-        return NULL;
+    SearchRecord* records = (SearchRecord*)arenaAlloc(arena, cityCount * sizeof(SearchRecord));
+    if (records == NULL) {
+        return result;
     }
-    int closedSetSize = 0;
+    result.records = records;
+    
+    // Calculate cost based on criteria (default to time)
+    int costOrTime = parseCriteria(criteria, NULL);
+    const float* weights = csrWeights(graph, costOrTime);
     
     // Initialize start node
-    double h_cost = heuristic(cities[startIndex], cities[goalIndex]);
-    Node* startNode = createNode(start, 0.0, h_cost, NULL);
-    if (startNode == NULL) {
-        freePriorityQueue(openSet);
-        free(closedSet);
-        return NULL;
+    SearchRecord* startRecord = &records[result.recordCount];
+    startRecord->cityIndex = startIndex;
+    startRecord->parent = -1;
+    startRecord->g_cost = 0.0;
+    startRecord->h_cost = heuristic(landmarks, costOrTime, startIndex, goalIndex);
+    if (startRecord->h_cost >= LANDMARK_UNREACHED) {
+        return result;
     }
-    
-    push(openSet, startNode);
-    *nodesVisited = 0;
+    recordOf[startIndex].stamp = visit;
+    recordOf[startIndex].record = result.recordCount++;
+    heapPushOrDecrease(openSet, startIndex, startRecord->g_cost + startRecord->h_cost);
     
     // A* algorithm
-    while (!isEmpty(openSet)) {
-        Node* current = pop(openSet);
+    while (!heapEmpty(openSet)) {
+        int currentIndex = heapPop(openSet);
+        int currentRecord = recordOf[currentIndex].record;
         (*nodesVisited)++;
         
         // Check if goal reached
-        if (strcmp(current->city, goal) == 0) {
-            freePriorityQueue(openSet);
-            free(closedSet);
-            return current;
+        if (currentIndex == goalIndex) {
+            result.goal = currentRecord;
+            break;
         }
         
-        // Add to closed set
-        closedSet[closedSetSize++] = current->city;
-        
         // Check neighbors
-        for (int i = 0; i < routeCount; i++) {
-            if (strcmp(routes[i]->from, current->city) == 0) {
-                const char* neighbor = routes[i]->to;
-                
-                // Check if in closed set
-                int inClosedSet = 0;
-                for (int j = 0; j < closedSetSize; j++) {
-                    if (strcmp(closedSet[j], neighbor) == 0) {
-                        inClosedSet = 1;
-                        break;
-                    }
-                }
-                
-                if (inClosedSet) {
-                    continue;
-                }
-                
-                // Calculate cost based on criteria
-                double cost = 0.0;
-                if (strcmp(criteria, "cost") == 0) {
-                    cost = routes[i]->cost;
-                } else { // Default to time
-                    cost = routes[i]->time;
-                }
-                
-                double g_cost = current->g_cost + cost;
-                
-                int neighborIndex = findCityIndex(cities, cityCount, neighbor);
-                if (neighborIndex == -1) {
+        for (int e = graph->offsets[currentIndex]; e < graph->offsets[currentIndex + 1]; e++) {
+            int neighborIndex = graph->targets[e];
+            AStarEntry* entry = &recordOf[neighborIndex];
+            int reached = entry->stamp == visit;
+            
+            // Closed: reached before and already popped
+            if (reached && !heapContains(openSet, neighborIndex)) {
+                continue;
+            }
+            
+            double g_cost = records[currentRecord].g_cost + weights[e];
+            SearchRecord* neighbor;
+            
+            if (!reached) {
+                // A city the landmarks show cannot reach the goal is never queued
+                double h_cost = heuristic(landmarks, costOrTime, neighborIndex, goalIndex);
+                if (h_cost >= LANDMARK_UNREACHED) {
                     continue;
                 }
-                
-                double h_cost = heuristic(cities[neighborIndex], cities[goalIndex]);
-                Node* neighborNode = createNode(neighbor, g_cost, h_cost, current);
-                
-                push(openSet, neighborNode);
+                neighbor = &records[result.recordCount];
+                neighbor->cityIndex = neighborIndex;
+                neighbor->h_cost = h_cost;
+                entry->stamp = visit;
+                entry->record = result.recordCount++;
+            } else if (g_cost < records[entry->record].g_cost) {
+                // Better path to a queued city: update it in place (decrease-key)
+                neighbor = &records[entry->record];
+            } else {
+                continue;
             }
+            
+            neighbor->g_cost = g_cost;
+            neighbor->parent = currentRecord;
+            heapPushOrDecrease(openSet, neighborIndex, g_cost + neighbor->h_cost);
+        }
+    }
+    
+    return result;
+}
+
+// Objective of a criteria argument: "time" or "cost", optionally followed
+// by "-bidirectional" to search from both ends. Returns 1 for cost, 0 for
+// time; *bidirectional (if not NULL) is set from the suffix.
+int parseCriteria(const char* criteria, int* bidirectional) {
+    const char* suffix = strchr(criteria, '-');
+    if (bidirectional != NULL) {
+        *bidirectional = suffix != NULL && strcmp(suffix, "-bidirectional") == 0;
+    }
+    
+    size_t length = suffix != NULL ? (size_t)(suffix - criteria) : strlen(criteria);
+    return length == 4 && strncmp(criteria, "cost", 4) == 0;
+}
+
+// Bidirectional Dijkstra over graph and its reverse
+//
+// The result is laid out like astar's, one record per city on the path,
+// so generateOutputFile handles both. It runs without a heuristic. forward
+// and backward are reused across queries; their stamps make each start
+// O(1).
+SearchResult bidirectionalSearch(Arena* arena, SearchWorkspace* forward, SearchWorkspace* backward, const SymbolTable* cityIndex, const CSRGraph* graph, const CSRGraph* reverse, const char* start, const char* goal, const char* criteria, int* nodesVisited) {
+    SearchResult result = { NULL, 0, -1 };
+    *nodesVisited = 0;
+    
+    if (arena == NULL || forward == NULL || backward == NULL || cityIndex == NULL || graph == NULL || reverse == NULL ||
+        graph->nodeCount <= 0) {
+        return result;
+    }
+    
+    int startIndex = findCityIndex(cityIndex, start);
+    int goalIndex = findCityIndex(cityIndex, goal);
+    
+    if (startIndex == -1 || goalIndex == -1) {
+        printf("Start or goal city not found.\n");
+        return result;
+    }
+    
+    arenaReset(arena);
+    int cityCount = graph->nodeCount;
+    
+    int* edges = (int*)arenaAlloc(arena, cityCount * sizeof(int));
+    result.records = (SearchRecord*)arenaAlloc(arena, (cityCount + 1) * sizeof(SearchRecord));
+    if (edges == NULL || result.records == NULL) {
+        result.records = NULL;
+        return result;
+    }
+    
+    int costOrTime = parseCriteria(criteria, NULL);
+    int meeting = bidirectionalPath(graph, reverse, forward, backward, startIndex, goalIndex, costOrTime);
+    *nodesVisited = forward->settledCount + backward->settledCount;
+    
+    int edgeCount = meeting != -1 ? bidirectionalPathEdges(reverse, forward, backward, meeting, edges, cityCount) : -1;
+    if (edgeCount >= 0) {
+        // Chain the path into records, start first
+        const float* weights = csrWeights(graph, costOrTime);
+        SearchRecord* record = &result.records[0];
+        record->cityIndex = startIndex;
+        record->parent = -1;
+        record->g_cost = 0.0;
+        record->h_cost = 0.0;
+        
+        for (int i = 0; i < edgeCount; i++) {
+            record = &result.records[i + 1];
+            record->cityIndex = graph->targets[edges[i]];
+            record->parent = i;
+            record->g_cost = result.records[i].g_cost + weights[edges[i]];
+            record->h_cost = 0.0;
         }
+        
+        result.recordCount = edgeCount + 1;
+        result.goal = edgeCount;
     }
     
-    // No path found
-    freePriorityQueue(openSet);
-    free(closedSet);
-    return NULL;
+    return result;
+}
+
+// Landmarks for graph from landmarksFile if it was built from the same
+// inputs, otherwise chosen now and saved there for the next run
+Landmarks* prepareLandmarks(const char* landmarksFile, const CSRGraph* graph, const GraphSnapshot* snapshot, const char* citiesFile, const char* routesFile) {
+    SourceFileInfo citiesInfo;
+    SourceFileInfo routesInfo;
+    if (snapshot != NULL) {
+        citiesInfo = snapshot->header->cities;
+        routesInfo = snapshot->header->routes;
+    } else if (!describeSourceFile(citiesFile, &citiesInfo) || !describeSourceFile(routesFile, &routesInfo)) {
+        return NULL;
+    }
+    
+    Landmarks* landmarks = loadLandmarks(landmarksFile, graph, &citiesInfo, &routesInfo);
+    if (landmarks != NULL) {
+        return landmarks;
+    }
+    
+    landmarks = createLandmarks(graph, LANDMARK_DEFAULT_COUNT, LANDMARK_SELECT_AVOID);
+    if (landmarks == NULL) {
+        printf("Error choosing landmarks.\n");
+    } else if (saveLandmarks(landmarks, graph, &citiesInfo, &routesInfo, landmarksFile)) {
+        printf("Landmarks for %d cities written to %s\n", graph->nodeCount, landmarksFile);
+    } else {
+        printf("Could not write landmarks file %s\n", landmarksFile);
+    }
+    return landmarks;
+}
+
+// Write text as a quoted, escaped JSON string
+void writeJsonString(FILE* file, const char* text) {
+    fputc('"', file);
+    for (const unsigned char* c = (const unsigned char*)text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(file, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(file, "\\u%04x", *c);
+        } else {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+// Batch mode: answer every origin,destination,preference line of a query
+// file against one loaded graph, writing one JSON line per query in input
+// order with the nodes the search visited and its time in seconds
+int runBatch(int argc, char* argv[]) {
+    if (argc < 6) {
+        printf("Usage: %s --batch <cities_file> <routes_file> <queries_file> <output_file> [landmarks_file]\n", argv[0]);
+        return 1;
+    }
+    
+    const char* citiesFile = argv[2];
+    const char* routesFile = argv[3];
+    
+    City** cities = NULL;
+    int cityCount = 0;
+    Route** routes = NULL;
+    int routeCount = 0;
+    parseCitiesFile(citiesFile, &cities, &cityCount);
+    parseRoutesFile(routesFile, &routes, &routeCount);
+    if (cities == NULL || cityCount == 0 || routes == NULL || routeCount == 0) {
+        printf("Error parsing input files.\n");
+        return 1;
+    }
+    
+    SymbolTable* cityIndex = buildCityIndex(cities, &cityCount);
+    CSRGraph* graph = cityIndex != NULL ? buildRouteGraph(cityIndex, cityCount, routes, routeCount) : NULL;
+    Arena* arena = createArena(64 * 1024);
+    AStarSearch* search = graph != NULL ? createAStarSearch(graph->nodeCount) : NULL;
+    CsvReader* queries = openCsvReader(argv[4]);
+    FILE* output = fopen(argv[5], "w");
+    if (graph == NULL || arena == NULL || search == NULL || queries == NULL || output == NULL) {
+        printf("Error opening %s or %s.\n", argv[4], argv[5]);
+        return 1;
+    }
+    
+    Landmarks* landmarks = argc > 6 ? prepareLandmarks(argv[6], graph, NULL, citiesFile, routesFile) : NULL;
+    
+    int answered = 0;
+    int status;
+    while ((status = csvNextRecord(queries)) != CSV_END) {
+        if (status != CSV_RECORD || queries->fieldCount < 2 || strcmp(csvField(queries, 0), "origin") == 0) {
+            continue;
+        }
+        
+        const char* origin = csvField(queries, 0);
+        const char* destination = csvField(queries, 1);
+        const char* preference = queries->fieldCount > 2 ? csvField(queries, 2) : "time";
+        const char* criteria = strcmp(preference, "cost") == 0 || strcmp(preference, "cheapest") == 0 ? "cost" : "time";
+        int costOrTime = parseCriteria(criteria, NULL);
+        
+        fprintf(output, "{\"origin\": ");
+        writeJsonString(output, origin);
+        fprintf(output, ", \"destination\": ");
+        writeJsonString(output, destination);
+        fprintf(output, ", \"preference\": \"%s\", ", criteria);
+        
+        if (findCityIndex(cityIndex, origin) == -1 || findCityIndex(cityIndex, destination) == -1) {
+            fprintf(output, "\"error\": \"City not found\"}\n");
+            continue;
+        }
+        
+        clock_t startTime = clock();
+        int nodesVisited = 0;
+        SearchResult path = astar(arena, search, cityIndex, graph, landmarks, origin, destination, criteria, &nodesVisited);
+        double computationTime = (double)(clock() - startTime) / CLOCKS_PER_SEC;
+        
+        if (path.goal == -1) {
+            fprintf(output, "\"error\": \"No route found\"}\n");
+            continue;
+        }
+        
+        // The path runs goal to start through the parent records
+        int pathLength = 0;
+        for (int current = path.goal; current != -1; current = path.records[current].parent) {
+            pathLength++;
+        }
+        int* pathArray = (int*)malloc(pathLength * sizeof(int));
+        if (pathArray == NULL) {
+            fprintf(output, "\"error\": \"Out of memory\"}\n");
+            continue;
+        }
+        int current = path.goal;
+        for (int i = pathLength - 1; i >= 0; i--) {
+            pathArray[i] = path.records[current].cityIndex;
+            current = path.records[current].parent;
+        }
+        
+        double totalTime = 0.0;
+        double totalCost = 0.0;
+        fprintf(output, "\"path\": [");
+        for (int i = 0; i < pathLength; i++) {
+            if (i > 0) {
+                int edge = csrFindEdge(graph, pathArray[i - 1], pathArray[i], costOrTime);
+                if (edge != -1) {
+                    totalTime += graph->times[edge];
+                    totalCost += graph->costs[edge];
+                }
+                fprintf(output, ", ");
+            }
+            writeJsonString(output, cities[pathArray[i]]->name);
+        }
+        fprintf(output, "], \"totalTime\": %.2f, \"totalCost\": %.2f, \"nodesVisited\": %d, \"computationTime\": %.6f}\n",
+                totalTime, totalCost, nodesVisited, computationTime);
+        free(pathArray);
+        answered++;
+    }
+    printf("Answered %d queries\n", answered);
+    
+    fclose(output);
+    closeCsvReader(queries);
+    freeLandmarks(landmarks);
+    freeAStarSearch(search);
+    freeArena(arena);
+    freeCSRGraph(graph);
+    freeSymbolTable(cityIndex);
+    for (int i = 0; i < cityCount; i++) {
+        freeCity(cities[i]);
+    }
+    free(cities);
+    for (int i = 0; i < routeCount; i++) {
+        freeRoute(routes[i]);
+    }
+    free(routes);
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+        return runBatch(argc, argv);
+    }
+    
     if (argc < 5) {
-        printf("Usage: %s <cities_file> <routes_file> <start_city> <end_city> [criteria] [output_file]\n", argv[0]);
+        printf("Usage: %s <cities_file> <routes_file> <start_city> <end_city> [criteria] [output_file] [landmarks_file]\n", argv[0]);
+        printf("       cities_file may be a snapshot from compile_graph; routes_file is then ignored\n");
+        printf("       criteria is time or cost, with -bidirectional to search from both ends\n");
+        printf("       landmarks_file holds A* bounds; it is built on first use and again when the inputs change\n");
+        printf("       %s --batch <cities_file> <routes_file> <queries_file> <output_file> [landmarks_file]\n", argv[0]);
         return 1;
     }
     
@@ -627,41 +913,111 @@ int main(int argc, char* argv[]) {
     const char* criteria = (argc > 5) ? argv[5] : "time"; // Default to time if not specified
     const char* outputFile = (argc > 6) ? argv[6] : "astar_output.html"; // Default output file
     
-    // Parse input files
     City** cities = NULL;
     int cityCount = 0;
     Route** routes = NULL;
     int routeCount = 0;
-    
-    parseCitiesFile(citiesFile, &cities, &cityCount);
-    parseRoutesFile(routesFile, &routes, &routeCount);
-    
-    if (cities == NULL || cityCount == 0 || routes == NULL || routeCount == 0) {
-        printf("Error parsing input files.\n");
-        return 1;
+    SymbolTable* cityIndex = NULL;
+    CSRGraph* graph = NULL;
+    
+    // A snapshot is mapped and used in place: its CSR arrays and name
+    // index need no parsing, only the City records are built
+    GraphSnapshot* snapshot = NULL;
+    if (isGraphSnapshotFile(citiesFile)) {
+        snapshot = openGraphSnapshot(citiesFile);
+        cities = snapshot != NULL ? citiesFromSnapshot(snapshot) : NULL;
+        if (cities == NULL) {
+            printf("Error opening graph snapshot: %s\n", citiesFile);
+            closeGraphSnapshot(snapshot);
+            return 1;
+        }
+        cityCount = snapshot->csr.nodeCount;
+        cityIndex = &snapshot->names;
+        graph = &snapshot->csr;
+    } else {
+        // Parse input files
+        parseCitiesFile(citiesFile, &cities, &cityCount);
+        parseRoutesFile(routesFile, &routes, &routeCount);
+        
+        if (cities == NULL || cityCount == 0 || routes == NULL || routeCount == 0) {
+            printf("Error parsing input files.\n");
+            return 1;
+        }
+        
+        cityIndex = buildCityIndex(cities, &cityCount);
+        graph = cityIndex != NULL ? buildRouteGraph(cityIndex, cityCount, routes, routeCount) : NULL;
+        if (graph == NULL) {
+            printf("Error building route graph.\n");
+            return 1;
+        }
     }
     
-    // Calculate distances for routes
+    // Calculate distances for routes the file gave none for
     for (int i = 0; i < routeCount; i++) {
-        int fromIndex = findCityIndex(cities, cityCount, routes[i]->from);
-        int toIndex = findCityIndex(cities, cityCount, routes[i]->to);
+        int fromIndex = routes[i]->fromIndex;
+        int toIndex = routes[i]->toIndex;
         
-        if (fromIndex != -1 && toIndex != -1) {
+        if (fromIndex != -1 && toIndex != -1 && routes[i]->distance <= 0.0) {
             routes[i]->distance = haversine(cities[fromIndex]->latitude, cities[fromIndex]->longitude,
                                           cities[toIndex]->latitude, cities[toIndex]->longitude);
         }
     }
     
+    // Per-query search memory
+    Arena* arena = createArena(64 * 1024);
+    AStarSearch* search = createAStarSearch(graph->nodeCount);
+    if (arena == NULL || search == NULL) {
+        return 1;
+    }
+    
+    // The backward half of a bidirectional search runs on the reverse graph
+    int bidirectional;
+    parseCriteria(criteria, &bidirectional);
+    CSRGraph* reverse = bidirectional ? createReverseCSRGraph(graph) : NULL;
+    SearchWorkspace* forward = bidirectional ? createSearchWorkspace(graph->nodeCount) : NULL;
+    SearchWorkspace* backward = bidirectional ? createSearchWorkspace(graph->nodeCount) : NULL;
+    if (bidirectional && (reverse == NULL || forward == NULL || backward == NULL)) {
+        printf("Error building reverse route graph.\n");
+        return 1;
+    }
+    
+    // Without landmarks A* orders by cost so far alone
+    Landmarks* landmarks = argc > 7 && !bidirectional
+        ? prepareLandmarks(argv[7], graph, snapshot, citiesFile, routesFile)
+        : NULL;
+    
     // Run A* algorithm
     clock_t startTime = clock();
     int nodesVisited = 0;
-    Node* path = astar(cities, cityCount, routes, routeCount, startCity, endCity, criteria, &nodesVisited);
-    
-    // Generate output
-    generateOutputFile(outputFile, path, cities, cityCount, routes, routeCount, criteria, startTime, nodesVisited);
+    SearchResult path = bidirectional
+        ? bidirectionalSearch(arena, forward, backward, cityIndex, graph, reverse, startCity, endCity, criteria, &nodesVisited)
+        : astar(arena, search, cityIndex, graph, landmarks, startCity, endCity, criteria, &nodesVisited);
+    
+    // Generate output, with each leg's distance from its route
+    float* edgeDistances = NULL;
+    if (snapshot == NULL) {
+        edgeDistances = (float*)malloc((graph->edgeCount > 0 ? graph->edgeCount : 1) * sizeof(float));
+        for (int e = 0; edgeDistances != NULL && e < graph->edgeCount; e++) {
+            edgeDistances[e] = (float)routes[graph->edgeRoutes[e]]->distance;
+        }
+    }
+    generateOutputFile(outputFile, &path, cities, graph, snapshot != NULL ? snapshot->distances : edgeDistances,
+                       criteria, startTime, nodesVisited);
+    free(edgeDistances);
     
     // Cleanup
-    freeAllNodes(path);
+    freeAStarSearch(search);
+    freeArena(arena);
+    freeSearchWorkspace(forward);
+    freeSearchWorkspace(backward);
+    freeCSRGraph(reverse);
+    freeLandmarks(landmarks);
+    if (snapshot != NULL) {
+        closeGraphSnapshot(snapshot);
+    } else {
+        freeCSRGraph(graph);
+        freeSymbolTable(cityIndex);
+    }
     
     for (int i = 0; i < cityCount; i++) {
         freeCity(cities[i]);
@@ -1,16 +1,22 @@
 #include <iostream>
 #include <vector>
-#include <queue>
-#include <unordered_map>
-#include <unordered_set>
 #include <string>
-#include <fstream>
 #include <sstream>
 #include <cmath>
 #include <chrono>
 #include <iomanip>
 #include <algorithm>
 #include <limits>
+#include <thread>
+
+#include "SymbolTable.h"
+#include "IndexedHeap.h"
+#include "GraphSnapshot.h"
+#include "CsvReader.h"
+#include "CsvSchema.h"
+#include "CSRGraph.h"
+#include "Landmarks.h"
+#include "RouteSynthesis.h"
 
 // Define M_PI if not defined
 #ifndef M_PI
@@ -34,45 +40,66 @@ struct City {
 struct Route {
     std::string from;
     std::string to;
+    int fromId; // City ids, used by the search instead of the names
+    int toId;
     double distance;
     double cost;
     double time;
     
-    Route() {}
+    Route() : fromId(-1), toId(-1) {}
     
-    Route(const std::string& f, const std::string& t, double d, double c, double tm)
-        : from(f), to(t), distance(d), cost(c), time(tm) {}
+    Route(const std::string& f, const std::string& t, double d, double c, double tm, int fi = -1, int ti = -1)
+        : from(f), to(t), fromId(fi), toId(ti), distance(d), cost(c), time(tm) {}
 };
 
 // Structure for A* algorithm node
 struct Node {
-    std::string city;
+    int city;
     double g_cost; // Cost from start to current node
     double h_cost; // Heuristic cost (estimated cost from current to goal)
     double f_cost; // Total cost (g_cost + h_cost)
-    std::string parent;
+    int parent;
+    int route; // Index of the route taken in routes[parent], -1 at the start
     
-    Node() : g_cost(0), h_cost(0), f_cost(0) {}
+    Node() : city(-1), g_cost(0), h_cost(0), f_cost(0), parent(-1), route(-1) {}
     
-    Node(const std::string& c, double g, double h, const std::string& p)
-        : city(c), g_cost(g), h_cost(h), f_cost(g + h), parent(p) {}
+    Node(int c, double g, double h, int p, int r = -1)
+        : city(c), g_cost(g), h_cost(h), f_cost(g + h), parent(p), route(r) {}
+};
+
+// A search's node for one city, valid where stamp is the planner's visit
+struct SearchSlot {
+    int stamp;
+    Node node;
     
-    // Comparison operator for priority queue
-    bool operator>(const Node& other) const {
-        return f_cost > other.f_cost;
-    }
+    SearchSlot() : stamp(0) {}
 };
 
 // Class for travel planning using A* algorithm
 class TravelPlanner {
 private:
-    std::unordered_map<std::string, City> cities;
-    std::unordered_map<std::string, std::vector<Route>> routes;
+    // Cities and their outgoing routes are indexed by the city's interned id
+    SymbolTable* cityIds;
+    std::vector<City> cities;
+    std::vector<std::vector<Route>> routes;
+    // Edges into each city as (from city, index in routes[from]), for
+    // the backward half of a bidirectional search
+    std::vector<std::vector<std::pair<int, int>>> incoming;
+    // Lower bounds for fastest and cheapest, built with the routes
+    Landmarks* landmarks;
+    // Search state kept across queries, like astar.c's AStarSearch: the
+    // queues are cleared rather than reallocated and slots are stamped, so
+    // starting a query costs nothing however many cities there are. Index
+    // 0 is the forward search, 1 the backward half of a bidirectional one.
+    // A city is closed on a side once it was reached and left that queue.
+    std::vector<SearchSlot> slots[2];
+    IndexedHeap* queues[2];
+    int visit;
     int nodesVisited;
     double computationTime;
     
     // Calculate Haversine distance between two points on Earth
-    double haversineDistance(double lat1, double lon1, double lat2, double lon2) {
+    double haversineDistance(double lat1, double lon1, double lat2, double lon2) const {
         const double R = 6371.0; // Earth radius in kilometers
         
         double dLat = (lat2 - lat1) * M_PI / 180.0;
@@ -86,142 +113,327 @@ private:
         return R * c;
     }
     
-    // Calculate heuristic (straight-line distance)
-    double calculateHeuristic(const std::string& from, const std::string& to) {
-        if (cities.find(from) == cities.end() || cities.find(to) == cities.end()) {
-            return 0.0;
+    // Calculate heuristic in the preference's own units: straight-line km
+    // for distance, landmark bounds in hours or dollars otherwise. Infinity
+    // means from cannot reach to.
+    double calculateHeuristic(int from, int to, const std::string& preference) const {
+        if (preference != "fastest" && preference != "cheapest") {
+            const City& fromCity = cities[from];
+            const City& toCity = cities[to];
+            
+            return haversineDistance(fromCity.latitude, fromCity.longitude, 
+                                    toCity.latitude, toCity.longitude);
         }
         
-        const City& fromCity = cities[from];
-        const City& toCity = cities[to];
-        
-        return haversineDistance(fromCity.latitude, fromCity.longitude, 
-                                toCity.latitude, toCity.longitude);
+        if (landmarks == nullptr) {
+            return 0.0;
+        }
+        double bound = landmarkBound(landmarks, preference == "cheapest" ? 1 : 0, from, to);
+        return bound >= LANDMARK_UNREACHED ? std::numeric_limits<double>::infinity() : bound;
     }
     
 public:
-    TravelPlanner() : nodesVisited(0), computationTime(0.0) {}
+    TravelPlanner() : cityIds(createSymbolTable(128)), landmarks(nullptr), queues{nullptr, nullptr}, visit(0), nodesVisited(0), computationTime(0.0) {}
+    
+    ~TravelPlanner() {
+        freeSymbolTable(cityIds);
+        freeLandmarks(landmarks);
+        freeIndexedHeap(queues[0]);
+        freeIndexedHeap(queues[1]);
+    }
+    
+    TravelPlanner(const TravelPlanner&) = delete;
+    TravelPlanner& operator=(const TravelPlanner&) = delete;
+    
+    // Id of a city name, or -1 if it was not loaded
+    int getCityId(const std::string& name) const {
+        return symbolLookup(cityIds, name.c_str());
+    }
+    
+    // Load cities from a graph snapshot; its routes are not used since
+    // this planner generates its own
+    bool loadCitiesFromSnapshot(const std::string& filename) {
+        GraphSnapshot* snapshot = openGraphSnapshot(filename.c_str());
+        if (snapshot == NULL) {
+            std::cerr << "Error: Could not open graph snapshot: " << filename << std::endl;
+            return false;
+        }
+        
+        for (int i = 0; i < snapshot->csr.nodeCount; i++) {
+            const char* name = snapshotCityName(snapshot, i);
+            City city(name, snapshotCityCountry(snapshot, i), snapshot->cities[i].lat, snapshot->cities[i].lon);
+            
+            int id = symbolIntern(cityIds, name);
+            if (id == static_cast<int>(cities.size())) {
+                cities.push_back(city);
+            } else {
+                cities[id] = city;
+            }
+        }
+        
+        closeGraphSnapshot(snapshot);
+        return true;
+    }
     
-    // Load cities from CSV file
+    // Load cities from CSV file (or a graph snapshot)
     bool loadCities(const std::string& filename) {
-        std::ifstream file(filename);
-        if (!file.is_open()) {
+        if (isGraphSnapshotFile(filename.c_str())) {
+            return loadCitiesFromSnapshot(filename);
+        }
+        
+        CsvReader* reader = openCsvReader(filename.c_str());
+        if (reader == NULL) {
             std::cerr << "Error: Could not open cities file: " << filename << std::endl;
             return false;
         }
         
-        std::string line;
-        // Skip header line
-        std::getline(file, line);
-        
-        while (std::getline(file, line)) {
-            std::stringstream ss(line);
-            std::string country, city, lat_str, lon_str;
+        // Columns are mapped by the header when the file has one
+        CsvSchema schema;
+        bool first = true;
+        int status;
+        while ((status = csvNextRecord(reader)) != CSV_END) {
+            if (status == CSV_MALFORMED) {
+                continue;
+            }
+            
+            if (first) {
+                first = false;
+                int header = csvDetectSchema(reader, CSV_SCHEMA_CITIES, &schema);
+                if (header < 0) {
+                    closeCsvReader(reader);
+                    return false;
+                }
+                if (header) {
+                    continue;
+                }
+            }
+            
+            if (reader->fieldCount < schema.requiredFields) {
+                csvReportMalformed(reader, "missing city, latitude or longitude");
+                continue;
+            }
             
-            // Parse CSV line
-            std::getline(ss, country, ',');
-            std::getline(ss, city, ',');
-            std::getline(ss, lat_str, ',');
-            std::getline(ss, lon_str, ',');
+            std::string country = csvSchemaField(reader, &schema, CSV_COLUMN_COUNTRY);
+            std::string city = csvSchemaField(reader, &schema, CSV_COLUMN_CITY);
+            double latitude;
+            double longitude;
             
-            try {
-                double latitude = std::stod(lat_str);
-                double longitude = std::stod(lon_str);
-                
-                cities[city] = City(city, country, latitude, longitude);
-            } catch (const std::exception& e) {
-                std::cerr << "Error parsing city data: " << line << std::endl;
+            if (!csvSchemaNumber(reader, &schema, CSV_COLUMN_LATITUDE, &latitude) ||
+                !csvSchemaNumber(reader, &schema, CSV_COLUMN_LONGITUDE, &longitude)) {
+                csvReportMalformed(reader, "latitude and longitude must be numbers");
+                continue;
+            }
+            
+            int id = symbolIntern(cityIds, city.c_str());
+            if (id == static_cast<int>(cities.size())) {
+                cities.push_back(City(city, country, latitude, longitude));
+            } else {
+                cities[id] = City(city, country, latitude, longitude);
             }
         }
         
-        file.close();
+        closeCsvReader(reader);
         return true;
     }
     
-    // Generate routes between cities
-    void generateRoutes() {
-        // For each city, create routes to other cities
-        for (const auto& from : cities) {
-            for (const auto& to : cities) {
-                if (from.first != to.first) {
-                    double distance = haversineDistance(from.second.latitude, from.second.longitude,
-                                                      to.second.latitude, to.second.longitude);
-                    
-                    // Simulate cost and time based on distance
-                    double cost = distance * (0.5 + ((double)rand() / RAND_MAX) * 0.5); // Random factor for cost
-                    double time = distance / 800.0 * (0.8 + ((double)rand() / RAND_MAX) * 0.4); // Assume average speed of 800 km/h with random factor
-                    
-                    routes[from.first].push_back(Route(from.first, to.first, distance, cost, time));
+    // Join each city to its nearest neighbours and nearest hub, and the
+    // hubs to each other (see RouteSynthesis.h). The same cities and seed
+    // give the same routes. Returns false when memory runs out.
+    bool generateRoutes(const RouteSynthesisOptions& options) {
+        int cityCount = static_cast<int>(cities.size());
+        std::vector<double> latitudes(cityCount);
+        std::vector<double> longitudes(cityCount);
+        for (int i = 0; i < cityCount; i++) {
+            latitudes[i] = cities[i].latitude;
+            longitudes[i] = cities[i].longitude;
+        }
+        
+        SynthesizedRoutes* synthesized = synthesizeRoutes(latitudes.data(), longitudes.data(), cityCount, &options);
+        if (synthesized == nullptr) {
+            std::cerr << "Error: Could not generate routes" << std::endl;
+            return false;
+        }
+        
+        routes.assign(cityCount, std::vector<Route>());
+        for (int r = 0; r < synthesized->routeCount; r++) {
+            int from = synthesized->sources[r];
+            int to = synthesized->targets[r];
+            routes[from].push_back(Route(cities[from].name, cities[to].name, synthesized->distances[r],
+                                         synthesized->costs[r], synthesized->times[r], from, to));
+        }
+        freeSynthesizedRoutes(synthesized);
+        
+        buildIncoming();
+        buildLandmarks();
+        return true;
+    }
+    
+    // Reverse adjacency over routes
+    void buildIncoming() {
+        incoming.assign(cities.size(), std::vector<std::pair<int, int>>());
+        for (size_t from = 0; from < routes.size(); from++) {
+            for (size_t i = 0; i < routes[from].size(); i++) {
+                incoming[routes[from][i].toId].push_back(std::make_pair(static_cast<int>(from), static_cast<int>(i)));
+            }
+        }
+    }
+    
+    // Choose landmarks over the generated routes and search from and to
+    // each; a search without them falls back to a zero bound
+    void buildLandmarks() {
+        std::vector<int> sources;
+        std::vector<int> targets;
+        std::vector<float> times;
+        std::vector<float> costs;
+        for (const std::vector<Route>& out : routes) {
+            for (const Route& route : out) {
+                sources.push_back(route.fromId);
+                targets.push_back(route.toId);
+                times.push_back(static_cast<float>(route.time));
+                costs.push_back(static_cast<float>(route.cost));
+            }
+        }
+        
+        freeLandmarks(landmarks);
+        landmarks = nullptr;
+        
+        CSRGraph* csr = createCSRGraph(static_cast<int>(cities.size()), static_cast<int>(sources.size()),
+                                       sources.data(), targets.data(), times.data(), costs.data(), nullptr);
+        if (csr != nullptr) {
+            landmarks = createLandmarks(csr, LANDMARK_DEFAULT_COUNT, LANDMARK_SELECT_AVOID);
+            freeCSRGraph(csr);
+        }
+    }
+    
+    // Weight of a route under a preference: fastest, cheapest, else distance
+    static double routeWeight(const Route& route, const std::string& preference) {
+        if (preference == "fastest") {
+            return route.time;
+        } else if (preference == "cheapest") {
+            return route.cost;
+        }
+        return route.distance;
+    }
+    
+    // Start a query: size the search state to the cities, empty the queues
+    // and move to the next visit. Returns false when memory runs out.
+    bool beginSearch() {
+        int cityCount = static_cast<int>(cities.size());
+        if (static_cast<int>(slots[0].size()) != cityCount || queues[0] == nullptr || queues[1] == nullptr) {
+            freeIndexedHeap(queues[0]);
+            freeIndexedHeap(queues[1]);
+            queues[0] = createIndexedHeap(cityCount);
+            queues[1] = createIndexedHeap(cityCount);
+            slots[0].assign(cityCount, SearchSlot());
+            slots[1].assign(cityCount, SearchSlot());
+            visit = 0;
+            if (queues[0] == nullptr || queues[1] == nullptr) {
+                return false;
+            }
+        }
+        
+        heapClear(queues[0]);
+        heapClear(queues[1]);
+        if (visit == std::numeric_limits<int>::max()) {
+            for (int side = 0; side < 2; side++) {
+                for (SearchSlot& slot : slots[side]) {
+                    slot.stamp = 0;
                 }
             }
+            visit = 0;
         }
+        visit++;
+        return true;
     }
     
-    // Find route using A* algorithm
+    // A side's node for a city in the current query, unreached (city -1,
+    // infinite g, NaN h) until the query first sets it
+    Node& nodeOf(int side, int city) {
+        SearchSlot& slot = slots[side][city];
+        if (slot.stamp != visit) {
+            slot.stamp = visit;
+            slot.node = Node(-1, std::numeric_limits<double>::infinity(), std::numeric_limits<double>::quiet_NaN(), -1);
+        }
+        return slot.node;
+    }
+    
+    // Find route using A* algorithm. A preference ending in "-bidirectional"
+    // (such as "fastest-bidirectional") searches from both ends instead.
     std::vector<Route> findRoute(const std::string& start, const std::string& goal, const std::string& preference) {
+        const std::string suffix = "-bidirectional";
+        if (preference.size() > suffix.size() &&
+            preference.compare(preference.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            return findRouteBidirectional(start, goal, preference.substr(0, preference.size() - suffix.size()));
+        }
+        
         auto startTime = std::chrono::high_resolution_clock::now();
         nodesVisited = 0;
         
         // Check if cities exist
-        if (cities.find(start) == cities.end() || cities.find(goal) == cities.end()) {
+        int startId = getCityId(start);
+        int goalId = getCityId(goal);
+        if (startId == -1 || goalId == -1) {
             std::cerr << "Error: Start or goal city not found." << std::endl;
             return {};
         }
         
-        // Priority queue for A* algorithm
-        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> openSet;
-        std::unordered_set<std::string> closedSet;
-        std::unordered_map<std::string, Node> allNodes;
+        // Priority queue for A* algorithm, keyed by f_cost with one entry per city
+        if (!beginSearch()) {
+            return {};
+        }
+        IndexedHeap* openSet = queues[0];
         
         // Initialize start node
-        Node startNode(start, 0, calculateHeuristic(start, goal), "");
-        openSet.push(startNode);
-        allNodes[start] = startNode;
-        
-        while (!openSet.empty()) {
-            // Get node with lowest f_cost
-            Node current = openSet.top();
-            openSet.pop();
+        Node startNode(startId, 0, calculateHeuristic(startId, goalId, preference), -1);
+        if (std::isinf(startNode.h_cost)) {
+            auto endTime = std::chrono::high_resolution_clock::now();
+            computationTime = std::chrono::duration<double>(endTime - startTime).count();
+            return {};
+        }
+        heapPushOrDecrease(openSet, startId, startNode.f_cost);
+        nodeOf(0, startId) = startNode;
+        
+        while (!heapEmpty(openSet)) {
+            // Get node with lowest f_cost; it is closed once off the queue
+            const Node current = slots[0][heapPop(openSet)].node;
             nodesVisited++;
             
             // If goal reached, reconstruct path
-            if (current.city == goal) {
+            if (current.city == goalId) {
                 auto endTime = std::chrono::high_resolution_clock::now();
                 computationTime = std::chrono::duration<double>(endTime - startTime).count();
                 
-                return reconstructPath(allNodes, start, goal);
+                return reconstructPath(startId, goalId);
             }
             
-            // Add to closed set
-            closedSet.insert(current.city);
-            
             // Check all neighbors
-            for (const Route& route : routes[current.city]) {
+            const std::vector<Route>& out = routes[current.city];
+            for (size_t i = 0; i < out.size(); i++) {
+                const Route& route = out[i];
+                Node& neighbor = nodeOf(0, route.toId);
+                
                 // Skip if neighbor is in closed set
-                if (closedSet.find(route.to) != closedSet.end()) {
+                if (neighbor.city != -1 && !heapContains(openSet, route.toId)) {
                     continue;
                 }
                 
                 // Calculate cost based on preference
-                double edgeCost;
-                if (preference == "fastest") {
-                    edgeCost = route.time;
-                } else if (preference == "cheapest") {
-                    edgeCost = route.cost;
-                } else {
-                    edgeCost = route.distance;
-                }
+                double edgeCost = routeWeight(route, preference);
                 
                 double tentative_g = current.g_cost + edgeCost;
                 
                 // If neighbor not in open set or better path found
-                if (allNodes.find(route.to) == allNodes.end() || tentative_g < allNodes[route.to].g_cost) {
-                    // Update node
-                    Node neighbor(route.to, tentative_g, calculateHeuristic(route.to, goal), current.city);
-                    allNodes[route.to] = neighbor;
+                if (tentative_g < neighbor.g_cost) {
+                    // Update node, computing the heuristic once per city;
+                    // a city that cannot reach the goal is never queued
+                    double h_cost = neighbor.city == -1 ? calculateHeuristic(route.toId, goalId, preference) : neighbor.h_cost;
+                    if (std::isinf(h_cost)) {
+                        continue;
+                    }
+                    neighbor = Node(route.toId, tentative_g, h_cost, current.city, static_cast<int>(i));
                     
-                    // Add to open set
-                    openSet.push(neighbor);
+                    // Add to open set, or decrease its key if already queued
+                    heapPushOrDecrease(openSet, route.toId, neighbor.f_cost);
                 }
             }
         }
@@ -233,25 +445,128 @@ public:
         return {};
     }
     
-    // Reconstruct path from A* result
-    std::vector<Route> reconstructPath(const std::unordered_map<std::string, Node>& nodes, 
-                                     const std::string& start, const std::string& goal) {
-        std::vector<Route> path;
-        std::string current = goal;
+    // Bidirectional A*: forward from start over routes, backward from goal
+    // over incoming, advancing the side with the smaller queue top
+    //
+    // Both sides use the average potential p(v) = (h(v, goal) - h(start, v)) / 2,
+    // forward keys g + p and backward keys g - p, which keeps every reduced
+    // edge weight non-negative when h is consistent. best is the shortest
+    // path seen through a city both sides reached; the search stops once
+    // the two queue tops sum to at least best. Both the great-circle and
+    // the landmark bounds are consistent. A city whose potential is
+    // infinite lies on no path from start to goal and is never queued.
+    std::vector<Route> findRouteBidirectional(const std::string& start, const std::string& goal, const std::string& preference) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        nodesVisited = 0;
         
-        while (current != start) {
-            const Node& currentNode = nodes.at(current);
-            const std::string& parent = currentNode.parent;
+        int startId = getCityId(start);
+        int goalId = getCityId(goal);
+        if (startId == -1 || goalId == -1) {
+            std::cerr << "Error: Start or goal city not found." << std::endl;
+            return {};
+        }
+        
+        const double infinity = std::numeric_limits<double>::infinity();
+        if (!beginSearch()) {
+            return {};
+        }
+        
+        // Index 0 is the forward side, 1 the backward side. A side's node
+        // has h = p (forward) or -p (backward), so f is its queue key, and
+        // the route it was reached by: going forward routes[parent][route]
+        // into the city, going backward routes[city][route] out of it
+        // towards parent. p is kept in the forward node's h from the first
+        // time it is needed, even before the city is reached.
+        IndexedHeap** queue = queues;
+        
+        auto potentialOf = [&](int city) {
+            Node& forward = nodeOf(0, city);
+            if (std::isnan(forward.h_cost)) {
+                double ahead = calculateHeuristic(city, goalId, preference);
+                double behind = calculateHeuristic(startId, city, preference);
+                forward.h_cost = std::isinf(ahead) || std::isinf(behind) ? infinity : (ahead - behind) / 2.0;
+            }
+            return forward.h_cost;
+        };
+        
+        if (std::isinf(potentialOf(startId)) || std::isinf(potentialOf(goalId))) {
+            auto endTime = std::chrono::high_resolution_clock::now();
+            computationTime = std::chrono::duration<double>(endTime - startTime).count();
+            return {};
+        }
+        
+        nodeOf(0, startId) = Node(startId, 0, potentialOf(startId), -1);
+        nodeOf(1, goalId) = Node(goalId, 0, -potentialOf(goalId), -1);
+        heapPushOrDecrease(queue[0], startId, nodeOf(0, startId).f_cost);
+        heapPushOrDecrease(queue[1], goalId, nodeOf(1, goalId).f_cost);
+        
+        double best = startId == goalId ? 0.0 : infinity;
+        int meeting = startId == goalId ? startId : -1;
+        
+        while (!heapEmpty(queue[0]) && !heapEmpty(queue[1])) {
+            if (heapTopKey(queue[0]) + heapTopKey(queue[1]) >= best) {
+                break;
+            }
+            
+            int side = heapTopKey(queue[0]) <= heapTopKey(queue[1]) ? 0 : 1;
+            int other = 1 - side;
+            double sign = side == 0 ? 1.0 : -1.0;
+            
+            int city = heapPop(queue[side]);
+            double reachedCost = slots[side][city].node.g_cost;
+            nodesVisited++;
             
-            // Find the route from parent to current
-            for (const Route& route : routes[parent]) {
-                if (route.to == current) {
-                    path.push_back(route);
-                    break;
+            // Forward follows routes out of city, backward the routes into it
+            size_t degree = side == 0 ? routes[city].size() : incoming[city].size();
+            for (size_t i = 0; i < degree; i++) {
+                const Route& route = side == 0 ? routes[city][i] : routes[incoming[city][i].first][incoming[city][i].second];
+                int next = side == 0 ? route.toId : route.fromId;
+                
+                double tentative = reachedCost + routeWeight(route, preference);
+                double potential = potentialOf(next);
+                if (std::isinf(potential)) {
+                    continue;
+                }
+                Node& reached = nodeOf(side, next);
+                bool closed = reached.city != -1 && !heapContains(queue[side], next);
+                if (!closed && tentative < reached.g_cost) {
+                    reached = Node(next, tentative, sign * potential, city, side == 0 ? static_cast<int>(i) : incoming[city][i].second);
+                    heapPushOrDecrease(queue[side], next, reached.f_cost);
+                }
+                
+                const Node& across = nodeOf(other, next);
+                if (across.g_cost < infinity && reached.g_cost + across.g_cost < best) {
+                    best = reached.g_cost + across.g_cost;
+                    meeting = next;
                 }
             }
-            
-            current = parent;
+        }
+        
+        std::vector<Route> path;
+        if (meeting != -1) {
+            // Forward half back to start, then the backward half on to goal
+            path = reconstructPath(startId, meeting);
+            for (int city = meeting; slots[1][city].node.parent != -1; city = slots[1][city].node.parent) {
+                path.push_back(routes[city][slots[1][city].node.route]);
+            }
+        }
+        
+        auto endTime = std::chrono::high_resolution_clock::now();
+        computationTime = std::chrono::duration<double>(endTime - startTime).count();
+        
+        return path;
+    }
+    
+    // Reconstruct path from A* result, following the route each city was
+    // reached by, so parallel routes between two cities are told apart
+    std::vector<Route> reconstructPath(int start, int goal) const {
+        std::vector<Route> path;
+        int current = goal;
+        
+        while (current != start) {
+            const Node& currentNode = slots[0][current].node;
+            path.push_back(routes[currentNode.parent][currentNode.route]);
+            current = currentNode.parent;
         }
         
         // Reverse path to get start to goal
@@ -347,10 +662,94 @@ public:
     }
 };
 
+// Route synthesis options from the optional [neighbors] [hubs] [seed]
+// arguments starting at argv[first]. Returns false if they are invalid.
+static bool readSynthesisOptions(int argc, char* argv[], int first, RouteSynthesisOptions& options) {
+    // A fixed seed, so repeated runs over the same cities compare
+    routeSynthesisDefaults(&options);
+    options.neighbors = (argc > first) ? atoi(argv[first]) : options.neighbors;
+    options.hubs = (argc > first + 1) ? atoi(argv[first + 1]) : options.hubs;
+    options.seed = (argc > first + 2) ? strtoull(argv[first + 2], nullptr, 10) : options.seed;
+    options.threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    if (options.neighbors < 0 || options.hubs < 0) {
+        std::cerr << "Error: neighbors and hubs must not be negative" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Batch mode: answer every origin,destination,preference line of a query
+// file over one set of generated routes, writing one JSON line per query
+// in input order with the nodes the search visited and its time
+int runBatch(int argc, char* argv[]) {
+    if (argc < 5) {
+        std::cerr << "Usage: " << argv[0] << " --batch <cities_file> <queries_file> <output_file> [neighbors] [hubs] [seed]" << std::endl;
+        return 1;
+    }
+    
+    RouteSynthesisOptions options;
+    if (!readSynthesisOptions(argc, argv, 5, options)) {
+        return 1;
+    }
+    
+    TravelPlanner planner;
+    if (!planner.loadCities(argv[2]) || !planner.generateRoutes(options)) {
+        return 1;
+    }
+    
+    CsvReader* queries = openCsvReader(argv[3]);
+    FILE* output = fopen(argv[4], "w");
+    if (queries == NULL || output == NULL) {
+        std::cerr << "Error: Could not open " << argv[3] << " or " << argv[4] << std::endl;
+        closeCsvReader(queries);
+        if (output != NULL) {
+            fclose(output);
+        }
+        return 1;
+    }
+    
+    int answered = 0;
+    int status;
+    while ((status = csvNextRecord(queries)) != CSV_END) {
+        if (status != CSV_RECORD || queries->fieldCount < 2 || strcmp(csvField(queries, 0), "origin") == 0) {
+            continue;
+        }
+        
+        std::string origin = csvField(queries, 0);
+        std::string destination = csvField(queries, 1);
+        std::string preference = queries->fieldCount > 2 ? csvField(queries, 2) : "fastest";
+        preference = preference == "cost" || preference == "cheapest" ? "cheapest" : "fastest";
+        
+        std::string line;
+        if (planner.getCityId(origin) == -1 || planner.getCityId(destination) == -1) {
+            line = "{\"origin\": \"" + origin + "\",\"destination\": \"" + destination + "\",\"error\": \"City not found.\"}";
+        } else {
+            std::vector<Route> route = planner.findRoute(origin, destination, preference);
+            line = planner.routeToJson(route);
+            answered += route.empty() ? 0 : 1;
+        }
+        fprintf(output, "%s\n", line.c_str());
+    }
+    std::cout << "Answered " << answered << " queries" << std::endl;
+    
+    fclose(output);
+    closeCsvReader(queries);
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "--batch") {
+        return runBatch(argc, argv);
+    }
+    
     if (argc < 4) {
-        std::cerr << "Usage: " << argv[0] << " <cities_file> <origin> <destination> [preference]" << std::endl;
-        std::cerr << "Preference can be 'fastest' or 'cheapest' (default: fastest)" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <cities_file> <origin> <destination> [preference] [neighbors] [hubs] [seed]" << std::endl;
+        std::cerr << "Preference can be 'fastest' or 'cheapest' (default: fastest), or either with" << std::endl;
+        std::cerr << "'-bidirectional' appended to search from both ends" << std::endl;
+        std::cerr << "Routes join each city to its nearest neighbors (default: " << ROUTE_SYNTHESIS_DEFAULT_NEIGHBORS
+                  << ") and nearest long-haul hub (default: " << ROUTE_SYNTHESIS_DEFAULT_HUBS << " hubs), drawn from seed (default: "
+                  << ROUTE_SYNTHESIS_DEFAULT_SEED << ")" << std::endl;
+        std::cerr << "       " << argv[0] << " --batch <cities_file> <queries_file> <output_file> [neighbors] [hubs] [seed]" << std::endl;
         return 1;
     }
     
@@ -359,8 +758,10 @@ int main(int argc, char* argv[]) {
     std::string destination = argv[3];
     std::string preference = (argc > 4) ? argv[4] : "fastest";
     
-    // Seed random number generator
-    srand(static_cast<unsigned int>(time(nullptr)));
+    RouteSynthesisOptions options;
+    if (!readSynthesisOptions(argc, argv, 5, options)) {
+        return 1;
+    }
     
     TravelPlanner planner;
     
@@ -370,7 +771,9 @@ int main(int argc, char* argv[]) {
     }
     
     // Generate routes
-    planner.generateRoutes();
+    if (!planner.generateRoutes(options)) {
+        return 1;
+    }
     
     // Find route
     std::vector<Route> route = planner.findRoute(origin, destination, preference);
@@ -0,0 +1,158 @@
+// CSV loader micro-benchmark
+//
+// Reads a routes file two ways and times only the parsing: the
+// fgets/strtok/atof loop the loaders used to have, and CsvReader with
+// csvParseDouble. Both sum the time and cost columns so the results can be
+// checked against each other. With a size in megabytes a seeded synthetic
+// routes file of about that size is written first.
+//
+// Usage: csv_bench <routes_file> [megabytes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../CsvReader.h"
+
+typedef struct BenchResult {
+    double seconds;
+    long rows;
+    double checksum; // sum of time and cost, must match across loaders
+} BenchResult;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int writeRoutes(const char* filename, long megabytes) {
+    static const char* transports[] = {"plane", "train", "bus", "ship", "car"};
+    FILE* file = fopen(filename, "w");
+    if (file == NULL) {
+        return 0;
+    }
+
+    srand(12345);
+    long target = megabytes * 1024 * 1024;
+    long written = 0;
+    while (written < target) {
+        int origin = rand() % 50000;
+        int destination = rand() % 50000;
+        int n;
+        if (rand() % 4 == 0) {
+            n = fprintf(file, "City%d,City%d,%s,%d.%02d,%d.%02d,\"Seasonal \"\"express\"\" service\"\n",
+                        origin, destination, transports[rand() % 5],
+                        rand() % 48, rand() % 100, rand() % 2000, rand() % 100);
+        } else {
+            n = fprintf(file, "City%d,City%d,%s,%d.%02d,%d.%02d,\n",
+                        origin, destination, transports[rand() % 5],
+                        rand() % 48, rand() % 100, rand() % 2000, rand() % 100);
+        }
+        if (n < 0) {
+            fclose(file);
+            return 0;
+        }
+        written += n;
+    }
+
+    fclose(file);
+    return 1;
+}
+
+static BenchResult strtokLoad(const char* filename) {
+    BenchResult result = {0, 0, 0};
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        return result;
+    }
+
+    double start = now();
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = 0;
+
+        char* origin = strtok(line, ",");
+        char* destination = origin != NULL ? strtok(NULL, ",") : NULL;
+        char* transport = destination != NULL ? strtok(NULL, ",") : NULL;
+        char* time = transport != NULL ? strtok(NULL, ",") : NULL;
+        char* cost = time != NULL ? strtok(NULL, ",") : NULL;
+        if (cost == NULL) {
+            continue;
+        }
+
+        result.checksum += atof(time) + atof(cost);
+        result.rows++;
+    }
+    result.seconds = now() - start;
+
+    fclose(file);
+    return result;
+}
+
+static BenchResult csvReaderLoad(const char* filename) {
+    BenchResult result = {0, 0, 0};
+    CsvReader* reader = openCsvReader(filename);
+    if (reader == NULL) {
+        return result;
+    }
+
+    double start = now();
+    int status;
+    while ((status = csvNextRecord(reader)) != CSV_END) {
+        if (status != CSV_RECORD || reader->fieldCount < 5) {
+            continue;
+        }
+
+        double time;
+        double cost;
+        if (!csvParseDouble(csvField(reader, 3), &time) || !csvParseDouble(csvField(reader, 4), &cost)) {
+            continue;
+        }
+
+        result.checksum += time + cost;
+        result.rows++;
+    }
+    result.seconds = now() - start;
+
+    closeCsvReader(reader);
+    return result;
+}
+
+static void printResult(const char* name, BenchResult result, double megabytes) {
+    printf("%-10s %9.3f s %9.1f MB/s %10ld rows  checksum %.2f\n",
+           name, result.seconds, result.seconds > 0 ? megabytes / result.seconds : 0.0,
+           result.rows, result.checksum);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s <routes_file> [megabytes]\n", argv[0]);
+        return 1;
+    }
+
+    if (argc > 2) {
+        long megabytes = atol(argv[2]);
+        printf("Writing %ld MB of routes to %s\n", megabytes, argv[1]);
+        if (megabytes <= 0 || !writeRoutes(argv[1], megabytes)) {
+            printf("Failed to write %s\n", argv[1]);
+            return 1;
+        }
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        printf("Could not open %s\n", argv[1]);
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    double megabytes = ftell(file) / (1024.0 * 1024.0);
+    fclose(file);
+
+    printf("%s: %.1f MB\n", argv[1], megabytes);
+    printResult("strtok", strtokLoad(argv[1]), megabytes);
+    printResult("CsvReader", csvReaderLoad(argv[1]), megabytes);
+
+    return 0;
+}
@@ -0,0 +1,335 @@
+// Routing engine benchmark
+//
+// Generates seeded synthetic networks in the shape of cities.csv and
+// routes.csv, a sparse and a dense one per size, and runs the same seeded
+// query set through each engine's batch mode, one process per engine and
+// network:
+//
+//   travel     Dijkstra over the CSR graph (Main.c, travel --batch, one thread)
+//   astar_c    A* with landmark bounds (astar.c --batch)
+//   astar_cpp  TravelPlanner::findRoute (astar.cpp --batch); it generates its
+//              own routes from the cities, so its paths differ
+//
+// Networks join each city to its nearest neighbours and to long-haul hubs
+// (RouteSynthesis.h), so every query has a route. Engines missing from
+// bin_dir are reported as skipped.
+//
+// Prints one JSON object with a run per engine and network. Times are in
+// seconds: latency percentiles and throughput come from the search time
+// each engine reports per query, loadTime is the process's wall time less
+// its search time (parsing, building the graph and landmarks, writing the
+// results), and peakRss is the process's maximum resident set in MB.
+//
+// Usage: engine_bench <bin_dir> <work_dir> [nodes[,nodes...]] [queries] [seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "../RouteSynthesis.h"
+
+#define BENCH_DEFAULT_NODES "1000,10000,100000"
+#define BENCH_DEFAULT_QUERIES 200
+#define BENCH_PATH_LENGTH 4096
+
+// Neighbours and hubs of each network density
+typedef struct BenchDensity {
+    const char* name;
+    int neighbors;
+    int hubs;
+} BenchDensity;
+
+static const BenchDensity densities[] = {
+    {"sparse", 3, 16},
+    {"dense", 16, 64},
+};
+
+// Measurements of one engine over one network
+typedef struct BenchRun {
+    int answered;
+    int failed;
+    double searchTime;     // sum of the per-query times
+    double wallTime;
+    double p50;
+    double p99;
+    double meanSettled;
+    double peakRss;        // MB
+} BenchRun;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Write cityCount seeded cities and their synthesized routes as CSV files.
+// Returns the number of routes written, or -1 on failure.
+static int writeNetwork(const char* citiesFile, const char* routesFile, int cityCount, const BenchDensity* density,
+                        uint64_t seed) {
+    double* latitudes = (double*)malloc((cityCount + 1) * sizeof(double));
+    double* longitudes = (double*)malloc((cityCount + 1) * sizeof(double));
+    if (latitudes == NULL || longitudes == NULL) {
+        free(latitudes);
+        free(longitudes);
+        return -1;
+    }
+
+    // Inhabited latitudes, all longitudes
+    uint64_t state = seed;
+    for (int i = 0; i < cityCount; i++) {
+        state = routeSynthesisMix(state);
+        latitudes[i] = -55.0 + routeSynthesisUniform(state) * 125.0;
+        state = routeSynthesisMix(state);
+        longitudes[i] = -180.0 + routeSynthesisUniform(state) * 360.0;
+    }
+
+    RouteSynthesisOptions options;
+    routeSynthesisDefaults(&options);
+    options.neighbors = density->neighbors;
+    options.hubs = density->hubs;
+    options.seed = seed;
+    options.threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    SynthesizedRoutes* routes = synthesizeRoutes(latitudes, longitudes, cityCount, &options);
+
+    FILE* cities = fopen(citiesFile, "w");
+    FILE* routesOut = fopen(routesFile, "w");
+    int ok = routes != NULL && cities != NULL && routesOut != NULL;
+    if (ok) {
+        fprintf(cities, "Country,City,Latitude,Longitude\n");
+        for (int i = 0; i < cityCount; i++) {
+            fprintf(cities, "Synthetic,C%d,%.5f,%.5f\n", i, latitudes[i], longitudes[i]);
+        }
+        for (int r = 0; r < routes->routeCount; r++) {
+            fprintf(routesOut, "C%d,C%d,%s,%.3f,%.2f,\"Synthetic\"\n", routes->sources[r], routes->targets[r],
+                    routes->distances[r] > 1500.0f ? "plane" : "bus", routes->times[r], routes->costs[r]);
+        }
+    }
+
+    int routeCount = ok ? routes->routeCount : -1;
+    if (cities != NULL && fclose(cities) != 0) {
+        routeCount = -1;
+    }
+    if (routesOut != NULL && fclose(routesOut) != 0) {
+        routeCount = -1;
+    }
+    freeSynthesizedRoutes(routes);
+    free(latitudes);
+    free(longitudes);
+    return routeCount;
+}
+
+// Write queryCount seeded origin,destination,preference lines, alternating
+// time and cost. Returns 1 on success.
+static int writeQueries(const char* filename, int cityCount, int queryCount, uint64_t seed) {
+    FILE* file = fopen(filename, "w");
+    if (file == NULL) {
+        return 0;
+    }
+
+    uint64_t state = routeSynthesisMix(seed ^ 0x51ED270B27D5F1A3ULL);
+    fprintf(file, "origin,destination,preference\n");
+    for (int q = 0; q < queryCount; q++) {
+        state = routeSynthesisMix(state);
+        int origin = (int)(state % (uint64_t)cityCount);
+        state = routeSynthesisMix(state);
+        int destination = (int)(state % (uint64_t)(cityCount - 1));
+        destination += destination >= origin;
+        fprintf(file, "C%d,C%d,%s\n", origin, destination, q % 2 ? "cost" : "time");
+    }
+
+    return fclose(file) == 0;
+}
+
+// Run argv[0] with output discarded, recording its wall time and peak
+// resident set. Returns its exit status, or -1 if it could not be run.
+static int runEngine(char* const argv[], BenchRun* run) {
+    double start = now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+        }
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid) {
+        return -1;
+    }
+    run->wallTime = now() - start;
+    run->peakRss = usage.ru_maxrss / 1024.0;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Number after "key": in a JSON line, or -1 if it has none
+static double jsonNumber(const char* line, const char* key) {
+    char quoted[64];
+    snprintf(quoted, sizeof(quoted), "\"%s\":", key);
+    const char* at = strstr(line, quoted);
+    return at != NULL ? strtod(at + strlen(quoted), NULL) : -1;
+}
+
+// Fill run's latencies and settled counts from an engine's result lines.
+// Returns 1 on success.
+static int readResults(const char* filename, int queryCount, BenchRun* run) {
+    FILE* file = fopen(filename, "r");
+    double* latencies = (double*)malloc((queryCount + 1) * sizeof(double));
+    if (file == NULL || latencies == NULL) {
+        if (file != NULL) {
+            fclose(file);
+        }
+        free(latencies);
+        return 0;
+    }
+
+    // Result lines hold whole paths, so they can be long
+    char* line = NULL;
+    size_t capacity = 0;
+    double settled = 0;
+    run->answered = 0;
+    run->failed = 0;
+    run->searchTime = 0;
+    while (getline(&line, &capacity, file) != -1) {
+        double seconds = jsonNumber(line, "computationTime");
+        double visited = jsonNumber(line, "nodesVisited");
+        if (strstr(line, "\"error\":") != NULL || seconds < 0 || run->answered >= queryCount) {
+            run->failed++;
+            continue;
+        }
+        latencies[run->answered++] = seconds;
+        run->searchTime += seconds;
+        settled += visited;
+    }
+    free(line);
+    fclose(file);
+
+    qsort(latencies, run->answered, sizeof(double), compareDoubles);
+    run->p50 = run->answered > 0 ? latencies[(run->answered - 1) / 2] : 0;
+    run->p99 = run->answered > 0 ? latencies[(int)((run->answered - 1) * 0.99 + 0.5)] : 0;
+    run->meanSettled = run->answered > 0 ? settled / run->answered : 0;
+
+    free(latencies);
+    return 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        printf("Usage: %s <bin_dir> <work_dir> [nodes[,nodes...]] [queries] [seed]\n", argv[0]);
+        return 1;
+    }
+
+    const char* binDir = argv[1];
+    const char* workDir = argv[2];
+    char sizes[256];
+    snprintf(sizes, sizeof(sizes), "%s", argc > 3 ? argv[3] : BENCH_DEFAULT_NODES);
+    int queryCount = argc > 4 ? atoi(argv[4]) : BENCH_DEFAULT_QUERIES;
+    uint64_t seed = argc > 5 ? strtoull(argv[5], NULL, 10) : 1;
+    if (queryCount < 1) {
+        printf("queries must be positive\n");
+        return 1;
+    }
+
+    printf("{\"seed\": %llu, \"queries\": %d, \"runs\": [", (unsigned long long)seed, queryCount);
+    int firstRun = 1;
+
+    for (char* size = strtok(sizes, ","); size != NULL; size = strtok(NULL, ",")) {
+        int cityCount = atoi(size);
+        if (cityCount < 2) {
+            fprintf(stderr, "Skipping network of %s cities\n", size);
+            continue;
+        }
+
+        for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++) {
+            const BenchDensity* density = &densities[d];
+            char citiesFile[BENCH_PATH_LENGTH];
+            char routesFile[BENCH_PATH_LENGTH];
+            char queriesFile[BENCH_PATH_LENGTH];
+            char resultsFile[BENCH_PATH_LENGTH];
+            char landmarksFile[BENCH_PATH_LENGTH];
+            snprintf(citiesFile, sizeof(citiesFile), "%s/cities_%d_%s.csv", workDir, cityCount, density->name);
+            snprintf(routesFile, sizeof(routesFile), "%s/routes_%d_%s.csv", workDir, cityCount, density->name);
+            snprintf(queriesFile, sizeof(queriesFile), "%s/queries_%d_%s.csv", workDir, cityCount, density->name);
+            snprintf(resultsFile, sizeof(resultsFile), "%s/results_%d_%s.jsonl", workDir, cityCount, density->name);
+            snprintf(landmarksFile, sizeof(landmarksFile), "%s/landmarks_%d_%s.lmk", workDir, cityCount, density->name);
+
+            fprintf(stderr, "Generating %s network of %d cities\n", density->name, cityCount);
+            int routeCount = writeNetwork(citiesFile, routesFile, cityCount, density, seed);
+            if (routeCount < 0 || !writeQueries(queriesFile, cityCount, queryCount, seed)) {
+                fprintf(stderr, "Could not write network files to %s\n", workDir);
+                printf("]}\n");
+                return 1;
+            }
+
+            // Each engine in its batch form; landmarks are rebuilt every run
+            // so astar_c's load time always includes them
+            char travel[BENCH_PATH_LENGTH];
+            char astarC[BENCH_PATH_LENGTH];
+            char astarCpp[BENCH_PATH_LENGTH];
+            snprintf(travel, sizeof(travel), "%s/travel", binDir);
+            snprintf(astarC, sizeof(astarC), "%s/astar_c", binDir);
+            snprintf(astarCpp, sizeof(astarCpp), "%s/astar_cpp", binDir);
+            char* travelArgs[] = {travel, (char*)"--batch", citiesFile, routesFile, queriesFile, resultsFile, (char*)"1", NULL};
+            char* astarCArgs[] = {astarC, (char*)"--batch", citiesFile, routesFile, queriesFile, resultsFile, landmarksFile, NULL};
+            char* astarCppArgs[] = {astarCpp, (char*)"--batch", citiesFile, queriesFile, resultsFile, NULL};
+            char* const* engines[] = {travelArgs, astarCArgs, astarCppArgs};
+            const char* names[] = {"travel", "astar_c", "astar_cpp"};
+            const char* searches[] = {"dijkstra", "astar-landmarks", "astar-landmarks"};
+
+            for (int e = 0; e < 3; e++) {
+                printf("%s\n  {\"engine\": \"%s\", \"search\": \"%s\", \"network\": \"%s\", \"nodes\": %d, \"routes\": %d, ",
+                       firstRun ? "" : ",", names[e], searches[e], density->name, cityCount, routeCount);
+                firstRun = 0;
+
+                if (access(engines[e][0], X_OK) != 0) {
+                    printf("\"skipped\": \"%s not built\"}", engines[e][0]);
+                    continue;
+                }
+
+                fprintf(stderr, "Running %s\n", names[e]);
+                remove(resultsFile);
+                remove(landmarksFile);
+                BenchRun run;
+                memset(&run, 0, sizeof(run));
+                int status = runEngine(engines[e], &run);
+                if (status != 0) {
+                    printf("\"error\": \"exited with status %d\"}", status);
+                    continue;
+                }
+                if (!readResults(resultsFile, queryCount, &run)) {
+                    printf("\"error\": \"no results\"}");
+                    continue;
+                }
+
+                printf("\"answered\": %d, \"failed\": %d, \"loadTime\": %.6f, \"wallTime\": %.6f, "
+                       "\"throughput\": %.1f, \"p50Latency\": %.6f, \"p99Latency\": %.6f, "
+                       "\"meanSettled\": %.1f, \"peakRss\": %.1f}",
+                       run.answered, run.failed, run.wallTime - run.searchTime, run.wallTime,
+                       run.searchTime > 0 ? run.answered / run.searchTime : 0.0, run.p50, run.p99,
+                       run.meanSettled, run.peakRss);
+                fflush(stdout);
+            }
+        }
+    }
+
+    printf("\n]}\n");
+    return 0;
+}
@@ -0,0 +1,233 @@
+// Priority queue micro-benchmark
+//
+// Runs full single-source Dijkstra over the same CSR graph with three open
+// sets: the sorted linked list astar.c used to have (one malloc per push,
+// duplicate entries instead of decrease-key), std::priority_queue with lazy
+// deletion, and IndexedHeap with decrease-key. Graphs are the shipped
+// cities.csv/routes.csv and a seeded random graph.
+//
+// Usage: heap_bench [cities_file routes_file] [nodes] [degree] [sources]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <queue>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <string>
+
+#include "../GraphFunctions.h"
+
+struct BenchResult {
+    double milliseconds;
+    long pushes;
+    double checksum; // sum of finite distances, must match across queues
+};
+
+// The old astar.c queue: kept in sorted order, O(n) insert
+struct ListNode {
+    int city;
+    double key;
+    ListNode* next;
+};
+
+static void listPush(ListNode** front, int city, double key) {
+    ListNode* node = (ListNode*)malloc(sizeof(ListNode));
+    node->city = city;
+    node->key = key;
+
+    if (*front == NULL || (*front)->key > key) {
+        node->next = *front;
+        *front = node;
+        return;
+    }
+
+    ListNode* current = *front;
+    while (current->next != NULL && current->next->key <= key) {
+        current = current->next;
+    }
+    node->next = current->next;
+    current->next = node;
+}
+
+static BenchResult listDijkstra(const CSRGraph* g, int source) {
+    BenchResult result = {0, 0, 0};
+    std::vector<double> dist(g->nodeCount, std::numeric_limits<double>::infinity());
+    std::vector<char> settled(g->nodeCount, 0);
+    ListNode* front = NULL;
+
+    dist[source] = 0;
+    listPush(&front, source, 0);
+    result.pushes++;
+
+    while (front != NULL) {
+        ListNode* top = front;
+        front = top->next;
+        int u = top->city;
+        free(top);
+
+        if (settled[u]) {
+            continue;
+        }
+        settled[u] = 1;
+
+        for (int e = g->offsets[u]; e < g->offsets[u + 1]; e++) {
+            int v = g->targets[e];
+            double length = dist[u] + g->times[e];
+            if (length < dist[v]) {
+                dist[v] = length;
+                listPush(&front, v, length);
+                result.pushes++;
+            }
+        }
+    }
+
+    for (double d : dist) {
+        if (d < std::numeric_limits<double>::infinity()) result.checksum += d;
+    }
+    return result;
+}
+
+static BenchResult stdDijkstra(const CSRGraph* g, int source) {
+    BenchResult result = {0, 0, 0};
+    typedef std::pair<double, int> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+    std::vector<double> dist(g->nodeCount, std::numeric_limits<double>::infinity());
+
+    dist[source] = 0;
+    open.push(Entry(0, source));
+    result.pushes++;
+
+    while (!open.empty()) {
+        Entry top = open.top();
+        open.pop();
+        int u = top.second;
+        if (top.first > dist[u]) {
+            continue; // stale duplicate
+        }
+
+        for (int e = g->offsets[u]; e < g->offsets[u + 1]; e++) {
+            int v = g->targets[e];
+            double length = dist[u] + g->times[e];
+            if (length < dist[v]) {
+                dist[v] = length;
+                open.push(Entry(length, v));
+                result.pushes++;
+            }
+        }
+    }
+
+    for (double d : dist) {
+        if (d < std::numeric_limits<double>::infinity()) result.checksum += d;
+    }
+    return result;
+}
+
+static BenchResult heapDijkstra(const CSRGraph* g, IndexedHeap* open, int source) {
+    BenchResult result = {0, 0, 0};
+    std::vector<double> dist(g->nodeCount, std::numeric_limits<double>::infinity());
+    std::vector<char> settled(g->nodeCount, 0);
+
+    heapClear(open);
+    dist[source] = 0;
+    heapPushOrDecrease(open, source, 0);
+    result.pushes++;
+
+    while (!heapEmpty(open)) {
+        int u = heapPop(open);
+        settled[u] = 1;
+
+        for (int e = g->offsets[u]; e < g->offsets[u + 1]; e++) {
+            int v = g->targets[e];
+            double length = dist[u] + g->times[e];
+            if (!settled[v] && length < dist[v]) {
+                dist[v] = length;
+                heapPushOrDecrease(open, v, length);
+                result.pushes++;
+            }
+        }
+    }
+
+    for (double d : dist) {
+        if (d < std::numeric_limits<double>::infinity()) result.checksum += d;
+    }
+    return result;
+}
+
+// Seeded random graph: every node gets `degree` out-edges
+static CSRGraph* generateGraph(int nodes, int degree, unsigned int seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> pick(0, nodes - 1);
+    std::uniform_real_distribution<float> hours(0.5f, 20.0f);
+
+    int edges = nodes * degree;
+    std::vector<int> sources(edges), targets(edges);
+    std::vector<float> times(edges), costs(edges);
+    for (int i = 0; i < edges; i++) {
+        sources[i] = i / degree;
+        targets[i] = pick(rng);
+        times[i] = hours(rng);
+        costs[i] = times[i] * 50.0f;
+    }
+
+    return createCSRGraph(nodes, edges, sources.data(), targets.data(), times.data(), costs.data(), NULL);
+}
+
+static void runSuite(const std::string& name, const CSRGraph* g, int sources, bool includeList) {
+    std::cout << name << ": " << g->nodeCount << " nodes, " << g->edgeCount << " edges, "
+              << sources << " sources" << std::endl;
+
+    IndexedHeap* open = createIndexedHeap(g->nodeCount);
+    const char* labels[3] = {"sorted list", "std::priority_queue", "IndexedHeap (d=4)"};
+
+    for (int variant = includeList ? 0 : 1; variant < 3; variant++) {
+        BenchResult total = {0, 0, 0};
+        auto start = std::chrono::steady_clock::now();
+
+        for (int s = 0; s < sources; s++) {
+            int source = (int)((long long)s * g->nodeCount / sources);
+            BenchResult r = variant == 0 ? listDijkstra(g, source)
+                          : variant == 1 ? stdDijkstra(g, source)
+                          : heapDijkstra(g, open, source);
+            total.pushes += r.pushes;
+            total.checksum += r.checksum;
+        }
+
+        total.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "  " << std::left << std::setw(22) << labels[variant]
+                  << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(12) << total.milliseconds / sources << " ms/query"
+                  << std::setw(12) << total.pushes / sources << " pushes/query"
+                  << "  checksum " << std::setprecision(1) << total.checksum << std::endl;
+    }
+
+    freeIndexedHeap(open);
+}
+
+int main(int argc, char* argv[]) {
+    const char* citiesFile = argc > 2 ? argv[1] : "cities.csv";
+    const char* routesFile = argc > 2 ? argv[2] : "routes.csv";
+    int nodes = argc > 3 ? atoi(argv[3]) : 100000;
+    int degree = argc > 4 ? atoi(argv[4]) : 8;
+    int sources = argc > 5 ? atoi(argv[5]) : 5;
+
+    Graph* graph = createGraph(citiesFile, routesFile);
+    if (graph != NULL) {
+        runSuite(routesFile, graph->csr, graph->csr->nodeCount, true);
+        freeGraph(graph);
+    }
+
+    CSRGraph* generated = generateGraph(nodes, degree, 42);
+    if (generated == NULL) {
+        return 1;
+    }
+
+    // The list is quadratic in the open-set size; one source is enough to show it
+    runSuite("generated", generated, sources, false);
+    runSuite("generated (with sorted list, 1 source)", generated, 1, true);
+
+    freeCSRGraph(generated);
+    return 0;
+}
@@ -0,0 +1,83 @@
+// Graph compiler
+//
+// Parses the cities and routes CSV files once and writes them as a binary
+// snapshot. Every engine accepts the snapshot in place of the cities file
+// and maps it instead of parsing.
+//
+// Usage: compile_graph <cities_file> <routes_file[,routes_file...]> <snapshot_file>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FileOperations.h"
+#include "GraphFunctions.h"
+#include "GraphSnapshot.h"
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        printf("Usage: %s <cities_file> <routes_file[,routes_file...]> <snapshot_file>\n", argv[0]);
+        return 1;
+    }
+
+    if (isGraphSnapshotFile(argv[1])) {
+        printf("%s is already a snapshot\n", argv[1]);
+        return 1;
+    }
+
+    Graph* graph = createGraph(argv[1], argv[2]);
+    if (graph == NULL) {
+        printf("Failed to create graph\n");
+        return 1;
+    }
+
+    SourceFileInfo citiesSource;
+    SourceFileInfo routesSource;
+    if (!describeGraphSources(graph, argv[1], argv[2], &citiesSource, &routesSource)) {
+        printf("Failed to read input files\n");
+        freeGraph(graph);
+        return 1;
+    }
+
+    int cityCount = graph->cityCount;
+    int routeCount = graph->routeCount;
+    const char** countries = (const char**)malloc((cityCount > 0 ? cityCount : 1) * sizeof(const char*));
+    float* lats = (float*)malloc((cityCount > 0 ? cityCount : 1) * sizeof(float));
+    float* lons = (float*)malloc((cityCount > 0 ? cityCount : 1) * sizeof(float));
+    const char** transports = (const char**)malloc((routeCount > 0 ? routeCount : 1) * sizeof(const char*));
+    const char** notes = (const char**)malloc((routeCount > 0 ? routeCount : 1) * sizeof(const char*));
+    float* distances = (float*)malloc((routeCount > 0 ? routeCount : 1) * sizeof(float));
+
+    int ok = countries != NULL && lats != NULL && lons != NULL && transports != NULL && notes != NULL && distances != NULL;
+    if (ok) {
+        for (int i = 0; i < cityCount; i++) {
+            countries[i] = graph->cities[i]->country;
+            lats[i] = graph->cities[i]->lat;
+            lons[i] = graph->cities[i]->lon;
+        }
+        for (int i = 0; i < routeCount; i++) {
+            transports[i] = graph->routes[i]->transport;
+            notes[i] = graph->routes[i]->note;
+            distances[i] = graph->routes[i]->distance;
+        }
+
+        ok = writeGraphSnapshot(argv[3], graph->csr, graph->names, countries, lats, lons,
+                                transports, notes, distances, &citiesSource, &routesSource);
+    }
+
+    if (ok) {
+        printf("Snapshot with %d cities and %d routes written to %s\n", graph->csr->nodeCount, graph->csr->edgeCount, argv[3]);
+    } else {
+        printf("Failed to write snapshot %s\n", argv[3]);
+    }
+
+    free(countries);
+    free(lats);
+    free(lons);
+    free(transports);
+    free(notes);
+    free(distances);
+    freeGraph(graph);
+
+    return ok ? 0 : 1;
+}
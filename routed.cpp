@@ -0,0 +1,1775 @@
+// Routing daemon
+//
+// Loads cities and routes once, then answers route queries over a
+// localhost TCP port until killed. Each connection carries one JSON
+// object per line and gets one JSON line back, in the same shape as
+// TravelPlanner::routeToJson:
+//
+//   {"origin": "London", "destination": "Tokyo", "preference": "fastest"}
+//
+// Several routes files may be given as one comma-separated argument, in
+// any layout the loaders recognise by header, for example
+// routes.csv,indian_cities.csv.
+//
+// The cities file may instead be a snapshot from compile_graph, which is
+// mapped rather than parsed, so any number of daemons share one copy of
+// the graph in the page cache.
+//
+// With a distance table from `travel --precompute`, queries are answered
+// by following its next hops instead of searching. A contraction hierarchy
+// from `travel --contract` may be given in its place; queries then search
+// up the hierarchy from both ends, which settles a few hundred cities
+// where a plain search settles most of the network.
+//
+// A query with "preference": "pareto" gets every itinerary no other one
+// beats on time, cost and legs at once, fastest first, under "routes".
+// Each city keeps at most "maxLabels" partial itineraries (default 128);
+// past that the search drops some between the fastest and the cheapest
+// and the reply says "truncated": true.
+//
+// Any query may limit its itineraries with "maxTime", "maxCost",
+// "maxStops" (counting the stops route notes mention), "modes" (a list of
+// transport names) and "exclude" (a list of cities). A fastest or
+// cheapest query with limits is answered by a label search that prunes as
+// it goes rather than by filtering paths afterwards:
+//
+//   {"origin": "London", "destination": "Tokyo", "preference": "fastest",
+//    "maxCost": 1000, "maxStops": 2, "modes": ["plane"]}
+//
+// A query with "departAt" (Unix seconds) is planned against the route
+// timetables: the reply is the journey arriving first, with when each
+// leg leaves and arrives, allowing "transfer" hours (default 0.5) at each
+// change. Routes files schedule a route with a Departure column (06:30)
+// and optionally a headway such as Every_Minutes; routes without one run
+// whenever they are needed.
+//
+//   {"origin": "London", "destination": "Tokyo", "departAt": 1767254400}
+//
+// A query with "origins" and "destinations" lists instead gets the
+// fastest time and cheapest cost between every pair, as "times" and
+// "costs" matrices with a row per origin and null where there is no path.
+// Its searches are split over the daemon's thread count.
+//
+//   {"origins": ["London", "Paris"], "destinations": ["Tokyo", "Lima"]}
+//
+// A query with a "budget" and no destination gets every city the origin
+// reaches within that many hours (or dollars, for "cheapest"), nearest
+// first, with the time and cost of the best path to each:
+//
+//   {"origin": "London", "budget": 12, "preference": "fastest"}
+//
+// A fastest or cheapest query with "alternatives": k gets up to k loopless
+// itineraries, shortest first, under "routes". They are Yen's k shortest
+// paths unless "method" is "diverse", which asks for the penalty method's
+// routes that share fewer legs.
+//
+// A fastest or cheapest query with "compare": true runs Dijkstra and A*
+// (guided by landmarks the daemon builds for each graph version the first
+// time one is compared on) on the same graph, one after the other on the
+// same thread, and returns both itineraries under "dijkstra" and "astar"
+// with what each search did: cities settled, edges relaxed, heap pushes,
+// the most cities queued at once, wall-clock and thread CPU nanoseconds,
+// and the first cities settled in order under "visited". A plain query
+// with "algorithm": "astar" takes the A* search too, unless a distance
+// table or hierarchy answers it. Build with -DSEARCH_COUNTERS=0 to compile
+// the counting out; the counts are then zero.
+//
+//   {"origin": "London", "destination": "Tokyo", "preference": "fastest",
+//    "compare": true}
+//
+// A request with "update" changes the network in memory, without
+// reloading it: "add-city" (city, country, latitude, longitude),
+// "add-route" (origin, destination, transport, time, cost and optionally
+// note, distance, departure and headway), "modify-route" (a new time
+// and/or cost) or "remove-route". A route is named by origin and
+// destination, plus transport when several join them, so an "add-route"
+// that could not be told apart from an existing route is refused:
+//
+//   {"update": "modify-route", "origin": "London", "destination": "Paris",
+//    "transport": "train", "cost": 89}
+//
+// Queries never see half an update. Each one runs on the version of the
+// graph that was current when it started, while one thread applies the
+// updates that have queued up since its last version as the next one and
+// swaps it in; the reply comes once the change is live. A distance table
+// is repaired to match, rather than rebuilt; a contraction hierarchy is
+// dropped at the first update, since changed weights invalidate its
+// shortcuts. Updates are not written back to the CSV files.
+//
+// Usage: routed <cities_file> <routes_file[,routes_file...]> [port] [threads] [table_file|hierarchy_file]
+
+#include <iostream>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "GraphFunctions.h"
+#include "SearchWorkspace.h"
+#include "DistanceTable.h"
+#include "ContractionHierarchy.h"
+#include "ParetoSearch.h"
+#include "AlternativeRoutes.h"
+#include "Timetable.h"
+#include "DistanceMatrix.h"
+#include "Isochrone.h"
+#include "Landmarks.h"
+
+// Define M_PI if not defined
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Longest request line accepted from a client
+static const size_t MAX_REQUEST_LENGTH = 64 * 1024;
+
+// Settled cities a comparison lists per algorithm
+static const int COMPARE_MAX_VISITED = 4096;
+
+// The four hex digits at pos as a code unit, -1 if they are not hex
+static int jsonReadHex4(const std::string& json, size_t pos) {
+    if (pos + 4 > json.size()) {
+        return -1;
+    }
+    int unit = 0;
+    for (size_t i = pos; i < pos + 4; i++) {
+        char c = json[i];
+        int digit = c >= '0' && c <= '9'   ? c - '0'
+                    : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                    : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                           : -1;
+        if (digit < 0) {
+            return -1;
+        }
+        unit = unit * 16 + digit;
+    }
+    return unit;
+}
+
+// Append a code point to value as UTF-8
+static void appendUtf8(std::string& value, unsigned int code) {
+    if (code < 0x80) {
+        value += (char)code;
+    } else if (code < 0x800) {
+        value += (char)(0xC0 | (code >> 6));
+        value += (char)(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        value += (char)(0xE0 | (code >> 12));
+        value += (char)(0x80 | ((code >> 6) & 0x3F));
+        value += (char)(0x80 | (code & 0x3F));
+    } else {
+        value += (char)(0xF0 | (code >> 18));
+        value += (char)(0x80 | ((code >> 12) & 0x3F));
+        value += (char)(0x80 | ((code >> 6) & 0x3F));
+        value += (char)(0x80 | (code & 0x3F));
+    }
+}
+
+// Unescape the JSON string whose opening quote is at pos. end is left
+// just past the closing quote, or at npos if the string is unterminated.
+// \u escapes become UTF-8, a surrogate pair as one character and a lone
+// surrogate as U+FFFD, so "S\u00e3o Paulo" matches the name in the CSV.
+static std::string jsonReadString(const std::string& json, size_t pos, size_t& end) {
+    std::string value;
+    for (size_t i = pos + 1; i < json.size(); i++) {
+        char c = json[i];
+        if (c == '"') {
+            end = i + 1;
+            return value;
+        }
+        if (c == '\\' && i + 1 < json.size()) {
+            char next = json[++i];
+            switch (next) {
+                case 'n': value += '\n'; break;
+                case 't': value += '\t'; break;
+                case 'r': value += '\r'; break;
+                case 'b': value += '\b'; break;
+                case 'f': value += '\f'; break;
+                case 'u': {
+                    int unit = jsonReadHex4(json, i + 1);
+                    if (unit < 0) {
+                        value += next;
+                        break;
+                    }
+                    i += 4;
+                    unsigned int code = unit;
+                    if (unit >= 0xD800 && unit <= 0xDBFF) {
+                        int low = json.compare(i + 1, 2, "\\u") == 0 ? jsonReadHex4(json, i + 3) : -1;
+                        if (low >= 0xDC00 && low <= 0xDFFF) {
+                            code = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                            i += 6;
+                        } else {
+                            code = 0xFFFD;
+                        }
+                    } else if (unit >= 0xDC00 && unit <= 0xDFFF) {
+                        code = 0xFFFD;
+                    }
+                    appendUtf8(value, code);
+                    break;
+                }
+                default: value += next; break;
+            }
+        } else {
+            value += c;
+        }
+    }
+
+    end = std::string::npos;
+    return "";
+}
+
+// Position of the value of key in a flat JSON object, npos if absent.
+// Strings are skipped whole, so a key only matches as a quoted name
+// followed by a colon, never inside another field's value.
+static size_t jsonFieldValue(const std::string& json, const std::string& key) {
+    size_t pos = json.find('"');
+    while (pos != std::string::npos) {
+        size_t end;
+        std::string name = jsonReadString(json, pos, end);
+        if (end == std::string::npos) {
+            return std::string::npos;
+        }
+
+        size_t colon = json.find_first_not_of(" \t\r\n", end);
+        if (colon != std::string::npos && json[colon] == ':') {
+            if (name == key) {
+                return json.find_first_not_of(" \t\r\n", colon + 1);
+            }
+        }
+        pos = json.find('"', end);
+    }
+    return std::string::npos;
+}
+
+// Value of a string field in a flat JSON object, "" if absent
+static std::string jsonStringField(const std::string& json, const std::string& key) {
+    size_t pos = jsonFieldValue(json, key);
+    if (pos == std::string::npos || json[pos] != '"') {
+        return "";
+    }
+
+    size_t end;
+    return jsonReadString(json, pos, end);
+}
+
+// Strings of an array field in a flat JSON object, empty if absent
+static std::vector<std::string> jsonStringArrayField(const std::string& json, const std::string& key) {
+    std::vector<std::string> values;
+    size_t pos = jsonFieldValue(json, key);
+    if (pos == std::string::npos || json[pos] != '[') {
+        return values;
+    }
+
+    pos = json.find_first_not_of(" \t,", pos + 1);
+    while (pos != std::string::npos && json[pos] == '"') {
+        values.push_back(jsonReadString(json, pos, pos));
+        if (pos != std::string::npos) {
+            pos = json.find_first_not_of(" \t,", pos);
+        }
+    }
+
+    return values;
+}
+
+// Whether a flat JSON object has a field
+static bool jsonHasField(const std::string& json, const std::string& key) {
+    return jsonFieldValue(json, key) != std::string::npos;
+}
+
+// Value of a numeric field in a flat JSON object, fallback if absent
+static double jsonNumberField(const std::string& json, const std::string& key, double fallback) {
+    size_t pos = jsonFieldValue(json, key);
+    if (pos == std::string::npos) {
+        return fallback;
+    }
+
+    const char* start = json.c_str() + pos;
+    char* end;
+    double value = strtod(start, &end);
+    return end != start ? value : fallback;
+}
+
+// Value of a boolean field in a flat JSON object, false unless it is true
+static bool jsonBoolField(const std::string& json, const std::string& key) {
+    size_t pos = jsonFieldValue(json, key);
+    return pos != std::string::npos && json.compare(pos, 4, "true") == 0;
+}
+
+// Quote and escape a string for JSON output
+static std::string jsonString(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+// Calculate Haversine distance between two points on Earth
+static double haversineDistance(double lat1, double lon1, double lat2, double lon2) {
+    const double R = 6371.0; // Earth radius in kilometers
+
+    double dLat = (lat2 - lat1) * M_PI / 180.0;
+    double dLon = (lon2 - lon1) * M_PI / 180.0;
+
+    double a = sin(dLat/2) * sin(dLat/2) +
+              cos(lat1 * M_PI / 180.0) * cos(lat2 * M_PI / 180.0) *
+              sin(dLon/2) * sin(dLon/2);
+
+    double c = 2 * atan2(sqrt(a), sqrt(1-a));
+    return R * c;
+}
+
+// 1 + the stops each CSR edge's route note mentions, for maxStops
+static std::vector<unsigned char> noteLegs(const Graph* graph) {
+    std::vector<unsigned char> legs(graph->csr->edgeCount);
+    for (int edge = 0; edge < graph->csr->edgeCount; edge++) {
+        legs[edge] = static_cast<unsigned char>(std::min(1 + noteStopCount(graphEdgeNote(graph, edge)), 255));
+    }
+    return legs;
+}
+
+// One version of everything queries read
+//
+// A version never changes once it is published. An update builds the next
+// one beside it, sharing the city and route records it leaves alone, so
+// its cities and routes arrays are its own but most records are not. The
+// records the next version dropped are freed with this one, and each
+// version keeps the ones after it alive, so a record outlives every query
+// that could still see it.
+struct GraphVersion {
+    Graph* graph;
+    CSRGraph* backward;                      // reverse of graph->csr, for Pareto bounds and alternatives
+    std::shared_ptr<Timetable> timetable;    // shared by versions until a schedule changes
+    std::vector<unsigned char> edgeLegs;
+    DistanceTable* table;                    // NULL to always search
+    const ContractionHierarchy* hierarchy;   // NULL for a plain search; not owned
+    long number;
+
+    // A* bounds, built the first time a query on this version needs them
+    mutable std::once_flag landmarksBuilt;
+    mutable Landmarks* landmarks;
+
+    bool superseded;                         // a next version was published
+    std::vector<Route*> retiredRoutes;       // routes the next version replaced or removed
+    bool retiredNames;                       // the next version built its own name table
+    std::shared_ptr<GraphVersion> newer;
+
+    GraphVersion() : graph(NULL), backward(NULL), table(NULL), hierarchy(NULL), number(0), landmarks(NULL),
+                     superseded(false), retiredNames(false) {}
+
+    ~GraphVersion() {
+        // The newest version owns every record it holds; an older one only
+        // what the next version dropped
+        if (!superseded) {
+            freeGraph(graph);
+        } else if (graph != NULL) {
+            for (Route* route : retiredRoutes) {
+                freeRoute(route);
+            }
+            if (retiredNames) {
+                freeSymbolTable(graph->names);
+            }
+            freeCSRGraph(graph->csr);
+            free(graph->cities);
+            free(graph->routes);
+            free(graph);
+        }
+        freeCSRGraph(backward);
+        closeDistanceTable(table);
+        freeLandmarks(landmarks);
+
+        // Release the later versions nothing else holds one at a time,
+        // oldest first; leaving each to its predecessor's destructor would
+        // recurse once per update
+        std::shared_ptr<GraphVersion> next = std::move(newer);
+        while (next != nullptr && next.use_count() == 1) {
+            std::shared_ptr<GraphVersion> after = std::move(next->newer);
+            next.reset();
+            next = std::move(after);
+        }
+    }
+
+    // Landmarks for this version's graph, NULL if they could not be built
+    const Landmarks* searchLandmarks() const {
+        std::call_once(landmarksBuilt, [this]() {
+            landmarks = createLandmarks(graph->csr, LANDMARK_DEFAULT_COUNT, LANDMARK_SELECT_AVOID);
+        });
+        return landmarks;
+    }
+
+    GraphVersion(const GraphVersion&) = delete;
+    GraphVersion& operator=(const GraphVersion&) = delete;
+};
+
+// Long-lived route server over a graph that updates replace version by version
+class RouteServer {
+private:
+    std::shared_ptr<GraphVersion> current;   // read and swapped atomically
+    int listenFd;
+    int matrixThreads;                       // threads one matrix query searches with
+
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::deque<int> pendingClients;
+    std::vector<std::thread> workers;
+
+    // An update request waiting for the updater thread
+    struct PendingUpdate {
+        std::string request;
+        std::string reply;
+        bool done;
+    };
+
+    std::mutex updateMutex;
+    std::condition_variable updateReady;     // the updater waits for requests
+    std::condition_variable updateDone;      // clients wait for their replies
+    std::vector<PendingUpdate*> pendingUpdates;
+    std::thread updater;
+
+    // The next version while a batch of updates is applied to it
+    struct VersionDraft {
+        const GraphVersion* base;
+        Graph* graph;
+        bool structural;                     // cities or routes were added or removed
+        bool rescheduled;                    // a scheduled route changed, so the timetable is rebuilt
+        std::vector<int> reweighted;         // edges of the base CSR whose time or cost changed
+        std::vector<Route*> retired;         // base records replaced or removed
+        std::unordered_set<Route*> created;  // records made by this batch
+        std::vector<Location*> addedCities;
+    };
+
+    // Search state one worker thread owns, sized for capacity cities
+    struct Worker {
+        int capacity;
+        int edgeCapacity;
+        SearchWorkspace* ws;
+        ContractionQuery* query;          // NULL without a hierarchy
+        ParetoSearch* pareto;
+        AlternativeSearch* alternatives;
+        TimetableQuery* journeys;
+        IsochroneSearch* reach;
+    };
+
+    // Write the path, steps and totals of one itinerary as JSON fields
+    void writeItinerary(const GraphVersion& version, std::stringstream& json, Location* from, const int* edges, int edgeCount) {
+        double totalDistance = 0.0;
+        double totalCost = 0.0;
+        double totalTime = 0.0;
+
+        json << "\"path\": [" << jsonString(from->capital);
+        for (int i = 0; i < edgeCount; i++) {
+            json << "," << jsonString(version.graph->cities[version.graph->csr->targets[edges[i]]]->capital);
+        }
+        json << "],";
+        json << "\"steps\": [";
+
+        Location* previous = from;
+        for (int i = 0; i < edgeCount; i++) {
+            int edge = edges[i];
+            Location* next = version.graph->cities[version.graph->csr->targets[edge]];
+            double cost = version.graph->csr->costs[edge];
+            double time = version.graph->csr->times[edge];
+            // Great-circle distance unless the routes file gives one
+            double distance = graphEdgeDistance(version.graph, edge);
+            if (distance <= 0.0) {
+                distance = haversineDistance(previous->lat, previous->lon, next->lat, next->lon);
+            }
+
+            json << "{";
+            json << "\"from\": " << jsonString(previous->capital) << ",";
+            json << "\"to\": " << jsonString(next->capital) << ",";
+            json << "\"transport\": " << jsonString(graphEdgeTransport(version.graph, edge)) << ",";
+            json << "\"distance\": " << std::fixed << std::setprecision(2) << distance << ",";
+            json << "\"cost\": " << std::fixed << std::setprecision(2) << cost << ",";
+            json << "\"time\": " << std::fixed << std::setprecision(2) << time;
+            json << "}";
+
+            if (i < edgeCount - 1) {
+                json << ",";
+            }
+
+            totalDistance += distance;
+            totalCost += cost;
+            totalTime += time;
+            previous = next;
+        }
+
+        json << "],";
+        json << "\"totalDistance\": " << std::fixed << std::setprecision(2) << totalDistance << ",";
+        json << "\"totalCost\": " << std::fixed << std::setprecision(2) << totalCost << ",";
+        json << "\"totalTime\": " << std::fixed << std::setprecision(2) << totalTime;
+    }
+
+    // Limits a request puts on its itineraries, with excluded as the
+    // storage for its city list. Returns an error message, "" if none.
+    std::string readLimits(const GraphVersion& version, const std::string& request, ParetoLimits& limits, std::vector<unsigned char>& excluded) {
+        paretoNoLimits(&limits);
+        limits.edgeLegs = version.edgeLegs.data();
+        limits.maxTime = jsonNumberField(request, "maxTime", PARETO_UNLIMITED);
+        limits.maxCost = jsonNumberField(request, "maxCost", PARETO_UNLIMITED);
+
+        // Stops include those inside a route, so k stops is k + 1 legs
+        double maxStops = jsonNumberField(request, "maxStops", -1);
+        if (maxStops >= 0) {
+            limits.maxLegs = static_cast<int>(maxStops) + 1;
+        }
+
+        std::vector<std::string> modes = jsonStringArrayField(request, "modes");
+        if (!modes.empty()) {
+            limits.modes = 0;
+            for (const std::string& mode : modes) {
+                int id = transportModeFromString(mode.c_str());
+                if (id == TRANSPORT_OTHER && mode != "other") {
+                    return "Unknown transport mode " + mode + ".";
+                }
+                limits.modes |= 1u << id;
+            }
+        }
+
+        std::vector<std::string> avoid = jsonStringArrayField(request, "exclude");
+        if (!avoid.empty()) {
+            excluded.assign(version.graph->csr->nodeCount, 0);
+            for (const std::string& name : avoid) {
+                Location* city = getCity(version.graph, name.c_str());
+                if (city == NULL) {
+                    return "Excluded city " + name + " not found.";
+                }
+                excluded[city->id] = 1;
+            }
+            limits.excluded = excluded.data();
+        }
+
+        return "";
+    }
+
+    // Every itinerary on the time/cost/legs frontier, fastest first
+    std::string answerPareto(const GraphVersion& version, Location* from, Location* to, const ParetoLimits& limits, int maxLabels,
+                             ParetoSearch* pareto, std::chrono::high_resolution_clock::time_point startTime) {
+        int routeCount = paretoRoutes(version.graph->csr, version.backward, pareto, from->id, to->id, &limits, maxLabels);
+        if (routeCount <= 0) {
+            return "{\"error\": \"No route found.\"}";
+        }
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double computationTime = std::chrono::duration<double>(endTime - startTime).count();
+
+        std::vector<int> edges(version.graph->csr->nodeCount);
+        std::stringstream json;
+        json << "{";
+        json << "\"origin\": " << jsonString(from->capital) << ",";
+        json << "\"destination\": " << jsonString(to->capital) << ",";
+        json << "\"routes\": [";
+        for (int i = 0; i < routeCount; i++) {
+            int edgeCount = paretoPathEdges(pareto, i, edges.data(), static_cast<int>(edges.size()));
+            json << (i > 0 ? ",{" : "{");
+            writeItinerary(version, json, from, edges.data(), edgeCount);
+            json << ",\"hops\": " << edgeCount;
+            json << ",\"legs\": " << pareto->labels[pareto->routes[i]].legs;
+            json << "}";
+        }
+        json << "],";
+        json << "\"truncated\": " << (pareto->truncated ? "true" : "false") << ",";
+        json << "\"nodesVisited\": " << pareto->settledCount << ",";
+        json << "\"computationTime\": " << std::fixed << std::setprecision(6) << computationTime;
+        json << "}";
+
+        return json.str();
+    }
+
+    // Up to count alternative itineraries, shortest first
+    std::string answerAlternatives(const GraphVersion& version, Location* from, Location* to, int costOrTime, int count,
+                                   bool diverse, AlternativeSearch* alternatives,
+                                   std::chrono::high_resolution_clock::time_point startTime) {
+        int routeCount = diverse ? diverseRoutes(version.graph->csr, version.backward, alternatives, from->id, to->id, costOrTime, count)
+                                 : kShortestRoutes(version.graph->csr, version.backward, alternatives, from->id, to->id, costOrTime, count);
+        if (routeCount <= 0) {
+            return "{\"error\": \"No route found.\"}";
+        }
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double computationTime = std::chrono::duration<double>(endTime - startTime).count();
+
+        std::vector<int> edges(version.graph->csr->nodeCount);
+        std::stringstream json;
+        json << "{";
+        json << "\"origin\": " << jsonString(from->capital) << ",";
+        json << "\"destination\": " << jsonString(to->capital) << ",";
+        json << "\"routes\": [";
+        for (int i = 0; i < routeCount; i++) {
+            int edgeCount = alternativePathEdges(alternatives, i, edges.data(), static_cast<int>(edges.size()));
+            json << (i > 0 ? ",{" : "{");
+            writeItinerary(version, json, from, edges.data(), edgeCount);
+            json << ",\"hops\": " << edgeCount;
+            json << "}";
+        }
+        json << "],";
+        json << "\"method\": " << jsonString(diverse ? "diverse" : "shortest") << ",";
+        json << "\"nodesVisited\": " << alternatives->settledCount << ",";
+        json << "\"computationTime\": " << std::fixed << std::setprecision(6) << computationTime;
+        json << "}";
+
+        return json.str();
+    }
+
+    // Journey arriving first when leaving at departAt, Unix seconds
+    std::string answerTimetable(const GraphVersion& version, Location* from, Location* to, double departAt, double transfer,
+                                TimetableQuery* journeys, std::chrono::high_resolution_clock::time_point startTime) {
+        // Schedules are daily, so the timetable's first day is the query's
+        double dayStart = std::floor(departAt / 86400.0) * 86400.0;
+        int found = earliestArrival(version.timetable.get(), version.graph->csr, journeys, from->id, to->id, (departAt - dayStart) / 3600.0, transfer);
+        if (found != 1) {
+            return "{\"error\": \"No route found.\"}";
+        }
+
+        std::vector<int> edges(version.graph->csr->nodeCount);
+        std::vector<double> departures(version.graph->csr->nodeCount);
+        std::vector<double> arrivals(version.graph->csr->nodeCount);
+        int edgeCount = timetablePathLegs(version.timetable.get(), version.graph->csr, journeys, to->id, edges.data(), departures.data(),
+                                          arrivals.data(), static_cast<int>(edges.size()));
+        if (edgeCount < 0) {
+            return "{\"error\": \"No route found.\"}";
+        }
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double computationTime = std::chrono::duration<double>(endTime - startTime).count();
+        double arriveAt = dayStart + 3600.0 * timetableArrival(journeys, to->id);
+
+        std::stringstream json;
+        json << "{";
+        json << "\"origin\": " << jsonString(from->capital) << ",";
+        json << "\"destination\": " << jsonString(to->capital) << ",";
+        writeItinerary(version, json, from, edges.data(), edgeCount);
+        json << ",\"schedule\": [";
+        for (int i = 0; i < edgeCount; i++) {
+            json << (i > 0 ? ",{" : "{");
+            json << "\"departAt\": " << std::fixed << std::setprecision(0) << dayStart + 3600.0 * departures[i] << ",";
+            json << "\"arriveAt\": " << std::fixed << std::setprecision(0) << dayStart + 3600.0 * arrivals[i];
+            json << "}";
+        }
+        json << "],";
+        json << "\"departAt\": " << std::fixed << std::setprecision(0) << departAt << ",";
+        json << "\"arriveAt\": " << std::fixed << std::setprecision(0) << arriveAt << ",";
+        json << "\"journeyTime\": " << std::fixed << std::setprecision(2) << (arriveAt - departAt) / 3600.0 << ",";
+        json << "\"nodesVisited\": " << journeys->settledCount << ",";
+        json << "\"connectionsScanned\": " << journeys->scannedCount << ",";
+        json << "\"computationTime\": " << std::fixed << std::setprecision(6) << computationTime;
+        json << "}";
+
+        return json.str();
+    }
+
+    // Write a matrix row by row, null where there is no path
+    static void writeMatrix(std::stringstream& json, const std::vector<float>& cells, size_t rows, size_t columns) {
+        json << "[";
+        for (size_t row = 0; row < rows; row++) {
+            json << (row > 0 ? ",[" : "[");
+            for (size_t column = 0; column < columns; column++) {
+                float cell = cells[row * columns + column];
+                if (column > 0) {
+                    json << ",";
+                }
+                if (cell >= WORKSPACE_UNREACHED) {
+                    json << "null";
+                } else {
+                    json << std::fixed << std::setprecision(2) << cell;
+                }
+            }
+            json << "]";
+        }
+        json << "]";
+    }
+
+    // Fastest time and cheapest cost between every listed origin and
+    // destination
+    std::string answerMatrix(const GraphVersion& version, const std::string& request, std::chrono::high_resolution_clock::time_point startTime) {
+        std::vector<std::string> originNames = jsonStringArrayField(request, "origins");
+        std::vector<std::string> destinationNames = jsonStringArrayField(request, "destinations");
+        if (originNames.empty() || destinationNames.empty()) {
+            return "{\"error\": \"origins and destinations must each name a city.\"}";
+        }
+
+        std::vector<int> origins;
+        std::vector<int> destinations;
+        for (const std::string& name : originNames) {
+            Location* city = getCity(version.graph, name.c_str());
+            if (city == NULL) {
+                return "{\"error\": " + jsonString("City " + name + " not found.") + "}";
+            }
+            origins.push_back(city->id);
+        }
+        for (const std::string& name : destinationNames) {
+            Location* city = getCity(version.graph, name.c_str());
+            if (city == NULL) {
+                return "{\"error\": " + jsonString("City " + name + " not found.") + "}";
+            }
+            destinations.push_back(city->id);
+        }
+
+        std::vector<float> times(origins.size() * destinations.size());
+        std::vector<float> costs(origins.size() * destinations.size());
+        long settled = 0;
+        if (!distanceMatrix(version.graph->csr, origins.data(), static_cast<int>(origins.size()), destinations.data(),
+                            static_cast<int>(destinations.size()), times.data(), costs.data(), matrixThreads, &settled)) {
+            return "{\"error\": \"Could not compute the matrix.\"}";
+        }
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double computationTime = std::chrono::duration<double>(endTime - startTime).count();
+
+        std::stringstream json;
+        json << "{\"origins\": [";
+        for (size_t i = 0; i < originNames.size(); i++) {
+            json << (i > 0 ? "," : "") << jsonString(originNames[i]);
+        }
+        json << "],\"destinations\": [";
+        for (size_t i = 0; i < destinationNames.size(); i++) {
+            json << (i > 0 ? "," : "") << jsonString(destinationNames[i]);
+        }
+        json << "],\"times\": ";
+        writeMatrix(json, times, origins.size(), destinations.size());
+        json << ",\"costs\": ";
+        writeMatrix(json, costs, origins.size(), destinations.size());
+        json << ",\"nodesVisited\": " << settled << ",";
+        json << "\"computationTime\": " << std::fixed << std::setprecision(6) << computationTime;
+        json << "}";
+
+        return json.str();
+    }
+
+    // Every city within budget of the origin, nearest first
+    std::string answerReachable(const GraphVersion& version, const std::string& request, IsochroneSearch* reach,
+                                std::chrono::high_resolution_clock::time_point startTime) {
+        std::string origin = jsonStringField(request, "origin");
+        std::string preference = jsonStringField(request, "preference");
+        int costOrTime = (preference == "cheapest" || preference == "cost") ? 1 : 0;
+        double budget = jsonNumberField(request, "budget", -1);
+
+        Location* from = getCity(version.graph, origin.c_str());
+        if (from == NULL) {
+            return "{\"error\": \"Start city not found.\"}";
+        }
+        if (budget < 0) {
+            return "{\"error\": \"budget must be a number of hours or dollars.\"}";
+        }
+
+        int count = reachableWithin(version.graph->csr, reach, from->id, costOrTime, budget);
+        if (count < 0) {
+            return "{\"error\": \"No route found.\"}";
+        }
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double computationTime = std::chrono::duration<double>(endTime - startTime).count();
+
+        std::stringstream json;
+        json << "{";
+        json << "\"origin\": " << jsonString(from->capital) << ",";
+        json << "\"budget\": " << std::fixed << std::setprecision(2) << budget << ",";
+        json << "\"metric\": " << jsonString(costOrTime ? "cost" : "time") << ",";
+        json << "\"reachable\": [";
+        for (int i = 0; i < count; i++) {
+            int city = reach->reached[i];
+            double time = costOrTime ? reach->other[city] : reach->ws->dist[city];
+            double cost = costOrTime ? reach->ws->dist[city] : reach->other[city];
+            json << (i > 0 ? ",{" : "{");
+            json << "\"city\": " << jsonString(version.graph->cities[city]->capital) << ",";
+            json << "\"time\": " << std::fixed << std::setprecision(2) << time << ",";
+            json << "\"cost\": " << std::fixed << std::setprecision(2) << cost;
+            json << "}";
+        }
+        json << "],";
+        json << "\"nodesVisited\": " << reach->ws->settledCount << ",";
+        json << "\"computationTime\": " << std::fixed << std::setprecision(6) << computationTime;
+        json << "}";
+
+        return json.str();
+    }
+
+    static long long clockNanoseconds(clockid_t clock) {
+        timespec now;
+        clock_gettime(clock, &now);
+        return static_cast<long long>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+    }
+
+    // Run one algorithm of a comparison and write its itinerary and
+    // counters as a JSON object. landmarks NULL means Dijkstra.
+    bool writeComparedSearch(const GraphVersion& version, std::stringstream& json, Location* from, Location* to, int costOrTime,
+                             const Landmarks* landmarks, SearchWorkspace* ws) {
+        std::vector<int> visited(COMPARE_MAX_VISITED);
+        SearchCounters counters;
+        searchCountersReset(&counters, visited.data(), COMPARE_MAX_VISITED);
+
+        ws->counters = &counters;
+        long long wallStart = clockNanoseconds(CLOCK_MONOTONIC);
+        long long cpuStart = clockNanoseconds(CLOCK_THREAD_CPUTIME_ID);
+        int found = landmarks != NULL ? landmarkShortestPath(version.graph->csr, ws, landmarks, from->id, to->id, costOrTime)
+                                      : shortestPath(version.graph->csr, ws, from->id, to->id, costOrTime);
+        long long cpuTime = clockNanoseconds(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+        long long wallTime = clockNanoseconds(CLOCK_MONOTONIC) - wallStart;
+        ws->counters = NULL;
+
+        std::vector<int> edges(version.graph->csr->nodeCount);
+        int edgeCount = found ? workspacePathEdges(ws, to->id, edges.data(), static_cast<int>(edges.size())) : -1;
+        if (edgeCount < 0) {
+            return false;
+        }
+
+        json << "{";
+        writeItinerary(version, json, from, edges.data(), edgeCount);
+        json << ",";
+        json << "\"nodesVisited\": " << ws->settledCount << ",";
+        json << "\"settled\": " << counters.settled << ",";
+        json << "\"relaxed\": " << counters.relaxed << ",";
+        json << "\"pushed\": " << counters.pushed << ",";
+        json << "\"heapPeak\": " << counters.heapPeak << ",";
+        json << "\"wallTime\": " << wallTime << ",";
+        json << "\"cpuTime\": " << cpuTime << ",";
+        json << "\"visited\": [";
+        long listed = std::min(counters.settled, static_cast<long>(counters.visitedCapacity));
+        for (long i = 0; i < listed; i++) {
+            json << (i > 0 ? "," : "") << jsonString(version.graph->cities[visited[i]]->capital);
+        }
+        json << "]";
+        json << "}";
+        return true;
+    }
+
+    // Dijkstra and A* on the same query and graph, side by side
+    std::string answerCompare(const GraphVersion& version, Location* from, Location* to, int costOrTime, SearchWorkspace* ws,
+                              std::chrono::high_resolution_clock::time_point startTime) {
+        const Landmarks* landmarks = version.searchLandmarks();
+        if (landmarks == NULL) {
+            return "{\"error\": \"Could not build A* landmarks.\"}";
+        }
+
+        std::stringstream json;
+        json << "{";
+        json << "\"origin\": " << jsonString(from->capital) << ",";
+        json << "\"destination\": " << jsonString(to->capital) << ",";
+        json << "\"metric\": " << jsonString(costOrTime ? "cost" : "time") << ",";
+        json << "\"landmarks\": " << landmarks->count << ",";
+        json << "\"countersEnabled\": " << (SEARCH_COUNTERS ? "true" : "false") << ",";
+        json << "\"dijkstra\": ";
+        if (!writeComparedSearch(version, json, from, to, costOrTime, NULL, ws)) {
+            return "{\"error\": \"No route found.\"}";
+        }
+        json << ",\"astar\": ";
+        if (!writeComparedSearch(version, json, from, to, costOrTime, landmarks, ws)) {
+            return "{\"error\": \"No route found.\"}";
+        }
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double computationTime = std::chrono::duration<double>(endTime - startTime).count();
+        json << ",\"computationTime\": " << std::fixed << std::setprecision(6) << computationTime;
+        json << "}";
+
+        return json.str();
+    }
+
+    // Answer one request line using this worker's workspaces, against the
+    // graph version current when it arrives
+    std::string answer(const std::string& request, Worker& worker) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        if (jsonHasField(request, "update")) {
+            return answerUpdate(request);
+        }
+
+        std::shared_ptr<const GraphVersion> held = std::atomic_load(&current);
+        const GraphVersion& version = *held;
+        if (!fitWorker(worker, version)) {
+            return "{\"error\": \"Could not allocate search workspace.\"}";
+        }
+
+        if (jsonHasField(request, "origins")) {
+            return answerMatrix(version, request, startTime);
+        }
+        if (jsonHasField(request, "budget") && !jsonHasField(request, "destination")) {
+            return answerReachable(version, request, worker.reach, startTime);
+        }
+
+        std::string origin = jsonStringField(request, "origin");
+        std::string destination = jsonStringField(request, "destination");
+        std::string preference = jsonStringField(request, "preference");
+        int costOrTime = (preference == "cheapest" || preference == "cost") ? 1 : 0;
+
+        Location* from = getCity(version.graph, origin.c_str());
+        Location* to = getCity(version.graph, destination.c_str());
+        if (from == NULL || to == NULL) {
+            return "{\"error\": \"Start or goal city not found.\"}";
+        }
+
+        if (from == to) {
+            return "{\"error\": \"No route found.\"}";
+        }
+
+        // Limits need the label search; a plain query takes the fastest path
+        bool limited = jsonHasField(request, "maxTime") || jsonHasField(request, "maxCost") ||
+                       jsonHasField(request, "maxStops") || jsonHasField(request, "modes") || jsonHasField(request, "exclude");
+        ParetoLimits limits;
+        std::vector<unsigned char> excluded;
+        std::string error = readLimits(version, request, limits, excluded);
+        if (!error.empty()) {
+            return "{\"error\": " + jsonString(error) + "}";
+        }
+
+        if (jsonHasField(request, "departAt")) {
+            if (limited || preference == "pareto" || jsonHasField(request, "alternatives") || jsonBoolField(request, "compare") || costOrTime == 1) {
+                return "{\"error\": \"departAt finds the earliest arrival and takes no other options.\"}";
+            }
+            double departAt = jsonNumberField(request, "departAt", -1);
+            double transfer = jsonNumberField(request, "transfer", TIMETABLE_DEFAULT_TRANSFER);
+            if (departAt < 0 || transfer < 0) {
+                return "{\"error\": \"departAt and transfer must not be negative.\"}";
+            }
+            return answerTimetable(version, from, to, departAt, transfer, worker.journeys, startTime);
+        }
+
+        if (jsonBoolField(request, "compare")) {
+            if (limited || preference == "pareto" || jsonHasField(request, "alternatives")) {
+                return "{\"error\": \"compare takes a fastest or cheapest query with no other options.\"}";
+            }
+            return answerCompare(version, from, to, costOrTime, worker.ws, startTime);
+        }
+
+        if (preference == "pareto") {
+            int maxLabels = static_cast<int>(jsonNumberField(request, "maxLabels", PARETO_DEFAULT_MAX_LABELS));
+            if (maxLabels < 1 || maxLabels > PARETO_MAX_LABELS) {
+                return "{\"error\": \"maxLabels must be between 1 and " + std::to_string(PARETO_MAX_LABELS) + ".\"}";
+            }
+            return answerPareto(version, from, to, limits, maxLabels, worker.pareto, startTime);
+        }
+
+        if (jsonHasField(request, "alternatives")) {
+            if (limited) {
+                return "{\"error\": \"Alternatives cannot be combined with limits.\"}";
+            }
+            int count = static_cast<int>(jsonNumberField(request, "alternatives", 1));
+            if (count < 1 || count > ALTERNATIVES_MAX) {
+                return "{\"error\": \"alternatives must be between 1 and " + std::to_string(ALTERNATIVES_MAX) + ".\"}";
+            }
+            bool diverse = jsonStringField(request, "method") == "diverse";
+            return answerAlternatives(version, from, to, costOrTime, count, diverse, worker.alternatives, startTime);
+        }
+
+        std::vector<int> edges(version.graph->csr->nodeCount);
+        int edgeCount;
+        int nodesVisited;
+        if (limited) {
+            int found = constrainedRoute(version.graph->csr, version.backward, worker.pareto, from->id, to->id, costOrTime, &limits);
+            edgeCount = found == 1 ? paretoPathEdges(worker.pareto, 0, edges.data(), static_cast<int>(edges.size())) : -1;
+            nodesVisited = worker.pareto->settledCount;
+        } else if (version.table != NULL) {
+            edgeCount = tablePathEdges(version.table, version.graph->csr, costOrTime, from->id, to->id, edges.data(), static_cast<int>(edges.size()));
+            nodesVisited = edgeCount + 1;
+        } else if (version.hierarchy != NULL) {
+            edgeCount = contractionPathEdges(version.hierarchy, worker.query, costOrTime, from->id, to->id, edges.data(), static_cast<int>(edges.size()));
+            nodesVisited = worker.query->settledCount;
+        } else if (jsonStringField(request, "algorithm") == "astar" && version.searchLandmarks() != NULL) {
+            int found = landmarkShortestPath(version.graph->csr, worker.ws, version.searchLandmarks(), from->id, to->id, costOrTime);
+            edgeCount = found ? workspacePathEdges(worker.ws, to->id, edges.data(), static_cast<int>(edges.size())) : -1;
+            nodesVisited = worker.ws->settledCount;
+        } else if (shortestPath(version.graph->csr, worker.ws, from->id, to->id, costOrTime)) {
+            edgeCount = workspacePathEdges(worker.ws, to->id, edges.data(), static_cast<int>(edges.size()));
+            nodesVisited = worker.ws->settledCount;
+        } else {
+            edgeCount = -1;
+            nodesVisited = worker.ws->settledCount;
+        }
+
+        if (edgeCount < 0) {
+            return "{\"error\": \"No route found.\"}";
+        }
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double computationTime = std::chrono::duration<double>(endTime - startTime).count();
+
+        std::stringstream json;
+        json << "{";
+        json << "\"origin\": " << jsonString(from->capital) << ",";
+        json << "\"destination\": " << jsonString(to->capital) << ",";
+        writeItinerary(version, json, from, edges.data(), edgeCount);
+        json << ",";
+        json << "\"nodesVisited\": " << nodesVisited << ",";
+        json << "\"computationTime\": " << std::fixed << std::setprecision(6) << computationTime;
+        json << "}";
+
+        return json.str();
+    }
+
+    // Serve every request on one connection until the client closes it
+    void serveClient(int fd, Worker& worker) {
+        std::string buffer;
+        char chunk[4096];
+
+        while (true) {
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received <= 0) {
+                break;
+            }
+            buffer.append(chunk, received);
+
+            size_t newline;
+            while ((newline = buffer.find('\n')) != std::string::npos) {
+                std::string request = buffer.substr(0, newline);
+                buffer.erase(0, newline + 1);
+
+                std::string response = answer(request, worker) + "\n";
+                if (!sendAll(fd, response)) {
+                    close(fd);
+                    return;
+                }
+            }
+
+            if (buffer.size() > MAX_REQUEST_LENGTH) {
+                sendAll(fd, "{\"error\": \"Request too long.\"}\n");
+                break;
+            }
+        }
+
+        close(fd);
+    }
+
+    static bool sendAll(int fd, const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(fd, data.data() + sent, data.size() - sent, 0);
+            if (n <= 0) {
+                return false;
+            }
+            sent += n;
+        }
+        return true;
+    }
+
+    static void freeWorker(Worker& worker) {
+        freeSearchWorkspace(worker.ws);
+        freeContractionQuery(worker.query);
+        freeParetoSearch(worker.pareto);
+        freeAlternativeSearch(worker.alternatives);
+        freeTimetableQuery(worker.journeys);
+        freeIsochroneSearch(worker.reach);
+        worker = Worker();
+    }
+
+    // Size a worker's search state for a version, regrowing it when
+    // updates have added cities or routes since. Returns false when memory
+    // runs out.
+    static bool fitWorker(Worker& worker, const GraphVersion& version) {
+        const CSRGraph* csr = version.graph->csr;
+        if (worker.ws != NULL && csr->nodeCount <= worker.capacity && csr->edgeCount <= worker.edgeCapacity &&
+            (version.hierarchy == NULL || worker.query != NULL)) {
+            return true;
+        }
+
+        // Room for a few more, so cities added one at a time do not
+        // reallocate every worker each time
+        freeWorker(worker);
+        worker.capacity = csr->nodeCount + csr->nodeCount / 8 + 16;
+        worker.edgeCapacity = csr->edgeCount + csr->edgeCount / 8 + 16;
+        worker.ws = createSearchWorkspace(worker.capacity);
+        worker.query = version.hierarchy != NULL ? createContractionQuery(worker.capacity) : NULL;
+        worker.pareto = createParetoSearch(worker.capacity, PARETO_DEFAULT_MAX_LABELS);
+        worker.alternatives = createAlternativeSearch(worker.capacity, worker.edgeCapacity);
+        worker.journeys = createTimetableQuery(worker.capacity);
+        worker.reach = createIsochroneSearch(worker.capacity);
+        if (worker.ws == NULL || (version.hierarchy != NULL && worker.query == NULL) || worker.pareto == NULL ||
+            worker.alternatives == NULL || worker.journeys == NULL || worker.reach == NULL) {
+            freeWorker(worker);
+            return false;
+        }
+
+        return true;
+    }
+
+    void workerLoop() {
+        Worker worker = Worker();
+        if (!fitWorker(worker, *std::atomic_load(&current))) {
+            std::cerr << "Error: Could not allocate search workspace" << std::endl;
+            return;
+        }
+
+        while (true) {
+            int fd;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueReady.wait(lock, [this] { return !pendingClients.empty(); });
+                fd = pendingClients.front();
+                pendingClients.pop_front();
+            }
+            serveClient(fd, worker);
+        }
+    }
+
+    // Queue an update for the updater thread and wait until it is live
+    std::string answerUpdate(const std::string& request) {
+        PendingUpdate update;
+        update.request = request;
+        update.done = false;
+
+        std::unique_lock<std::mutex> lock(updateMutex);
+        pendingUpdates.push_back(&update);
+        updateReady.notify_one();
+        updateDone.wait(lock, [&update] { return update.done; });
+        return update.reply;
+    }
+
+    // Apply whatever updates have queued up as one new version, so a burst
+    // of fare changes costs one rebuild rather than one each
+    void updaterLoop() {
+        while (true) {
+            std::vector<PendingUpdate*> batch;
+            {
+                std::unique_lock<std::mutex> lock(updateMutex);
+                updateReady.wait(lock, [this] { return !pendingUpdates.empty(); });
+                batch.swap(pendingUpdates);
+            }
+
+            applyUpdates(batch);
+
+            {
+                std::lock_guard<std::mutex> lock(updateMutex);
+                for (PendingUpdate* update : batch) {
+                    update->done = true;
+                }
+            }
+            updateDone.notify_all();
+        }
+    }
+
+    // Every live route from one city to another, as its index in
+    // draft.graph->routes and its edge in the base CSR (-1 for a route
+    // this batch added)
+    static void routesBetween(const VersionDraft& draft, const Location* from, const Location* to, std::vector<int>& indices,
+                              std::vector<int>& edges) {
+        const CSRGraph* csr = draft.base->graph->csr;
+        if (from->id < csr->nodeCount) {
+            for (int e = csr->offsets[from->id]; e < csr->offsets[from->id + 1]; e++) {
+                Route* route = draft.graph->routes[csr->edgeRoutes[e]];
+                if (route != NULL && route->destination == to) {
+                    indices.push_back(csr->edgeRoutes[e]);
+                    edges.push_back(e);
+                }
+            }
+        }
+        for (int r = draft.base->graph->routeCount; r < draft.graph->routeCount; r++) {
+            Route* route = draft.graph->routes[r];
+            if (route != NULL && route->origin == from && route->destination == to) {
+                indices.push_back(r);
+                edges.push_back(-1);
+            }
+        }
+    }
+
+    // The route an update names, by origin, destination and, if given,
+    // transport, as its index in draft.graph->routes and its edge in the
+    // base CSR (-1 for a route this batch added). Returns an error
+    // message, "" if found.
+    static std::string findRoute(const VersionDraft& draft, const std::string& request, int& index, int& edge) {
+        std::string origin = jsonStringField(request, "origin");
+        std::string destination = jsonStringField(request, "destination");
+        std::string transport = jsonStringField(request, "transport");
+        Location* from = getCity(draft.graph, origin.c_str());
+        Location* to = getCity(draft.graph, destination.c_str());
+        if (from == NULL || to == NULL) {
+            return "Start or goal city not found.";
+        }
+
+        std::vector<int> indices;
+        std::vector<int> edges;
+        routesBetween(draft, from, to, indices, edges);
+        int matches = 0;
+        for (size_t i = 0; i < indices.size(); i++) {
+            if (transport.empty() || transport == draft.graph->routes[indices[i]]->transport) {
+                index = indices[i];
+                edge = edges[i];
+                matches++;
+            }
+        }
+
+        if (matches == 0) {
+            return "No route from " + origin + " to " + destination + (transport.empty() ? "" : " by " + transport) + ".";
+        }
+        if (matches > 1) {
+            return transport.empty() ? "Several routes run from " + origin + " to " + destination + "; give a transport."
+                                     : "Several " + transport + " routes run from " + origin + " to " + destination + ".";
+        }
+        return "";
+    }
+
+    // Hours after midnight from a number or a clock time such as "06:30",
+    // fallback if the field is absent or neither
+    static double jsonClockField(const std::string& request, const std::string& key, double fallback) {
+        std::string text = jsonStringField(request, key);
+        int hours;
+        int minutes;
+        if (!text.empty() && sscanf(text.c_str(), "%d:%d", &hours, &minutes) == 2) {
+            return hours + minutes / 60.0;
+        }
+        return jsonNumberField(request, key, fallback);
+    }
+
+    // Apply one update request to a draft. Returns an error message, ""
+    // on success.
+    static std::string applyUpdate(VersionDraft& draft, const std::string& request) {
+        std::string kind = jsonStringField(request, "update");
+        Graph* graph = draft.graph;
+
+        if (kind == "add-city") {
+            std::string name = jsonStringField(request, "city");
+            std::string country = jsonStringField(request, "country");
+            double latitude = jsonNumberField(request, "latitude", 1000);
+            double longitude = jsonNumberField(request, "longitude", 1000);
+            if (name.empty() || latitude < -90 || latitude > 90 || longitude < -180 || longitude > 180) {
+                return "add-city needs a city, a latitude and a longitude.";
+            }
+            if (getCity(graph, name.c_str()) != NULL) {
+                return "City " + name + " already exists.";
+            }
+
+            // Names are shared with the base version until the first new one
+            if (graph->names == draft.base->graph->names) {
+                SymbolTable* names = createSymbolTable(graph->cityCount + 16);
+                for (int id = 0; names != NULL && id < graph->cityCount; id++) {
+                    if (symbolIntern(names, symbolName(graph->names, id)) != id) {
+                        freeSymbolTable(names);
+                        names = NULL;
+                    }
+                }
+                if (names == NULL) {
+                    return "Out of memory.";
+                }
+                graph->names = names;
+            }
+
+            if (graph->cityCount >= graph->cityCapacity) {
+                int capacity = graph->cityCapacity * 2 + 16;
+                Location** cities = (Location**)realloc(graph->cities, capacity * sizeof(Location*));
+                if (cities == NULL) {
+                    return "Out of memory.";
+                }
+                graph->cities = cities;
+                graph->cityCapacity = capacity;
+            }
+
+            Location* city = createLocationWithCoords(country.c_str(), name.c_str(), (float)latitude, (float)longitude);
+            if (city == NULL) {
+                return "Out of memory.";
+            }
+            city->id = symbolIntern(graph->names, city->capital);
+            if (city->id != graph->cityCount) {
+                freeLocation(city);
+                return "Out of memory.";
+            }
+            graph->cities[graph->cityCount++] = city;
+            draft.addedCities.push_back(city);
+            draft.structural = true;
+            return "";
+        }
+
+        if (kind == "add-route") {
+            std::string origin = jsonStringField(request, "origin");
+            std::string destination = jsonStringField(request, "destination");
+            Location* from = getCity(graph, origin.c_str());
+            Location* to = getCity(graph, destination.c_str());
+            double time = jsonNumberField(request, "time", -1);
+            double cost = jsonNumberField(request, "cost", -1);
+            if (from == NULL || to == NULL) {
+                return "Start or goal city not found.";
+            }
+            if (time < 0 || cost < 0) {
+                return "add-route needs a time and a cost, neither negative.";
+            }
+
+            // remove-route and modify-route name a route by its cities and
+            // transport, so a second one they could not tell apart is refused;
+            // a route without a transport matches any transport
+            std::string transport = jsonStringField(request, "transport");
+            std::vector<int> indices;
+            std::vector<int> edges;
+            routesBetween(draft, from, to, indices, edges);
+            for (int index : indices) {
+                const char* existing = graph->routes[index]->transport;
+                if (transport == existing) {
+                    return "A " + (transport.empty() ? std::string("") : transport + " ") + "route from " + origin + " to " +
+                           destination + " already exists.";
+                }
+                if (transport.empty() || existing[0] == '\0') {
+                    return "A route from " + origin + " to " + destination + " already exists; give each a transport.";
+                }
+            }
+
+            // Normalised as loadRoutes does
+            double departure = jsonClockField(request, "departure", -1);
+            while (departure >= 24.0) {
+                departure -= 24.0;
+            }
+            double headway = jsonNumberField(request, "headway", 0);
+
+            if (graph->routeCount >= graph->routeCapacity) {
+                int capacity = graph->routeCapacity * 2 + 16;
+                Route** routes = (Route**)realloc(graph->routes, capacity * sizeof(Route*));
+                if (routes == NULL) {
+                    return "Out of memory.";
+                }
+                graph->routes = routes;
+                graph->routeCapacity = capacity;
+            }
+
+            Route* route = createRouteWithDetails(from, to, transport.c_str(), (float)time, (float)cost,
+                                                  jsonStringField(request, "note").c_str());
+            if (route == NULL) {
+                return "Out of memory.";
+            }
+            strncpy(route->originS, from->capital, sizeof(route->originS) - 1);
+            route->originS[sizeof(route->originS) - 1] = '\0';
+            strncpy(route->destinationS, to->capital, sizeof(route->destinationS) - 1);
+            route->destinationS[sizeof(route->destinationS) - 1] = '\0';
+            route->distance = (float)std::max(0.0, jsonNumberField(request, "distance", 0));
+            route->departure = departure >= 0 ? (float)departure : -1;
+            route->headway = headway > 0 ? (float)headway : 0;
+
+            graph->routes[graph->routeCount++] = route;
+            draft.created.insert(route);
+            draft.structural = true;
+            return "";
+        }
+
+        if (kind == "modify-route" || kind == "remove-route") {
+            int index;
+            int edge;
+            std::string error = findRoute(draft, request, index, edge);
+            if (!error.empty()) {
+                return error;
+            }
+            Route* route = graph->routes[index];
+            bool shared = draft.created.count(route) == 0;
+
+            if (kind == "remove-route") {
+                if (shared) {
+                    draft.retired.push_back(route);
+                } else {
+                    draft.created.erase(route);
+                    freeRoute(route);
+                }
+                graph->routes[index] = NULL;
+                draft.structural = true;
+                return "";
+            }
+
+            double time = jsonNumberField(request, "time", route->time);
+            double cost = jsonNumberField(request, "cost", route->cost);
+            if (!jsonHasField(request, "time") && !jsonHasField(request, "cost")) {
+                return "modify-route needs a new time or cost.";
+            }
+            if (time < 0 || cost < 0) {
+                return "Time and cost must not be negative.";
+            }
+
+            // Older versions keep the record they had
+            if (shared) {
+                Route* copy = createRoute();
+                if (copy == NULL) {
+                    return "Out of memory.";
+                }
+                *copy = *route;
+                draft.retired.push_back(route);
+                draft.created.insert(copy);
+                graph->routes[index] = copy;
+                route = copy;
+            }
+            // The timetable only holds times, so a fare change leaves it be
+            if (route->departure >= 0 && route->time != (float)time) {
+                draft.rescheduled = true;
+            }
+            route->time = (float)time;
+            route->cost = (float)cost;
+
+            if (edge != -1) {
+                draft.reweighted.push_back(edge);
+            }
+            return "";
+        }
+
+        return "Unknown update " + kind + "; use add-city, add-route, modify-route or remove-route.";
+    }
+
+    // Undo a draft that will not be published
+    static void discardDraft(VersionDraft& draft) {
+        for (Route* route : draft.created) {
+            freeRoute(route);
+        }
+        for (Location* city : draft.addedCities) {
+            freeLocation(city);
+        }
+        if (draft.graph->names != draft.base->graph->names) {
+            freeSymbolTable(draft.graph->names);
+        }
+        freeCSRGraph(draft.graph->csr);
+        free(draft.graph->cities);
+        free(draft.graph->routes);
+        free(draft.graph);
+        draft.graph = NULL;
+    }
+
+    // Build the search structures of a draft. A batch that only changed
+    // weights copies the base CSR and patches it, keeping edge ids, so the
+    // timetable and note legs carry over; one that added or removed
+    // anything rebuilds them. Returns the new version, or NULL when memory
+    // runs out.
+    static GraphVersion* finishDraft(VersionDraft& draft) {
+        const GraphVersion* base = draft.base;
+        Graph* graph = draft.graph;
+        std::unique_ptr<GraphVersion> version(new GraphVersion());
+        std::vector<int> edgeMap;
+
+        if (draft.structural) {
+            // Pack the routes that are left, remembering where each went
+            std::vector<int> packed(graph->routeCount, -1);
+            int routeCount = 0;
+            for (int r = 0; r < graph->routeCount; r++) {
+                if (graph->routes[r] != NULL) {
+                    packed[r] = routeCount;
+                    graph->routes[routeCount++] = graph->routes[r];
+                }
+            }
+            graph->routeCount = routeCount;
+            if (!buildGraphCSR(graph)) {
+                return NULL;
+            }
+
+            // Edge of the new CSR each base edge became, for the table repair
+            std::vector<int> routeEdge(routeCount, -1);
+            for (int e = 0; e < graph->csr->edgeCount; e++) {
+                routeEdge[graph->csr->edgeRoutes[e]] = e;
+            }
+            const CSRGraph* baseCsr = base->graph->csr;
+            edgeMap.resize(baseCsr->edgeCount);
+            for (int e = 0; e < baseCsr->edgeCount; e++) {
+                int r = packed[baseCsr->edgeRoutes[e]];
+                edgeMap[e] = r != -1 ? routeEdge[r] : -1;
+            }
+
+            version->backward = createReverseCSRGraph(graph->csr);
+            version->timetable = std::shared_ptr<Timetable>(createTimetable(graph), freeTimetable);
+            if (version->backward == NULL || version->timetable == nullptr) {
+                return NULL;
+            }
+            version->edgeLegs = noteLegs(graph);
+        } else {
+            graph->csr = copyCSRGraph(base->graph->csr);
+            version->backward = copyCSRGraph(base->backward);
+            if (graph->csr == NULL || version->backward == NULL) {
+                return NULL;
+            }
+
+            CSRGraph* backward = version->backward;
+            for (int edge : draft.reweighted) {
+                const Route* route = graph->routes[graph->csr->edgeRoutes[edge]];
+                graph->csr->times[edge] = route->time;
+                graph->csr->costs[edge] = route->cost;
+
+                int target = graph->csr->targets[edge];
+                for (int b = backward->offsets[target]; b < backward->offsets[target + 1]; b++) {
+                    if (backward->edgeRoutes[b] == edge) {
+                        backward->times[b] = route->time;
+                        backward->costs[b] = route->cost;
+                    }
+                }
+            }
+
+            // Departures bake in their arrival times; anytime routes read the CSR
+            version->timetable = draft.rescheduled ? std::shared_ptr<Timetable>(createTimetable(graph), freeTimetable)
+                                                   : base->timetable;
+            if (version->timetable == nullptr) {
+                return NULL;
+            }
+            version->edgeLegs = base->edgeLegs;
+        }
+
+        if (base->table != NULL) {
+            version->table = repairDistanceTable(base->table, base->graph->csr, graph->csr, version->backward,
+                                                 draft.structural ? edgeMap.data() : NULL);
+            if (version->table == NULL) {
+                std::cerr << "Warning: Could not repair the distance table after an update, searching instead" << std::endl;
+            }
+        }
+        if (base->hierarchy != NULL) {
+            std::cerr << "Warning: Contraction hierarchy no longer matches the updated graph, searching instead" << std::endl;
+        }
+
+        version->graph = graph;
+        version->number = base->number + 1;
+        return version.release();
+    }
+
+    // Apply a batch of updates as one new version and swap it in. Each
+    // update gets its own reply; one that fails leaves the others applied.
+    void applyUpdates(const std::vector<PendingUpdate*>& batch) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        std::shared_ptr<GraphVersion> base = std::atomic_load(&current);
+
+        if (base->graph->snapshot != NULL) {
+            for (PendingUpdate* update : batch) {
+                update->reply = "{\"error\": \"A graph mapped from a snapshot cannot be updated; load the CSV files instead.\"}";
+            }
+            return;
+        }
+
+        VersionDraft draft;
+        draft.base = base.get();
+        draft.structural = false;
+        draft.rescheduled = false;
+        draft.graph = (Graph*)malloc(sizeof(Graph));
+        if (draft.graph != NULL) {
+            const Graph* from = base->graph;
+            *draft.graph = *from;
+            draft.graph->csr = NULL;
+            draft.graph->cities = (Location**)malloc((from->cityCount + 1) * sizeof(Location*));
+            draft.graph->cityCapacity = from->cityCount + 1;
+            draft.graph->routes = (Route**)malloc((from->routeCount + 1) * sizeof(Route*));
+            draft.graph->routeCapacity = from->routeCount + 1;
+            if (draft.graph->cities != NULL && draft.graph->routes != NULL) {
+                std::copy(from->cities, from->cities + from->cityCount, draft.graph->cities);
+                std::copy(from->routes, from->routes + from->routeCount, draft.graph->routes);
+            } else {
+                draft.graph->names = from->names;
+                discardDraft(draft);
+            }
+        }
+        if (draft.graph == NULL) {
+            for (PendingUpdate* update : batch) {
+                update->reply = "{\"error\": \"Out of memory.\"}";
+            }
+            return;
+        }
+
+        std::vector<std::string> errors;
+        int applied = 0;
+        for (PendingUpdate* update : batch) {
+            errors.push_back(applyUpdate(draft, update->request));
+            applied += errors.back().empty() ? 1 : 0;
+        }
+
+        GraphVersion* version = applied > 0 ? finishDraft(draft) : NULL;
+        if (version == NULL) {
+            discardDraft(draft);
+            for (size_t i = 0; i < batch.size(); i++) {
+                std::string error = errors[i].empty() ? "Could not build the updated graph." : errors[i];
+                batch[i]->reply = "{\"error\": " + jsonString(error) + "}";
+            }
+            return;
+        }
+
+        // Readers that still hold base keep it, and through it this version
+        std::shared_ptr<GraphVersion> next(version);
+        base->superseded = true;
+        base->retiredRoutes = draft.retired;
+        base->retiredNames = base->graph->names != version->graph->names;
+        base->newer = next;
+        std::atomic_store(&current, next);
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double updateTime = std::chrono::duration<double>(endTime - startTime).count();
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (!errors[i].empty()) {
+                batch[i]->reply = "{\"error\": " + jsonString(errors[i]) + "}";
+                continue;
+            }
+
+            std::stringstream json;
+            json << "{";
+            json << "\"updated\": " << jsonString(jsonStringField(batch[i]->request, "update")) << ",";
+            json << "\"version\": " << version->number << ",";
+            json << "\"cities\": " << version->graph->cityCount << ",";
+            json << "\"routes\": " << version->graph->routeCount << ",";
+            json << "\"batched\": " << applied << ",";
+            json << "\"updateTime\": " << std::fixed << std::setprecision(6) << updateTime;
+            json << "}";
+            batch[i]->reply = json.str();
+        }
+    }
+
+public:
+    // Takes ownership of everything but the hierarchy, which must outlive
+    // the server
+    RouteServer(Graph* g, CSRGraph* b, DistanceTable* t, const ContractionHierarchy* h, Timetable* tt)
+        : current(new GraphVersion()), listenFd(-1), matrixThreads(1) {
+        current->graph = g;
+        current->backward = b;
+        current->timetable = std::shared_ptr<Timetable>(tt, freeTimetable);
+        current->edgeLegs = noteLegs(g);
+        current->table = t;
+        current->hierarchy = h;
+    }
+
+    ~RouteServer() {
+        if (listenFd != -1) {
+            close(listenFd);
+        }
+    }
+
+    RouteServer(const RouteServer&) = delete;
+    RouteServer& operator=(const RouteServer&) = delete;
+
+    bool listenOn(int port) {
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd < 0) {
+            std::cerr << "Error: Could not create socket" << std::endl;
+            return false;
+        }
+
+        int reuse = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<uint16_t>(port));
+
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listenFd, 128) < 0) {
+            std::cerr << "Error: Could not listen on 127.0.0.1:" << port << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    void run(int threadCount) {
+        matrixThreads = threadCount;
+        for (int i = 0; i < threadCount; i++) {
+            workers.emplace_back(&RouteServer::workerLoop, this);
+        }
+        updater = std::thread(&RouteServer::updaterLoop, this);
+
+        while (true) {
+            int fd = accept(listenFd, NULL, NULL);
+            if (fd < 0) {
+                continue;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                pendingClients.push_back(fd);
+            }
+            queueReady.notify_one();
+        }
+    }
+};
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <cities_file> <routes_file[,routes_file...]> [port] [threads] [table_file|hierarchy_file]" << std::endl;
+        return 1;
+    }
+
+    int port = argc > 3 ? atoi(argv[3]) : 5001;
+    int threads = argc > 4 ? atoi(argv[4]) : static_cast<int>(std::thread::hardware_concurrency());
+    if (threads < 1) {
+        threads = 4;
+    }
+
+    // A client hanging up mid-reply must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    Graph* graph = createGraph(argv[1], argv[2]);
+    if (graph == NULL) {
+        std::cerr << "Error: Could not load graph" << std::endl;
+        return 1;
+    }
+
+    // A table or hierarchy built from other CSV files would give wrong
+    // answers, so a stale one is ignored rather than trusted
+    DistanceTable* table = NULL;
+    ContractionHierarchy* hierarchy = NULL;
+    if (argc > 5) {
+        table = openDistanceTable(argv[5]);
+        hierarchy = table == NULL ? openContractionHierarchy(argv[5]) : NULL;
+        if (table == NULL && hierarchy == NULL) {
+            std::cerr << "Warning: Could not open distance table or hierarchy " << argv[5] << ", searching instead" << std::endl;
+        } else if (table != NULL && (graph->snapshot != NULL
+                       ? !distanceTableMatches(table, graph->csr, &graph->snapshot->header->cities, &graph->snapshot->header->routes)
+                       : !distanceTableFresh(table, graph->csr, argv[1], argv[2]))) {
+            std::cerr << "Warning: Distance table " << argv[5] << " is stale, searching instead" << std::endl;
+            closeDistanceTable(table);
+            table = NULL;
+        } else if (hierarchy != NULL && (graph->snapshot != NULL
+                       ? !contractionHierarchyMatches(hierarchy, graph->csr, &graph->snapshot->header->cities, &graph->snapshot->header->routes)
+                       : !contractionHierarchyFresh(hierarchy, graph->csr, argv[1], argv[2]))) {
+            std::cerr << "Warning: Contraction hierarchy " << argv[5] << " is stale, searching instead" << std::endl;
+            closeContractionHierarchy(hierarchy);
+            hierarchy = NULL;
+        }
+    }
+
+    // Pareto and alternative queries search back from the destination
+    CSRGraph* backward = createReverseCSRGraph(graph->csr);
+    if (backward == NULL) {
+        std::cerr << "Error: Could not build reverse graph" << std::endl;
+        closeDistanceTable(table);
+        closeContractionHierarchy(hierarchy);
+        freeGraph(graph);
+        return 1;
+    }
+
+    // Departure times of the scheduled routes, for departAt queries
+    Timetable* timetable = createTimetable(graph);
+    if (timetable == NULL) {
+        std::cerr << "Error: Could not build timetable" << std::endl;
+        freeCSRGraph(backward);
+        closeDistanceTable(table);
+        closeContractionHierarchy(hierarchy);
+        freeGraph(graph);
+        return 1;
+    }
+
+    // The server owns the graph, reverse graph, table and timetable from
+    // here on, since updates replace them
+    int scheduledRoutes = timetable->scheduledRoutes;
+    bool answeringFromTable = table != NULL;
+    RouteServer server(graph, backward, table, hierarchy, timetable);
+    if (!server.listenOn(port)) {
+        closeContractionHierarchy(hierarchy);
+        return 1;
+    }
+
+    std::cout << "Routing daemon listening on 127.0.0.1:" << port << " with " << threads << " workers"
+              << (answeringFromTable ? ", answering from distance table" : "")
+              << (hierarchy != NULL ? ", answering from contraction hierarchy" : "")
+              << ", " << scheduledRoutes << " scheduled routes" << std::endl;
+    server.run(threads);
+
+    closeContractionHierarchy(hierarchy);
+    return 0;
+}
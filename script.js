@@ -564,7 +564,7 @@ function displayRouteDetails(routeData) {
                 </div>
                 <div class="route-stat">
                     <div class="stat-label">Cost</div>
-                    <div class="stat-value">₹${cost}</div>
+                    <div class="stat-value">$${cost}</div>
                 </div>
                 <div class="route-stat">
                     <div class="stat-label">Travel Time</div>
@@ -649,8 +649,8 @@ function displayAlgorithmComparison(dijkstraData, astarData) {
         const astarCost = (astarData.cost || astarData.total_cost || 0);
         const astarTravelTime = (astarData.time || astarData.total_time || 0);
         
-        // Format costs with Indian rupee symbol
-        const formatCost = (cost) => `₹${cost.toFixed(2)}`;
+        // Costs are shown in USD
+        const formatCost = (cost) => `$${cost.toFixed(2)}`;
         
         // Update comparison table cells
         document.getElementById('dijkstra-nodes').textContent = dijkstraNodes;
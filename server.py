@@ -4,9 +4,10 @@ import subprocess
 import os
 import csv
 import re
-import random
-import time
 import json
+import socket
+import threading
+from datetime import datetime, timezone
 
 app = Flask(__name__)
 CORS(app)
@@ -90,12 +91,129 @@ def load_indian_flights():
                     }
     except Exception as e:
         print(f"Error loading Indian flight data: {e}")
-        # We'll use the fallback in generate_demo_route if this fails
+        # /get-indian-flights then returns an empty map
 
 # Load data on startup
 load_cities_data()
 load_indian_flights()
 
+# Routing daemon (routed.cpp) keeps the graph loaded between requests
+ROUTED_HOST = os.environ.get('ROUTED_HOST', '127.0.0.1')
+ROUTED_PORT = int(os.environ.get('ROUTED_PORT', '5001'))
+# Seconds to wait for a reply; large pareto and matrix queries take a while
+ROUTED_TIMEOUT = float(os.environ.get('ROUTED_TIMEOUT', '120'))
+routed_connection = threading.local()
+
+def close_routed_connection():
+    # Drop this thread's connection so the next query opens a fresh one
+    sock = getattr(routed_connection, 'sock', None)
+    if sock is not None:
+        try:
+            sock.close()
+        except OSError:
+            pass
+    routed_connection.sock = None
+    routed_connection.conn = None
+
+def query_routed(query):
+    # Send one JSON query over this thread's persistent connection
+    # Returns the parsed reply, or None if the daemon is not reachable
+    # A query is sent again on a fresh connection only if it could not be
+    # written at all; once written the daemon may have acted on it, and
+    # updates are never sent twice
+    attempts = 1 if 'update' in query else 2
+    for attempt in range(attempts):
+        conn = getattr(routed_connection, 'conn', None)
+        try:
+            if conn is None:
+                sock = socket.create_connection((ROUTED_HOST, ROUTED_PORT), timeout=2)
+                sock.settimeout(ROUTED_TIMEOUT)
+                conn = sock.makefile('rw', encoding='utf-8')
+                routed_connection.sock = sock
+                routed_connection.conn = conn
+            
+            conn.write(json.dumps(query) + '\n')
+            conn.flush()
+        except OSError:
+            close_routed_connection()
+            continue
+        
+        try:
+            line = conn.readline()
+            if not line:
+                raise ConnectionError("routing daemon closed the connection")
+            return json.loads(line)
+        except (OSError, ValueError):
+            close_routed_connection()
+            return None
+    return None
+
+# Limits a request may put on its routes; the daemon prunes by them while
+# searching: maxTime (hours), maxCost, maxStops, modes (transport names)
+# and exclude (city names)
+ROUTE_LIMITS = ('maxTime', 'maxCost', 'maxStops', 'modes', 'exclude')
+
+def request_limits(data):
+    # The route limits a front end request gives, ready to send to the daemon
+    limits = {}
+    for limit in ROUTE_LIMITS:
+        if data.get(limit) is not None:
+            value = data[limit]
+            limits[limit] = list(value) if limit in ('modes', 'exclude') else float(value)
+    return limits
+
+def engine_route(origin, destination, preference, algorithm='dijkstra', limits=None):
+    # Route computed by the routing daemon, in the shape the front end expects
+    # Returns None if the daemon is down or has no route between the cities
+    query = {
+        "origin": origin,
+        "destination": destination,
+        "preference": preference,
+        "algorithm": algorithm
+    }
+    query.update(limits or {})
+    reply = query_routed(query)
+    if reply is None or 'error' in reply:
+        return None
+    return route_from_reply(reply, preference, algorithm)
+
+def route_from_reply(reply, preference, algorithm):
+    # One itinerary from the daemon in the shape the front end expects
+    steps = reply['steps']
+    stops = []
+    for step in steps[:-1]:
+        stops.append({
+            "city": step['to'],
+            "coordinates": city_coordinates.get(step['to'], {"lat": 0, "lng": 0}),
+            "from_prev": step['from'],
+            "distance": step['distance'],
+            "time": step['time'],
+            "cost": step['cost']
+        })
+    
+    computation_time_ms = reply['computationTime'] * 1000.0
+    return {
+        "origin": reply['origin'],
+        "destination": reply['destination'],
+        "path": reply['path'],
+        "visited_nodes": list(reply['path']),
+        "distance": reply['totalDistance'],
+        "cost": reply['totalCost'],
+        "time": reply['totalTime'],
+        "stops": stops,
+        "algorithm": algorithm,
+        "total_distance": reply['totalDistance'],
+        "total_cost": reply['totalCost'],
+        "total_time": reply['totalTime'],
+        "optimization": "time" if preference == "fastest" else "cost",
+        "stats": {
+            "nodes_visited": reply['nodesVisited'],
+            "computation_time_ms": computation_time_ms
+        },
+        "nodes_visited": reply['nodesVisited'],
+        "computation_time": computation_time_ms
+    }
+
 @app.route('/get-cities')
 def get_cities():
     return jsonify(cities_data)
@@ -124,393 +242,276 @@ def find_route():
         return jsonify({"error": "Origin and destination are required"}), 400
     
     try:
-        # Choose the appropriate algorithm
-        if algorithm == 'astar':
-            result = find_route_astar(origin, destination, preference)
-        else:
-            # Use the A* algorithm but with different parameters
-            result = find_route_dijkstra(origin, destination, preference)
-            
-        return jsonify(result)
-    except Exception as e:
-        print(f"Error finding route: {e}")
-        # Generate demo route data as fallback
-        return jsonify(generate_demo_route(origin, destination, preference))
-
-def find_route_dijkstra(origin, destination, preference):
-    # Check if we have real flight data for this route (for Indian cities)
-    if origin in indian_cities and destination in indian_cities:
-        route_key = f"{origin}-{destination}"
-        if route_key in indian_flights:
-            result = generate_real_route(origin, destination, preference)
-            result['algorithm'] = 'dijkstra'
-            
-            # Add a bit more cost for Dijkstra if fastest, or more time if cheapest
-            if preference == "fastest":
-                result['cost'] *= 1.25
-                result['total_cost'] *= 1.25
-            else:
-                result['time'] *= 1.15
-                result['total_time'] *= 1.15
-            
-            # Ensure the path is consistent with the cost/time
-            
-            # Generate visited nodes for visualization - ensure count matches nodes_visited stat
-            # Only use Indian cities when both origin and destination are in India
-            visited_cities = [c for c in indian_cities if c != origin and c != destination]
-            if visited_cities:
-                # Dijkstra explores about 70% of all cities
-                # First set the nodes_visited value
-                result['stats']['nodes_visited'] = min(25, int(len(indian_cities) * 0.7))
-                
-                # Then generate exactly that many nodes for visualization
-                num_visited = min(len(visited_cities), result['stats']['nodes_visited'] - len(result.get('path', [origin, destination])))
-                if num_visited > 0:
-                    result['visited_nodes'] = random.sample(visited_cities, num_visited)
-                    # Add the path cities
-                    result['visited_nodes'].extend(result.get('path', [origin, destination]))
-                else:
-                    result['visited_nodes'] = result.get('path', [origin, destination]).copy()
-            
-            return result
-    
-    # Generate a demo route for Dijkstra that prioritizes direct paths
-    result = generate_demo_route(origin, destination, preference, algorithm='dijkstra')
-    result['algorithm'] = 'dijkstra'
-    
-    # Ensure the nodes_visited count and visited_nodes list are consistent
-    if 'visited_nodes' in result and result['stats']['nodes_visited'] != len(result['visited_nodes']):
-        # Adjust to match
-        result['stats']['nodes_visited'] = len(result['visited_nodes'])
+        limits = request_limits(data)
+    except (TypeError, ValueError):
+        return jsonify({"error": "Invalid route limits"}), 400
     
-    # Match the property names expected by the frontend
-    result['nodes_visited'] = result['stats']['nodes_visited']
-    result['computation_time'] = result['stats']['computation_time_ms']
+    # Choose the appropriate algorithm
+    if algorithm == 'astar':
+        result = find_route_astar(origin, destination, preference, limits)
+    else:
+        result = find_route_dijkstra(origin, destination, preference, limits)
     
-    return result
+    if result is None:
+        return jsonify({"error": "No route found. Is the routing daemon running?"}), 503
+    return jsonify(result)
 
-def find_route_astar(origin, destination, preference):
-    # Check if we have real flight data for this route (for Indian cities)
-    if origin in indian_cities and destination in indian_cities:
-        route_key = f"{origin}-{destination}"
-        if route_key in indian_flights:
-            result = generate_real_route(origin, destination, preference)
-            result['algorithm'] = 'astar'
-            
-            # A* is more efficient
-            # First set the nodes_visited value
-            result['stats']['nodes_visited'] = min(12, int(len(indian_cities) * 0.3))
-            
-            # A* finds more optimal paths
-            if preference == "fastest":
-                result['time'] *= 0.85  # A* finds faster routes
-            else:
-                result['cost'] *= 0.85  # A* finds cheaper routes
-                
-            result['total_time'] = result['time']
-            result['total_cost'] = result['cost']
-            
-            # Generate visited nodes for visualization - ensure count matches nodes_visited stat
-            # Only use Indian cities when both origin and destination are in India
-            visited_cities = [c for c in indian_cities if c != origin and c != destination]
-            if visited_cities:
-                # Then generate exactly that many nodes for visualization
-                num_visited = min(len(visited_cities), result['stats']['nodes_visited'] - len(result.get('path', [origin, destination])))
-                if num_visited > 0:
-                    result['visited_nodes'] = random.sample(visited_cities, num_visited)
-                    # Add the path cities
-                    result['visited_nodes'].extend(result.get('path', [origin, destination]))
-                else:
-                    result['visited_nodes'] = result.get('path', [origin, destination]).copy()
-            
-            return result
+def find_route_dijkstra(origin, destination, preference, limits=None):
+    # Real search from the routing daemon, None if it is down or finds no route
+    return engine_route(origin, destination, preference, 'dijkstra', limits)
+
+def find_route_astar(origin, destination, preference, limits=None):
+    # The daemon loads indian_cities.csv alongside routes.csv, so Indian
+    # routes come from the same search as everything else
+    return engine_route(origin, destination, preference, 'astar', limits)
+
+@app.route('/pareto-routes', methods=['POST'])
+def pareto_routes():
+    # Every route no other one beats on time, cost and stops at once, from
+    # one daemon query; the route limits drop the rest
+    data = request.json
+    origin = data.get('origin')
+    destination = data.get('destination')
     
-    # Generate a demo route for A* that might take a different path than Dijkstra
-    result = generate_demo_route(origin, destination, preference, algorithm='astar')
-    result['algorithm'] = 'astar'
+    if not origin or not destination:
+        return jsonify({"error": "Origin and destination are required"}), 400
     
-    # Ensure the nodes_visited count and visited_nodes list are consistent
-    if 'visited_nodes' in result and result['stats']['nodes_visited'] != len(result['visited_nodes']):
-        # Adjust to match
-        result['stats']['nodes_visited'] = len(result['visited_nodes'])
+    try:
+        limits = request_limits(data)
+        # Partial routes the daemon keeps per city; more finds more routes
+        if data.get('maxLabels') is not None:
+            limits['maxLabels'] = int(data['maxLabels'])
+    except (TypeError, ValueError):
+        return jsonify({"error": "Invalid route limits"}), 400
+    
+    query = {
+        "origin": origin,
+        "destination": destination,
+        "preference": "pareto"
+    }
+    query.update(limits)
+    
+    reply = query_routed(query)
+    if reply is None or 'error' in reply:
+        return jsonify({"error": "No route found. Is the routing daemon running?"}), 503
+    
+    # Each itinerary shares the query's endpoints and search stats
+    routes = []
+    for itinerary in reply['routes']:
+        route = route_from_reply(dict(itinerary,
+                                      origin=reply['origin'],
+                                      destination=reply['destination'],
+                                      nodesVisited=reply['nodesVisited'],
+                                      computationTime=reply['computationTime']), 'pareto', 'dijkstra')
+        route['optimization'] = 'pareto'
+        route['hops'] = itinerary['hops']
+        route['legs'] = itinerary['legs']
+        routes.append(route)
+    
+    return jsonify({
+        "routes": routes,
+        "truncated": reply['truncated']
+    })
+
+def departure_timestamp(value):
+    # Unix seconds from a number or an ISO 8601 time; a time without a
+    # zone is taken as UTC, as the timetables are
+    if isinstance(value, (int, float)):
+        return float(value)
+    moment = datetime.fromisoformat(str(value))
+    if moment.tzinfo is None:
+        moment = moment.replace(tzinfo=timezone.utc)
+    return moment.timestamp()
+
+@app.route('/plan-journey', methods=['POST'])
+def plan_journey():
+    # Journey arriving first when leaving at departAt, following the
+    # routes' timetables with transfer hours at each change
+    data = request.json
+    origin = data.get('origin')
+    destination = data.get('destination')
     
-    # Match the property names expected by the frontend
-    result['nodes_visited'] = result['stats']['nodes_visited']
-    result['computation_time'] = result['stats']['computation_time_ms']
+    if not origin or not destination or data.get('departAt') is None:
+        return jsonify({"error": "Origin, destination and departAt are required"}), 400
     
-    return result
+    try:
+        query = {
+            "origin": origin,
+            "destination": destination,
+            "departAt": departure_timestamp(data['departAt'])
+        }
+        if data.get('transfer') is not None:
+            query['transfer'] = float(data['transfer'])
+    except (TypeError, ValueError):
+        return jsonify({"error": "Invalid departAt or transfer"}), 400
+    
+    reply = query_routed(query)
+    if reply is None or 'error' in reply:
+        return jsonify({"error": "No route found. Is the routing daemon running?"}), 503
+    
+    route = route_from_reply(reply, 'fastest', 'csa')
+    route['schedule'] = reply['schedule']
+    route['depart_at'] = reply['departAt']
+    route['arrive_at'] = reply['arriveAt']
+    route['journey_time'] = reply['journeyTime']
+    route['stats']['connections_scanned'] = reply['connectionsScanned']
+    return jsonify(route)
+
+@app.route('/distance-matrix', methods=['POST'])
+def distance_matrix():
+    # Fastest time and cheapest cost between every origin and destination
+    # from one daemon query, a row per origin, None where there is no path
+    data = request.json
+    origins = data.get('origins')
+    destinations = data.get('destinations')
+    
+    if not isinstance(origins, list) or not isinstance(destinations, list) or not origins or not destinations:
+        return jsonify({"error": "Lists of origins and destinations are required"}), 400
+    
+    reply = query_routed({
+        "origins": [str(city) for city in origins],
+        "destinations": [str(city) for city in destinations]
+    })
+    if reply is None:
+        return jsonify({"error": "Routing daemon is not running"}), 503
+    if 'error' in reply:
+        return jsonify({"error": reply['error']}), 400
+    
+    return jsonify({
+        "origins": reply['origins'],
+        "destinations": reply['destinations'],
+        "times": reply['times'],
+        "costs": reply['costs'],
+        "stats": {
+            "nodes_visited": reply['nodesVisited'],
+            "computation_time_ms": reply['computationTime'] * 1000.0
+        }
+    })
 
-def generate_real_route(origin, destination, preference):
-    route_key = f"{origin}-{destination}"
-    flight_data = indian_flights.get(route_key)
+@app.route('/reachable-cities', methods=['POST'])
+def reachable_cities():
+    # Every city reachable from origin within budget hours (or dollars with
+    # preference cheapest), nearest first, with map coordinates for shading
+    data = request.json
+    origin = data.get('origin')
+    preference = data.get('preference', 'fastest')
     
-    if not flight_data:
-        return generate_demo_route(origin, destination, preference)
+    if not origin or data.get('budget') is None:
+        return jsonify({"error": "Origin and budget are required"}), 400
     
-    # Convert preference to actual field name
-    cost_or_time = "time" if preference == "fastest" else "cost"
+    try:
+        budget = float(data['budget'])
+    except (TypeError, ValueError):
+        return jsonify({"error": "Invalid budget"}), 400
     
-    # Use actual flight data
-    route = {
+    reply = query_routed({
         "origin": origin,
-        "destination": destination,
-        "distance": flight_data["distance"],
-        "cost": flight_data["cost"],
-        "time": flight_data["time"],
-        "stops": [],
-        "algorithm": "dijkstra",  # Default algorithm
-        "total_distance": flight_data["distance"],
-        "total_cost": flight_data["cost"],
-        "total_time": flight_data["time"],
-        "optimization": cost_or_time,
+        "budget": budget,
+        "preference": preference
+    })
+    if reply is None or 'error' in reply:
+        return jsonify({"error": "No route found. Is the routing daemon running?"}), 503
+    
+    cities = []
+    for city in reply['reachable']:
+        cities.append({
+            "city": city['city'],
+            "coordinates": city_coordinates.get(city['city'], {"lat": 0, "lng": 0}),
+            "time": city['time'],
+            "cost": city['cost']
+        })
+    
+    return jsonify({
+        "origin": reply['origin'],
+        "budget": reply['budget'],
+        "metric": reply['metric'],
+        "cities": cities,
         "stats": {
-            "nodes_visited": 2,  # Just origin and destination
-            "computation_time_ms": 0.5
+            "nodes_visited": reply['nodesVisited'],
+            "computation_time_ms": reply['computationTime'] * 1000.0
         }
-    }
-    
-    return route
-    
-def generate_demo_route(origin, destination, preference, algorithm='dijkstra'):
-    # This function generates a demo route if the algorithm fails or times out
-    # Get coordinates
-    org_coords = city_coordinates.get(origin, {"lat": 0, "lng": 0})
-    dest_coords = city_coordinates.get(destination, {"lat": 0, "lng": 0})
-    
-    # Calculate rough distance using latitude/longitude (very approximate)
-    lat_diff = abs(org_coords["lat"] - dest_coords["lat"])
-    lng_diff = abs(org_coords["lng"] - dest_coords["lng"])
-    distance = ((lat_diff ** 2 + lng_diff ** 2) ** 0.5) * 111  # 1 degree ≈ 111 km
-    
-    # Decide whether to include intermediate stops
-    include_stops = (distance > 500 and random.random() > 0.3)
-    
-    # Check if this is an international route (either origin or destination is not in Indian cities)
-    is_international = origin not in indian_cities or destination not in indian_cities
-    
-    # For fastest vs cheapest preferences
-    if preference == "fastest":
-        # Fastest routes have fewer stops and higher cost
-        stops_factor = 0.7  # Fewer stops
-        time_factor = 0.8   # Faster
-        cost_factor = 1.3   # More expensive
-    else:  # cheapest
-        # Cheaper routes have more stops and take longer
-        stops_factor = 1.3  # More stops
-        time_factor = 1.4   # Slower
-        cost_factor = 0.7   # Cheaper
-    
-    # Apply 100x multiplier for international routes
-    if is_international:
-        # International flights are much more expensive
-        cost_factor *= 100
-    
-    # A* vs Dijkstra differences
-    if algorithm == 'astar':
-        # A* takes more optimal routes based on heuristic
-        if preference == "fastest":
-            # For fastest, A* finds a more direct route with fewer stops
-            num_stops = int(random.randint(1, 2) * stops_factor * 0.7)
-            # A* is better at finding fastest routes
-            time_factor *= 0.8
-        else:
-            # For cheapest, A* still tries to be somewhat direct
-            num_stops = int(random.randint(1, 3) * stops_factor * 0.8)
-            # A* is better at finding optimal cost routes
-            cost_factor *= 0.8
-    else:  # dijkstra
-        # Dijkstra may explore more paths and find less optimal routes
-        if preference == "fastest":
-            # For fastest, Dijkstra still finds a direct route but with more variation
-            num_stops = int(random.randint(1, 2) * stops_factor)
-            # Dijkstra isn't as good at optimizing for time
-            time_factor *= 1.2
-        else:
-            # For cheapest, Dijkstra may find routes with many stops
-            num_stops = int(random.randint(2, 4) * stops_factor)
-            # Dijkstra isn't as good at optimizing for cost
-            cost_factor *= 1.2
-    
-    # Ensure at least some difference between algorithms
-    if num_stops < 1:
-        num_stops = 1
+    })
+
+@app.route('/alternative-routes', methods=['POST'])
+def alternative_routes():
+    # Up to count loopless routes, shortest first, from one daemon query;
+    # method 'diverse' asks for routes that share fewer legs
+    data = request.json
+    origin = data.get('origin')
+    destination = data.get('destination')
+    preference = data.get('preference', 'fastest')
+    method = data.get('method', 'shortest')
     
-    stops = []
-    # For Indian routes, only consider Indian cities for stops
-    if origin in indian_cities and destination in indian_cities:
-        available_cities = [c for c in indian_cities if c != origin and c != destination]
-    else:
-        available_cities = [c for c in cities_data if c != origin and c != destination]
+    if not origin or not destination:
+        return jsonify({"error": "Origin and destination are required"}), 400
     
-    if include_stops and available_cities:
-        # Add intermediate cities as stops
-        selected_stops = random.sample(available_cities, min(num_stops, len(available_cities)))
-        stops = []
-        
-        for stop in selected_stops:
-            stop_coords = city_coordinates.get(stop, {"lat": 0, "lng": 0})
-            
-            # Calculate segments
-            from_prev = stops[-1]["city"] if stops else origin
-            prev_coords = stops[-1]["coordinates"] if stops else org_coords
-            
-            # Calculate segment distance
-            lat_diff = abs(prev_coords["lat"] - stop_coords["lat"])
-            lng_diff = abs(prev_coords["lng"] - stop_coords["lng"])
-            segment_distance = ((lat_diff ** 2 + lng_diff ** 2) ** 0.5) * 111
-            
-            # Check if this segment is international (involves a non-Indian city)
-            segment_international = from_prev not in indian_cities or stop not in indian_cities
-            
-            # Generate reasonable time and cost
-            segment_time = segment_distance / 800 * 60 * time_factor  # Adjusted by preference
-            segment_cost = segment_distance * 0.1 * cost_factor + 50  # Adjusted by preference
-            
-            # Apply international price adjustment if needed
-            if segment_international and not is_international:  # If not already adjusted at route level
-                segment_cost *= 100
-            
-            stops.append({
-                "city": stop,
-                "coordinates": stop_coords,
-                "from_prev": from_prev,
-                "distance": segment_distance,
-                "time": segment_time,
-                "cost": segment_cost
-            })
-    
-    # Calculate total values
-    if stops:
-        # Add final segment
-        last_city = stops[-1]["city"]
-        last_coords = stops[-1]["coordinates"]
-        
-        lat_diff = abs(last_coords["lat"] - dest_coords["lat"])
-        lng_diff = abs(last_coords["lng"] - dest_coords["lng"])
-        final_segment_distance = ((lat_diff ** 2 + lng_diff ** 2) ** 0.5) * 111
-        
-        final_segment_time = final_segment_distance / 800 * 60 * time_factor
-        final_segment_cost = final_segment_distance * 0.1 * cost_factor + 50
-        
-        # Check if final segment is international
-        final_segment_international = last_city not in indian_cities or destination not in indian_cities
-        
-        # Apply international price adjustment if needed
-        if final_segment_international and not is_international:  # If not already adjusted at route level
-            final_segment_cost *= 100
-        
-        # Calculate totals
-        total_distance = sum(s["distance"] for s in stops) + final_segment_distance
-        total_time = sum(s["time"] for s in stops) + final_segment_time
-        total_cost = sum(s["cost"] for s in stops) + final_segment_cost
-    else:
-        # Direct flight
-        total_distance = distance
-        total_time = distance / 800 * 60 * time_factor  # Adjusted by preference
-        total_cost = distance * 0.1 * cost_factor + 100  # Adjusted by preference
-    
-    # Add some randomization
-    total_distance *= random.uniform(0.95, 1.05)
-    
-    # Build the path
-    path = [origin]
-    for stop in stops:
-        path.append(stop["city"])
-    path.append(destination)
-    
-    # Generate visited nodes based on algorithm
-    visited_nodes = []
-    
-    # For domestic routes, only use Indian cities for visited nodes
-    if origin in indian_cities and destination in indian_cities:
-        potential_visits = [c for c in indian_cities if c not in path]
-    else:
-        potential_visits = [c for c in cities_data if c not in path]
+    try:
+        count = int(data.get('count', 3))
+    except (TypeError, ValueError):
+        return jsonify({"error": "Invalid route count"}), 400
+    if count < 1 or count > 10:
+        return jsonify({"error": "Route count must be between 1 and 10"}), 400
     
-    if algorithm == 'dijkstra':
-        # Dijkstra visits more nodes - use a fixed number for consistency (20-25)
-        target_nodes_count = random.randint(20, 25)
-        
-        if potential_visits:
-            extra_visits = target_nodes_count - len(path)
-            if extra_visits > 0:
-                visited_nodes = random.sample(potential_visits, min(extra_visits, len(potential_visits)))
-                # Add the actual path too
-                visited_nodes.extend(path)
-            else:
-                visited_nodes = path.copy()
-            # Set nodes_visited to match the visualization
-            nodes_visited = len(visited_nodes)
-            computation_time = random.uniform(4.5, 8.0)  # Higher for Dijkstra
-        else:
-            visited_nodes = path.copy()
-            nodes_visited = len(visited_nodes)
-            computation_time = random.uniform(3.0, 6.0)
-    else:  # A*
-        # A* visits fewer nodes - use a fixed number for consistency (10-12)
-        target_nodes_count = random.randint(10, 12)
-        
-        if potential_visits:
-            extra_visits = target_nodes_count - len(path)
-            if extra_visits > 0:
-                visited_nodes = random.sample(potential_visits, min(extra_visits, len(potential_visits)))
-                # Add the actual path too
-                visited_nodes.extend(path)
-            else:
-                visited_nodes = path.copy()
-            # Set nodes_visited to match the visualization
-            nodes_visited = len(visited_nodes)
-            computation_time = random.uniform(0.8, 3.0)  # Lower for A*
-        else:
-            visited_nodes = path.copy()
-            nodes_visited = len(visited_nodes)
-            computation_time = random.uniform(0.5, 1.5)
-    
-    # Make sure time and cost are realistic
-    # Average flight speed is around 800 km/h
-    # Average cost is around ₹5-7 per km plus base fare
-    
-    # Adjust time to be more realistic (in hours)
-    if total_time > 24:  # Cap at 24 hours
-        total_time = random.uniform(18, 24)
-    elif total_time < 0.5 and distance > 200:  # Minimum time for longer distances
-        total_time = random.uniform(0.5, 1.5)
-    
-    # Adjust cost to be more realistic (in INR)
-    if total_cost < 1000 and distance > 200:  # Minimum cost for longer distances
-        total_cost = random.uniform(1000, 3000)
-    elif total_cost > 50000:  # Cap at 50,000 INR
-        total_cost = random.uniform(30000, 50000)
-    
-    # Ensure consistent algorithm comparisons:
-    # A* should always have fewer nodes visited than Dijkstra
-    # A* should always have shorter computation time
-    # For fastest preference:
-    #   - A* should have equal or less time
-    # For cheapest preference:
-    #   - A* should have equal or less cost
-    
-    route = {
+    reply = query_routed({
         "origin": origin,
         "destination": destination,
-        "path": path,
-        "visited_nodes": visited_nodes,  # All nodes that were "visited" during search
-        "distance": total_distance,
-        "cost": total_cost,
-        "time": total_time,
-        "stops": stops,
-        "algorithm": algorithm,
-        "total_distance": total_distance,
-        "total_cost": total_cost,
-        "total_time": total_time,
-        "optimization": "time" if preference == "fastest" else "cost",
+        "preference": preference,
+        "alternatives": count,
+        "method": method
+    })
+    if reply is None or 'error' in reply:
+        return jsonify({"error": "No route found. Is the routing daemon running?"}), 503
+    
+    routes = []
+    for itinerary in reply['routes']:
+        route = route_from_reply(dict(itinerary,
+                                      origin=reply['origin'],
+                                      destination=reply['destination'],
+                                      nodesVisited=reply['nodesVisited'],
+                                      computationTime=reply['computationTime']), preference, 'dijkstra')
+        route['hops'] = itinerary['hops']
+        routes.append(route)
+    
+    return jsonify({
+        "routes": routes,
+        "method": reply['method']
+    })
+
+# Fields an update may give; which ones each kind needs is up to the daemon
+UPDATE_FIELDS = ('update', 'city', 'country', 'latitude', 'longitude', 'origin', 'destination',
+                 'transport', 'time', 'cost', 'note', 'distance', 'departure', 'headway')
+
+@app.route('/update-network', methods=['POST'])
+def update_network():
+    # Add a city or add, reprice or remove a route in the running daemon;
+    # queries see the change as soon as this returns. Not saved to the CSV
+    # files, so a restarted daemon starts from them again
+    data = request.json
+    if not data or not data.get('update'):
+        return jsonify({"error": "An update kind is required"}), 400
+    
+    reply = query_routed({field: data[field] for field in UPDATE_FIELDS if field in data})
+    if reply is None:
+        return jsonify({"error": "Routing daemon is not running"}), 503
+    if 'error' in reply:
+        return jsonify({"error": reply['error']}), 400
+    
+    # New cities go on the map and into the city lists straight away
+    if reply['updated'] == 'add-city':
+        city = data['city']
+        cities_data.append(city)
+        city_coordinates[city] = {"lat": float(data['latitude']), "lng": float(data['longitude'])}
+    
+    return jsonify({
+        "updated": reply['updated'],
+        "version": reply['version'],
+        "cities": reply['cities'],
+        "routes": reply['routes'],
         "stats": {
-            "nodes_visited": nodes_visited,
-            "computation_time_ms": computation_time
+            "batched_updates": reply['batched'],
+            "update_time_ms": reply['updateTime'] * 1000.0
         }
-    }
-    
-    return route
+    })
 
 @app.route('/compare-algorithms', methods=['POST'])
 def compare_algorithms():
@@ -522,60 +523,39 @@ def compare_algorithms():
     if not origin or not destination:
         return jsonify({"error": "Origin and destination are required"}), 400
     
-    try:
-        # Get routes using both algorithms
-        dijkstra_result = find_route_dijkstra(origin, destination, preference)
-        astar_result = find_route_astar(origin, destination, preference)
-        
-        # Ensure consistent algorithm comparisons by forcing the expected relationships
-        # This is to ensure the visualization matches the general algorithm expectations:
-        
-        # 1. A* should always have fewer nodes visited than Dijkstra
-        astar_nodes = astar_result['stats']['nodes_visited']
-        dijkstra_nodes = dijkstra_result['stats']['nodes_visited']
-        if astar_nodes >= dijkstra_nodes:
-            # Adjust A* to have fewer nodes
-            astar_result['stats']['nodes_visited'] = max(5, int(dijkstra_nodes * 0.5))
-            # Also adjust the visualization
-            if 'visited_nodes' in astar_result:
-                # Trim visited nodes list to match
-                astar_result['visited_nodes'] = astar_result['visited_nodes'][:astar_result['stats']['nodes_visited']]
-        
-        # 2. A* should always have shorter computation time
-        astar_time = astar_result['stats']['computation_time_ms']
-        dijkstra_time = dijkstra_result['stats']['computation_time_ms']
-        if astar_time >= dijkstra_time:
-            # Adjust A* to have shorter time
-            astar_result['stats']['computation_time_ms'] = dijkstra_time * 0.6
-        
-        # 3. For fastest preference: A* should have less travel time
-        if preference == 'fastest' and astar_result['time'] >= dijkstra_result['time']:
-            # Adjust A* to have less travel time
-            astar_result['time'] = dijkstra_result['time'] * 0.85
-            astar_result['total_time'] = astar_result['time']
-        
-        # 4. For cheapest preference: A* should have less cost
-        if preference == 'cheapest' and astar_result['cost'] >= dijkstra_result['cost']:
-            # Adjust A* to have less cost
-            astar_result['cost'] = dijkstra_result['cost'] * 0.8
-            astar_result['total_cost'] = astar_result['cost']
-        
-        # 5. Ensure the same path is used when comparing identical distance
-        if round(astar_result['distance'], 2) == round(dijkstra_result['distance'], 2):
-            # Use the same path on both algorithms for consistency
-            astar_result['path'] = dijkstra_result['path']
-        
-        return jsonify({
-            "dijkstra": dijkstra_result,
-            "astar": astar_result
-        })
-    except Exception as e:
-        print(f"Error comparing algorithms: {e}")
-        # Generate demo routes as fallback
-        return jsonify({
-            "dijkstra": generate_demo_route(origin, destination, preference, algorithm='dijkstra'),
-            "astar": generate_demo_route(origin, destination, preference, algorithm='astar')
+    # Both searches run in the daemon on the same graph, one after the
+    # other, and every number below is what they measured
+    reply = query_routed({
+        "origin": origin,
+        "destination": destination,
+        "preference": preference,
+        "compare": True
+    })
+    if reply is None:
+        return jsonify({"error": "Routing daemon is not running"}), 503
+    if 'error' in reply:
+        return jsonify({"error": reply['error']}), 404
+    
+    results = {}
+    for algorithm in ('dijkstra', 'astar'):
+        search = reply[algorithm]
+        result = route_from_reply(dict(search, origin=reply['origin'], destination=reply['destination'],
+                                       computationTime=search['wallTime'] / 1e9), preference, algorithm)
+        # The cities the search settled, in order, for the map to replay
+        result['visited_nodes'] = search['visited']
+        result['stats'].update({
+            "settled": search['settled'],
+            "relaxed": search['relaxed'],
+            "pushed": search['pushed'],
+            "heap_peak": search['heapPeak'],
+            "wall_time_ns": search['wallTime'],
+            "cpu_time_ns": search['cpuTime']
         })
+        results[algorithm] = result
+    
+    results['landmarks'] = reply['landmarks']
+    results['counters_enabled'] = reply['countersEnabled']
+    return jsonify(results)
 
 if __name__ == '__main__':
     app.run(host='0.0.0.0', port=5000, debug=True)
\ No newline at end of file